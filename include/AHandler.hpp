@@ -5,6 +5,7 @@
 
 // Forward declaration
 struct Connection;
+struct DirectoryListing;
 struct HttpRequest;
 
 // Abstract base class for all request handlers.
@@ -23,6 +24,13 @@ class AHandler {
     //    setting up file FDs if needed, potentially requesting EPOLLOUT).
     // Should handle errors and potentially set conn->state = CONN_ERROR.
     virtual void handle(Connection* conn) = 0;
+
+    // Takes the finished job that opened a file for the body of conn (see
+    // WebServer::start_spliced_body()) and switches the parser to
+    // PARSING_SPLICED_BODY, which splices the body from the socket into it.
+    // False if there is no file to splice into.
+    static bool body_file_opened(Connection* conn);
+
     // Optional: Methods for handling specific I/O events if needed,
     // allowing the Server's main loop to delegate more directly.
     // virtual void on_readable(Connection* conn) {} // e.g., For CGI reading
@@ -30,14 +38,15 @@ class AHandler {
     // writing stdin or sending file chunks
    protected:
     std::string parse_absolute_path(Connection* conn);
-    bool process_location_redirect(Connection* conn);
 
-    bool process_directory_redirect(Connection* conn,
-                                    std::string& absolute_path);
-    bool process_directory_index(Connection* conn, std::string& absolute_path,
-                                 bool& need_autoindex);
+    bool process_directory_redirect(Connection* conn);
+    // Answers with listing, whole or, if it has several pages, streamed by
+    // further stream_directory_listing() calls, which take a reference
     void generate_directory_listing(Connection* conn,
-                                    const std::string& dir_path);
+                                    DirectoryListing* listing);
+    // Sends what is queued and queues the next page of conn->listing_. The
+    // handler calls it on EPOLLOUT until conn_state_ is CONN_WRITING.
+    void stream_directory_listing(Connection* conn);
 
 };  // class Handler
 
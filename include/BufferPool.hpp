@@ -0,0 +1,99 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include "webserv.hpp"
+
+// Memory of the connection I/O buffers, in blocks of three sizes.
+//
+// A request for n bytes gets a block of the smallest class that holds n:
+// 4K, 16K or 64K. Blocks are carved from slabs of SLAB_SIZE bytes, one
+// malloc() per slab, and go back to a free list of their class when
+// released, so buffers that come and go with requests never reach malloc()
+// once the pool has grown to the load. Slabs are kept for the lifetime of
+// the process. Requests past the largest class are passed to malloc() and
+// counted as oversized.
+//
+// Used from the event loop thread only.
+class BufferPool {
+   public:
+    static const size_t CLASS_COUNT = 3;
+    static const size_t SLAB_SIZE = 262144;  // 64 small or 4 large blocks
+
+    // Occupancy of one size class
+    struct ClassStats {
+        size_t block_size_;
+        size_t slabs_;   // Slabs carved into blocks of this class
+        size_t in_use_;  // Blocks handed out
+        size_t free_;    // Blocks in the free list
+    };
+
+    // A block of at least size bytes
+    static char* allocate(size_t size);
+    // Returns a block, size as given to allocate()
+    static void deallocate(char* block, size_t size);
+
+    // Bytes of the block allocate(size) returns, size itself past the
+    // largest class. Buffers sized to it use their whole block.
+    static size_t block_size(size_t size);
+
+    static ClassStats class_stats(size_t index);
+    static size_t oversized_in_use();  // Blocks past the largest class
+
+   private:
+    // Not instantiable
+    BufferPool();
+};  // class BufferPool
+
+// Allocator putting a standard container in BufferPool blocks
+template <typename T>
+class PoolAllocator {
+   public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    pointer address(reference value) const { return &value; }
+    const_pointer address(const_reference value) const { return &value; }
+
+    pointer allocate(size_type count, const void* = 0) {
+        return reinterpret_cast<pointer>(
+            BufferPool::allocate(count * sizeof(T)));
+    }
+    void deallocate(pointer block, size_type count) {
+        BufferPool::deallocate(reinterpret_cast<char*>(block),
+                               count * sizeof(T));
+    }
+
+    size_type max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+
+    void construct(pointer p, const T& value) { new (p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+};  // class PoolAllocator
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+    return false;
+}
+
+// Bytes received from or sent to a client, CGI or upstream
+typedef std::vector<char, PoolAllocator<char> > IoBuffer;
+
+#endif  // BUFFERPOOL_HPP
@@ -41,7 +41,7 @@ class CgiHandler : public AHandler {
                          int cgi_to_server_pipe[2]);
     void handle_child_pipes(int server_to_cgi_pipe[2],
                             int cgi_to_server_pipe[2]);
-    std::vector<char*> create_cgi_envp(Connection* conn);
+    void create_cgi_envp(Connection* conn);
     void execute_cgi_script(Connection* conn, char** envp);
     bool handle_parent_pipes(Connection* conn, int server_to_cgi_pipe[2],
                              int cgi_to_server_pipe[2]);
@@ -8,6 +8,13 @@ class AHandler;
 struct HttpRequest;
 struct HttpResponse;
 struct VirtualServer;
+class VirtualHostIndex;
+struct Upstream;
+struct UpstreamServer;
+struct FileJob;
+struct StreamedUpload;
+struct DirectoryListing;
+struct ErrorPage;
 
 // Represents the state associated with a single client connection
 struct Connection {
@@ -25,18 +32,31 @@ struct Connection {
         default_virtual_server_;           // Pointer to default virtual server
     const VirtualServer* virtual_server_;  // Pointer to virtual server matching
                                            // the Host header
+    const VirtualHostIndex* host_index_;   // Server names of the listener
     time_t
         last_activity_;  // Timestamp of last read/write activity (for timeouts)
+    std::string remote_addr_;  // Peer IP address (for REMOTE_ADDR)
+    size_t requests_served_;   // Responses completed on this connection
+    time_t idle_timeout_;  // keepalive_timeout of the server that answered
+                           // the last request
+    bool parked_;  // Idle between requests, with its buffers and request and
+                   // response given back to ConnectionManager
 
     //--------------------------------------
     // Buffers
     //--------------------------------------
-    std::vector<char> read_buffer_;   // Buffer for incoming data from client
+    ReadBuffer read_buffer_;          // Buffer for incoming data from client
+    size_t body_remaining_bytes_;     // Content-Length body bytes still due
+    codes::ChunkState chunk_state_;   // Position in a chunked request body
     size_t chunk_remaining_bytes_;    // Remaining bytes in the current chunk
-    std::vector<char> write_buffer_;  // Buffer for outgoing data to client
+    IoBuffer write_buffer_;       // Buffer for outgoing data to client
     size_t write_buffer_offset_;  // How much of the write_buffer has been sent
-    std::vector<char>
-        cgi_read_buffer_;  // Buffer for writing to CGI stdin (if active)
+    bool response_prepared_;      // write_buffer_ already holds the serialized
+                                  // response (or its streamed head)
+    IoBuffer pipelined_output_;  // Whole responses to earlier pipelined
+                                 // requests, sent ahead of the next bytes
+                                 // to the client
+    IoBuffer cgi_read_buffer_;  // Buffer for writing to CGI stdin (if active)
     size_t cgi_read_buffer_offset_;  // Offset for CGI write buffer
 
     //--------------------------------------
@@ -44,8 +64,13 @@ struct Connection {
     //--------------------------------------
     HttpRequest* request_data_;  // Pointer to the parsed request info (NULL
                                  // until allocated)
+    RequestArena arena_;  // Header bytes of request_data_, reset with it
     HttpResponse*
         response_data_;  // Pointer to the response info (NULL until allocated)
+    ErrorPage* error_page_;  // Shared headers and body of an error response,
+                             // sent after response_data_'s headers
+    bool fixed_response_;    // Response is the return_response_ of
+                             // location_match_, sent as is
 
     //--------------------------------------
     // State Management
@@ -61,10 +86,12 @@ struct Connection {
     // Connection Management
     //--------------------------------------
     void reset_for_keep_alive();  // Resets state for handling another request
+    void discard_body_file();     // Drops an unfinished spliced body file
 
     // Connection state checks
     bool is_readable() const;
     bool is_cgi() const;
+    bool is_proxy() const;
     bool is_writable() const;
     bool is_keep_alive() const;
 
@@ -78,14 +105,60 @@ struct Connection {
     pid_t cgi_pid_;           // Process ID of the CGI script (-1 if none)
     int cgi_pipe_stdin_fd_;   // FD for writing request body TO CGI (-1 if none)
     int cgi_pipe_stdout_fd_;  // FD for reading response FROM CGI (-1 if none)
+    size_t cgi_body_offset_;  // Request body bytes written to the CGI so far
     std::string cgi_script_path_;  // Path to the CGI script
-    std::vector<std::string>
-        cgi_envp_;  // Environment variables for the CGI script execution
+    std::vector<char> cgi_env_block_;  // Request specific "NAME=VALUE\0"
+                                       // entries, stored contiguously
+    std::vector<char*>
+        cgi_envp_;  // envp for execve (template entries + cgi_env_block_)
+
+    // Proxy State (Only relevant if active_handler is ProxyHandler)
+    codes::ProxyHandlerState proxy_handler_state_;
+    Upstream* upstream_;         // Upstream of the matched location
+    UpstreamServer* upstream_server_;  // Server handling this request
+    size_t upstream_attempts_;   // Servers tried for this request
+    double upstream_started_ms_;  // When the current attempt started
+    int upstream_fd_;            // Socket to the backend (-1 if none)
+    bool upstream_reused_;       // upstream_fd_ was taken from the idle pool
+    bool upstream_retried_;      // Request was already retried once
+    bool upstream_keep_alive_;   // Backend connection can go back to the pool
+    std::string upstream_request_;        // Serialized request head
+    size_t upstream_request_offset_;      // Bytes of head + body sent so far
+    IoBuffer upstream_buffer_;            // Received, not yet processed bytes
+    codes::BodyFraming upstream_framing_;  // Body framing used by the backend
+    codes::BodyFraming client_framing_;    // Body framing sent to the client
+    size_t upstream_body_remaining_;  // Bytes left in the body/current chunk
+    codes::ChunkState upstream_chunk_state_;  // Chunked decoder position
+
+    // Response Cache State (Only relevant for locations with response_cache)
+    std::string cache_key_;   // Key fetched or waited for, empty if neither
+    bool cache_leader_;       // This request fetches the response for others
+    bool cache_bypass_;       // Run the handler without consulting the cache
+    bool cache_capturing_;    // Proxied response is being copied for storing
+    std::string cache_headers_;     // Captured proxied response headers
+    std::vector<char> cache_body_;  // Captured proxied response body
+
+    // Spliced Body State (Only relevant for a PUT or resumable upload PATCH
+    // body taken straight from the socket)
+    int body_file_fd_;            // File of the body (-1 if none)
+    std::string body_temp_path_;  // Its name until renamed over the target,
+                                  // empty for the <id>.part of a PATCH
+    int body_pipe_[2];            // splice() goes socket -> pipe -> file
+
+    // Streamed Upload State (Only relevant for a multipart POST body
+    // FileUploadHandler parses as it arrives)
+    StreamedUpload* upload_;  // Fed by request_data_->body_ (NULL if none)
+
+    // File Job State (Only relevant while a handler waits for FileWorkerPool)
+    FileJob* file_job_;  // Submitted job, or its result once the handler
+                         // runs again (NULL if none)
 
     // Static File State (Only relevant if active_handler is StaticFileHandler)
     int static_file_fd_;        // FD of the file being sent (-1 if none)
     off_t static_file_offset_;  // Current position within the file
     size_t static_file_bytes_to_send_;  // Total bytes to send from file
+    DirectoryListing* listing_;  // Listing being streamed (NULL if none)
+    size_t listing_page_;        // Its next page to queue
 
    private:
     // Prevent copying
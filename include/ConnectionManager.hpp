@@ -8,6 +8,12 @@ struct Connection;
 struct VirtualServer;
 
 // Manages the lifecycle of active Connection objects.
+//
+// Connections waiting for their next keep-alive request are parked: their
+// buffers go back to the BufferPool, and their request and response to
+// spare pools shared by all connections, handed out again when the next
+// request arrives. An idle connection then costs little more than the
+// Connection itself.
 struct ConnectionManager {
    public:
     ConnectionManager();
@@ -31,14 +37,32 @@ struct ConnectionManager {
     // Returns NULL if the FD is not managed.
     Connection* get_connection(int client_fd);
 
-    // Iterates through connections and closes those inactive beyond timeout.
-    // Returns the number of connections closed due to timeout.
+    // Iterates through connections and closes those inactive beyond their
+    // timeout, at most once a second. Returns the number of connections
+    // closed due to timeout.
     int close_timed_out_connections();
 
     bool is_timed_out(Connection* conn);
 
+    // Seconds a connection may stay inactive. A parked one gets the
+    // keepalive_timeout of the server that answered its last request, cut
+    // down as the connection count nears the limit; any other one
+    // http_limits::TIMEOUT.
+    time_t timeout_for(const Connection* conn) const;
+
+    // Whether another client may be accepted
+    bool has_room() const;
+
+    // Releases the buffers of an idle connection and moves its request and
+    // response to the spare pools, or frees them
+    void park(Connection* conn);
+    // Gives a parked connection a request, a response and buffers again
+    void unpark(Connection* conn);
+
     // Get the number of active connections
     size_t get_active_connection_count() const;
+    size_t get_parked_connection_count() const;
+    size_t get_connection_limit() const;
 
     void register_pipe(int pipe_fd, Connection* conn);
     void unregister_pipe(int pipe_fd);
@@ -49,6 +73,14 @@ struct ConnectionManager {
     std::map<int, Connection*> active_connections_;
     std::map<int, Connection*> active_pipes_;  // For managing pipes (e.g., CGI)
 
+    size_t connection_limit_;  // Clients accepted at once
+    size_t parked_count_;
+    time_t last_sweep_;  // Second of the last timeout check
+
+    // Left by parked connections, at most http_limits::SPARE_POOL_SIZE each
+    std::vector<HttpRequest*> spare_requests_;    // Cleared
+    std::vector<HttpResponse*> spare_responses_;  // Cleared
+
     // Prevent copying
     ConnectionManager(const ConnectionManager&);
     ConnectionManager& operator=(const ConnectionManager&);
@@ -0,0 +1,50 @@
+#ifndef DELIMITERSCANNER_HPP
+#define DELIMITERSCANNER_HPP
+
+#include "webserv.hpp"
+
+// x86-64 always has SSE2
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    !defined(DELIMITER_SCANNER_PORTABLE)
+#define DELIMITER_SCANNER_SSE2
+#endif
+
+// Finds HTTP delimiters (codes::Delimiter) in received bytes.
+//
+// On x86-64, which always has SSE2, 16 bytes are compared per step.
+// Elsewhere the C library's memchr scans for one wanted byte at a time.
+// Defining DELIMITER_SCANNER_PORTABLE selects the memchr code on x86-64
+// too, so the benchmark can compare both.
+class DelimiterScanner {
+   public:
+    static const size_t npos = static_cast<size_t>(-1);
+    static const size_t BLOCK_SIZE = 64;  // Bytes classified by match()
+
+    // Whether match() compares a block in a few instructions. Without it,
+    // match() costs a memchr per delimiter and one more, so a caller after
+    // a single delimiter is better served by find() from hit to hit.
+#ifdef DELIMITER_SCANNER_SSE2
+    static const bool VECTORIZED = true;
+#else
+    static const bool VECTORIZED = false;
+#endif
+
+    // Offset of the first byte in the delimiters mask, npos if there is none
+    static size_t find(const char* data, size_t length, unsigned delimiters);
+
+    // Bit i is set if data[i] is in the delimiters mask, for up to
+    // BLOCK_SIZE bytes. Lets a caller walk every delimiter of a block with
+    // bit operations instead of one find() per delimiter.
+    // BLOCK_SIZE bytes at data must be readable whatever the length, the
+    // bits of bytes past it are cleared.
+    static uint64_t match(const char* data, size_t length, unsigned delimiters);
+
+    // Name of the implementation built in: "sse2" or "portable"
+    static const char* implementation();
+
+   private:
+    // Not instantiable
+    DelimiterScanner();
+};  // class DelimiterScanner
+
+#endif  // DELIMITERSCANNER_HPP
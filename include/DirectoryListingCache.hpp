@@ -0,0 +1,63 @@
+#ifndef DIRECTORYLISTINGCACHE_HPP
+#define DIRECTORYLISTINGCACHE_HPP
+
+#include "webserv.hpp"
+
+// A directory entry read for a listing
+struct DirectoryEntry {
+    std::string name_;
+    bool is_directory_;
+    off_t size_;
+};
+
+// An autoindex page, rendered in pages of LISTING_PAGE_ENTRIES rows that
+// large listings are streamed in. Shared by the cache and the connections
+// sending it, and deleted with its last reference. Never changes once
+// rendered.
+struct DirectoryListing {
+    struct timespec mtime_;  // Of the directory when it was read
+    std::vector<std::string> pages_;
+    size_t size_;  // Bytes in all pages
+    size_t refs_;
+};
+
+// Rendered directory listings by directory and URI, valid while the
+// directory's mtime is unchanged. Used by the event loop only, the worker
+// threads just render.
+//
+// The mtime changes when entries are added, removed or renamed, not when a
+// listed file grows, so sizes in a cached listing can be behind.
+class DirectoryListingCache {
+   public:
+    DirectoryListingCache();
+    ~DirectoryListingCache();
+
+    // Renders the listing of uri, sorting entries. Safe on any thread.
+    // Returns a listing with one reference, owned by the caller.
+    static DirectoryListing* render(const std::string& uri,
+                                    std::vector<DirectoryEntry>& entries,
+                                    const struct timespec& mtime);
+
+    // A new reference to the cached listing, or NULL if there is none
+    DirectoryListing* acquire(const std::string& key);
+
+    // Caches listing under key, replacing what was there, unless the cache
+    // is full. Takes a reference of its own.
+    void store(const std::string& key, DirectoryListing* listing);
+
+    // Drops one reference
+    static void release(DirectoryListing* listing);
+
+    static std::string make_key(const std::string& path,
+                                const std::string& uri);
+
+   private:
+    std::map<std::string, DirectoryListing*> entries_;
+    size_t total_bytes_;
+
+    // Prevent copying
+    DirectoryListingCache(const DirectoryListingCache&);
+    DirectoryListingCache& operator=(const DirectoryListingCache&);
+};  // class DirectoryListingCache
+
+#endif  // DIRECTORYLISTINGCACHE_HPP
@@ -5,8 +5,6 @@
 
 // Forward declarations
 struct Connection;
-struct HttpResponse;
-struct VirtualServer;
 
 // Centralized error handling for HTTP responses
 namespace ErrorHandler {
@@ -14,17 +12,18 @@ namespace ErrorHandler {
 // ==================== MAIN ERROR RESPONSE GENERATORS ====================
 void generate_error_response(Connection* conn,
                              codes::ResponseStatus status = codes::UNDEFINED);
+// Any status, also one without a codes::ResponseStatus value
+void generate_error_response(Connection* conn, int status_code);
 
 // ==================== ERROR INFO MAPPING ====================
 int get_parse_message_status(codes::ParseStatus parse_status);
 
 // ==================== CORE ERROR HANDLING ====================
-void handle_error(HttpResponse* resp, int status_code,
-                  const VirtualServer& virtual_server);
+// Sets the status and attaches the prepared page of the virtual server
+void handle_error(Connection* conn, int status_code);
 
 // ==================== ERROR PAGE GENERATION ====================
-std::string get_error_page_content(int status_code,
-                                   const VirtualServer& virtual_server);
+// Built once per status by ErrorPageCache
 std::string generate_default_error_page(int status_code,
                                         const std::string& status_message);
 
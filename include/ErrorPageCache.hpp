@@ -0,0 +1,59 @@
+#ifndef ERRORPAGECACHE_HPP
+#define ERRORPAGECACHE_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct VirtualServer;
+
+// An error response body with the headers describing it, serialized once
+// and sent as is by every response that uses it. Shared by the cache and
+// the connections sending it, and deleted with its last reference. Never
+// changes once loaded.
+struct ErrorPage {
+    std::string data_;       // Content-Type and Content-Length lines, the
+                             // blank line and the body
+    size_t headers_length_;  // Bytes of data_ before the body
+    size_t body_length_;
+    std::string path_;       // Configured page file, empty for the default
+    bool loaded_;            // path_ was read, otherwise data_ holds the
+                             // default page
+    struct stat stat_;       // Of path_ when read, zeroed if missing
+    time_t checked_at_;      // When path_ was last compared with stat_
+    size_t refs_;
+};
+
+// Error pages of all virtual servers and the default page of every error
+// status, loaded at startup. A configured page is looked up on its file
+// again at most every ERROR_PAGE_CHECK_INTERVAL seconds and reloaded if
+// the file changed, appeared or went away.
+class ErrorPageCache {
+   public:
+    ErrorPageCache();
+    ~ErrorPageCache();
+
+    // Loads every error_page of servers and the default pages
+    void preload(const std::list<VirtualServer>& servers);
+
+    // The page for status_code on virtual_server, with a new reference
+    ErrorPage* acquire(int status_code, const VirtualServer& virtual_server);
+
+    // Drops one reference
+    static void release(ErrorPage* page);
+
+   private:
+    std::map<int, std::map<std::string, ErrorPage*> >
+        configured_;                     // By status, then path
+    std::map<int, ErrorPage*> defaults_;  // By status
+
+    ErrorPage* configured_page(int status_code, const std::string& path);
+    ErrorPage* default_page(int status_code);
+    static ErrorPage* load(int status_code, const std::string& path);
+    static bool is_current(const ErrorPage* page);
+
+    // Prevent copying
+    ErrorPageCache(const ErrorPageCache&);
+    ErrorPageCache& operator=(const ErrorPageCache&);
+};  // class ErrorPageCache
+
+#endif  // ERRORPAGECACHE_HPP
@@ -5,8 +5,10 @@
 
 // Forward declarations
 struct Connection;
+struct FileJob;
 
-// Handles file deletion requests using DELETE method
+// Handles file deletion requests using DELETE method. The unlink runs as a
+// FileJob on the FileWorkerPool, the handler is called again with its result.
 class FileDeleteHandler : public AHandler {
    public:
     FileDeleteHandler();
@@ -20,7 +22,7 @@ class FileDeleteHandler : public AHandler {
     bool extract_file_path(Connection* conn, std::string& file_path);
     
     // File operations
-    bool delete_file(Connection* conn, const std::string& file_path);
+    bool check_delete_result(Connection* conn, const FileJob& job);
     
     // Response generation
     void send_delete_success_response(Connection* conn, const std::string& filename);
@@ -0,0 +1,54 @@
+#ifndef FILEPUTHANDLER_HPP
+#define FILEPUTHANDLER_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+struct FileJob;
+
+// Handles PUT requests: stores the request body as the file at the request
+// path, creating or replacing it.
+//
+// A body with a Content-Length is normally not read into the request at all:
+// open_spliced_body() is called once the headers are in and has a file
+// worker create a temporary file next to the target, allocated to its full
+// size up front. The parser then splices the body from the socket into it.
+// handle() has a worker write the body, or only rename the spliced file
+// into place, and answers once that is done.
+class FilePutHandler : public AHandler {
+   public:
+    FilePutHandler();
+    virtual ~FilePutHandler();
+
+    virtual void handle(Connection* conn);
+
+    // Submits the job opening the file the body of conn is spliced into,
+    // see WebServer::continue_spliced_body(). False if the body has to be
+    // read into the request instead; handle() then reports any error.
+    bool open_spliced_body(Connection* conn);
+
+    // Run on a file worker: FILE_JOB_OPEN_BODY and FILE_JOB_STORE_BODY
+    static void open_body_file(FileJob* job);
+    static void store_body(FileJob* job);
+
+   private:
+    // Request validation and processing
+    bool extract_file_path(Connection* conn, std::string& file_path);
+
+    // File operations, on a file worker
+    static void store_file(FileJob* job);
+    static void store_spliced_file(FileJob* job);
+    // Unique temporary file next to the target, -1 (errno set) on failure
+    static int create_temp_file(const std::string& file_path,
+                                std::string& temp_path);
+
+    // Response generation
+    void send_put_success_response(Connection* conn, bool created);
+
+    // Prevent copying
+    FilePutHandler(const FilePutHandler&);
+    FilePutHandler& operator=(const FilePutHandler&);
+};
+
+#endif  // FILEPUTHANDLER_HPP
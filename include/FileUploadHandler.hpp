@@ -5,6 +5,70 @@
 
 // Forward declarations
 struct Connection;
+struct FileJob;
+
+// Streams the file parts of an upload into the upload directory. Each file
+// is written to an unnamed O_TMPFILE as its part arrives. link_files() names
+// them all once the whole body was parsed, so a failed or cut off upload
+// leaves nothing behind and a file being replaced is never seen half
+// written.
+class UploadWriter : public MultipartSink {
+   public:
+    explicit UploadWriter(const std::string& upload_dir);
+    virtual ~UploadWriter();
+
+    virtual bool begin_part(const std::string& filename);
+    virtual bool part_data(const char* data, size_t length);
+    virtual bool end_part();
+
+    // Links every complete file under its name, on a file worker. False
+    // once one could not be.
+    bool link_files();
+
+    // Status for the response once a part could not be stored
+    codes::ResponseStatus error() const;
+
+   private:
+    // A complete file waiting for link_files()
+    struct File {
+        int fd_;
+        std::string temp_name_;
+        std::string target_;
+    };
+
+    bool open_temp_file();
+    bool link_file(File& file);
+    bool fail(const char* action, const std::string& path);
+    void discard();
+
+    std::string upload_dir_;
+    std::string target_;     // Path the current file gets, empty if none
+    std::string temp_name_;  // Named temporary file, empty for O_TMPFILE
+    int fd_;
+    std::vector<File> files_;
+    codes::ResponseStatus error_;
+
+    // Prevent copying
+    UploadWriter(const UploadWriter&);
+    UploadWriter& operator=(const UploadWriter&);
+};  // class UploadWriter
+
+// A multipart body parsed as it is received. The connection keeps it until
+// the body is complete, then the FILE_JOB_UPLOAD linking its files takes it.
+struct StreamedUpload {
+    explicit StreamedUpload(const std::string& upload_dir);
+
+    codes::ResponseStatus status_;  // Of creating the upload directory. On
+                                    // an error the parser is never reset,
+                                    // so the body is dropped.
+    UploadWriter writer_;
+    MultipartParser parser_;
+
+   private:
+    // Prevent copying
+    StreamedUpload(const StreamedUpload&);
+    StreamedUpload& operator=(const StreamedUpload&);
+};  // struct StreamedUpload
 
 // Handles file upload requests
 class FileUploadHandler : public AHandler {
@@ -15,45 +79,33 @@ class FileUploadHandler : public AHandler {
 
     virtual void handle(Connection* conn);
 
+    // Submits the job creating the upload directory for the multipart body
+    // of conn, see WebServer::continue_streamed_upload(). False if the body
+    // has to be read into the request instead; handle() then reports the
+    // error.
+    bool open_streamed_upload(Connection* conn);
+    // Takes the finished job of open_streamed_upload() and has the rest of
+    // the body parsed as it is received
+    void upload_directory_created(Connection* conn);
+
+    // Run on a file worker: FILE_JOB_OPEN_UPLOAD and FILE_JOB_UPLOAD
+    static void create_upload_directory(FileJob* job);
+    static void store_upload(FileJob* job);
+
    private:
     // Request validation and processing
     bool validate_request(Connection* conn, std::string& boundary);
+    bool needs_trailing_slash(Connection* conn);
     bool process_trailing_slash_redirect(Connection* conn);
     
     // Response generation
     void send_success_response(Connection* conn);
 
-    // Multipart form data parsing
-    bool parse_multipart_form_data(Connection* conn,
-                                   const std::string& boundary);
-    bool process_part(Connection* conn, const std::string& body,
-                      const std::string& full_boundary,
-                      const std::string& end_boundary, size_t& pos,
-                      bool& file_found);
-    bool extract_part_headers(const std::string& body, size_t& pos,
-                              size_t& headers_end, std::string& headers);
-    bool extract_filename(const std::string& headers, std::string& filename);
-    bool extract_file_content(Connection* conn, const std::string& body,
-                              size_t pos, size_t& content_end,
-                              const std::string& full_boundary,
-                              const std::string& end_boundary,
-                              const std::string& filename, bool& file_found);
-    
-    // File saving operations
-    bool save_uploaded_file(Connection* conn, const std::string& filename,
-                            const std::vector<char>& data);
-    bool write_file_to_disk(Connection* conn, const std::string& file_path,
-                            const std::vector<char>& data);
-    
     // Directory operations
     std::string get_upload_directory(Connection* conn);
-    bool ensure_upload_directory_exists(Connection* conn, 
-                                        const std::string& upload_dir);
-    bool create_directory_recursive(Connection* conn, const std::string& path);
-    
+
     // Utility methods
     std::string extract_boundary(const std::string& content_type);
-    std::string sanitize_filename(const std::string& filename);
 
     // Prevent copying
     FileUploadHandler(const FileUploadHandler&);
@@ -0,0 +1,123 @@
+#ifndef FILEWORKERPOOL_HPP
+#define FILEWORKERPOOL_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+struct DirectoryListing;
+struct StreamedUpload;
+
+// One blocking filesystem operation. The event loop fills in the request
+// part, a worker thread the result. conn_ and finished_ are only ever used
+// by the event loop.
+struct FileJob {
+    FileJob(codes::FileJobType type, const std::string& path);
+    ~FileJob();
+
+    // Request
+    codes::FileJobType type_;
+    std::string path_;
+    std::string index_;    // FILE_JOB_LOAD: file to load if path_ is a
+                           // directory, none if empty
+    bool read_content_;    // FILE_JOB_LOAD: read the file, not only open it
+    bool list_directory_;  // FILE_JOB_LOAD: render the listing of a
+                           // directory without index file
+    std::string listing_uri_;       // Request path shown in the listing
+    bool has_cached_listing_;       // cached_mtime_ is set
+    struct timespec cached_mtime_;  // Of the cached listing, which is kept
+                                    // if the directory still has it
+    std::string boundary_;  // FILE_JOB_OPEN_UPLOAD: of the multipart body
+    size_t body_length_;    // FILE_JOB_OPEN_BODY: bytes to allocate,
+                            // FILE_JOB_RESUMABLE_OPEN: bytes to append
+    RequestBody body_;      // FILE_JOB_STORE_BODY,
+                            // FILE_JOB_RESUMABLE_APPEND: taken from the
+                            // request, unless spliced into fd_
+    std::string upload_id_;  // FILE_JOB_RESUMABLE_*: made up by
+                             // FILE_JOB_RESUMABLE_CREATE
+    std::string filename_;   // FILE_JOB_RESUMABLE_CREATE: from the metadata
+    size_t upload_length_;   // FILE_JOB_RESUMABLE_CREATE, and the result of
+                             // FILE_JOB_RESUMABLE_OFFSET
+    size_t upload_offset_;   // FILE_JOB_RESUMABLE_OPEN, _APPEND: where
+                             // the body goes. Result: where the stored
+                             // data ends.
+    Connection* conn_;     // Submitter, NULL once it went away
+    bool finished_;        // Handed back to conn_ by dispatch_completions()
+
+    // Result
+    bool exists_;        // stat() found path_
+    struct stat stat_;   // Of path_, or of the file loaded in its place
+    std::string file_;   // Regular file loaded: path_ or its index file
+    int error_;          // errno of the failed call, 0 if all succeeded
+    bool listing_current_;  // The cached listing is still valid
+    DirectoryListing* listing_;  // Newly rendered listing, owned by the job
+    std::vector<char> content_;
+    // FILE_JOB_OPEN_BODY result, FILE_JOB_STORE_BODY request: temporary file
+    // of a spliced body, closed and removed with the job unless taken.
+    // FILE_JOB_RESUMABLE_OPEN result, FILE_JOB_RESUMABLE_APPEND request:
+    // <id>.part with the body spliced in, never removed.
+    int fd_;
+    std::string temp_path_;
+    StreamedUpload* upload_;  // FILE_JOB_UPLOAD: the files written while
+                              // the body arrived, owned by the job
+    bool created_;  // FILE_JOB_STORE_BODY: path_ did not exist before
+    codes::ResponseStatus status_;  // FILE_JOB_OPEN_UPLOAD, FILE_JOB_UPLOAD,
+                                    // FILE_JOB_STORE_BODY,
+                                    // FILE_JOB_RESUMABLE_*: OK once done,
+                                    // the error otherwise
+};
+
+// Runs the filesystem calls of handlers on a few worker threads, so a slow
+// disk stalls the requests waiting for it and not the event loop.
+//
+// A handler submits a job and returns. Its connection parks in
+// CONN_FILE_WAIT without epoll interest. Workers report finished jobs
+// through an eventfd in the epoll set, and dispatch_completions() puts each
+// job in conn->file_job_ and resumes the connection with EPOLLOUT, so
+// handle_write() calls the handler again to build the response from it. The
+// file for a spliced PUT or PATCH body is opened before there is a handler,
+// its request goes on with WebServer::continue_spliced_body(). So is the
+// directory of a multipart upload, with
+// WebServer::continue_streamed_upload().
+class FileWorkerPool {
+   public:
+    FileWorkerPool();
+    ~FileWorkerPool();  // Stops the workers and drops unfinished jobs
+
+    // Creates the eventfd and the worker threads. Returns false on error.
+    bool start(size_t thread_count);
+    int event_fd() const { return event_fd_; }
+
+    // Takes ownership of job and parks conn until it is done
+    void submit(Connection* conn, FileJob* job);
+
+    // The eventfd is readable: hands finished jobs to their connections
+    void dispatch_completions();
+
+    // Detaches a closing connection from its job, which is dropped when done
+    void cancel(Connection* conn);
+
+   private:
+    pthread_mutex_t mutex_;
+    pthread_cond_t work_ready_;
+    std::deque<FileJob*> queue_;  // Submitted, not yet picked up
+    std::vector<FileJob*> done_;  // Finished, not yet dispatched
+    std::vector<pthread_t> threads_;
+    int event_fd_;
+    bool stopping_;
+
+    void stop();
+    static void* worker_main(void* pool);
+    void run_worker();
+    static void run_job(FileJob* job);
+    static void load_path(FileJob* job);
+    static bool load_file(FileJob* job, const std::string& path);
+    static void list_directory(FileJob* job);
+    static void delete_file(FileJob* job);
+
+    // Prevent copying
+    FileWorkerPool(const FileWorkerPool&);
+    FileWorkerPool& operator=(const FileWorkerPool&);
+};  // class FileWorkerPool
+
+#endif  // FILEWORKERPOOL_HPP
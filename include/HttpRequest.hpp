@@ -4,6 +4,17 @@
 #include "webserv.hpp"
 
 struct Location;
+class RequestArena;
+
+// A header field of HttpRequest::fields_, its bytes in the connection's
+// RequestArena
+struct HeaderField {
+    const char* name_;  // Lowercase
+    size_t name_length_;
+    const char* value_;  // No surrounding whitespace
+    size_t value_length_;
+    codes::KnownHeader known_;
+};
 
 // Represents a parsed HTTP Request.
 // An instance of this is typically created during the parsing phase
@@ -13,13 +24,18 @@ struct HttpRequest {
     // Request Data Members
     //--------------------------------------
     std::string method_;   // e.g., "GET", "POST"
+    codes::Method method_type_;  // method_ parsed, METHOD_UNKNOWN if invalid
     std::string uri_;      // The original, unmodified URI from the request line
     std::string version_;  // e.g., "HTTP/1.1", "HTTP/1.0"
 
-    std::map<std::string, std::string>
-        headers_;  // Map of header names to values
+    // All headers, in arrival order. Keeps its capacity across keep-alive
+    // requests, the names and values live in the connection's arena.
+    std::vector<HeaderField> fields_;
+    // Index + 1 in fields_ of the last occurrence of each known header,
+    // 0 if absent
+    size_t known_fields_[codes::HEADER_COUNT];
 
-    std::vector<char> body_;  // Request body content
+    RequestBody body_;  // In memory or spooled to a file when large
 
     // Parsed components of the URI (populated after basic parsing)
     std::string path_;          // Path part of the URI (e.g., "/index.html")
@@ -34,8 +50,26 @@ struct HttpRequest {
     //--------------------------------------
     // Helper Methods
     //--------------------------------------
-    std::string get_header(const std::string& name) const;
-    void set_header(const std::string& name, const std::string& value);
+    // Stores a header, copying it into arena. name must be lowercase, value
+    // trimmed.
+    void add_header(RequestArena& arena, const char* name, size_t name_length,
+                    const char* value, size_t value_length);
+
+    bool has_header(codes::KnownHeader header) const;
+    std::string get_header(codes::KnownHeader header) const;
+    std::string get_header(const std::string& name) const;  // Any case
+    // Case-insensitive comparison of a known header's value, no copy
+    bool header_equals(codes::KnownHeader header, const char* value) const;
+    // Case-insensitive search for a token in a known header's value
+    bool header_contains(codes::KnownHeader header, const char* token) const;
+
+    // Start of a field's name or value
+    const char* field_name(const HeaderField& field) const;
+    const char* field_value(const HeaderField& field) const;
+
+    static codes::KnownHeader find_known_header(const char* name,
+                                                size_t length);
+
     void clear();
 
    private:
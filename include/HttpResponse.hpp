@@ -3,6 +3,13 @@
 
 #include "webserv.hpp"
 
+// A response header other than Content-Type and Content-Length, with its
+// name as given
+struct ResponseHeader {
+    std::string name_;
+    std::string value_;
+};
+
 // Represents an HTTP Response to be sent back to the client.
 // An instance of this is owned by Connection and pointed to by
 // Connection::response_data_.
@@ -15,12 +22,15 @@ struct HttpResponse {
     std::string
         version_;  // e.g., "HTTP/1.1" (usually match request or default)
 
-    std::map<std::string, std::string> headers_;  // Response headers
+    // Response headers in the order they were set. A handful per response,
+    // so a linear scan beats a map and clear() keeps the storage.
+    std::vector<ResponseHeader> headers_;
 
     std::vector<char> body_;  // Response body content
 
-    // Often useful to store these explicitly for header generation
+    // Fixed slots, set directly or through set_header()
     size_t content_length_;
+    bool has_content_length_;  // content_length_ was set, not just defaulted
     std::string content_type_;
 
     //--------------------------------------
@@ -32,15 +42,19 @@ struct HttpResponse {
     //--------------------------------------
     // Helper Methods (declarations)
     //--------------------------------------
+    // Names are case-insensitive. Content-Type and Content-Length go to
+    // their slots, any other header replaces one of the same name.
     void set_header(const std::string& name, const std::string& value);
     void set_status(int code);
     std::string get_header(const std::string& name) const;
+    // The value of a header in headers_, NULL if it is not set
+    const std::string* find_header(const char* name) const;
 
-    // Method to generate the full status line + headers string
-    std::string get_headers_string() const;
-
-    // Method to generate the status line only
-    std::string get_status_line() const;
+    // Appends the status line and headers to out, the Date line from
+    // http_date(). With entity_headers false the Content-Type and
+    // Content-Length lines and the blank line after the headers are left
+    // to the caller.
+    void write_head(IoBuffer& out, bool entity_headers) const;
 
     void clear();
 
@@ -51,4 +65,16 @@ struct HttpResponse {
 
 };  // class Response
 
+// Reason phrase of a status code, "Unknown Status" for codes not in the
+// table
+const char* status_reason(int code);
+
+// Value of the Date header for the current second, formatted when the
+// second changes
+const std::string& http_date();
+
+// Formats http_date() again if now is a new second. Called by the event
+// loop on every turn, so responses only copy the string.
+void refresh_http_date(time_t now);
+
 #endif  // RESPONSE_HPP
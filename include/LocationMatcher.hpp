@@ -0,0 +1,80 @@
+#ifndef LOCATIONMATCHER_HPP
+#define LOCATIONMATCHER_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Location;
+
+// Finds the location block for a request path. Built once per
+// VirtualServer from its locations, which it refers to by index.
+//
+// Prefix and exact locations live in a trie with one edge per path segment,
+// so a lookup walks the request path once whatever the number of locations.
+// Selection follows nginx:
+//   1. an exact (=) location matching the whole path wins at once;
+//   2. otherwise the longest matching prefix is remembered, and if it is a
+//      ^~ location it wins;
+//   3. otherwise regex locations (~, ~*) are tried in config order and the
+//      first match wins;
+//   4. otherwise the longest prefix wins.
+class LocationMatcher {
+   public:
+    LocationMatcher();
+    LocationMatcher(const LocationMatcher& other);
+    LocationMatcher& operator=(const LocationMatcher& other);
+    ~LocationMatcher();
+
+    // Rebuilds the matcher. Returns false if a regex fails to compile.
+    bool compile(const std::vector<Location>& locations);
+
+    // Index of the location for path, or -1 if none matches
+    int match(const std::string& path) const;
+
+   private:
+    // Child of a node, for one path segment
+    struct Edge {
+        std::string segment_;
+        size_t node_;
+    };
+
+    // Orders edges by segment length, then bytes, so a segment of the
+    // request path is looked up in place without copying it
+    struct EdgeLess {
+        bool operator()(const Edge& edge,
+                        const std::pair<const char*, size_t>& segment) const;
+    };
+
+    struct Node {
+        std::vector<Edge> children_;  // Sorted by EdgeLess
+        int prefix_;        // "/a/b": the segment and everything below it
+        int prefix_slash_;  // "/a/b/": only below the segment
+        int exact_;         // "= /a/b"
+        int exact_slash_;   // "= /a/b/"
+        bool prefix_final_;        // prefix_ is a ^~ location
+        bool prefix_slash_final_;  // prefix_slash_ is a ^~ location
+
+        Node();
+    };
+
+    struct RegexLocation {
+        std::string pattern_;
+        bool icase_;
+        int location_;
+    };
+
+    std::vector<Node> nodes_;  // nodes_[0] is the root, "/"
+    std::vector<RegexLocation> regexes_;
+    std::vector<regex_t> compiled_;  // Same order as regexes_
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    // Node index of the child of node for the segment, npos if none
+    size_t find_child(size_t node, const char* segment, size_t length) const;
+    void insert(const std::string& path, int location,
+                codes::LocationMatch type);
+    bool compile_regexes();
+    void free_regexes();
+};  // class LocationMatcher
+
+#endif  // LOCATIONMATCHER_HPP
@@ -37,6 +37,7 @@ enum log_level {
 };
 
 int log(log_level level, const char* msg, ...);
-std::string get_current_gmt_time();
+// Writes the time for a log line into buffer, returns its length
+size_t get_current_gmt_time(char* buffer, size_t size);
 
 #endif  // LOGGER_HPP
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef METRICSHANDLER_HPP
+#define METRICSHANDLER_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+class AHandler;
+
+// Serves a plain text snapshot of the server's counters for locations with
+// "metrics on". One "name{labels} value" line per figure, so the page can be
+// read by eye or scraped as-is.
+class MetricsHandler : public AHandler {
+   public:
+    MetricsHandler();
+    virtual ~MetricsHandler();
+
+    virtual void handle(Connection* conn);
+
+   private:
+    // Prevent copying
+    MetricsHandler(const MetricsHandler&);
+    MetricsHandler& operator=(const MetricsHandler&);
+};  // class MetricsHandler
+
+#endif  // METRICSHANDLER_HPP
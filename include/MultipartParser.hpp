@@ -0,0 +1,73 @@
+#ifndef MULTIPARTPARSER_HPP
+#define MULTIPARTPARSER_HPP
+
+#include "webserv.hpp"
+
+// Receives the parts found by MultipartParser. A false return stops the
+// parser with MULTIPART_ERROR.
+class MultipartSink {
+   public:
+    virtual ~MultipartSink() {}
+
+    // filename is empty for parts that are not files (form fields)
+    virtual bool begin_part(const std::string& filename) = 0;
+    virtual bool part_data(const char* data, size_t length) = 0;
+    virtual bool end_part() = 0;
+};
+
+// Incremental multipart/form-data parser (RFC 7578).
+//
+// The body can be fed in pieces of any size, split anywhere. Part content is
+// passed to the sink as it is found and never buffered whole: only the bytes
+// that may start a boundary (fewer than its length) and the headers of the
+// current part are kept between feeds. Boundaries are found with
+// Boyer-Moore-Horspool, which skips up to a boundary length per comparison.
+class MultipartParser {
+   public:
+    static const size_t npos = static_cast<size_t>(-1);
+    static const size_t MAX_BOUNDARY_LENGTH = 70;  // RFC 2046
+    static const size_t MAX_PART_HEADERS = 8192;
+
+    MultipartParser();
+
+    // Starts a new body, false if the boundary is not valid
+    bool reset(const std::string& boundary, MultipartSink* sink);
+
+    // Parses the next piece of the body, false once the body is malformed or
+    // the sink failed
+    bool feed(const char* data, size_t length);
+
+    // True once the closing boundary was parsed
+    bool finished() const;
+
+    // True once the body was malformed or the sink failed, or if reset()
+    // was never called with a valid boundary
+    bool failed() const;
+
+    // Parts seen so far with a filename
+    size_t file_parts() const;
+
+    // Offset of the delimiter in data, npos if it is not there in full
+    size_t find_delimiter(const char* data, size_t length) const;
+
+   private:
+    size_t parse_content(const char* data, size_t length);
+    size_t parse_boundary_tail(const char* data, size_t length);
+    size_t parse_headers(const char* data, size_t length);
+    bool emit(const char* data, size_t length);  // Content to the sink
+    bool end_content();                           // A delimiter was found
+    bool fail(const char* reason);
+
+    // Value of filename="..." in the Content-Disposition of the headers
+    static std::string extract_filename(const std::string& headers);
+
+    codes::MultipartState state_;
+    MultipartSink* sink_;
+    std::string delimiter_;  // CRLF "--" boundary
+    size_t skip_[256];       // Horspool shift for each byte
+    std::string held_;       // Bytes that may be the start of a delimiter
+    std::string headers_;    // Headers of the current part so far
+    size_t file_parts_;
+};  // class MultipartParser
+
+#endif  // MULTIPARTPARSER_HPP
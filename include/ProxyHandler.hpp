@@ -0,0 +1,55 @@
+#ifndef PROXYHANDLER_HPP
+#define PROXYHANDLER_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+class AHandler;
+
+// Forwards requests to the upstream server configured with proxy_pass.
+// The exchange runs as a state machine on the shared epoll loop: the upstream
+// socket is registered like a CGI pipe and every event on it (or on the client
+// socket) advances the state. Response bodies are relayed through the
+// connection's write buffer as they arrive, never buffered whole.
+class ProxyHandler : public AHandler {
+   public:
+    ProxyHandler();
+    virtual ~ProxyHandler();
+
+    virtual void handle(Connection* conn);
+
+   private:
+    // Request side
+    void start_exchange(Connection* conn);
+    bool open_upstream_connection(Connection* conn);
+    bool connect_to_server(Connection* conn);
+    void build_upstream_request(Connection* conn);
+    void check_upstream_connect(Connection* conn);
+    void send_upstream_request(Connection* conn);
+
+    // Response side
+    void read_upstream_headers(Connection* conn);
+    bool parse_upstream_headers(Connection* conn, size_t head_length);
+    void stream_upstream_body(Connection* conn);
+    bool process_body_bytes(Connection* conn);
+    bool process_chunked_bytes(Connection* conn);
+    void append_client_body(Connection* conn, const char* data, size_t length);
+    bool flush_to_client(Connection* conn);
+    void relay_to_client(Connection* conn);
+    ssize_t receive_from_upstream(Connection* conn);
+
+    // Completion and failure
+    void finish_exchange(Connection* conn);
+    void retry_or_fail(Connection* conn);
+    void fail_exchange(Connection* conn, codes::ResponseStatus status);
+    void abort_exchange(Connection* conn);
+    void release_upstream(Connection* conn, bool reusable);
+    void end_upstream_request(Connection* conn);
+
+    // Prevent copying
+    ProxyHandler(const ProxyHandler&);
+    ProxyHandler& operator=(const ProxyHandler&);
+};  // class ProxyHandler
+
+#endif  // PROXYHANDLER_HPP
@@ -0,0 +1,58 @@
+#ifndef READBUFFER_HPP
+#define READBUFFER_HPP
+
+#include "webserv.hpp"
+
+// Bytes received from a client that were not parsed yet.
+//
+// Parsing consumes from the front by advancing an offset instead of erasing.
+// The unread bytes are moved back to the start of the storage only when a
+// read needs room at the end, so each byte is moved at most once whatever
+// the number of lines, chunks or pipelined requests it is consumed in. The
+// storage is a BufferPool block and keeps its size between reads and
+// requests.
+//
+// Line ends are found by classifying DelimiterScanner::BLOCK_SIZE bytes at
+// a time into a mask of their CRs. Lines in the same block then only cost a
+// bit scan, and when a line arrives over several reads only the new bytes
+// are classified. Where DelimiterScanner has no vector code, a memchr from
+// one CR to the next is cheaper and used instead.
+class ReadBuffer {
+   public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    ReadBuffer();
+
+    const char* data() const;  // First unread byte
+    size_t size() const;       // Unread bytes
+    bool empty() const;
+    char operator[](size_t index) const;
+
+    // Offset of the first CRLF, npos if there is none yet
+    size_t find_crlf();
+
+    // Drops the first count unread bytes
+    void consume(size_t count);
+    void clear();
+
+    // Gives the storage back to the BufferPool, for an idle connection
+    void release();
+
+    // Makes room for at least min_room more bytes and returns where they go.
+    // writable() tells how many fit; commit() adds those actually written.
+    char* prepare(size_t min_room);
+    size_t writable() const;
+    void commit(size_t count);
+
+   private:
+    size_t find_crlf_from_scanned(const char* begin, size_t length);
+
+    IoBuffer storage_;
+    size_t start_;  // First unread byte in storage_
+    size_t end_;    // One past the last received byte
+    size_t scanned_;    // Unread bytes already classified
+    size_t cr_base_;    // Unread offset bit 0 of cr_mask_ stands for
+    uint64_t cr_mask_;  // Classified CRs not passed over yet
+};  // class ReadBuffer
+
+#endif  // READBUFFER_HPP
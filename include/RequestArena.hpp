@@ -0,0 +1,49 @@
+#ifndef REQUESTARENA_HPP
+#define REQUESTARENA_HPP
+
+#include "webserv.hpp"
+
+// Memory for the bytes parsed out of one request, freed all at once.
+//
+// Allocation bumps a pointer through BufferPool blocks chained together; a
+// request that outgrows its block takes another one. Nothing is freed
+// individually: reset() drops everything between keep-alive requests and
+// keeps the first block, so the next request of a similar size parses
+// without touching the pool, and release() gives every block back for an
+// idle connection.
+class RequestArena {
+   public:
+    RequestArena();
+    ~RequestArena();
+
+    // Room for size bytes, valid until the next reset() or release()
+    char* allocate(size_t size);
+
+    // Forgets all allocations, keeping the first block
+    void reset();
+    // Gives every block back to the BufferPool
+    void release();
+
+    size_t block_count() const;
+
+   private:
+    // Start of each block, the usable bytes follow it
+    struct Block {
+        Block* next_;
+        size_t size_;  // Whole block, as given to BufferPool::allocate()
+    };
+
+    Block* first_;
+    Block* last_;
+    char* next_;  // First free byte of the last block
+    char* end_;   // One past the last block
+
+    void add_block(size_t min_room);
+    static char* start_of(Block* block);
+
+    // Prevent copying
+    RequestArena(const RequestArena&);
+    RequestArena& operator=(const RequestArena&);
+};  // class RequestArena
+
+#endif  // REQUESTARENA_HPP
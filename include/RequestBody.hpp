@@ -0,0 +1,75 @@
+#ifndef REQUESTBODY_HPP
+#define REQUESTBODY_HPP
+
+#include "webserv.hpp"
+
+// The body of a request, in memory or spooled to a temporary file.
+//
+// Bodies up to the buffer size (client_body_buffer_size) stay in memory.
+// Larger ones go to an unlinked file in the temp path (client_body_temp_path),
+// opened as soon as the body is known to be too large, so concurrent uploads
+// cost disk space instead of RAM. The file has no name and disappears with
+// its descriptor.
+//
+// Handlers read the body through read() or write_to(), which work the same
+// for both kinds of storage. A multipart upload is not stored at all: it is
+// handed to its parser as it is appended, see stream_to().
+class RequestBody {
+   public:
+    RequestBody();
+    ~RequestBody();
+
+    // Sets where the coming body is stored. Called once the headers are
+    // parsed, before anything is appended.
+    void configure(size_t buffer_size, const std::string& temp_path);
+
+    // Announces a body of expected bytes: one over the buffer size goes to a
+    // file right away, one under it gets its memory reserved. False if the
+    // file cannot be created.
+    bool expect(size_t expected);
+
+    // Drops what is stored and feeds the rest of the body to parser as it
+    // is appended. The parser keeps any error to itself, size() still
+    // counts the bytes. Ends with clear().
+    void stream_to(MultipartParser* parser);
+
+    // False if the body had to move to a file and writing it failed
+    bool append(const char* data, size_t length);
+
+    size_t size() const;
+    bool empty() const;
+    bool in_memory() const;
+
+    // Contiguous bytes of a body in memory, NULL for a spooled one
+    const char* data() const;
+
+    // Copies up to length bytes from offset, returns the count or -1
+    ssize_t read(size_t offset, char* out, size_t length) const;
+
+    // Writes up to length bytes from offset to a socket, pipe or file, with
+    // sendfile() when spooled. Returns the count written or -1 (errno set).
+    ssize_t write_to(int fd, size_t offset, size_t length) const;
+
+    // Drops the body and closes its file. Memory below the buffer size is
+    // kept for the next request on the connection.
+    void clear();
+
+    // Exchanges the bodies, so one can be handed over without copying it
+    void swap(RequestBody& other);
+
+   private:
+    bool spool();  // Moves the body to a new temporary file
+
+    std::vector<char> memory_;
+    int fd_;                   // Temporary file, -1 while in memory
+    size_t size_;              // Bytes of a spooled or streamed body
+    MultipartParser* parser_;  // Fed instead of storing, NULL if none
+    size_t buffer_size_;
+    std::string temp_path_;
+
+    // Prevent copying
+    RequestBody(const RequestBody&);
+    RequestBody& operator=(const RequestBody&);
+};  // class RequestBody
+
+#endif  // REQUESTBODY_HPP
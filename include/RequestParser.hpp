@@ -6,6 +6,7 @@
 // Forward declarations
 struct Connection;
 struct HttpRequest;
+class ReadBuffer;
 struct VirtualServer;
 
 // Parses HTTP requests incrementally from a Connection's read buffer.
@@ -21,44 +22,51 @@ class RequestParser {
     // - If true, the read buffer is updated with the new data.
     bool read_from_socket(Connection* conn);
 
+    // Takes the place of read_from_socket() and parse() once a body is
+    // spliced (PARSING_SPLICED_BODY): moves body bytes from the socket into
+    // conn->body_file_fd_ without copying them to user space, and sets
+    // conn->parse_status_. Returns false if the connection is closed or an
+    // error occurs on the socket.
+    bool splice_body(Connection* conn);
+
     // Parses data currently in the connection's read buffer.
     // - Populates conn->request_data if successful (PARSE_SUCCESS).
-    // - Updates conn->read_buffer (removing parsed data).
+    // - Updates conn->read_buffer (consuming parsed data).
     // - Returns the result status.
     codes::ParseStatus parse(Connection* conn);
 
    private:
     // Request line parsing methods
     codes::ParseStatus parse_request_line(Connection* conn);
-    bool split_request_line(HttpRequest* request, std::string& request_line);
-    bool split_uri_components(HttpRequest* request);
-    std::string decode_uri_path(const std::string& uri);
-    std::string decode_uri_query(const std::string& uri);
-    inline int hex_to_int(char c);
-    codes::ParseStatus validate_request_line(const HttpRequest* request);
-    bool validate_method(const std::string& method);
-    bool validate_path(const std::string& path);
-    bool validate_query_string(const std::string& query_string);
+    bool split_request_line(HttpRequest* request, const char* line,
+                            size_t length);
+    codes::ParseStatus validate_request_line(HttpRequest* request);
+    codes::ParseStatus decode_uri(HttpRequest* request);
+    codes::ParseStatus decode_path(const unsigned char* uri,
+                                   const unsigned char* end, std::string& path);
+    codes::ParseStatus decode_query(const unsigned char* uri,
+                                    const unsigned char* end,
+                                    std::string& query_string);
     bool validate_http_version(const std::string& version);
 
     // Header parsing methods
     codes::ParseStatus parse_headers(Connection* conn);
-    codes::ParseStatus process_single_header(const std::string& header_line,
-                                             HttpRequest* request);
+    codes::ParseStatus process_single_header(const char* line, size_t length,
+                                             Connection* conn);
     codes::ParseStatus validate_headers(Connection* conn);
     codes::ParseStatus determine_request_body_handling(Connection* conn);
 
     // Body parsing methods
     codes::ParseStatus parse_body(Connection* conn);
     codes::ParseStatus parse_chunked_body(Connection* conn);
-    codes::ParseStatus parse_chunk_header(std::vector<char>& buffer,
+    codes::ParseStatus parse_chunk_header(ReadBuffer& buffer,
                                           size_t& out_chunk_size);
-    codes::ParseStatus read_chunk_data(std::vector<char>& buffer,
+    codes::ParseStatus read_chunk_data(ReadBuffer& buffer,
                                        HttpRequest* request,
                                        size_t& chunk_remaining_bytes,
                                        size_t client_max_body_size);
-    codes::ParseStatus process_chunk_terminator(std::vector<char>& buffer);
-    codes::ParseStatus finish_chunked_parsing(std::vector<char>& buffer);
+    codes::ParseStatus process_chunk_terminator(ReadBuffer& buffer);
+    codes::ParseStatus finish_chunked_parsing(ReadBuffer& buffer);
 
     // Prevent copying
     RequestParser(const RequestParser&);
@@ -0,0 +1,73 @@
+#ifndef RESPONSECACHE_HPP
+#define RESPONSECACHE_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+
+// A stored response, without the headers that are per connection
+struct CachedResponse {
+    int status_code_;
+    std::string header_lines_;  // "Name: value\r\n" lines, in order
+    std::vector<char> body_;
+    time_t stored_at_;
+    time_t fresh_until_;  // Served as is until then
+    time_t stale_until_;  // Served while one request revalidates until then
+};
+
+// Micro-cache for CGI and proxied responses of locations with
+// "response_cache <ttl> [<stale>]", keyed on method, host and URI.
+//
+// Only one request per key goes to the backend at a time (the leader).
+// Identical requests that miss meanwhile park in CONN_CACHE_WAIT and are
+// answered from the leader's response once it completes. While an expired
+// entry is within its stale window, the first request revalidates it and
+// the others are served the stale copy.
+class ResponseCache {
+   public:
+    ResponseCache();
+    ~ResponseCache();
+
+    // Called once the handler for a request is chosen. Returns true if the
+    // request was answered from the cache or is waiting for a leader, in
+    // which case the handler must not run.
+    bool serve_or_join(Connection* conn);
+
+    // The leader's response is complete. Stores it if cacheable and hands
+    // it to the waiting requests. The first form takes the response from
+    // conn->response_data_ (CGI), the second from the proxy's captured copy.
+    void complete(Connection* leader);
+    void complete(Connection* leader, const std::string& header_lines,
+                  const std::vector<char>& body);
+
+    // The leader failed or went away: waiting requests run their own
+    // handler instead
+    void abandon(Connection* leader);
+
+    // Detaches a closing connection from the cache
+    void cancel(Connection* conn);
+
+    // Drops entries past their stale window. Returns how many were removed.
+    int remove_expired(time_t now);
+
+   private:
+    std::map<std::string, CachedResponse> entries_;
+    std::map<std::string, std::vector<Connection*> > pending_;  // By key
+    size_t total_bytes_;
+
+    void store(const Connection* leader, const std::string& header_lines,
+               const std::vector<char>& body);
+    void release_waiters(const std::string& key);
+    void erase_entry(std::map<std::string, CachedResponse>::iterator it);
+
+    static std::string make_key(const Connection* conn);
+    static void serve(Connection* conn, const CachedResponse& entry,
+                      const char* cache_status);
+
+    // Prevent copying
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+};  // class ResponseCache
+
+#endif  // RESPONSECACHE_HPP
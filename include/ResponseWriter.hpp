@@ -16,16 +16,28 @@ class ResponseWriter {
 
     codes::WriteStatus write_response(Connection* conn);
 
+    // Appends the whole response to the ones held back for pipelined
+    // requests, to go out with a later response. False if it does not fit
+    // in PIPELINE_BATCH_SIZE and has to be sent with write_response().
+    bool hold_response(Connection* conn);
+
+    // Sends what is held back, before anything else goes to the client
+    codes::WriteStatus send_held_responses(Connection* conn);
+
     // Prepares the initial part of the response (status line + headers)
     // and places it into the Connection's write buffer.
     // Sets standard headers like Date, Server, Content-Length, Content-Type
     // based on Response object. Returns true on success, false on error.
+    // Serializes straight into the buffer, see HttpResponse::write_head().
+    // The body is not copied after them, response_parts() sends it from
+    // the response.
     bool write_headers(Connection* conn);
 
-    bool write_body(Connection* conn);
-
    private:
-    std::string get_current_gmt_time() const;  // Helper for Date header
+    bool prepare_response(Connection* conn);
+    size_t response_parts(Connection* conn, struct iovec* parts);
+    codes::WriteStatus send_parts(Connection* conn, struct iovec* parts,
+                                  size_t count);
 
     // Prevent copying
     ResponseWriter(const ResponseWriter&);
@@ -0,0 +1,88 @@
+#ifndef RESUMABLEUPLOADHANDLER_HPP
+#define RESUMABLEUPLOADHANDLER_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct Connection;
+struct FileJob;
+
+// Handles resumable uploads for locations with "resumable_upload on", in the
+// style of the tus protocol (core and creation):
+//
+//   POST   <location>       Upload-Length and optional Upload-Metadata,
+//                           creates <location><id> and returns it in Location
+//   PATCH  <location><id>   Appends the body at Upload-Offset, which has to
+//                           be the current offset
+//   HEAD   <location><id>   Reports Upload-Offset and Upload-Length
+//   DELETE <location><id>   Drops the upload
+//
+// A client that lost its connection asks for the offset and sends only the
+// rest. Partial uploads live in "uploads/.resumable/" as <id>.part and
+// <id>.info, so they also survive a restart. A complete upload moves to
+// "uploads/" under the filename from its metadata, or under its id.
+//
+// handle() checks the request headers and has a file worker do the rest,
+// one FILE_JOB_RESUMABLE_* job per method, then answers from its result.
+// A PATCH body is spliced into <id>.part as it arrives (see
+// open_spliced_body()), so what a dropped PATCH sent is kept too.
+class ResumableUploadHandler : public AHandler {
+   public:
+    ResumableUploadHandler();
+    virtual ~ResumableUploadHandler();
+
+    virtual void handle(Connection* conn);
+
+    // Submits the job opening <id>.part for the PATCH body of conn to be
+    // spliced into, see WebServer::continue_spliced_body(). False if the
+    // body has to be read into the request instead; handle() then reports
+    // any error.
+    bool open_spliced_body(Connection* conn);
+
+    // Run on a file worker, one per method, and FILE_JOB_RESUMABLE_OPEN
+    static void create_upload(FileJob* job);
+    static void open_upload_part(FileJob* job);
+    static void append_to_upload(FileJob* job);
+    static void report_offset(FileJob* job);
+    static void delete_upload(FileJob* job);
+
+   private:
+    // What <id>.info holds
+    struct UploadInfo {
+        size_t length_;
+        std::string filename_;  // Sanitized, empty if the client gave none
+    };
+
+    // Submits the job for the request method, or sets an error response
+    void submit_job(Connection* conn, const std::string& upload_dir);
+    // Builds the response from a finished job
+    void send_job_result(Connection* conn, const FileJob& job);
+
+    // On a file worker: writes a body read into the request at the end of
+    // <id>.part and sets offset past it
+    static bool write_to_upload(FileJob* job, const UploadInfo& info,
+                                size_t& offset);
+    // On a file worker: moves a complete upload into the upload directory
+    static bool complete_upload(FileJob* job, const UploadInfo& info);
+
+    // Upload state on disk, on a file worker
+    static bool load_info(const std::string& upload_dir, const std::string& id,
+                          UploadInfo& info);
+    static bool save_info(const std::string& upload_dir, const std::string& id,
+                          const UploadInfo& info);
+
+    // Last segment of the request path, empty if it is not an upload id
+    std::string extract_upload_id(Connection* conn);
+    static std::string generate_upload_id();
+    static std::string extract_metadata_filename(const std::string& metadata);
+
+    // Success and error responses, both with the protocol headers
+    void send_response(Connection* conn, codes::ResponseStatus status);
+    void send_error(Connection* conn, codes::ResponseStatus status);
+
+    // Prevent copying
+    ResumableUploadHandler(const ResumableUploadHandler&);
+    ResumableUploadHandler& operator=(const ResumableUploadHandler&);
+};  // class ResumableUploadHandler
+
+#endif  // RESUMABLEUPLOADHANDLER_HPP
@@ -5,6 +5,7 @@
 
 // Forward declarations
 struct Connection;
+struct FileJob;
 struct VirtualServer;
 
 // Handles requests for static files.
@@ -15,25 +16,20 @@ class StaticFileHandler : public AHandler {
     virtual ~StaticFileHandler();
 
     // Implementation of the handle method for static files.
-    // - Validates request method (GET, HEAD).
     // - Resolves file path based on server root and request URI.
-    // - Checks file existence and permissions.
-    // - Opens file, prepares response headers (status, content-type, length).
-    // - Sets up Connection state for sending (file FD, offset, bytes).
-    // - Uses ResponseWriter to format headers into Connection write buffer.
+    // - Submits a FileJob that stats the path and reads the file, its index
+    //   file or the directory listing, and returns.
+    // - Called again with the job in conn->file_job_, checks existence and
+    //   permissions and prepares the response (status, content-type, length).
+    // - Called on EPOLLOUT while a large directory listing is streamed.
     virtual void handle(Connection* conn);
 
-    // Optional: Could override on_writable if complex chunked sending needed,
-    // but often the main Server write loop can handle simple file sending.
-
    private:
-    // Helper methods for path resolution, MIME type lookup etc. go in .cpp
-    // bool process_directory_redirect(Connection* conn,
-    //                                 std::string& absolute_path);
-    // bool process_directory_index(Connection* conn, std::string& absolute_path,
-    //                              bool& need_autoindex);
-    // void generate_directory_listing(Connection* conn,
-    //                                 const std::string& dir_path);
+    void submit_load(Connection* conn, bool use_cached_listing);
+    void respond(Connection* conn, FileJob& job);
+    void send_listing(Connection* conn, FileJob& job);
+    void send_file(Connection* conn, FileJob& job);
+    static codes::ResponseStatus status_for_error(int error);
 
     // Prevent copying
     StaticFileHandler(const StaticFileHandler&);
@@ -0,0 +1,128 @@
+#ifndef UPSTREAM_HPP
+#define UPSTREAM_HPP
+
+#include "webserv.hpp"
+
+// An idle keep-alive connection parked in an UpstreamServer's pool
+struct IdleUpstreamConnection {
+    int fd_;
+    time_t idle_since_;
+};
+
+// One backend server of an Upstream: its address, its pool of idle
+// HTTP/1.1 keep-alive connections and the load/health figures the balancer
+// works with.
+struct UpstreamServer {
+    std::string address_;  // "host:port" or unix socket path (for logs)
+    struct sockaddr_storage sockaddr_;
+    socklen_t sockaddr_len_;
+
+    // Idle connections, most recently released last
+    std::vector<IdleUpstreamConnection> idle_connections_;
+
+    // Load and health, maintained by Upstream
+    size_t index_;                      // Position in Upstream::servers_
+    size_t inflight_;                   // Requests currently assigned
+    unsigned long last_pick_;           // Selection sequence number
+    double ewma_ms_;                    // Peak-EWMA response latency
+    double ewma_stamp_ms_;              // When ewma_ms_ was last updated
+    unsigned long requests_;            // Requests assigned in total
+    unsigned long failures_;            // Failed requests in total
+    unsigned int consecutive_failures_;
+    bool healthy_;
+    double retry_at_ms_;                // When an unhealthy server is retried
+
+    UpstreamServer();
+
+    // Parses "host:port" or "unix:/path/to.sock".
+    // Returns false (and logs) if the address is invalid.
+    static bool parse_address(const std::string& address,
+                              UpstreamServer& server);
+
+    // Returns a connected (or connecting) non-blocking socket to the server.
+    // Reuses an idle pooled connection when one is still alive, in which case
+    // reused is set to true. Returns -1 on failure.
+    int acquire_connection(bool& reused);
+
+    // Parks a connection whose last response was fully consumed.
+    // Closes it instead if the pool is full.
+    void release_connection(int fd);
+
+    // Closes idle connections older than UPSTREAM_IDLE_TIMEOUT.
+    // Returns the number of connections closed.
+    int close_expired_connections(time_t now);
+    void close_idle_connections();
+
+    // Latency estimate decayed to now, weighted by outstanding requests
+    double load_cost(double now_ms) const;
+};
+
+// A named group of backend servers that proxied locations forward to, and
+// the policy used to spread requests over them. Instances are owned by
+// WebServer: "upstream" blocks by name, plain proxy_pass addresses by target.
+//
+// Each policy keeps its own index of the healthy servers so that picking a
+// server is O(log n) (round robin, least connections) or O(1) (peak EWMA,
+// power of two choices). Unhealthy servers wait in down_ ordered by retry
+// time and rejoin the index lazily on the next selection.
+struct Upstream {
+    std::string name_;     // Block name or proxy_pass target
+    std::string host_;     // Host header used when the client sent none
+    codes::BalancePolicy policy_;
+    std::vector<UpstreamServer> servers_;
+
+    Upstream();
+
+    // Parses a proxy_pass target: "http://host:port[/]" or "unix:/path".
+    // The result is an upstream with a single server.
+    static bool parse_target(const std::string& target, Upstream& upstream);
+
+    // Parses an "upstream <name> {" block up to its closing brace
+    static bool parse_block(std::ifstream& file, const std::string& line,
+                            Upstream& upstream);
+
+    // Builds the selection index, once all servers are added
+    void init_balancer();
+
+    // Picks a server for a new request and counts it as in flight.
+    // Falls back to the unhealthy server due soonest if none is healthy.
+    UpstreamServer* select_server();
+
+    // The request assigned by select_server() is over
+    void end_request(UpstreamServer* server);
+
+    // Passive health checks, fed by ProxyHandler
+    void report_success(UpstreamServer* server, double latency_ms);
+    void report_failure(UpstreamServer* server);
+
+    int close_expired_connections(time_t now);
+    void close_idle_connections();
+
+    static double monotonic_ms();
+
+   private:
+    // Round robin: healthy indices in order, cursor is the last pick
+    std::set<size_t> rr_healthy_;
+    size_t rr_cursor_;
+
+    // Least connections: (inflight, last pick) -> index
+    typedef std::pair<std::pair<size_t, unsigned long>, size_t> LoadKey;
+    std::set<LoadKey> lc_healthy_;
+
+    // Peak EWMA: healthy indices for random access, and their positions
+    std::vector<size_t> ewma_healthy_;
+    std::vector<size_t> ewma_position_;
+
+    // Unhealthy servers by retry time
+    std::set<std::pair<double, size_t> > down_;
+
+    unsigned long pick_sequence_;
+    unsigned int random_state_;
+
+    void add_healthy(UpstreamServer& server);
+    void remove_healthy(UpstreamServer& server);
+    void revive_due_servers(double now_ms);
+    LoadKey load_key(const UpstreamServer& server) const;
+};
+
+#endif  // UPSTREAM_HPP
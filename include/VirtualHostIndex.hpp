@@ -0,0 +1,62 @@
+#ifndef VIRTUALHOSTINDEX_HPP
+#define VIRTUALHOSTINDEX_HPP
+
+#include "webserv.hpp"
+
+// Forward declarations
+struct VirtualServer;
+
+// Resolves the Host header of requests on one listener to a VirtualServer.
+// Built once per listener socket at startup, with the servers of the
+// listener's IP first and those listening on 0.0.0.0 merged in after them.
+//
+// Lookup order follows nginx:
+//   1. exact name, from a hash table;
+//   2. longest leading wildcard ("*.example.com", or ".example.com" which
+//      also matches example.com itself);
+//   3. longest trailing wildcard ("www.example.*").
+// Wildcards live in tries with one edge per DNS label, walked right to left
+// for leading wildcards and left to right for trailing ones.
+class VirtualHostIndex {
+   public:
+    VirtualHostIndex();
+
+    // Indexes the server's names. A name that is already taken keeps the
+    // server it was first added with.
+    void add_server(VirtualServer* server);
+
+    // Server for a lowercased hostname without port, NULL if none matches
+    VirtualServer* find(const std::string& hostname) const;
+
+    // Lowercases a Host header value and strips its port and trailing dot
+    static std::string normalize(const std::string& host_header);
+
+   private:
+    typedef std::pair<std::string, VirtualServer*> NameEntry;
+
+    struct LabelNode {
+        std::map<std::string, size_t> children_;  // Label -> node index
+        VirtualServer* below_;  // Names with at least one more label
+        VirtualServer* self_;   // This very name (".example.com" form)
+
+        LabelNode();
+    };
+
+    std::vector<std::vector<NameEntry> > buckets_;  // Exact names
+    size_t name_count_;
+    std::vector<LabelNode> leading_;   // Labels from the right
+    std::vector<LabelNode> trailing_;  // Labels from the left
+
+    void add_exact(const std::string& name, VirtualServer* server);
+    void grow();
+    static size_t hash(const std::string& name);
+
+    static void add_wildcard(std::vector<LabelNode>& trie,
+                             const std::vector<std::string>& labels,
+                             VirtualServer* server, bool match_self);
+    static VirtualServer* find_wildcard(const std::vector<LabelNode>& trie,
+                                        const std::vector<std::string>& labels);
+    static std::vector<std::string> split_labels(const std::string& name);
+};  // class VirtualHostIndex
+
+#endif  // VIRTUALHOSTINDEX_HPP
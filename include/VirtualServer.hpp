@@ -3,21 +3,52 @@
 
 #include "webserv.hpp"
 
+// Forward declarations
+struct Upstream;
+
 // Location configuration block
 struct Location {
-    std::string path_;
+    std::string path_;  // Path prefix, or pattern for regex locations
+    codes::LocationMatch match_type_;
     std::string root_;
     bool autoindex_;
-    std::vector<std::string> allowed_methods_;
+    unsigned int allowed_methods_;  // Bitmask of codes::Method
+    std::string allow_header_;      // allowed_methods_ as an Allow value
     bool cgi_enabled_;
     std::string index_;
-    std::string redirect_;
+    std::string return_;      // "<code> [text|URL]" of a return (or
+                              // redirect) directive, empty if none
+    int return_code_;         // Its status, 0 if none
+    std::string return_text_;  // Its body text or redirect URL
+    std::string return_response_;  // Whole response compiled from it, but
+                                   // for the Date line after the status line
+    size_t return_status_length_;  // Bytes of the status line in it
+    size_t return_head_length_;    // Bytes before the body in it
+    std::string proxy_pass_;  // Upstream target, empty if not proxied
+    Upstream* upstream_;      // Resolved by WebServer after config parsing
+    bool metrics_;            // Serves the metrics page instead of files
+    bool resumable_upload_;   // Takes resumable uploads (POST, PATCH, HEAD)
+    time_t cache_ttl_;        // response_cache TTL in seconds, 0 if off
+    time_t cache_stale_;      // Seconds an expired entry may still be served
+
+    // CGI environment entries that never change between requests
+    // ("NAME=VALUE"), built once by VirtualServer::build_cgi_env_templates()
+    std::vector<std::string> cgi_env_template_;
 
     // Constructor with defaults
     Location();
 
     // Validation method
     bool is_valid() const;
+
+    bool is_regex() const;
+
+    // Sets allowed_methods_ and the matching allow_header_
+    void set_allowed_methods(unsigned int methods);
+
+    // Parses return_ and builds return_response_ from it
+    void compile_return();
+    bool is_return_redirect() const;
 };
 
 // Server configuration
@@ -29,12 +60,18 @@ struct VirtualServer {
     bool listen_specified_;
     std::vector<std::string> server_names_;
     size_t client_max_body_size_;
+    size_t client_body_buffer_size_;  // Larger bodies are spooled to a file
+    std::string client_body_temp_path_;  // Directory of spooled bodies
+    time_t keepalive_timeout_;   // Idle seconds before a kept-alive
+                                 // connection is closed, 0 disables keep-alive
+    size_t keepalive_requests_;  // Requests served on one connection
 
     // Error pages mapping (status code -> file path)
     std::map<int, std::string> error_pages_;
 
     // Locations within this server
     std::vector<Location> locations_;
+    LocationMatcher location_matcher_;  // Compiled from locations_
 
     // Default constructor
     VirtualServer();
@@ -53,11 +90,23 @@ struct VirtualServer {
                                  VirtualServer& config);
     static bool parse_client_max_body_size(const std::string& value,
                                            VirtualServer& config);
+    static bool parse_client_body_buffer_size(const std::string& value,
+                                              VirtualServer& config);
+    static bool parse_client_body_temp_path(const std::string& value,
+                                            VirtualServer& config);
+    static bool parse_keepalive_timeout(const std::string& value,
+                                        VirtualServer& config);
+    static bool parse_keepalive_requests(const std::string& value,
+                                         VirtualServer& config);
     static bool parse_directive(const std::string& line, std::string& key,
                                 std::string& value);
     static bool add_directive_value(Location& location, const std::string& key,
                                     const std::string& value);
     bool apply_defaults();
+    void build_cgi_env_templates();
+
+    // Location block for a request path, NULL if none matches
+    const Location* find_location(const std::string& path) const;
 
     // Validation methods
     bool is_valid() const;
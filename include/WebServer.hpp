@@ -13,6 +13,16 @@ struct VirtualServer;
 class StaticFileHandler;
 class FileUploadHandler;
 class FileDeleteHandler;
+class FilePutHandler;
+class ResumableUploadHandler;
+class ProxyHandler;
+class MetricsHandler;
+class ResponseCache;
+class FileWorkerPool;
+class DirectoryListingCache;
+class ErrorPageCache;
+struct Upstream;
+class VirtualHostIndex;
 
 // Main server class - orchestrates setup and event loop
 class WebServer {
@@ -37,6 +47,27 @@ class WebServer {
     static WebServer* get_instance() { return instance_; };
     // Getter for the ConnectionManager
     ConnectionManager* get_conn_manager() const { return conn_manager_; }
+    // Getter for the ResponseCache
+    ResponseCache* get_response_cache() const { return response_cache_; }
+    // Getter for the FileWorkerPool
+    FileWorkerPool* get_file_workers() const { return file_workers_; }
+    // Getter for the DirectoryListingCache
+    DirectoryListingCache* get_listing_cache() const { return listing_cache_; }
+    // Getter for the ErrorPageCache
+    ErrorPageCache* get_error_pages() const { return error_pages_; }
+    // Getter for the ResponseWriter
+    ResponseWriter* get_response_writer() const { return response_writer_; }
+    // Getter for the upstreams, for metrics
+    const std::map<std::string, Upstream>& get_upstreams() const {
+        return upstreams_;
+    }
+
+    // Goes on reading a PUT or PATCH request once a file worker tried to
+    // open the file for its body, see start_spliced_body()
+    void continue_spliced_body(Connection* conn);
+    // Goes on reading a multipart POST once a file worker tried to create
+    // its upload directory, see start_streamed_upload()
+    void continue_streamed_upload(Connection* conn);
 
     static bool set_non_blocking(int fd);
     static bool register_epoll_events(int fd, uint32_t events = EPOLLIN);
@@ -59,8 +90,10 @@ class WebServer {
     std::list<VirtualServer> virtual_servers_;  // Loaded server configurations
     std::vector<int> listener_fds_;             // FDs for the listening sockets
     std::map<int, VirtualServer*> listener_to_default_server_;
+    std::map<int, VirtualHostIndex> listener_host_indexes_;  // By listener fd
     std::map<int, std::map<std::string, std::vector<VirtualServer*> > >
         port_to_hosts_;
+    std::map<std::string, Upstream> upstreams_;  // By block name or target
     volatile bool ready_;  // Flag for server readiness for event loop
 
     //--------------------------------------
@@ -69,11 +102,19 @@ class WebServer {
     ConnectionManager* conn_manager_;
     RequestParser* request_parser_;
     ResponseWriter* response_writer_;
+    ResponseCache* response_cache_;
+    FileWorkerPool* file_workers_;
+    DirectoryListingCache* listing_cache_;
+    ErrorPageCache* error_pages_;
     //// Handler instances
     StaticFileHandler* static_file_handler_;
     CgiHandler* cgi_handler_;
     FileUploadHandler* file_upload_handler_;
     FileDeleteHandler* file_delete_handler_;
+    FilePutHandler* file_put_handler_;
+    ResumableUploadHandler* resumable_upload_handler_;
+    ProxyHandler* proxy_handler_;
+    MetricsHandler* metrics_handler_;
 
     // Make singleton instance for signal handling
     static WebServer* instance_;
@@ -83,19 +124,47 @@ class WebServer {
     //--------------------------------------
     void event_loop();
     int cleanup_timed_out_connections();
+    bool resolve_upstreams();
     void accept_new_connection(int listener_fd);
     void handle_connection_event(int client_fd, uint32_t event);
 
     void handle_read(Connection* conn);
+    // Acts on parse_status_ after request bytes were parsed, read now or
+    // pipelined behind the previous request
+    void continue_request(Connection* conn);
+    // Hands a completely read request to handle_write(), or waits for more
+    void finish_reading(Connection* conn);
     void handle_write(Connection* conn);
     void handle_error(Connection* conn);
+    bool closes_after_response(Connection* conn) const;
+    // The read buffer holds the head of another request already
+    bool has_pipelined_request(Connection* conn) const;
+    // Sends held back responses while the next request is read, false on
+    // a send error
+    bool flush_held_responses(Connection* conn);
 
     void match_host_header(Connection* conn);
     const Location* find_matching_location(const VirtualServer* virtual_server,
                                            const std::string& path) const;
     bool is_cgi_extension(const std::string& request_uri) const;
     bool validate_request_location(Connection* conn);
+    // Answers with the location's return directive, if it has one
+    bool answer_return(Connection* conn);
+    bool answer_options_request(Connection* conn);
+    // Answers "Expect: 100-continue" before the body is sent: 100 Continue
+    // if the request would be accepted, false with the final error response
+    // set up if not
+    bool answer_expectation(Connection* conn);
     AHandler* choose_handler(Connection* conn);
+    // Has FilePutHandler open a file to splice a PUT body into, or
+    // ResumableUploadHandler the upload a PATCH body goes to, parking the
+    // connection meanwhile. False if the body is read into the request as
+    // usual.
+    bool start_spliced_body(Connection* conn);
+    // Has FileUploadHandler create the directory the files of a multipart
+    // POST body are written to as it arrives, parking the connection
+    // meanwhile. False if the body is read into the request as usual.
+    bool start_streamed_upload(Connection* conn);
     void close_client_connection(Connection* conn);
 
     bool setup_listener_sockets();
@@ -10,6 +10,9 @@ enum ConnectionState {
     CONN_READING,     // Waiting for/reading request data
     CONN_PROCESSING,  // Request received, handler is processing
     CONN_CGI_EXEC,    // Special state for active CGI execution
+    CONN_PROXYING,    // Request is being forwarded to an upstream server
+    CONN_CACHE_WAIT,  // Waiting for an identical request to fill the cache
+    CONN_FILE_WAIT,   // Waiting for a filesystem job on a worker thread
     CONN_WRITING,     // Handler generated response, sending data
     CONN_ERROR        // Connection encountered an error
 };
@@ -20,6 +23,7 @@ enum ParserState {
     PARSING_HEADERS,       // All header parsing
     PARSING_BODY,          // Normal body
     PARSING_CHUNKED_BODY,  // Chunked transfer encoding
+    PARSING_SPLICED_BODY,  // Body spliced from the socket into a file
     PARSING_COMPLETE,       // Request fully parsed
     PARSING_ERROR          // Error occurred during parsing
 };
@@ -33,6 +37,101 @@ enum CgiHandlerState {
     CGI_HANDLER_ERROR               // Error occurred during CGI handling
 };
 
+enum ProxyHandlerState {
+    PROXY_HANDLER_IDLE,
+    PROXY_HANDLER_CONNECTING,       // Non-blocking connect in progress
+    PROXY_HANDLER_SENDING_REQUEST,  // Writing request head and body upstream
+    PROXY_HANDLER_READING_HEADERS,  // Waiting for the upstream response head
+    PROXY_HANDLER_STREAMING_BODY,   // Relaying the response body to the client
+    PROXY_HANDLER_COMPLETE,         // Response fully received from upstream
+    PROXY_HANDLER_ERROR             // Error occurred during proxying
+};
+
+// How an upstream spreads requests over its servers
+enum BalancePolicy {
+    BALANCE_ROUND_ROBIN,  // Healthy servers in turn
+    BALANCE_LEAST_CONN,   // Fewest requests in flight
+    BALANCE_PEAK_EWMA     // Lowest latency estimate x requests in flight
+};
+
+// Request methods, one bit each so a location can allow a set of them
+enum Method {
+    METHOD_UNKNOWN = 0,
+    METHOD_GET = 1 << 0,
+    METHOD_HEAD = 1 << 1,
+    METHOD_POST = 1 << 2,
+    METHOD_PUT = 1 << 3,
+    METHOD_DELETE = 1 << 4,
+    METHOD_OPTIONS = 1 << 5,
+    METHOD_PATCH = 1 << 6
+};
+
+// Request headers with a fixed slot in HttpRequest, found without a search
+enum KnownHeader {
+    HEADER_HOST,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_EXPECT,
+    HEADER_AUTHORIZATION,
+    HEADER_COOKIE,
+    HEADER_USER_AGENT,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_REFERER,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_RANGE,
+    HEADER_COUNT,          // Number of known headers
+    HEADER_OTHER = -1      // Any other header
+};
+
+// How a location's path is matched against the request path
+enum LocationMatch {
+    MATCH_PREFIX,           // location /path
+    MATCH_PREFIX_NO_REGEX,  // location ^~ /path, regexes are not tried
+    MATCH_EXACT,            // location = /path
+    MATCH_REGEX,            // location ~ pattern
+    MATCH_REGEX_ICASE       // location ~* pattern
+};
+
+// How the end of a message body is determined
+enum BodyFraming {
+    FRAMING_NONE,            // No body
+    FRAMING_CONTENT_LENGTH,  // Fixed length
+    FRAMING_CHUNKED,         // Transfer-Encoding: chunked
+    FRAMING_UNTIL_CLOSE      // Body ends when the connection closes
+};
+
+// Position inside a chunked body while decoding it incrementally
+enum ChunkState {
+    CHUNK_SIZE_LINE,  // Reading "<hex size>[;ext]\r\n"
+    CHUNK_DATA,       // Reading chunk payload
+    CHUNK_DATA_CRLF,  // Reading the CRLF after the payload
+    CHUNK_TRAILERS,   // Reading trailer lines until the empty line
+    CHUNK_DONE        // Last chunk and trailers consumed
+};
+
+// Position in a multipart/form-data body
+enum MultipartState {
+    MULTIPART_PREAMBLE,       // Skipping text before the first boundary
+    MULTIPART_BOUNDARY_TAIL,  // After a boundary: "--" or CRLF
+    MULTIPART_HEADERS,        // Reading part headers until the empty line
+    MULTIPART_DATA,           // Passing part content to the sink
+    MULTIPART_DONE,           // Closing boundary seen, epilogue ignored
+    MULTIPART_ERROR           // Malformed body or sink failure
+};
+
+// Bytes DelimiterScanner can look for, combined as a mask
+enum Delimiter {
+    DELIMITER_CR = 1 << 0,
+    DELIMITER_LF = 1 << 1,
+    DELIMITER_COLON = 1 << 2,
+    DELIMITER_SPACE = 1 << 3
+};
+
 enum WriteStatus {
     WRITING_SUCCESS,   	 // Response fully sent
     WRITING_INCOMPLETE,  // Partial write, needs another EPOLLOUT event
@@ -49,6 +148,9 @@ enum ParseStatus {
     PARSE_METHOD_NOT_ALLOWED,     // Unsupported HTTP method
     PARSE_INVALID_PATH,           // Invalid path in URI
     PARSE_INVALID_QUERY_STRING,   // Invalid query string in URI
+    PARSE_INVALID_PERCENT_ENCODING,  // Malformed %XX escape in URI
+    PARSE_PATH_TRAVERSAL,            // "." or ".." segment in the path
+    PARSE_URI_TOO_LONG,              // Path or query over its length limit
     PARSE_VERSION_NOT_SUPPORTED,  // Unsupported HTTP version
     PARSE_REQUEST_TOO_LONG,       // Request exceeds maximum length
     PARSE_MISSING_HOST_HEADER,    // Host header is missing on HTTP/1.1 requests
@@ -59,7 +161,8 @@ enum ParseStatus {
     PARSE_INVALID_CONTENT_LENGTH,  // Content-Length header is invalid
     PARSE_CONTENT_TOO_LARGE,       // Content length exceeds maximum
     PARSE_UNKNOWN_ENCODING,        // Unknown or unimplemented transfer encoding
-    PARSE_INVALID_CHUNK_SIZE       // Invalid chunk size in chunked encoding
+    PARSE_INVALID_CHUNK_SIZE,      // Invalid chunk size in chunked encoding
+    PARSE_BODY_STORAGE_FAILED      // Body could not be written to its file
 };
 
 enum ResponseStatus {
@@ -87,6 +190,7 @@ enum ResponseStatus {
     PAYLOAD_TOO_LARGE = 413,   // Request entity too large
     URI_TOO_LONG = 414,        //  Request URI too long
     UNSUPPORTED_MEDIA_TYPE = 415,  // Media format not supported
+    EXPECTATION_FAILED = 417,      // Expect header value not supported
     HEADER_TOO_LONG = 431,         // Request header fields too large
 
     // 5xx - Server Errors
@@ -100,6 +204,23 @@ enum ResponseStatus {
 
 };
 
+// Blocking filesystem work a FileJob runs on a worker thread
+enum FileJobType {
+    FILE_JOB_LOAD,              // Stat a path, read the file or list the
+                                // directory
+    FILE_JOB_DELETE,            // Unlink a regular file
+    FILE_JOB_OPEN_UPLOAD,       // Create the directory a multipart body's
+                                // files are written to as it arrives
+    FILE_JOB_UPLOAD,            // Link those files into place
+    FILE_JOB_OPEN_BODY,         // Create the file a PUT body is spliced into
+    FILE_JOB_STORE_BODY,        // Move a PUT body into place as its target
+    FILE_JOB_RESUMABLE_CREATE,  // Start a resumable upload (POST)
+    FILE_JOB_RESUMABLE_OPEN,    // Open it for a PATCH body to be spliced in
+    FILE_JOB_RESUMABLE_APPEND,  // Append to it (PATCH)
+    FILE_JOB_RESUMABLE_OFFSET,  // Report how far it got (HEAD)
+    FILE_JOB_RESUMABLE_DELETE   // Drop it (DELETE)
+};
+
 }  // namespace codes
 
 namespace http_limits {
@@ -112,8 +233,31 @@ const size_t MAX_FRAGMENT_LENGTH = 1024;      // Fragment identifier
 const size_t MAX_HEADER_NAME_LENGTH = 256;    // Header name length
 const size_t MAX_HEADER_VALUE_LENGTH = 8192;  // Header value length
 const size_t MAX_HEADERS = 100;               // Maximum number of headers
-const size_t MAX_CONTENT_LENGTH = 10485760;   // 10MB
 const size_t MAX_CHUNK_SIZE = 1048576;        // 1MB
+const size_t SPLICE_PIPE_SIZE = 1048576;      // Body bytes moved per splice()
+const time_t UPSTREAM_IDLE_TIMEOUT = 60;      // Pooled connection lifetime
+const size_t MAX_IDLE_UPSTREAM_CONNECTIONS = 32;    // Per upstream
+const size_t MAX_UPSTREAM_HEADER_LENGTH = 16384;    // Upstream response head
+const double UPSTREAM_FAIL_BACKOFF_MS = 1000;     // First failure backoff
+const double UPSTREAM_MAX_BACKOFF_MS = 30000;     // Backoff upper bound
+const size_t PROXY_READ_SIZE = 16384;               // Bytes per upstream read
+const size_t PROXY_BUFFER_HIGH_WATERMARK = 65536;   // Unsent bytes before
+                                                    // reading upstream pauses
+const size_t PIPELINE_BATCH_SIZE = 65536;  // Responses to pipelined requests
+                                           // held back for one sendmsg()
+const size_t SPARE_POOL_SIZE = 1024;  // Requests and responses idle
+                                      // connections leave for reuse
+const size_t MAX_SPARE_BODY_SIZE = 65536;  // Larger response bodies are
+                                           // freed
+const size_t MAX_CACHED_RESPONSE_SIZE = 1048576;    // 1MB per cached body
+const size_t MAX_RESPONSE_CACHE_SIZE = 67108864;    // 64MB for all bodies
+const size_t FILE_WORKER_THREADS = 4;  // Threads for blocking file calls
+const size_t MAX_UPLOAD_FILES = 64;    // File parts of one multipart body,
+                                       // each open until the body ends
+const size_t LISTING_PAGE_ENTRIES = 1024;        // Rows per listing page
+const size_t MAX_LISTING_CACHE_SIZE = 33554432;  // 32MB of listings
+const time_t ERROR_PAGE_CHECK_INTERVAL = 1;  // Seconds between checks of
+                                             // an error page file
 }  // namespace http_limits
 
 #define CRLF "\r\n"  // Carriage return + line feed
@@ -124,22 +268,32 @@ const size_t MAX_CHUNK_SIZE = 1048576;        // 1MB
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <regex.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstdarg>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <list>
 #include <map>
+#include <new>
 #include <set>
 #include <sstream>
 #include <stdexcept>
@@ -148,8 +302,16 @@ const size_t MAX_CHUNK_SIZE = 1048576;        // 1MB
 
 #include "AHandler.hpp"
 #include "ErrorHandler.hpp"
+#include "DelimiterScanner.hpp"
+#include "BufferPool.hpp"
+#include "ReadBuffer.hpp"
+#include "RequestArena.hpp"
+#include "MultipartParser.hpp"
+#include "RequestBody.hpp"
 #include "RequestParser.hpp"
+#include "LocationMatcher.hpp"
 #include "VirtualServer.hpp"
+#include "VirtualHostIndex.hpp"
 
 #include "CgiHandler.hpp"
 #include "Connection.hpp"
@@ -161,10 +323,24 @@ const size_t MAX_CHUNK_SIZE = 1048576;        // 1MB
 #include "ResponseWriter.hpp"
 #include "StaticFileHandler.hpp"
 #include "FileDeleteHandler.hpp"
+#include "FilePutHandler.hpp"
+#include "ResumableUploadHandler.hpp"
+#include "MetricsHandler.hpp"
+#include "ProxyHandler.hpp"
+#include "ResponseCache.hpp"
+#include "DirectoryListingCache.hpp"
+#include "ErrorPageCache.hpp"
+#include "FileWorkerPool.hpp"
+#include "Upstream.hpp"
 #include "WebServer.hpp"
 
 // utils
 std::string trim(const std::string& str);
 std::string get_status_message(int code);
+codes::Method parse_method(const std::string& name);
+std::string method_list(unsigned int methods);
+std::string sanitize_filename(const std::string& filename);
+// Creates path and its missing parents, false (errno set) on failure
+bool make_directories(const std::string& path);
 
 #endif
\ No newline at end of file
@@ -1,25 +1,5 @@
 #include "webserv.hpp"
 
-bool AHandler::process_location_redirect(Connection* conn) {
-    const Location* location = conn->location_match_;
-
-    // Check if this location has a redirect
-    if (location->redirect_.empty()) {
-        log(LOG_DEBUG,
-            "process_location_redirect: No redirect configured for location %s",
-            location->path_.c_str());
-        return false;  // No redirect
-    }
-
-    log(LOG_INFO, "REDIRECT: Location %s redirecting to %s",
-        location->path_.c_str(), location->redirect_.c_str());
-
-    // Set up redirect response
-    ErrorHandler::generate_error_response(conn, codes::MOVED_PERMANENTLY);
-    conn->response_data_->set_header("Location", location->redirect_);
-    return true;  // Redirect was processed
-}
-
 std::string AHandler::parse_absolute_path(Connection* conn) {
     const Location* request_location = conn->location_match_;
     std::string request_root = request_location->root_;
@@ -34,12 +14,13 @@ std::string AHandler::parse_absolute_path(Connection* conn) {
     // Calculate the path relative to the location
     std::string relative_path = "";
 
-    // Calculate where the relative part starts
-    size_t location_len = request_location->path_.length();
+    // Calculate where the relative part starts. A regex location has no
+    // prefix to strip, the whole path is relative to the root.
+    size_t location_len =
+        request_location->is_regex() ? 0 : request_location->path_.length();
 
     // If location path ends with /, exclude it from length calculation
-    if (!request_location->path_.empty() &&
-        request_location->path_[location_len - 1] == '/') {
+    if (location_len > 0 && request_location->path_[location_len - 1] == '/') {
         location_len--;
     }
 
@@ -60,21 +41,13 @@ std::string AHandler::parse_absolute_path(Connection* conn) {
     return (absolute_path);
 }
 
-bool AHandler::process_directory_redirect(Connection* conn,
-                                          std::string& absolute_path) {
+// Called for a path the filesystem reported as a directory
+bool AHandler::process_directory_redirect(Connection* conn) {
     std::string path = conn->request_data_->path_;
 
     // Check if the request URI ends with a slash (indicating directory)
     bool path_ends_with_slash = !path.empty() && path[path.length() - 1] == '/';
 
-    // Check if the absolute path is a directory
-    struct stat path_stat;
-    if (stat(absolute_path.c_str(), &path_stat) != 0 ||
-        !S_ISDIR(path_stat.st_mode)) {
-        // Not a directory or couldn't stat
-        return false;
-    }
-
     // If URI doesn't end with slash, redirect to add the slash (nginx behavior)
     if (!path_ends_with_slash) {
         std::string query = conn->request_data_->query_string_;
@@ -92,213 +65,134 @@ bool AHandler::process_directory_redirect(Connection* conn,
         return true;
     }
 
-    return false;  // No redirect, but path modified
-}
-
-// Handle directory path resolution (index file or autoindex)
-bool AHandler::process_directory_index(Connection* conn,
-                                       std::string& absolute_path,
-                                       bool& need_autoindex) {
-    // Ensure absolute_path ends with /
-    // if (absolute_path[absolute_path.length() - 1] != '/') {
-    //     absolute_path += '/';
-    // }
-
-    // Get location config
-    const Location* location = conn->location_match_;
-    std::string index = location->index_;
-    if (!index.empty()) {
-        std::string index_path = absolute_path;
-        struct stat index_stat;
-        log(LOG_FATAL, "process_directory_index: Checking for index file at %s",
-            index_path.c_str());
-        // Check if index file exists and is a regular file
-        if (stat(index_path.c_str(), &index_stat) == 0 &&
-            S_ISREG(index_stat.st_mode)) {
-            // Index file exists, update path to use it
-            absolute_path = index_path;
-            return true;  // Found and using index file
-        }
-    }
-
-    // No index file found, check if autoindex is enabled
-    if (location->autoindex_) {
-        need_autoindex = true;
-        log(LOG_DEBUG,
-            "process_directory_index: No index file found, autoindex enabled "
-            "for %s",
-            absolute_path.c_str());
-        return true;  // Will use autoindex
-    }
-
-    // No index file and autoindex is disabled
-    // Fluxogram 403 - autoindex off - call error handler
-    ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
-    log(LOG_DEBUG,
-        "process_directory_index: No index file and autoindex disabled for %s",
-        absolute_path.c_str());
-    return false;  // Error response set
+    return false;
 }
 
 void AHandler::generate_directory_listing(Connection* conn,
-                                          const std::string& dir_path) {
-    // Open the directory
-    DIR* dir = opendir(dir_path.c_str());
-    log(LOG_DEBUG, "AHandler::generate_directory_listing: Opening directory %s",
-        dir_path.c_str());
-
-    // Fluxogram 500 - request resource not found - call error handler
-    if (!dir) {
-        log(LOG_ERROR, "Failed to open directory for listing: %s",
-            strerror(errno));
-        ErrorHandler::generate_error_response(conn,
-                                              codes::INTERNAL_SERVER_ERROR);
+                                          DirectoryListing* listing) {
+    // Fluxogram 200
+    conn->response_data_->status_code_ = 200;
+    conn->response_data_->status_message_ = "OK";
+    conn->response_data_->set_header("Content-Type", "text/html");
+    conn->response_data_->content_length_ = listing->size_;
+
+    // A HEAD response carries the headers of the GET response only
+    if (listing->pages_.size() == 1 ||
+        conn->request_data_->method_type_ == codes::METHOD_HEAD) {
+        if (conn->request_data_->method_type_ != codes::METHOD_HEAD) {
+            const std::string& html = listing->pages_[0];
+            conn->response_data_->body_.assign(html.begin(), html.end());
+        }
+        conn->conn_state_ = codes::CONN_WRITING;
         return;
     }
 
-    // Start building HTML for directory listing
-    std::string html =
-        "<!DOCTYPE html>\n"
-        "<html>\n"
-        "<head>\n"
-        "    <title>Index of " +
-        conn->request_data_->path_ +
-        "</title>\n"
-        "    <style>\n"
-        "        body { font-family: Arial, sans-serif; margin: 0; padding: "
-        "20px; color: #333; }\n"
-        "        h1 { border-bottom: 1px solid #eee; padding-bottom: 10px; "
-        "font-size: 24px; }\n"
-        "        table { border-collapse: collapse; width: 100%; }\n"
-        "        th { text-align: left; padding: 8px; border-bottom: 1px solid "
-        "#ddd; color: #666; }\n"
-        "        td { padding: 8px; border-bottom: 1px solid #eee; }\n"
-        "        a { text-decoration: none; color: #0366d6; }\n"
-        "        a:hover { text-decoration: underline; }\n"
-        "        .name { width: 70%; }\n"
-        "        .size { width: 30%; text-align: right; color: #666; }\n"
-        "        .parent { margin-bottom: 10px; display: block; }\n"
-        "    </style>\n"
-        "</head>\n"
-        "<body>\n"
-        "    <h1>Index of " +
-        conn->request_data_->path_ + "</h1>\n";
-
-    // Add parent directory link unless at root
-    if (conn->request_data_->path_ != "/") {
-        html += "    <a class=\"parent\" href=\"../\">Parent Directory</a>\n";
+    // Larger listings go out a page at a time as the client takes them, as
+    // chunks where the client understands them
+    if (conn->request_data_->version_ == "HTTP/1.1") {
+        conn->client_framing_ = codes::FRAMING_CHUNKED;
+        conn->response_data_->set_header("Transfer-Encoding", "chunked");
+    } else {
+        conn->client_framing_ = codes::FRAMING_CONTENT_LENGTH;
     }
+    WebServer::get_instance()->get_response_writer()->write_headers(conn);
+    conn->response_prepared_ = true;
 
-    html +=
-        "    <table>\n"
-        "        <tr>\n"
-        "            <th class=\"name\">Name</th>\n"
-        "            <th class=\"size\">Size</th>\n"
-        "        </tr>\n";
-
-    // Read and store directory entries
-    struct dirent* entry;
-    std::vector<std::string> dir_names;
-    std::vector<std::string> file_names;
-
-    while ((entry = readdir(dir)) != NULL) {
-        std::string name = entry->d_name;
+    ++listing->refs_;
+    conn->listing_ = listing;
+    conn->listing_page_ = 0;
+    stream_directory_listing(conn);
+}
 
-        // Skip "." and ".."
-        if (name == "." || name == "..") {
-            continue;
+void AHandler::stream_directory_listing(Connection* conn) {
+    // Queue the next page once the previous one is sent
+    if (conn->write_buffer_offset_ == conn->write_buffer_.size()) {
+        conn->write_buffer_.clear();
+        conn->write_buffer_offset_ = 0;
+
+        const std::string& page = conn->listing_->pages_[conn->listing_page_];
+        IoBuffer& out = conn->write_buffer_;
+        if (conn->client_framing_ == codes::FRAMING_CHUNKED) {
+            char size_line[32];
+            int size_length =
+                snprintf(size_line, sizeof(size_line), "%zx" CRLF, page.size());
+            out.insert(out.end(), size_line, size_line + size_length);
+            out.insert(out.end(), page.begin(), page.end());
+            out.insert(out.end(), CRLF, CRLF + 2);
+        } else {
+            out.insert(out.end(), page.begin(), page.end());
         }
 
-        // Get file stats
-        struct stat st;
-        std::string full_path = dir_path + name;
-
-        if (stat(full_path.c_str(), &st) == 0) {
-            // Check if it's a directory
-            if (S_ISDIR(st.st_mode)) {
-                dir_names.push_back(name);
-            } else {
-                file_names.push_back(name);
+        // The response writer sends the rest and finishes the request
+        if (++conn->listing_page_ == conn->listing_->pages_.size()) {
+            if (conn->client_framing_ == codes::FRAMING_CHUNKED) {
+                static const char LAST_CHUNK[] = "0" CRLF CRLF;
+                out.insert(out.end(), LAST_CHUNK,
+                           LAST_CHUNK + sizeof(LAST_CHUNK) - 1);
             }
+            DirectoryListingCache::release(conn->listing_);
+            conn->listing_ = NULL;
+            conn->conn_state_ = codes::CONN_WRITING;
+            return;
         }
     }
 
-    // Sort directories and files alphabetically
-    std::sort(dir_names.begin(), dir_names.end());
-    std::sort(file_names.begin(), file_names.end());
-
-    // Process directories first
-    for (size_t i = 0; i < dir_names.size(); ++i) {
-        std::string name = dir_names[i];
-
-        html +=
-            "        <tr>\n"
-            "            <td class=\"name\"><a href=\"" +
-            name + "/\">" + name +
-            "/</a></td>\n"
-            "            <td class=\"size\">-</td>\n"
-            "        </tr>\n";
-    }
-
-    // Then process files
-    for (size_t i = 0; i < file_names.size(); ++i) {
-        std::string name = file_names[i];
-        std::string full_path = dir_path + name;
-        struct stat st;
-
-        if (stat(full_path.c_str(), &st) != 0) {
-            continue;  // Skip if stat fails
+    // Responses to earlier pipelined requests go first
+    codes::WriteStatus held =
+        WebServer::get_instance()->get_response_writer()->send_held_responses(
+            conn);
+    if (held != codes::WRITING_SUCCESS) {
+        if (held == codes::WRITING_ERROR) {
+            conn->conn_state_ = codes::CONN_ERROR;
         }
+        return;
+    }
 
-        // Format file size
-        std::string size_str;
-        std::ostringstream oss;
-
-        if (st.st_size < 1024) {
-            oss << st.st_size << " B";
-        } else if (st.st_size < 1024 * 1024) {
-            oss << (st.st_size / 1024) << " KB";
-        } else if (st.st_size < 1024 * 1024 * 1024) {
-            oss << (st.st_size / (1024 * 1024)) << " MB";
-        } else {
-            oss << (st.st_size / (1024 * 1024 * 1024)) << " GB";
+    ssize_t sent =
+        send(conn->client_fd_,
+             conn->write_buffer_.data() + conn->write_buffer_offset_,
+             conn->write_buffer_.size() - conn->write_buffer_offset_,
+             MSG_NOSIGNAL);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            log(LOG_ERROR, "Failed to send directory listing to client_fd %d",
+                conn->client_fd_);
+            conn->conn_state_ = codes::CONN_ERROR;
         }
-        size_str = oss.str();
-
-        html +=
-            "        <tr>\n"
-            "            <td class=\"name\"><a href=\"" +
-            name + "\">" + name +
-            "</a></td>\n"
-            "            <td class=\"size\">" +
-            size_str +
-            "</td>\n"
-            "        </tr>\n";
+        return;
     }
+    conn->write_buffer_offset_ += sent;
+    conn->last_activity_ = time(NULL);
+}
 
-    // Count total entries
-    std::ostringstream count_str;
-    count_str << (dir_names.size() + file_names.size());
-
-    // Close HTML
-    html +=
-        "    </table>\n"
-        "    <div style=\"margin-top: 20px; color: #666; font-size: 12px;\">\n"
-        "        Webserv - " +
-        count_str.str() +
-        " items\n"
-        "    </div>\n"
-        "</body>\n"
-        "</html>";
-
-    // Set response
-    // Fluxogram 200
-    conn->response_data_->status_code_ = 200;
-    conn->response_data_->status_message_ = "OK";
-    conn->response_data_->set_header("Content-Type", "text/html");
-    conn->response_data_->body_.assign(html.begin(), html.end());
-    conn->conn_state_ = codes::CONN_WRITING;
+bool AHandler::body_file_opened(Connection* conn) {
+    FileJob* job = conn->file_job_;
+    conn->file_job_ = NULL;
+    if (job->fd_ == -1) {
+        delete job;
+        return false;
+    }
 
-    // Clean up
-    closedir(dir);
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        log(LOG_ERROR, "Cannot create splice pipe for client_fd %d: %s",
+            conn->client_fd_, strerror(errno));
+        delete job;  // Removes a temporary file
+        return false;
+    }
+    // A larger pipe moves more per splice(), the default is kept otherwise
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, http_limits::SPLICE_PIPE_SIZE);
+
+    conn->body_file_fd_ = job->fd_;
+    job->fd_ = -1;
+    conn->body_temp_path_.swap(job->temp_path_);
+    conn->body_pipe_[0] = pipe_fds[0];
+    conn->body_pipe_[1] = pipe_fds[1];
+    conn->request_data_->body_.clear();
+    conn->parser_state_ = codes::PARSING_SPLICED_BODY;
+
+    log(LOG_DEBUG, "Splicing %zu body bytes of client_fd %d for %s",
+        conn->body_remaining_bytes_, conn->client_fd_, job->path_.c_str());
+    delete job;
+    return true;
 }
@@ -0,0 +1,108 @@
+#include "webserv.hpp"
+
+const size_t BufferPool::CLASS_COUNT;
+const size_t BufferPool::SLAB_SIZE;
+
+static const size_t BLOCK_SIZES[BufferPool::CLASS_COUNT] = {4096, 16384,
+                                                            65536};
+
+// A free block, linked through its first bytes
+struct FreeBlock {
+    FreeBlock* next_;
+};
+
+static struct SizeClass {
+    FreeBlock* free_list_;
+    size_t slabs_;
+    size_t in_use_;
+    size_t free_;
+} CLASSES[BufferPool::CLASS_COUNT];
+
+static size_t oversized = 0;
+
+// Index of the smallest class holding size, CLASS_COUNT if none does
+static size_t class_of(size_t size) {
+    size_t index = 0;
+    while (index < BufferPool::CLASS_COUNT && BLOCK_SIZES[index] < size) {
+        ++index;
+    }
+    return index;
+}
+
+// Carves a new slab into free blocks of a class
+static bool grow(size_t index) {
+    char* slab = static_cast<char*>(std::malloc(BufferPool::SLAB_SIZE));
+    if (!slab) {
+        return false;
+    }
+    SizeClass& size_class = CLASSES[index];
+    size_t count = BufferPool::SLAB_SIZE / BLOCK_SIZES[index];
+    for (size_t i = 0; i < count; ++i) {
+        FreeBlock* block =
+            reinterpret_cast<FreeBlock*>(slab + i * BLOCK_SIZES[index]);
+        block->next_ = size_class.free_list_;
+        size_class.free_list_ = block;
+    }
+    ++size_class.slabs_;
+    size_class.free_ += count;
+    log(LOG_DEBUG, "Buffer pool: new slab of %zu %zu byte blocks", count,
+        BLOCK_SIZES[index]);
+    return true;
+}
+
+char* BufferPool::allocate(size_t size) {
+    size_t index = class_of(size);
+    if (index == CLASS_COUNT) {
+        char* block = static_cast<char*>(std::malloc(size));
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        ++oversized;
+        return block;
+    }
+
+    SizeClass& size_class = CLASSES[index];
+    if (!size_class.free_list_ && !grow(index)) {
+        throw std::bad_alloc();
+    }
+    FreeBlock* block = size_class.free_list_;
+    size_class.free_list_ = block->next_;
+    --size_class.free_;
+    ++size_class.in_use_;
+    return reinterpret_cast<char*>(block);
+}
+
+void BufferPool::deallocate(char* block, size_t size) {
+    if (!block) {
+        return;
+    }
+    size_t index = class_of(size);
+    if (index == CLASS_COUNT) {
+        std::free(block);
+        --oversized;
+        return;
+    }
+
+    SizeClass& size_class = CLASSES[index];
+    FreeBlock* free_block = reinterpret_cast<FreeBlock*>(block);
+    free_block->next_ = size_class.free_list_;
+    size_class.free_list_ = free_block;
+    --size_class.in_use_;
+    ++size_class.free_;
+}
+
+size_t BufferPool::block_size(size_t size) {
+    size_t index = class_of(size);
+    return index == CLASS_COUNT ? size : BLOCK_SIZES[index];
+}
+
+BufferPool::ClassStats BufferPool::class_stats(size_t index) {
+    ClassStats stats;
+    stats.block_size_ = BLOCK_SIZES[index];
+    stats.slabs_ = CLASSES[index].slabs_;
+    stats.in_use_ = CLASSES[index].in_use_;
+    stats.free_ = CLASSES[index].free_;
+    return stats;
+}
+
+size_t BufferPool::oversized_in_use() { return oversized; }
@@ -34,11 +34,6 @@ void CgiHandler::handle(Connection* conn) {
 }
 
 bool CgiHandler::validate_cgi_request(Connection* conn) {
-    // 1. Check redirect (same as StaticFileHandler)
-    if (process_location_redirect(conn)) {
-        return false;  // Redirect response was set up, stop processing
-    }
-
     // Extract request data
     const std::string& request_uri = conn->request_data_->uri_;
     const std::string& request_method = conn->request_data_->method_;
@@ -50,16 +45,17 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         request_uri.c_str(), request_method.c_str(), location->path_.c_str(),
         location->root_.c_str());
 
-    // 2. Method Validation (GET or POST only)
-    if (request_method != "GET" && request_method != "POST") {
+    // 1. Method Validation (GET, HEAD or POST only)
+    if (!(conn->request_data_->method_type_ &
+          (codes::METHOD_GET | codes::METHOD_HEAD | codes::METHOD_POST))) {
         log(LOG_ERROR, "Invalid request method '%s' for CGI script",
             request_method.c_str());
         ErrorHandler::generate_error_response(conn, codes::METHOD_NOT_ALLOWED);
-        conn->response_data_->set_header("Allow", "GET, POST");
+        conn->response_data_->set_header("Allow", "GET, HEAD, POST");
         return false;
     }
 
-    // 3. URI Format Check (can't execute a directory)
+    // 2. URI Format Check (can't execute a directory)
     if (!request_uri.empty() && request_uri[request_uri.length() - 1] == '/') {
         log(LOG_ERROR, "URI is a directory, cannot execute: %s",
             request_uri.c_str());
@@ -67,7 +63,7 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         return false;
     }
 
-    // 4. Script Path Resolution
+    // 3. Script Path Resolution
     conn->cgi_script_path_ = parse_absolute_path(conn);
     if (conn->cgi_script_path_.empty()) {
         log(LOG_ERROR, "Failed to determine CGI script path for URI: %s",
@@ -77,7 +73,7 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         return false;
     }
 
-    // 5. Script Extension Check
+    // 4. Script Extension Check
     bool is_valid_extension = false;
     std::string extension;
     size_t dot_pos = conn->cgi_script_path_.find_last_of('.');
@@ -96,7 +92,7 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         return false;
     }
 
-    // 6. Script Existence Check
+    // 5. Script Existence Check
     struct stat file_info;
     if (stat(conn->cgi_script_path_.c_str(), &file_info) == -1) {
         if (errno == ENOENT) {
@@ -112,7 +108,7 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         return false;
     }
 
-    // 7. Script Type Validation
+    // 6. Script Type Validation
     if (!S_ISREG(file_info.st_mode)) {
         log(LOG_ERROR, "CGI script '%s' is not a regular file",
             conn->cgi_script_path_.c_str());
@@ -120,7 +116,7 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
         return false;
     }
 
-    // 8. Script Permission Check
+    // 7. Script Permission Check
     if (!(file_info.st_mode & S_IXUSR)) {  // Check for user execute permission
         log(LOG_ERROR, "CGI script '%s' is not executable",
             conn->cgi_script_path_.c_str());
@@ -134,8 +130,8 @@ bool CgiHandler::validate_cgi_request(Connection* conn) {
 }
 
 bool CgiHandler::setup_cgi_execution(Connection* conn) {
-    // Ensure request_method is accessible
-    const std::string& request_method = conn->request_data_->method_;
+    // Build the environment before forking, so the child only has to exec
+    create_cgi_envp(conn);
 
     // Setup pipes
     int server_to_cgi_pipe[2];  // pipe for server to write to CGI's stdin
@@ -160,8 +156,7 @@ bool CgiHandler::setup_cgi_execution(Connection* conn) {
     } else if (pid == 0) {
         // This code runs ONLY in the CHILD process
         handle_child_pipes(server_to_cgi_pipe, cgi_to_server_pipe);
-        std::vector<char*> envp = create_cgi_envp(conn);
-        execute_cgi_script(conn, envp.data());
+        execute_cgi_script(conn, conn->cgi_envp_.data());
     } else {
         // This code runs ONLY in the PARENT process
         conn->cgi_pid_ = pid;
@@ -172,7 +167,8 @@ bool CgiHandler::setup_cgi_execution(Connection* conn) {
             return false;
         }
 
-        if (request_method == "POST" && !conn->request_data_->body_.empty()) {
+        if (conn->request_data_->method_type_ == codes::METHOD_POST &&
+            !conn->request_data_->body_.empty()) {
             conn->cgi_handler_state_ = codes::CGI_HANDLER_WRITING_TO_PIPE;
 
             // Register this pipe with epoll for EPOLLOUT events
@@ -286,85 +282,121 @@ void CgiHandler::handle_child_pipes(int server_to_cgi_pipe[2],
     close(cgi_to_server_pipe[1]);
 }
 
-std::vector<char*> CgiHandler::create_cgi_envp(Connection* conn) {
-    std::vector<std::string>& cgi_env_strings =
-        conn->cgi_envp_;                 // To store "NAME=VALUE"
-    std::vector<char*> envp_char_array;  // To store char* for execve
-
-    cgi_env_strings.push_back("REQUEST_METHOD=" + conn->request_data_->method_);
-    cgi_env_strings.push_back("SCRIPT_NAME=" + conn->cgi_script_path_);
-    cgi_env_strings.push_back("SERVER_PROTOCOL=" +
-                              conn->request_data_->version_);
-    cgi_env_strings.push_back("SERVER_SOFTWARE=webserv/1.0");
+// Appends "NAME=VALUE\0" to the environment block. The block capacity is
+// reserved up front, so the returned pointer stays valid.
+static char* append_env_entry(std::vector<char>& block, const char* name,
+                              const std::string& value) {
+    size_t start = block.size();
+    block.insert(block.end(), name, name + strlen(name));
+    block.push_back('=');
+    block.insert(block.end(), value.begin(), value.end());
+    block.push_back('\0');
+    return &block[start];
+}
 
-    if (!conn->request_data_->query_string_.empty()) {
-        cgi_env_strings.push_back("QUERY_STRING=" +
-                                  conn->request_data_->query_string_);
+void CgiHandler::create_cgi_envp(Connection* conn) {
+    const HttpRequest* request = conn->request_data_;
+    const std::vector<std::string>& env_template =
+        conn->location_match_->cgi_env_template_;
+    std::vector<char>& block = conn->cgi_env_block_;
+    std::vector<char*>& envp = conn->cgi_envp_;
+
+    bool is_post = request->method_type_ == codes::METHOD_POST;
+    std::string content_type;
+    std::string content_length;
+    if (is_post) {
+        content_type = request->get_header(codes::HEADER_CONTENT_TYPE);
+        content_length = request->get_header(codes::HEADER_CONTENT_LENGTH);
+    }
+
+    // Size the block once so no entry pointer is invalidated while filling it
+    size_t block_size =
+        sizeof("REQUEST_METHOD=") + request->method_.size() +
+        sizeof("SCRIPT_NAME=") + conn->cgi_script_path_.size() +
+        sizeof("SCRIPT_FILENAME=") + conn->cgi_script_path_.size() +
+        sizeof("SERVER_PROTOCOL=") + request->version_.size() +
+        sizeof("QUERY_STRING=") + request->query_string_.size() +
+        sizeof("REMOTE_ADDR=") + conn->remote_addr_.size() +
+        sizeof("CONTENT_TYPE=") + content_type.size() +
+        sizeof("CONTENT_LENGTH=") + content_length.size();
+    for (size_t i = 0; i < request->fields_.size(); ++i) {
+        block_size += sizeof("HTTP_=") + request->fields_[i].name_length_ +
+                      request->fields_[i].value_length_;
+    }
+
+    block.clear();
+    block.reserve(block_size);
+    envp.clear();
+    envp.reserve(env_template.size() + request->fields_.size() + 10);
+
+    // Constant entries point straight into the location's template
+    for (size_t i = 0; i < env_template.size(); ++i) {
+        envp.push_back(const_cast<char*>(env_template[i].c_str()));
+    }
+
+    envp.push_back(append_env_entry(block, "REQUEST_METHOD", request->method_));
+    envp.push_back(
+        append_env_entry(block, "SCRIPT_NAME", conn->cgi_script_path_));
+    envp.push_back(
+        append_env_entry(block, "SCRIPT_FILENAME", conn->cgi_script_path_));
+    envp.push_back(
+        append_env_entry(block, "SERVER_PROTOCOL", request->version_));
+    if (!request->query_string_.empty()) {
+        envp.push_back(
+            append_env_entry(block, "QUERY_STRING", request->query_string_));
+    }
+    if (!conn->remote_addr_.empty()) {
+        envp.push_back(
+            append_env_entry(block, "REMOTE_ADDR", conn->remote_addr_));
     }
 
-    cgi_env_strings.push_back("SCRIPT_FILENAME=" + conn->cgi_script_path_);
-    cgi_env_strings.push_back("GATEWAY_INTERFACE=CGI/1.1");
-    cgi_env_strings.push_back("SERVER_NAME=" +
-                              conn->virtual_server_->host_name_);
-    std::ostringstream oss;
-    oss << conn->virtual_server_->port_;
-    cgi_env_strings.push_back("SERVER_PORT=" + oss.str());
-
     // Add CONTENT_TYPE, CONTENT_LENGTH for POST
-    bool content_type_set = false;
-    bool content_length_set = false;
-    if (conn->request_data_->method_ == "POST") {
-        std::string ct = conn->request_data_->get_header("content-type");
-        if (!ct.empty()) {
-            cgi_env_strings.push_back("CONTENT_TYPE=" + ct);
-            content_type_set = true;
-        }
-        std::string cl = conn->request_data_->get_header("content-length");
-        if (!cl.empty()) {
-            cgi_env_strings.push_back("CONTENT_LENGTH=" + cl);
-            content_length_set = true;
-        }
+    if (!content_type.empty()) {
+        envp.push_back(append_env_entry(block, "CONTENT_TYPE", content_type));
+    }
+    if (!content_length.empty()) {
+        envp.push_back(
+            append_env_entry(block, "CONTENT_LENGTH", content_length));
     }
 
     // Add all HTTP_ headers
-    for (std::map<std::string, std::string>::const_iterator it =
-             conn->request_data_->headers_.begin();
-         it != conn->request_data_->headers_.end(); ++it) {
+    for (size_t i = 0; i < request->fields_.size(); ++i) {
+        const HeaderField& field = request->fields_[i];
         // Skip content-type and content-length if they were already set
         // directly
-        if (content_type_set && it->first == "content-type") {
+        if (!content_type.empty() &&
+            field.known_ == codes::HEADER_CONTENT_TYPE) {
             continue;
         }
-        if (content_length_set && it->first == "content-length") {
+        if (!content_length.empty() &&
+            field.known_ == codes::HEADER_CONTENT_LENGTH) {
             continue;
         }
 
-        std::string header_name_env = "HTTP_";
-        for (size_t i = 0; i < it->first.length(); ++i) {
-            char c = it->first[i];
-            header_name_env +=
-                (c == '-') ? '_' : std::toupper(static_cast<unsigned char>(c));
+        size_t start = block.size();
+        block.insert(block.end(), "HTTP_", &"HTTP_"[5]);
+        const char* name = request->field_name(field);
+        for (size_t j = 0; j < field.name_length_; ++j) {
+            char c = name[j];
+            block.push_back((c == '-')
+                                ? '_'
+                                : std::toupper(static_cast<unsigned char>(c)));
         }
-        cgi_env_strings.push_back(header_name_env + "=" + it->second);
-    }
-
-    // Convert vector of std::string to vector of char*
-    for (size_t i = 0; i < cgi_env_strings.size(); ++i) {
-        envp_char_array.push_back(
-            const_cast<char*>(cgi_env_strings[i].c_str()));
+        block.push_back('=');
+        const char* value = request->field_value(field);
+        block.insert(block.end(), value, value + field.value_length_);
+        block.push_back('\0');
+        envp.push_back(&block[start]);
     }
-    envp_char_array.push_back(NULL);  // Null-terminate
+    envp.push_back(NULL);  // Null-terminate
 
     log(LOG_DEBUG, "CGI environment variables created for client %d",
         conn->client_fd_);
 
     // Log the environment variables for debugging
-    for (std::vector<std::string>::const_iterator it = cgi_env_strings.begin();
-         it != cgi_env_strings.end(); ++it) {
-        log(LOG_TRACE, "CGI env: %s", it->c_str());
+    for (size_t i = 0; envp[i] != NULL; ++i) {
+        log(LOG_TRACE, "CGI env: %s", envp[i]);
     }
-
-    return envp_char_array;
 }
 
 void CgiHandler::execute_cgi_script(Connection* conn, char** envp) {
@@ -428,25 +460,26 @@ bool CgiHandler::handle_parent_pipes(Connection* conn,
 }
 
 void CgiHandler::handle_cgi_write(Connection* conn) {
-    // Write request body to CGI's stdin pipe
+    // Write the rest of the request body to CGI's stdin pipe
+    const RequestBody& body = conn->request_data_->body_;
     ssize_t bytes_written =
-        write(conn->cgi_pipe_stdin_fd_, conn->request_data_->body_.data(),
-              conn->request_data_->body_.size());
+        body.write_to(conn->cgi_pipe_stdin_fd_, conn->cgi_body_offset_,
+                      body.size() - conn->cgi_body_offset_);
 
     if (bytes_written < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;  // Pipe full, resume on the next EPOLLOUT
+        }
         log(LOG_ERROR, "Failed to write to CGI stdin pipe: %s",
             strerror(errno));
         finalize_cgi_error(conn, codes::INTERNAL_SERVER_ERROR);
         return;
     }
 
-    // Clear written bytes from request body after writing
-    conn->request_data_->body_.erase(
-        conn->request_data_->body_.begin(),
-        conn->request_data_->body_.begin() + bytes_written);
+    conn->cgi_body_offset_ += bytes_written;
 
     // If all data is written, close the pipe and switch to reading state
-    if (conn->request_data_->body_.empty()) {
+    if (conn->cgi_body_offset_ == body.size()) {
         close(conn->cgi_pipe_stdin_fd_);
         conn->cgi_pipe_stdin_fd_ = -1;  // Mark as closed
         conn->cgi_handler_state_ =
@@ -539,8 +572,9 @@ void CgiHandler::handle_cgi_read(Connection* conn) {
 
         if (conn->cgi_handler_state_ == codes::CGI_HANDLER_READING_FROM_PIPE) {
             // Headers not fully parsed before EOF - this is an error
-            if (conn->cgi_read_buffer_.empty() &&
-                conn->response_data_->headers_.empty()) {
+            const HttpResponse* resp = conn->response_data_;
+            if (conn->cgi_read_buffer_.empty() && resp->headers_.empty() &&
+                resp->content_type_.empty() && !resp->has_content_length_) {
                 // No data at all - script execution failure
                 log(LOG_WARNING,
                     "CGI: No output received from script for client %d",
@@ -588,10 +622,10 @@ void CgiHandler::parse_cgi_output(Connection* conn) {
         conn->cgi_handler_state_);
 
     // 1. Parse Headers
-    std::vector<char>& buffer = conn->cgi_read_buffer_;
+    IoBuffer& buffer = conn->cgi_read_buffer_;
     while ((conn->cgi_handler_state_ != codes::CGI_HANDLER_HEADERS_PARSED) &&
            (!buffer.empty())) {
-        std::vector<char>::iterator line_end_it =
+        IoBuffer::iterator line_end_it =
             std::search(buffer.begin(), buffer.end(), CRLF, &CRLF[2]);
 
         if (line_end_it == buffer.end()) {
@@ -725,6 +759,9 @@ void CgiHandler::finalize_cgi_response(Connection* conn) {
 
     cleanup_cgi_resources(conn);
 
+    // Share the output with identical requests waiting for it
+    WebServer::get_instance()->get_response_cache()->complete(conn);
+
     log(LOG_DEBUG, "CGI response finalized for client %d, status: %d",
         conn->client_fd_, conn->response_data_->status_code_);
 }
@@ -735,6 +772,7 @@ void CgiHandler::finalize_cgi_error(Connection* conn,
     conn->cgi_handler_state_ = codes::CGI_HANDLER_ERROR;
 
     cleanup_cgi_resources(conn);
+    WebServer::get_instance()->get_response_cache()->abandon(conn);
 }
 
 bool CgiHandler::set_status_line(Connection* conn) {
@@ -4,12 +4,21 @@ Connection::Connection(int fd, const VirtualServer* default_virtual_server)
     : client_fd_(fd),
       default_virtual_server_(default_virtual_server),
       virtual_server_(default_virtual_server),
+      host_index_(NULL),
       last_activity_(time(NULL)),
+      requests_served_(0),
+      idle_timeout_(0),
+      parked_(false),
+      body_remaining_bytes_(0),
+      chunk_state_(codes::CHUNK_SIZE_LINE),
       chunk_remaining_bytes_(0),
       write_buffer_offset_(0),
+      response_prepared_(false),
       cgi_read_buffer_offset_(0),
       request_data_(new HttpRequest()),
       response_data_(new HttpResponse()),
+      error_page_(NULL),
+      fixed_response_(false),
       conn_state_(codes::CONN_READING),
       parser_state_(codes::PARSING_REQUEST_LINE),
       cgi_handler_state_(codes::CGI_HANDLER_IDLE),
@@ -20,11 +29,46 @@ Connection::Connection(int fd, const VirtualServer* default_virtual_server)
       cgi_pid_(-1),
       cgi_pipe_stdin_fd_(-1),
       cgi_pipe_stdout_fd_(-1),
+      cgi_body_offset_(0),
       cgi_script_path_(""),
+      cgi_env_block_(),
       cgi_envp_(),
+      proxy_handler_state_(codes::PROXY_HANDLER_IDLE),
+      upstream_(NULL),
+      upstream_server_(NULL),
+      upstream_attempts_(0),
+      upstream_started_ms_(0),
+      upstream_fd_(-1),
+      upstream_reused_(false),
+      upstream_retried_(false),
+      upstream_keep_alive_(false),
+      upstream_request_(),
+      upstream_request_offset_(0),
+      upstream_buffer_(),
+      upstream_framing_(codes::FRAMING_NONE),
+      client_framing_(codes::FRAMING_NONE),
+      upstream_body_remaining_(0),
+      upstream_chunk_state_(codes::CHUNK_SIZE_LINE),
+      cache_key_(),
+      cache_leader_(false),
+      cache_bypass_(false),
+      cache_capturing_(false),
+      cache_headers_(),
+      cache_body_(),
+      body_file_fd_(-1),
+      body_temp_path_(),
+      upload_(NULL),
+      file_job_(NULL),
       static_file_fd_(-1),
       static_file_offset_(0),
-      static_file_bytes_to_send_(0) {}
+      static_file_bytes_to_send_(0),
+      listing_(NULL),
+      listing_page_(0) {
+    body_pipe_[0] = -1;
+    body_pipe_[1] = -1;
+    // A response head and small body fit one block, no regrowing
+    write_buffer_.reserve(BufferPool::block_size(1));
+}
 
 Connection::~Connection() {
     // Clean up owned resources
@@ -35,6 +79,7 @@ Connection::~Connection() {
     if (response_data_) {
         delete response_data_;
     }
+    ErrorPageCache::release(error_page_);
 
     // Close any open file descriptors
     if (client_fd_ >= 0) {
@@ -43,6 +88,9 @@ Connection::~Connection() {
     if (static_file_fd_ >= 0) {
         close(static_file_fd_);
     }
+    discard_body_file();
+    delete upload_;  // After the request body that feeds it
+    DirectoryListingCache::release(listing_);
 
     if (cgi_pipe_stdin_fd_ >= 0) {
         WebServer::unregister_active_pipe(cgi_pipe_stdin_fd_);
@@ -53,18 +101,40 @@ Connection::~Connection() {
         close(cgi_pipe_stdout_fd_);
     }
 
+    // An upstream connection still open here is mid-response and can not be
+    // returned to the pool
+    if (upstream_fd_ >= 0) {
+        WebServer::unregister_active_pipe(upstream_fd_);
+        close(upstream_fd_);
+    }
+    if (upstream_server_) {
+        upstream_->end_request(upstream_server_);
+    }
+
+    // Requests waiting on this one must not wait forever
+    WebServer::get_instance()->get_response_cache()->cancel(this);
+    WebServer::get_instance()->get_file_workers()->cancel(this);
+
     log(LOG_TRACE, "Connection resources cleaned up for socket '%i'",
         client_fd_);
 }
 
 void Connection::reset_for_keep_alive() {
+    ++requests_served_;
+
+    // Kept from the server that answered, the default one may differ
+    idle_timeout_ = virtual_server_->keepalive_timeout_;
+
     // Reset virtual server
     virtual_server_ = default_virtual_server_;
 
     // Reset write buffer and offsets
+    body_remaining_bytes_ = 0;
+    chunk_state_ = codes::CHUNK_SIZE_LINE;
     chunk_remaining_bytes_ = 0;
     write_buffer_.clear();
     write_buffer_offset_ = 0;
+    response_prepared_ = false;
     cgi_read_buffer_.clear();
     cgi_read_buffer_offset_ = 0;
 
@@ -72,9 +142,13 @@ void Connection::reset_for_keep_alive() {
     if (request_data_) {
         request_data_->clear();
     }
+    arena_.reset();
     if (response_data_) {
         response_data_->clear();
     }
+    ErrorPageCache::release(error_page_);
+    error_page_ = NULL;
+    fixed_response_ = false;
 
     // Reset state variables
     conn_state_ = codes::CONN_READING;
@@ -94,6 +168,9 @@ void Connection::reset_for_keep_alive() {
         close(static_file_fd_);
         static_file_fd_ = -1;
     }
+    discard_body_file();
+    delete upload_;  // After the request body that feeds it
+    upload_ = NULL;
 
     if (cgi_pipe_stdin_fd_ >= 0) {
         WebServer::unregister_active_pipe(cgi_pipe_stdin_fd_);
@@ -105,13 +182,47 @@ void Connection::reset_for_keep_alive() {
         close(cgi_pipe_stdout_fd_);
         cgi_pipe_stdout_fd_ = -1;
     }
+    if (upstream_fd_ >= 0) {
+        WebServer::unregister_active_pipe(upstream_fd_);
+        close(upstream_fd_);
+        upstream_fd_ = -1;
+    }
+    if (upstream_server_) {
+        upstream_->end_request(upstream_server_);
+        upstream_server_ = NULL;
+    }
 
     // Reset Handler-Specific State
     static_file_offset_ = 0;
     static_file_bytes_to_send_ = 0;
+    DirectoryListingCache::release(listing_);
+    listing_ = NULL;
+    listing_page_ = 0;
     cgi_pid_ = -1;
+    cgi_body_offset_ = 0;
     cgi_script_path_.clear();
+    cgi_env_block_.clear();
     cgi_envp_.clear();
+    proxy_handler_state_ = codes::PROXY_HANDLER_IDLE;
+    upstream_ = NULL;
+    upstream_attempts_ = 0;
+    upstream_started_ms_ = 0;
+    upstream_reused_ = false;
+    upstream_retried_ = false;
+    upstream_keep_alive_ = false;
+    upstream_request_.clear();
+    upstream_request_offset_ = 0;
+    upstream_buffer_.clear();
+    upstream_framing_ = codes::FRAMING_NONE;
+    client_framing_ = codes::FRAMING_NONE;
+    upstream_body_remaining_ = 0;
+    upstream_chunk_state_ = codes::CHUNK_SIZE_LINE;
+    WebServer::get_instance()->get_response_cache()->cancel(this);
+    cache_bypass_ = false;
+    cache_capturing_ = false;
+    cache_headers_.clear();
+    cache_body_.clear();
+    WebServer::get_instance()->get_file_workers()->cancel(this);
 
     // Reset activity timer
     last_activity_ = time(NULL);
@@ -120,12 +231,34 @@ void Connection::reset_for_keep_alive() {
         client_fd_);
 }
 
+void Connection::discard_body_file() {
+    for (int i = 0; i < 2; ++i) {
+        if (body_pipe_[i] >= 0) {
+            close(body_pipe_[i]);
+            body_pipe_[i] = -1;
+        }
+    }
+    if (body_file_fd_ >= 0) {
+        close(body_file_fd_);
+        body_file_fd_ = -1;
+    }
+    // A file still under its temporary name never became the target
+    if (!body_temp_path_.empty()) {
+        unlink(body_temp_path_.c_str());
+        body_temp_path_.clear();
+    }
+}
+
 bool Connection::is_readable() const {
     return conn_state_ == codes::CONN_READING;
 }
 
 bool Connection::is_cgi() const { return conn_state_ == codes::CONN_CGI_EXEC; }
 
+bool Connection::is_proxy() const {
+    return conn_state_ == codes::CONN_PROXYING;
+}
+
 bool Connection::is_writable() const {
     return conn_state_ == codes::CONN_PROCESSING ||
            conn_state_ == codes::CONN_WRITING;
@@ -139,13 +272,18 @@ bool Connection::is_keep_alive() const {
 
     log(LOG_TRACE, "Checking keep-alive for socket '%i'", client_fd_);
 
+    // The limits of the server that answered the request
+    if (virtual_server_->keepalive_timeout_ == 0 ||
+        requests_served_ + 1 >= virtual_server_->keepalive_requests_) {
+        return false;
+    }
+
     // For HTTP/1.0: requires explicit "Connection: keep-alive"
     if (request_data_->version_ == "HTTP/1.0") {
-        std::string connection = request_data_->get_header("Connection");
-        return connection.find("keep-alive") != std::string::npos;
+        return request_data_->header_contains(codes::HEADER_CONNECTION,
+                                              "keep-alive");
     }
 
     // For HTTP/1.1: keep-alive by default unless "Connection: close"
-    std::string connection = request_data_->get_header("Connection");
-    return connection.find("close") == std::string::npos;
+    return !request_data_->header_contains(codes::HEADER_CONNECTION, "close");
 }
@@ -1,6 +1,23 @@
 #include "webserv.hpp"
 
-ConnectionManager::ConnectionManager() {}
+// Used when the descriptor limit is unlimited or unknown
+static const size_t DEFAULT_CONNECTION_LIMIT = 1024;
+
+ConnectionManager::ConnectionManager()
+    : connection_limit_(DEFAULT_CONNECTION_LIMIT),
+      parked_count_(0),
+      last_sweep_(0) {
+    // Half the descriptors go to clients, the other half stays for CGI
+    // pipes, upstream sockets and files
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+        connection_limit_ = std::max<size_t>(limit.rlim_cur / 2, 1);
+    }
+    // Parking never reallocates the pools
+    spare_requests_.reserve(http_limits::SPARE_POOL_SIZE);
+    spare_responses_.reserve(http_limits::SPARE_POOL_SIZE);
+}
 
 ConnectionManager::~ConnectionManager() {
     // Destructor implementation
@@ -8,6 +25,12 @@ ConnectionManager::~ConnectionManager() {
          it != active_connections_.end(); ++it) {
         delete it->second;
     }
+    for (size_t i = 0; i < spare_requests_.size(); ++i) {
+        delete spare_requests_[i];
+    }
+    for (size_t i = 0; i < spare_responses_.size(); ++i) {
+        delete spare_responses_[i];
+    }
 
     log(LOG_TRACE, "ConnectionManager resources cleaned up");
 }
@@ -35,6 +58,9 @@ void ConnectionManager::close_connection(int client_fd) {
         active_connections_.find(client_fd);
     if (it != active_connections_.end()) {
         // Close and delete the connection
+        if (it->second->parked_) {
+            --parked_count_;
+        }
         delete it->second;
         active_connections_.erase(it);
         log(LOG_INFO, "Closed connection for client (fd: %i)", client_fd);
@@ -46,18 +72,21 @@ void ConnectionManager::close_connection(int client_fd) {
 
 void ConnectionManager::close_connection(Connection* conn) {
     // Find the connection in the map
+    int client_fd = conn->client_fd_;
     std::map<int, Connection*>::iterator it =
-        active_connections_.find(conn->client_fd_);
+        active_connections_.find(client_fd);
     if (it != active_connections_.end()) {
         // Close and delete the connection
+        if (it->second->parked_) {
+            --parked_count_;
+        }
         delete it->second;
         active_connections_.erase(it);
-        log(LOG_INFO, "Closed connection for client (fd: %i)",
-            conn->client_fd_);
+        log(LOG_INFO, "Closed connection for client (fd: %i)", client_fd);
         return;
     }
 
-    log(LOG_FATAL, "Connection not found for socket '%i'", conn->client_fd_);
+    log(LOG_FATAL, "Connection not found for socket '%i'", client_fd);
 }
 
 Connection* ConnectionManager::get_connection(int client_fd) {
@@ -86,15 +115,21 @@ int ConnectionManager::close_timed_out_connections() {
     int closed = 0;
     time_t current_time = time(NULL);
 
+    // Timeouts are whole seconds, checking more often finds nothing new
+    if (current_time == last_sweep_) {
+        return 0;
+    }
+    last_sweep_ = current_time;
+
     std::map<int, Connection*>::iterator it = active_connections_.begin();
     while (it != active_connections_.end()) {
         Connection* conn = it->second;
+        time_t timeout = conn ? timeout_for(conn) : 0;
 
-        if (conn &&
-            (current_time - conn->last_activity_) > http_limits::TIMEOUT) {
-            log(LOG_WARNING,
+        if (conn && (current_time - conn->last_activity_) > timeout) {
+            log(conn->parked_ ? LOG_DEBUG : LOG_WARNING,
                 "Connection (fd: %d) timed out after %ld seconds, closing",
-                conn->client_fd_, http_limits::TIMEOUT);
+                conn->client_fd_, static_cast<long>(timeout));
 
             int fd_to_close = conn->client_fd_;
             ++it;
@@ -111,13 +146,115 @@ int ConnectionManager::close_timed_out_connections() {
 bool ConnectionManager::is_timed_out(Connection* conn) {
     // Check if the connection is timed out
     time_t current_time = time(NULL);
-    return (current_time - conn->last_activity_) > http_limits::TIMEOUT;
+    return (current_time - conn->last_activity_) > timeout_for(conn);
+}
+
+time_t ConnectionManager::timeout_for(const Connection* conn) const {
+    if (!conn->parked_) {
+        return http_limits::TIMEOUT;
+    }
+
+    // Past half the limit the idle timeout shrinks with the room left, to a
+    // second when there is none, so idle clients make way for new ones
+    size_t timeout = conn->idle_timeout_;
+    size_t count = active_connections_.size();
+    if (count * 2 > connection_limit_) {
+        size_t room = count < connection_limit_ ? connection_limit_ - count : 0;
+        timeout = std::max<size_t>(timeout * room * 2 / connection_limit_, 1);
+    }
+    return static_cast<time_t>(timeout);
+}
+
+bool ConnectionManager::has_room() const {
+    return active_connections_.size() < connection_limit_;
+}
+
+void ConnectionManager::park(Connection* conn) {
+    if (conn->parked_) {
+        return;
+    }
+
+    conn->read_buffer_.release();
+    conn->arena_.release();
+    IoBuffer().swap(conn->write_buffer_);
+    IoBuffer().swap(conn->pipelined_output_);
+    IoBuffer().swap(conn->cgi_read_buffer_);
+    IoBuffer().swap(conn->upstream_buffer_);
+
+    // Only some requests use these
+    std::vector<char>().swap(conn->cache_body_);
+    std::vector<char>().swap(conn->cgi_env_block_);
+    std::vector<char*>().swap(conn->cgi_envp_);
+    std::string().swap(conn->cgi_script_path_);
+    std::string().swap(conn->upstream_request_);
+    std::string().swap(conn->cache_key_);
+    std::string().swap(conn->cache_headers_);
+    std::string().swap(conn->body_temp_path_);
+
+    // A large response body is not worth keeping around
+    HttpResponse* response = conn->response_data_;
+    if (response->body_.capacity() > http_limits::MAX_SPARE_BODY_SIZE) {
+        std::vector<char>().swap(response->body_);
+    }
+    if (spare_requests_.size() < http_limits::SPARE_POOL_SIZE) {
+        spare_requests_.push_back(conn->request_data_);
+    } else {
+        delete conn->request_data_;
+    }
+    if (spare_responses_.size() < http_limits::SPARE_POOL_SIZE) {
+        spare_responses_.push_back(response);
+    } else {
+        delete response;
+    }
+    conn->request_data_ = NULL;
+    conn->response_data_ = NULL;
+
+    conn->parked_ = true;
+    conn->last_activity_ = time(NULL);
+    ++parked_count_;
+    log(LOG_DEBUG, "Parked idle connection (fd: %i), %zu parked",
+        conn->client_fd_, parked_count_);
+}
+
+void ConnectionManager::unpark(Connection* conn) {
+    if (!conn->parked_) {
+        return;
+    }
+
+    if (spare_requests_.empty()) {
+        conn->request_data_ = new HttpRequest();
+    } else {
+        conn->request_data_ = spare_requests_.back();
+        spare_requests_.pop_back();
+    }
+    if (spare_responses_.empty()) {
+        conn->response_data_ = new HttpResponse();
+    } else {
+        conn->response_data_ = spare_responses_.back();
+        spare_responses_.pop_back();
+    }
+
+    // The read buffer takes its block on the first read
+    conn->write_buffer_.reserve(BufferPool::block_size(1));
+
+    conn->parked_ = false;
+    --parked_count_;
+    log(LOG_DEBUG, "Unparked connection (fd: %i) for its next request",
+        conn->client_fd_);
 }
 
 size_t ConnectionManager::get_active_connection_count() const {
     return active_connections_.size();
 }
 
+size_t ConnectionManager::get_parked_connection_count() const {
+    return parked_count_;
+}
+
+size_t ConnectionManager::get_connection_limit() const {
+    return connection_limit_;
+}
+
 void ConnectionManager::register_pipe(int pipe_fd, Connection* conn) {
     // Register a pipe with the connection manager
     active_pipes_[pipe_fd] = conn;
@@ -0,0 +1,182 @@
+#include "webserv.hpp"
+
+#ifdef DELIMITER_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+const size_t DelimiterScanner::npos;
+const size_t DelimiterScanner::BLOCK_SIZE;
+const bool DelimiterScanner::VECTORIZED;
+
+// For every delimiters mask, the wanted bytes and how many there are. Slots
+// past the count repeat a wanted byte, so a mask of three can be compared
+// as four.
+static const char DELIMITER_NEEDLES[16][4] = {
+    {0, 0, 0, 0},             {'\r', '\r', '\r', '\r'},
+    {'\n', '\n', '\n', '\n'}, {'\r', '\n', '\r', '\r'},
+    {':', ':', ':', ':'},     {'\r', ':', '\r', '\r'},
+    {'\n', ':', '\n', '\n'},  {'\r', '\n', ':', '\r'},
+    {' ', ' ', ' ', ' '},     {'\r', ' ', '\r', '\r'},
+    {'\n', ' ', '\n', '\n'},  {'\r', '\n', ' ', '\r'},
+    {':', ' ', ':', ':'},     {'\r', ':', ' ', '\r'},
+    {'\n', ':', ' ', '\n'},   {'\r', '\n', ':', ' '}};
+static const size_t DELIMITER_COUNT[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4};
+
+// The C library's memchr beats a byte class table even on header lines.
+// With several wanted bytes, each search ends where an earlier one hit.
+static size_t find_portable(const char* data, size_t length,
+                            unsigned delimiters) {
+    if (DELIMITER_COUNT[delimiters] == 1) {  // Every caller's case
+        const char* found = static_cast<const char*>(
+            std::memchr(data, DELIMITER_NEEDLES[delimiters][0], length));
+        return found ? found - data : DelimiterScanner::npos;
+    }
+
+    size_t first = DelimiterScanner::npos;
+    for (size_t i = 0; i < DELIMITER_COUNT[delimiters]; ++i) {
+        const char* found = static_cast<const char*>(
+            std::memchr(data, DELIMITER_NEEDLES[delimiters][i], length));
+        if (found) {
+            first = length = found - data;
+        }
+    }
+    return first;
+}
+
+#ifdef DELIMITER_SCANNER_SSE2
+// Instantiated per number of wanted bytes, so looking for a single CR costs
+// one comparison per block, not four.
+
+// Bit i is set if byte i of the 16 at data is one of the COUNT needles
+template <size_t COUNT>
+static inline unsigned compare16(const char* data, const __m128i* needles) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+    for (size_t i = 1; i < COUNT; ++i) {
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[i]));
+    }
+    return _mm_movemask_epi8(hits);
+}
+
+template <size_t COUNT>
+static inline void load_needles(const char* wanted, __m128i* needles) {
+    for (size_t i = 0; i < COUNT; ++i) {
+        needles[i] = _mm_set1_epi8(wanted[i]);
+    }
+}
+
+// At least 16 bytes
+template <size_t COUNT>
+static size_t find_sse2(const char* data, size_t length, const char* wanted) {
+    __m128i needles[COUNT];
+    load_needles<COUNT>(wanted, needles);
+
+    size_t offset = 0;
+    while (true) {
+        unsigned mask = compare16<COUNT>(data + offset, needles);
+        if (mask) {
+            return offset + __builtin_ctz(mask);
+        }
+        if (offset + 16 == length) {
+            return DelimiterScanner::npos;
+        }
+        // The last block overlaps bytes already found to hold no delimiter
+        offset = std::min(offset + 16, length - 16);
+    }
+}
+
+template <size_t COUNT>
+static uint64_t match_sse2(const char* block, const char* wanted) {
+    __m128i needles[COUNT];
+    load_needles<COUNT>(wanted, needles);
+
+    return static_cast<uint64_t>(compare16<COUNT>(block, needles)) |
+           static_cast<uint64_t>(compare16<COUNT>(block + 16, needles)) << 16 |
+           static_cast<uint64_t>(compare16<COUNT>(block + 32, needles)) << 32 |
+           static_cast<uint64_t>(compare16<COUNT>(block + 48, needles)) << 48;
+}
+
+static size_t find_sse2(const char* data, size_t length, unsigned delimiters) {
+    // Shorter than a vector, as many request line tokens are
+    if (length < 16) {
+        return find_portable(data, length, delimiters);
+    }
+
+    const char* wanted = DELIMITER_NEEDLES[delimiters];
+    switch (DELIMITER_COUNT[delimiters]) {
+        case 1:
+            return find_sse2<1>(data, length, wanted);
+        case 2:
+            return find_sse2<2>(data, length, wanted);
+        default:
+            return find_sse2<4>(data, length, wanted);
+    }
+}
+
+static uint64_t match_sse2(const char* block, unsigned delimiters) {
+    const char* wanted = DELIMITER_NEEDLES[delimiters];
+    switch (DELIMITER_COUNT[delimiters]) {
+        case 1:
+            return match_sse2<1>(block, wanted);
+        case 2:
+            return match_sse2<2>(block, wanted);
+        default:
+            return match_sse2<4>(block, wanted);
+    }
+}
+#else
+static uint64_t match_portable(const char* data, size_t length,
+                               unsigned delimiters) {
+    const char* end = data + length;
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < DELIMITER_COUNT[delimiters]; ++i) {
+        const char* found = data;
+        while ((found = static_cast<const char*>(std::memchr(
+                    found, DELIMITER_NEEDLES[delimiters][i], end - found)))) {
+            mask |= uint64_t(1) << (found - data);
+            ++found;
+        }
+    }
+    return mask;
+}
+#endif
+
+size_t DelimiterScanner::find(const char* data, size_t length,
+                              unsigned delimiters) {
+    if (length == 0 || delimiters == 0) {
+        return npos;
+    }
+#ifdef DELIMITER_SCANNER_SSE2
+    return find_sse2(data, length, delimiters);
+#else
+    return find_portable(data, length, delimiters);
+#endif
+}
+
+uint64_t DelimiterScanner::match(const char* data, size_t length,
+                                 unsigned delimiters) {
+    if (length == 0 || delimiters == 0) {
+        return 0;
+    }
+#ifdef DELIMITER_SCANNER_SSE2
+    // Always compares the whole block, bytes past length are masked off
+    uint64_t mask = match_sse2(data, delimiters);
+#else
+    length = std::min(length, BLOCK_SIZE);
+    uint64_t mask = match_portable(data, length, delimiters);
+#endif
+    if (length >= BLOCK_SIZE) {
+        return mask;
+    }
+    return mask & ((uint64_t(1) << length) - 1);
+}
+
+const char* DelimiterScanner::implementation() {
+#ifdef DELIMITER_SCANNER_SSE2
+    return "sse2";
+#else
+    return "portable";
+#endif
+}
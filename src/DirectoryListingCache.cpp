@@ -0,0 +1,180 @@
+#include "webserv.hpp"
+
+static const char LISTING_HEAD[] =
+    "    <style>\n"
+    "        body { font-family: Arial, sans-serif; margin: 0; padding: "
+    "20px; color: #333; }\n"
+    "        h1 { border-bottom: 1px solid #eee; padding-bottom: 10px; "
+    "font-size: 24px; }\n"
+    "        table { border-collapse: collapse; width: 100%; }\n"
+    "        th { text-align: left; padding: 8px; border-bottom: 1px solid "
+    "#ddd; color: #666; }\n"
+    "        td { padding: 8px; border-bottom: 1px solid #eee; }\n"
+    "        a { text-decoration: none; color: #0366d6; }\n"
+    "        a:hover { text-decoration: underline; }\n"
+    "        .name { width: 70%; }\n"
+    "        .size { width: 30%; text-align: right; color: #666; }\n"
+    "        .parent { margin-bottom: 10px; display: block; }\n"
+    "    </style>\n"
+    "</head>\n"
+    "<body>\n";
+
+static const char TABLE_HEAD[] =
+    "    <table>\n"
+    "        <tr>\n"
+    "            <th class=\"name\">Name</th>\n"
+    "            <th class=\"size\">Size</th>\n"
+    "        </tr>\n";
+
+// Directories first, each group by name
+static bool entry_order(const DirectoryEntry& a, const DirectoryEntry& b) {
+    if (a.is_directory_ != b.is_directory_) {
+        return a.is_directory_;
+    }
+    return a.name_ < b.name_;
+}
+
+static void append_row(std::string& page, const DirectoryEntry& entry) {
+    page.append("        <tr>\n            <td class=\"name\"><a href=\"");
+    page.append(entry.name_);
+    if (entry.is_directory_) {
+        page.append("/\">").append(entry.name_).append("/</a></td>\n");
+        page.append("            <td class=\"size\">-</td>\n");
+    } else {
+        page.append("\">").append(entry.name_).append("</a></td>\n");
+
+        char size[32];
+        off_t bytes = entry.size_;
+        if (bytes < 1024) {
+            snprintf(size, sizeof(size), "%lld B",
+                     static_cast<long long>(bytes));
+        } else if (bytes < 1024 * 1024) {
+            snprintf(size, sizeof(size), "%lld KB",
+                     static_cast<long long>(bytes / 1024));
+        } else if (bytes < 1024 * 1024 * 1024) {
+            snprintf(size, sizeof(size), "%lld MB",
+                     static_cast<long long>(bytes / (1024 * 1024)));
+        } else {
+            snprintf(size, sizeof(size), "%lld GB",
+                     static_cast<long long>(bytes / (1024 * 1024 * 1024)));
+        }
+        page.append("            <td class=\"size\">").append(size);
+        page.append("</td>\n");
+    }
+    page.append("        </tr>\n");
+}
+
+DirectoryListingCache::DirectoryListingCache() : total_bytes_(0) {}
+
+DirectoryListingCache::~DirectoryListingCache() {
+    for (std::map<std::string, DirectoryListing*>::iterator it =
+             entries_.begin();
+         it != entries_.end(); ++it) {
+        release(it->second);
+    }
+}
+
+DirectoryListing* DirectoryListingCache::render(
+    const std::string& uri, std::vector<DirectoryEntry>& entries,
+    const struct timespec& mtime) {
+    std::sort(entries.begin(), entries.end(), entry_order);
+
+    DirectoryListing* listing = new DirectoryListing;
+    listing->mtime_ = mtime;
+    listing->size_ = 0;
+    listing->refs_ = 1;
+
+    size_t page_count =
+        entries.size() / http_limits::LISTING_PAGE_ENTRIES + 1;
+    listing->pages_.resize(page_count);
+
+    std::string& first = listing->pages_[0];
+    first.append("<!DOCTYPE html>\n<html>\n<head>\n    <title>Index of ");
+    first.append(uri).append("</title>\n").append(LISTING_HEAD);
+    first.append("    <h1>Index of ").append(uri).append("</h1>\n");
+    // Add parent directory link unless at root
+    if (uri != "/") {
+        first.append(
+            "    <a class=\"parent\" href=\"../\">Parent Directory</a>\n");
+    }
+    first.append(TABLE_HEAD);
+
+    for (size_t page = 0; page < page_count; ++page) {
+        size_t begin = page * http_limits::LISTING_PAGE_ENTRIES;
+        size_t end = std::min(entries.size(),
+                              begin + http_limits::LISTING_PAGE_ENTRIES);
+        std::string& html = listing->pages_[page];
+        // Rows come to around 150 bytes
+        html.reserve(html.size() + (end - begin) * 160 + 256);
+        for (size_t i = begin; i < end; ++i) {
+            append_row(html, entries[i]);
+        }
+    }
+
+    char footer[256];
+    snprintf(footer, sizeof(footer),
+             "    </table>\n"
+             "    <div style=\"margin-top: 20px; color: #666; font-size: "
+             "12px;\">\n"
+             "        Webserv - %zu items\n"
+             "    </div>\n"
+             "</body>\n"
+             "</html>",
+             entries.size());
+    listing->pages_[page_count - 1].append(footer);
+
+    for (size_t page = 0; page < page_count; ++page) {
+        listing->size_ += listing->pages_[page].size();
+    }
+    return listing;
+}
+
+DirectoryListing* DirectoryListingCache::acquire(const std::string& key) {
+    std::map<std::string, DirectoryListing*>::iterator it = entries_.find(key);
+    if (it == entries_.end()) {
+        return NULL;
+    }
+    ++it->second->refs_;
+    return it->second;
+}
+
+void DirectoryListingCache::store(const std::string& key,
+                                  DirectoryListing* listing) {
+    std::map<std::string, DirectoryListing*>::iterator it = entries_.find(key);
+    size_t old_size = (it != entries_.end()) ? it->second->size_ : 0;
+    if (total_bytes_ - old_size + listing->size_ >
+        http_limits::MAX_LISTING_CACHE_SIZE) {
+        // The old listing is outdated either way
+        if (it != entries_.end()) {
+            total_bytes_ -= old_size;
+            release(it->second);
+            entries_.erase(it);
+        }
+        log(LOG_WARNING, "Directory listing cache full, not storing %s",
+            key.c_str());
+        return;
+    }
+
+    if (it != entries_.end()) {
+        release(it->second);
+        it->second = listing;
+    } else {
+        entries_[key] = listing;
+    }
+    ++listing->refs_;
+    total_bytes_ = total_bytes_ - old_size + listing->size_;
+    log(LOG_DEBUG, "Cached directory listing %s, %zu bytes in %zu pages",
+        key.c_str(), listing->size_, listing->pages_.size());
+}
+
+void DirectoryListingCache::release(DirectoryListing* listing) {
+    if (listing && --listing->refs_ == 0) {
+        delete listing;
+    }
+}
+
+std::string DirectoryListingCache::make_key(const std::string& path,
+                                            const std::string& uri) {
+    // NUL is never part of either, and logging the key shows the path
+    return path + std::string(1, '\0') + uri;
+}
@@ -8,6 +8,8 @@ int ErrorHandler::get_parse_message_status(codes::ParseStatus parse_status) {
         case codes::PARSE_INVALID_REQUEST_LINE:
         case codes::PARSE_INVALID_PATH:
         case codes::PARSE_INVALID_QUERY_STRING:
+        case codes::PARSE_INVALID_PERCENT_ENCODING:
+        case codes::PARSE_PATH_TRAVERSAL:
         case codes::PARSE_MISSING_HOST_HEADER:
         case codes::PARSE_INVALID_CONTENT_LENGTH:
         case codes::PARSE_INVALID_CHUNK_SIZE:
@@ -20,6 +22,7 @@ int ErrorHandler::get_parse_message_status(codes::ParseStatus parse_status) {
             status_code = codes::PAYLOAD_TOO_LARGE;
             break;
         case codes::PARSE_REQUEST_TOO_LONG:
+        case codes::PARSE_URI_TOO_LONG:
             status_code = codes::URI_TOO_LONG;
             break;
         case codes::PARSE_HEADER_TOO_LONG:
@@ -53,17 +56,18 @@ void ErrorHandler::generate_error_response(Connection* conn,
 
     // Get error info from parse status
     if (status_code == codes::UNDEFINED) {
-        int parse_status_code = get_parse_message_status(conn->parse_status_);
-        handle_error(conn->response_data_, parse_status_code,
-                     *conn->virtual_server_);
+        generate_error_response(conn,
+                                get_parse_message_status(conn->parse_status_));
     } else {  // Use provided status code
-        handle_error(conn->response_data_, status_code, *conn->virtual_server_);
+        generate_error_response(conn, static_cast<int>(status_code));
     }
+}
+
+void ErrorHandler::generate_error_response(Connection* conn, int status_code) {
+    handle_error(conn, status_code);
 
     // Set additional headers
-    conn->response_data_->set_header("connection", "close");
-    conn->response_data_->set_header("server", "webserv/1.0");
-    conn->response_data_->set_header("date", get_current_gmt_time());
+    conn->response_data_->set_header("Connection", "close");
 
     // Update connection state to writing
     WebServer::update_epoll_events(conn->client_fd_, EPOLLOUT);
@@ -74,12 +78,8 @@ void ErrorHandler::generate_error_response(Connection* conn,
         status_code, conn->client_fd_, status_msg.c_str());
 }
 
-void ErrorHandler::handle_error(HttpResponse* resp, int status_code,
-                                const VirtualServer& config) {
-    if (!resp) {
-        log(LOG_ERROR, "handle_error: NULL response pointer");
-        return;
-    }
+void ErrorHandler::handle_error(Connection* conn, int status_code) {
+    HttpResponse* resp = conn->response_data_;
 
     // Clear any existing response data
     resp->headers_.clear();
@@ -89,65 +89,20 @@ void ErrorHandler::handle_error(HttpResponse* resp, int status_code,
     resp->status_code_ = status_code;
     resp->status_message_ = get_status_message(status_code);
 
-    // Get error page content (custom or default)
-    std::string content = get_error_page_content(status_code, config);
-
-    // Set response body and headers
-    resp->body_.assign(content.begin(), content.end());
-
-    // Set headers
-    resp->set_header("Content-Type", "text/html; charset=UTF-8");
-
-    // Convert size to string (C++98 compatible)
-    std::ostringstream content_length;
-    content_length << resp->body_.size();
-    resp->set_header("Content-Length", content_length.str());
+    // The body and the headers describing it are prepared once and shared,
+    // custom or default
+    ErrorPage* page = WebServer::get_instance()->get_error_pages()->acquire(
+        status_code, *conn->virtual_server_);
+    ErrorPageCache::release(conn->error_page_);
+    conn->error_page_ = page;
+    resp->content_length_ = page->body_length_;
 
     log(LOG_DEBUG, "Generated error page for status %d (%zu bytes)",
-        status_code, resp->body_.size());
+        status_code, page->body_length_);
 }
 
 // ==================== ERROR PAGE GENERATION ====================
 
-std::string ErrorHandler::get_error_page_content(int status_code,
-                                                 const VirtualServer& config) {
-    // Check if custom error page is configured
-    std::map<int, std::string>::const_iterator it =
-        config.error_pages_.find(status_code);
-
-    if (it != config.error_pages_.end()) {
-        // Custom error page found, try to read the file
-        std::string error_page_path = it->second;
-
-        std::ifstream file(error_page_path.c_str());
-        if (file.is_open()) {
-            std::string content;
-            std::string line;
-            while (std::getline(file, line)) {
-                content += line + "\n";
-            }
-            file.close();
-
-            if (!content.empty()) {
-                log(LOG_DEBUG, "Loaded custom error page: %s",
-                    error_page_path.c_str());
-                return content;
-            } else {
-                log(LOG_WARNING, "Custom error page is empty: %s",
-                    error_page_path.c_str());
-            }
-        } else {
-            log(LOG_WARNING, "Could not read custom error page: %s",
-                error_page_path.c_str());
-        }
-    }
-
-    // No custom page or couldn't read it, generate default
-    log(LOG_DEBUG, "Generating default error page for status %d", status_code);
-    return generate_default_error_page(status_code,
-                                       get_status_message(status_code));
-}
-
 std::string ErrorHandler::generate_default_error_page(
     int status_code, const std::string& status_message) {
     std::ostringstream html;
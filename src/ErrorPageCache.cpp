@@ -0,0 +1,167 @@
+#include "webserv.hpp"
+
+// The statuses ErrorHandler answers with, given a default page up front
+static const int ERROR_STATUSES[] = {
+    codes::BAD_REQUEST,
+    codes::UNAUTHORIZED,
+    codes::FORBIDDEN,
+    codes::NOT_FOUND,
+    codes::METHOD_NOT_ALLOWED,
+    codes::REQUEST_TIMEOUT,
+    codes::CONFLICT,
+    codes::LENGTH_REQUIRED,
+    codes::PAYLOAD_TOO_LARGE,
+    codes::URI_TOO_LONG,
+    codes::UNSUPPORTED_MEDIA_TYPE,
+    codes::EXPECTATION_FAILED,
+    codes::HEADER_TOO_LONG,
+    codes::INTERNAL_SERVER_ERROR,
+    codes::NOT_IMPLEMENTED,
+    codes::BAD_GATEWAY,
+    codes::SERVICE_UNAVAILABLE,
+    codes::GATEWAY_TIMEOUT,
+    codes::HTTP_VERSION_NOT_SUPPORTED,
+    codes::INSUFFICIENT_STORAGE};
+
+ErrorPageCache::ErrorPageCache() {}
+
+ErrorPageCache::~ErrorPageCache() {
+    for (std::map<int, std::map<std::string, ErrorPage*> >::iterator it =
+             configured_.begin();
+         it != configured_.end(); ++it) {
+        for (std::map<std::string, ErrorPage*>::iterator page =
+                 it->second.begin();
+             page != it->second.end(); ++page) {
+            release(page->second);
+        }
+    }
+    for (std::map<int, ErrorPage*>::iterator it = defaults_.begin();
+         it != defaults_.end(); ++it) {
+        release(it->second);
+    }
+}
+
+void ErrorPageCache::preload(const std::list<VirtualServer>& servers) {
+    for (size_t i = 0; i < sizeof(ERROR_STATUSES) / sizeof(*ERROR_STATUSES);
+         ++i) {
+        default_page(ERROR_STATUSES[i]);
+    }
+
+    for (std::list<VirtualServer>::const_iterator server = servers.begin();
+         server != servers.end(); ++server) {
+        for (std::map<int, std::string>::const_iterator it =
+                 server->error_pages_.begin();
+             it != server->error_pages_.end(); ++it) {
+            configured_page(it->first, it->second);
+        }
+    }
+    log(LOG_DEBUG, "Prepared %zu default error pages", defaults_.size());
+}
+
+ErrorPage* ErrorPageCache::acquire(int status_code,
+                                   const VirtualServer& virtual_server) {
+    std::map<int, std::string>::const_iterator it =
+        virtual_server.error_pages_.find(status_code);
+    ErrorPage* page = (it != virtual_server.error_pages_.end())
+                          ? configured_page(status_code, it->second)
+                          : default_page(status_code);
+    ++page->refs_;
+    return page;
+}
+
+void ErrorPageCache::release(ErrorPage* page) {
+    if (page && --page->refs_ == 0) {
+        delete page;
+    }
+}
+
+ErrorPage* ErrorPageCache::configured_page(int status_code,
+                                           const std::string& path) {
+    std::map<std::string, ErrorPage*>& pages = configured_[status_code];
+    std::map<std::string, ErrorPage*>::iterator it = pages.find(path);
+    if (it == pages.end()) {
+        ErrorPage* page = load(status_code, path);
+        pages[path] = page;
+        return page;
+    }
+
+    // Connections still sending the old page keep it until they are done
+    ErrorPage* page = it->second;
+    time_t now = time(NULL);
+    if (now - page->checked_at_ >= http_limits::ERROR_PAGE_CHECK_INTERVAL) {
+        if (is_current(page)) {
+            page->checked_at_ = now;
+        } else {
+            log(LOG_INFO, "Error page %s changed, reloading", path.c_str());
+            release(page);
+            page = load(status_code, path);
+            it->second = page;
+        }
+    }
+    return page;
+}
+
+ErrorPage* ErrorPageCache::default_page(int status_code) {
+    std::map<int, ErrorPage*>::iterator it = defaults_.find(status_code);
+    if (it != defaults_.end()) {
+        return it->second;
+    }
+    ErrorPage* page = load(status_code, "");
+    defaults_[status_code] = page;
+    return page;
+}
+
+ErrorPage* ErrorPageCache::load(int status_code, const std::string& path) {
+    ErrorPage* page = new ErrorPage;
+    page->path_ = path;
+    page->loaded_ = false;
+    memset(&page->stat_, 0, sizeof(page->stat_));
+    page->checked_at_ = time(NULL);
+    page->refs_ = 1;
+
+    std::string body;
+    int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        if (fstat(fd, &page->stat_) == 0 && S_ISREG(page->stat_.st_mode)) {
+            char buffer[4096];
+            ssize_t bytes;
+            while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+                body.append(buffer, bytes);
+            }
+            page->loaded_ = (bytes == 0 && !body.empty());
+        }
+        close(fd);
+    }
+
+    if (page->loaded_) {
+        log(LOG_DEBUG, "Loaded custom error page: %s", path.c_str());
+    } else {
+        if (!path.empty()) {
+            log(LOG_WARNING, "Could not read custom error page: %s",
+                path.c_str());
+        }
+        body = ErrorHandler::generate_default_error_page(
+            status_code, get_status_message(status_code));
+    }
+
+    std::ostringstream headers;
+    headers << "Content-Type: text/html; charset=UTF-8" CRLF
+            << "Content-Length: " << body.size() << CRLF CRLF;
+    page->data_ = headers.str();
+    page->headers_length_ = page->data_.size();
+    page->body_length_ = body.size();
+    page->data_.append(body);
+    return page;
+}
+
+// The file is the one read, or still missing if none was
+bool ErrorPageCache::is_current(const ErrorPage* page) {
+    struct stat st;
+    if (stat(page->path_.c_str(), &st) != 0) {
+        return page->stat_.st_ino == 0;
+    }
+    return st.st_ino == page->stat_.st_ino && st.st_dev == page->stat_.st_dev &&
+           st.st_size == page->stat_.st_size &&
+           st.st_mtim.tv_sec == page->stat_.st_mtim.tv_sec &&
+           st.st_mtim.tv_nsec == page->stat_.st_mtim.tv_nsec;
+}
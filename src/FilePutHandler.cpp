@@ -0,0 +1,230 @@
+#include "webserv.hpp"
+
+FilePutHandler::FilePutHandler() : AHandler() {}
+
+FilePutHandler::~FilePutHandler() {}
+
+void FilePutHandler::handle(Connection* conn) {
+    log(LOG_DEBUG, "FilePutHandler: Starting processing for client_fd %d",
+        conn->client_fd_);
+
+    // 3. Called again once the body is stored
+    if (conn->file_job_) {
+        FileJob* job = conn->file_job_;
+        conn->file_job_ = NULL;
+        if (job->status_ == codes::OK) {
+            send_put_success_response(conn, job->created_);
+        } else {
+            ErrorHandler::generate_error_response(conn, job->status_);
+        }
+        delete job;
+        conn->conn_state_ = codes::CONN_WRITING;
+        return;
+    }
+
+    // 1. Extract file path from request
+    std::string file_path;
+    if (!extract_file_path(conn, file_path)) {
+        return;  // Error response already set
+    }
+
+    // 2. Write the body, or move the spliced one into place, replacing any
+    // existing file, on a worker thread
+    FileJob* job = new FileJob(codes::FILE_JOB_STORE_BODY, file_path);
+    if (conn->body_file_fd_ >= 0) {
+        job->fd_ = conn->body_file_fd_;
+        job->temp_path_.swap(conn->body_temp_path_);
+        conn->body_file_fd_ = -1;
+        conn->discard_body_file();  // Only the pipe is left
+    } else {
+        job->body_.swap(conn->request_data_->body_);
+    }
+    WebServer::get_instance()->get_file_workers()->submit(conn, job);
+}
+
+bool FilePutHandler::extract_file_path(Connection* conn,
+                                       std::string& file_path) {
+    file_path = parse_absolute_path(conn);
+
+    if (file_path.empty()) {
+        log(LOG_ERROR, "FilePutHandler: Failed to resolve file path for URI: %s",
+            conn->request_data_->uri_.c_str());
+        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
+        return false;
+    }
+
+    // A directory cannot be the target of a PUT
+    if (file_path[file_path.length() - 1] == '/') {
+        log(LOG_ERROR, "FilePutHandler: Cannot PUT a directory: %s",
+            file_path.c_str());
+        ErrorHandler::generate_error_response(conn, codes::CONFLICT);
+        return false;
+    }
+
+    if (file_path.find("..") != std::string::npos) {
+        log(LOG_ERROR, "FilePutHandler: Path traversal detected: %s",
+            file_path.c_str());
+        ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
+        return false;
+    }
+
+    log(LOG_DEBUG, "FilePutHandler: Resolved file path: %s",
+        file_path.c_str());
+    return true;
+}
+
+void FilePutHandler::store_body(FileJob* job) {
+    if (job->fd_ != -1) {
+        store_spliced_file(job);
+    } else {
+        store_file(job);
+    }
+}
+
+void FilePutHandler::store_file(FileJob* job) {
+    const std::string& file_path = job->path_;
+    struct stat file_stat;
+    if (stat(file_path.c_str(), &file_stat) == 0) {
+        if (!S_ISREG(file_stat.st_mode)) {
+            log(LOG_ERROR, "FilePutHandler: Cannot replace non-regular file: %s",
+                file_path.c_str());
+            job->status_ = codes::CONFLICT;
+            return;
+        }
+        job->created_ = false;
+    } else {
+        job->created_ = true;
+    }
+
+    // Write a sibling temporary file and rename it over the target, so
+    // readers never see a partially written file
+    std::string temp_path;
+    int fd = create_temp_file(file_path, temp_path);
+    if (fd == -1) {
+        // The parent directory has to exist already
+        log(LOG_ERROR, "FilePutHandler: Cannot create a file next to %s: %s",
+            file_path.c_str(), strerror(errno));
+        if (errno == ENOENT || errno == ENOTDIR) {
+            job->status_ = codes::CONFLICT;
+        } else if (errno == EACCES) {
+            job->status_ = codes::FORBIDDEN;
+        } else {
+            job->status_ = codes::INTERNAL_SERVER_ERROR;
+        }
+        return;
+    }
+
+    // A spooled body is copied file to file by the kernel
+    const RequestBody& body = job->body_;
+    size_t written = 0;
+    while (written < body.size()) {
+        ssize_t bytes = body.write_to(fd, written, body.size() - written);
+        if (bytes <= 0) {
+            break;
+        }
+        written += bytes;
+    }
+    close(fd);
+
+    if (written != body.size() ||
+        rename(temp_path.c_str(), file_path.c_str()) != 0) {
+        int error = errno;
+        log(LOG_ERROR, "FilePutHandler: Failed to store %s: %s",
+            file_path.c_str(), strerror(error));
+        unlink(temp_path.c_str());
+        job->status_ = error == ENOSPC ? codes::INSUFFICIENT_STORAGE
+                                       : codes::INTERNAL_SERVER_ERROR;
+        return;
+    }
+
+    log(LOG_INFO, "FilePutHandler: Stored %zu bytes in %s", body.size(),
+        file_path.c_str());
+    job->status_ = codes::OK;
+}
+
+bool FilePutHandler::open_spliced_body(Connection* conn) {
+    std::string file_path = parse_absolute_path(conn);
+    if (file_path.empty() || file_path[file_path.length() - 1] == '/' ||
+        file_path.find("..") != std::string::npos) {
+        return false;
+    }
+
+    FileJob* job = new FileJob(codes::FILE_JOB_OPEN_BODY, file_path);
+    job->body_length_ = conn->body_remaining_bytes_;
+    WebServer::get_instance()->get_file_workers()->submit(conn, job);
+    return true;
+}
+
+void FilePutHandler::open_body_file(FileJob* job) {
+    // Anything but a regular file is refused once the body is read
+    struct stat file_stat;
+    if (stat(job->path_.c_str(), &file_stat) == 0 &&
+        !S_ISREG(file_stat.st_mode)) {
+        return;
+    }
+
+    job->fd_ = create_temp_file(job->path_, job->temp_path_);
+    if (job->fd_ == -1) {
+        return;
+    }
+
+    // All blocks at once: no fragmentation, and a full disk shows now
+    if (fallocate(job->fd_, 0, 0, job->body_length_) != 0 &&
+        errno != EOPNOTSUPP) {
+        log(LOG_ERROR, "FilePutHandler: Cannot allocate %zu bytes for %s: %s",
+            job->body_length_, job->path_.c_str(), strerror(errno));
+        close(job->fd_);
+        job->fd_ = -1;
+        unlink(job->temp_path_.c_str());
+        job->temp_path_.clear();
+    }
+}
+
+void FilePutHandler::store_spliced_file(FileJob* job) {
+    struct stat file_stat;
+    job->created_ = stat(job->path_.c_str(), &file_stat) != 0;
+
+    if (rename(job->temp_path_.c_str(), job->path_.c_str()) != 0) {
+        log(LOG_ERROR, "FilePutHandler: Failed to store %s: %s",
+            job->path_.c_str(), strerror(errno));
+        job->status_ = codes::INTERNAL_SERVER_ERROR;
+        return;  // The temporary file goes with the job
+    }
+    job->temp_path_.clear();
+
+    off_t size = lseek(job->fd_, 0, SEEK_END);
+    log(LOG_INFO, "FilePutHandler: Stored %lld spliced bytes in %s",
+        static_cast<long long>(size), job->path_.c_str());
+    job->status_ = codes::OK;
+}
+
+int FilePutHandler::create_temp_file(const std::string& file_path,
+                                     std::string& temp_path) {
+    temp_path = file_path + ".put-XXXXXX";
+    int fd = mkostemp(&temp_path[0], O_CLOEXEC);
+    if (fd == -1) {
+        temp_path.clear();
+        return -1;
+    }
+    fchmod(fd, 0644);
+    return fd;
+}
+
+void FilePutHandler::send_put_success_response(Connection* conn,
+                                               bool created) {
+    HttpResponse* resp = conn->response_data_;
+
+    // 201 for a new resource, 204 when an existing one was replaced
+    if (created) {
+        resp->status_code_ = codes::CREATED;
+        resp->status_message_ = "Created";
+        resp->set_header("Location", conn->request_data_->path_);
+    } else {
+        resp->status_code_ = codes::NO_CONTENT;
+        resp->status_message_ = "No Content";
+    }
+
+    resp->body_.clear();
+    resp->content_length_ = 0;
+    resp->set_header("Content-Length", "0");
+}
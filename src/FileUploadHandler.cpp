@@ -2,6 +2,175 @@
 
 // curl -v -F "file=@files/cutecat.png" http://localhost:8080/upload
 
+//--------------------------------------
+// UploadWriter
+//--------------------------------------
+
+UploadWriter::UploadWriter(const std::string& upload_dir)
+    : upload_dir_(upload_dir), fd_(-1), error_(codes::BAD_REQUEST) {}
+
+UploadWriter::~UploadWriter() {
+    discard();
+    // Files never linked: an unnamed one vanishes when closed
+    for (size_t i = 0; i < files_.size(); ++i) {
+        if (!files_[i].temp_name_.empty()) {
+            unlink(files_[i].temp_name_.c_str());
+        }
+        if (files_[i].fd_ != -1) {
+            close(files_[i].fd_);
+        }
+    }
+}
+
+bool UploadWriter::begin_part(const std::string& filename) {
+    if (filename.empty()) {
+        return true;  // A form field, its content is skipped
+    }
+    // Every file stays open until the body is complete
+    if (files_.size() >= http_limits::MAX_UPLOAD_FILES) {
+        log(LOG_ERROR, "FileUploadHandler: More than %zu files in an upload",
+            http_limits::MAX_UPLOAD_FILES);
+        error_ = codes::PAYLOAD_TOO_LARGE;
+        return false;
+    }
+    target_ = upload_dir_ + sanitize_filename(filename);
+    return open_temp_file();
+}
+
+bool UploadWriter::part_data(const char* data, size_t length) {
+    if (fd_ == -1) {
+        return true;
+    }
+    size_t written = 0;
+    while (written < length) {
+        ssize_t bytes = write(fd_, data + written, length - written);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return fail("write", target_);
+        }
+        written += bytes;
+    }
+    return true;
+}
+
+bool UploadWriter::end_part() {
+    if (fd_ == -1) {
+        return true;
+    }
+    File file;
+    file.fd_ = fd_;
+    file.temp_name_.swap(temp_name_);
+    file.target_.swap(target_);
+    files_.push_back(file);
+    fd_ = -1;
+    return true;
+}
+
+bool UploadWriter::link_files() {
+    for (size_t i = 0; i < files_.size(); ++i) {
+        if (!link_file(files_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+codes::ResponseStatus UploadWriter::error() const { return error_; }
+
+bool UploadWriter::open_temp_file() {
+    fd_ = open(upload_dir_.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd_ == -1 && (errno == EOPNOTSUPP || errno == EISDIR)) {
+        // No O_TMPFILE on this filesystem, a named file is renamed instead
+        temp_name_ = target_ + ".upload-XXXXXX";
+        fd_ = mkostemp(&temp_name_[0], O_CLOEXEC);
+        if (fd_ == -1) {
+            temp_name_.clear();
+        } else {
+            fchmod(fd_, 0644);
+        }
+    }
+    if (fd_ == -1) {
+        return fail("create", target_);
+    }
+    return true;
+}
+
+bool UploadWriter::link_file(File& file) {
+    if (file.temp_name_.empty()) {
+        // Give the unnamed file its name. An existing file is replaced by
+        // linking next to it and renaming over it.
+        char fd_path[32];
+        snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", file.fd_);
+        if (linkat(AT_FDCWD, fd_path, AT_FDCWD, file.target_.c_str(),
+                   AT_SYMLINK_FOLLOW) == 0) {
+            log(LOG_INFO, "FileUploadHandler: Stored %s",
+                file.target_.c_str());
+            close(file.fd_);
+            file.fd_ = -1;
+            return true;
+        }
+        if (errno != EEXIST) {
+            return fail("link", file.target_);
+        }
+        std::string link_name = file.target_ + ".upload-tmp";
+        unlink(link_name.c_str());
+        if (linkat(AT_FDCWD, fd_path, AT_FDCWD, link_name.c_str(),
+                   AT_SYMLINK_FOLLOW) != 0) {
+            return fail("link", link_name);
+        }
+        file.temp_name_ = link_name;
+    }
+
+    if (rename(file.temp_name_.c_str(), file.target_.c_str()) != 0) {
+        return fail("rename", file.target_);
+    }
+    file.temp_name_.clear();
+    log(LOG_INFO, "FileUploadHandler: Stored %s", file.target_.c_str());
+    close(file.fd_);
+    file.fd_ = -1;
+    return true;
+}
+
+bool UploadWriter::fail(const char* action, const std::string& path) {
+    log(LOG_ERROR, "FileUploadHandler: Failed to %s %s: %s", action,
+        path.c_str(), strerror(errno));
+    if (errno == EACCES || errno == EPERM) {
+        error_ = codes::FORBIDDEN;
+    } else if (errno == ENOSPC || errno == EDQUOT) {
+        error_ = codes::INSUFFICIENT_STORAGE;
+    } else {
+        error_ = codes::INTERNAL_SERVER_ERROR;
+    }
+    discard();
+    return false;
+}
+
+// Drops the current file: an unnamed one vanishes when closed
+void UploadWriter::discard() {
+    if (!temp_name_.empty()) {
+        unlink(temp_name_.c_str());
+        temp_name_.clear();
+    }
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+    target_.clear();
+}
+
+//--------------------------------------
+// StreamedUpload
+//--------------------------------------
+
+StreamedUpload::StreamedUpload(const std::string& upload_dir)
+    : status_(codes::OK), writer_(upload_dir) {}
+
+//--------------------------------------
+// FileUploadHandler
+//--------------------------------------
+
 FileUploadHandler::FileUploadHandler() : AHandler() {}
 
 FileUploadHandler::~FileUploadHandler() {}
@@ -10,8 +179,21 @@ void FileUploadHandler::handle(Connection* conn) {
     log(LOG_DEBUG, "FileUploadHandler: Starting processing for client_fd %d",
         conn->client_fd_);
 
-    if (process_location_redirect(conn) ||
-        process_trailing_slash_redirect(conn)) {
+    // Called again once the upload below is stored
+    if (conn->file_job_) {
+        FileJob* job = conn->file_job_;
+        conn->file_job_ = NULL;
+        if (job->status_ == codes::OK) {
+            send_success_response(conn);
+        } else {
+            ErrorHandler::generate_error_response(conn, job->status_);
+        }
+        delete job;
+        conn->conn_state_ = codes::CONN_WRITING;
+        return;
+    }
+
+    if (process_trailing_slash_redirect(conn)) {
         return;
     }
 
@@ -25,32 +207,85 @@ void FileUploadHandler::handle(Connection* conn) {
         return;
     }
 
-    if (parse_multipart_form_data(conn, boundary)) {
-        send_success_response(conn);
+    // The body was parsed and its files written as it arrived, see
+    // open_streamed_upload(). Only an empty body never is.
+    StreamedUpload* upload = conn->upload_;
+    conn->upload_ = NULL;
+    conn->request_data_->body_.clear();
+    codes::ResponseStatus status = codes::BAD_REQUEST;
+    if (upload && upload->status_ != codes::OK) {
+        status = upload->status_;
+    } else if (upload && upload->parser_.failed()) {
+        status = upload->writer_.error();
+    } else if (upload && upload->parser_.finished() &&
+               upload->parser_.file_parts() > 0) {
+        // The files get their names on a worker thread
+        FileJob* job =
+            new FileJob(codes::FILE_JOB_UPLOAD, get_upload_directory(conn));
+        job->upload_ = upload;
+        WebServer::get_instance()->get_file_workers()->submit(conn, job);
+        return;
     } else {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
+        log(LOG_ERROR, "Upload without a complete file part");
+    }
+    delete upload;
+    ErrorHandler::generate_error_response(conn, status);
+}
+
+bool FileUploadHandler::open_streamed_upload(Connection* conn) {
+    std::string content_type =
+        conn->request_data_->get_header(codes::HEADER_CONTENT_TYPE);
+    std::string boundary = extract_boundary(content_type);
+    if (needs_trailing_slash(conn) ||
+        content_type.find("multipart/form-data") != 0 || boundary.empty()) {
+        return false;
+    }
+
+    FileJob* job =
+        new FileJob(codes::FILE_JOB_OPEN_UPLOAD, get_upload_directory(conn));
+    job->boundary_ = boundary;
+    WebServer::get_instance()->get_file_workers()->submit(conn, job);
+    return true;
+}
+
+void FileUploadHandler::upload_directory_created(Connection* conn) {
+    FileJob* job = conn->file_job_;
+    conn->file_job_ = NULL;
+
+    // A bad boundary leaves the parser failed, reported as a bad request
+    StreamedUpload* upload = new StreamedUpload(job->path_);
+    upload->status_ = job->status_;
+    if (upload->status_ == codes::OK) {
+        upload->parser_.reset(job->boundary_, &upload->writer_);
     }
+    conn->upload_ = upload;
+    conn->request_data_->body_.stream_to(&upload->parser_);
 
-    conn->conn_state_ = codes::CONN_WRITING;
+    log(LOG_DEBUG,
+        "FileUploadHandler: Parsing %zu body bytes of client_fd %d as they "
+        "arrive",
+        conn->body_remaining_bytes_, conn->client_fd_);
+    delete job;
 }
 
-bool FileUploadHandler::process_trailing_slash_redirect(Connection* conn) {
-    std::string uri = conn->request_data_->uri_;
+bool FileUploadHandler::needs_trailing_slash(Connection* conn) {
+    const std::string& uri = conn->request_data_->uri_;
     const Location* location = conn->location_match_;
 
     // If location path ends with / but URI doesn't, redirect to add slash
-    if (!location->path_.empty() && 
-        location->path_[location->path_.length() - 1] == '/' &&
-        !uri.empty() && uri[uri.length() - 1] != '/') {
-        
-        ErrorHandler::generate_error_response(conn, codes::MOVED_PERMANENTLY);
-        
-        conn->response_data_->set_header("Location", uri + "/");
-
+    return !location->is_regex() && !location->path_.empty() &&
+           location->path_[location->path_.length() - 1] == '/' &&
+           !uri.empty() && uri[uri.length() - 1] != '/';
+}
 
-        return true;
+bool FileUploadHandler::process_trailing_slash_redirect(Connection* conn) {
+    if (!needs_trailing_slash(conn)) {
+        return false;
     }
-    return false;
+    ErrorHandler::generate_error_response(conn, codes::MOVED_PERMANENTLY);
+    conn->response_data_->set_header("Location",
+                                     conn->request_data_->uri_ + "/");
+    return true;
 }
 
 bool FileUploadHandler::validate_request(Connection* conn,
@@ -60,9 +295,7 @@ bool FileUploadHandler::validate_request(Connection* conn,
         return false;
     }
 
-    std::string content_length =
-        conn->request_data_->get_header("content-length");    
-    if (content_length.empty()) {
+    if (!conn->request_data_->has_header(codes::HEADER_CONTENT_LENGTH)) {
         ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
         return false;
     }
@@ -72,7 +305,8 @@ bool FileUploadHandler::validate_request(Connection* conn,
         return false;
     }
 
-    std::string content_type = conn->request_data_->get_header("content-type");
+    std::string content_type =
+        conn->request_data_->get_header(codes::HEADER_CONTENT_TYPE);
     if (content_type.empty() || content_type.find("multipart/form-data") != 0) {
         ErrorHandler::generate_error_response(conn, codes::UNSUPPORTED_MEDIA_TYPE);
         return false;
@@ -99,171 +333,22 @@ void FileUploadHandler::send_success_response(Connection* conn) {
     resp->content_length_ = resp->body_.size();
 }
 
-bool FileUploadHandler::parse_multipart_form_data(Connection* conn,
-                                                  const std::string& boundary) {
-    std::string body(conn->request_data_->body_.begin(),
-                     conn->request_data_->body_.end());
-    std::string full_boundary = "--" + boundary;
-    std::string end_boundary = full_boundary + "--";
-
-    size_t pos = 0;
-    bool file_found = false;
-
-    while (pos < body.length()) {
-        pos = body.find(full_boundary, pos);
-        if (pos == std::string::npos) {
-            break;
-        }
-
-        pos += full_boundary.length();
-        if (pos >= body.length()) {
-            break;
-        }
-
-        // Skip CRLF after boundary
-        if (pos + 2 <= body.length() && body.substr(pos, 2) == "\r\n") {
-            pos += 2;
-        }
-
-        // Check for end boundary
-        if (pos + 2 <= body.length() && body.substr(pos, 2) == "--") {
-            break;
-        }
-
-        if (!process_part(conn, body, full_boundary, end_boundary, pos,
-                          file_found)) {
-            return false;
-        }
-
-        // Safety check to prevent infinite loops
-        if (pos >= body.length()) {
-            break;
-        }
-    }
-
-    return file_found;
-}
-
-bool FileUploadHandler::process_part(Connection* conn, const std::string& body,
-                                     const std::string& full_boundary,
-                                     const std::string& end_boundary,
-                                     size_t& pos, bool& file_found) {
-    // Extract headers
-    size_t headers_end;
-    std::string headers;
-
-    if (!extract_part_headers(body, pos, headers_end, headers)) {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-        return false;
-    }
-
-    // Extract filename from headers
-    std::string filename;
-    if (!extract_filename(headers, filename)) {
-        // Not a file part, skip it
-        // Find the end of this part to update pos for next iteration
-        size_t content_end = body.find(full_boundary, pos);
-        if (content_end != std::string::npos) {
-            pos = content_end;
-        } else {
-            // Try end boundary
-            content_end = body.find(end_boundary, pos);
-            if (content_end != std::string::npos) {
-                pos = content_end;
-            } else {
-                // Can't find next boundary, something's wrong
-                ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-                return false;
-            }
-        }
-        return true;  // Skip this part but continue parsing
-    }
-
-    // Move to content start
-    pos = headers_end + 4;  // Skip "\r\n\r\n"
-
-    // Extract and process file content
-    return extract_file_content(conn, body, pos, pos, full_boundary,
-                                end_boundary, filename, file_found);
-}
-
-bool FileUploadHandler::extract_part_headers(const std::string& body,
-                                             size_t& pos, size_t& headers_end,
-                                             std::string& headers) {
-    // Find the end of the headers section (double newline)
-    headers_end = body.find("\r\n\r\n", pos);
-    if (headers_end == std::string::npos) {
-        return false;  // Invalid format
+void FileUploadHandler::create_upload_directory(FileJob* job) {
+    if (!make_directories(job->path_)) {
+        int mkdir_errno = errno;
+        log(LOG_ERROR, "FileUploadHandler: Cannot create %s: %s",
+            job->path_.c_str(), strerror(mkdir_errno));
+        job->status_ = (mkdir_errno == EACCES || mkdir_errno == EPERM)
+                           ? codes::FORBIDDEN
+                           : codes::INTERNAL_SERVER_ERROR;
+        return;
     }
-
-    // Extract headers
-    headers = body.substr(pos, headers_end - pos);
-    return true;
+    job->status_ = codes::OK;
 }
 
-bool FileUploadHandler::extract_filename(const std::string& headers,
-                                         std::string& filename) {
-    // Find Content-Disposition header
-    size_t content_disp_pos = headers.find("Content-Disposition:");
-    if (content_disp_pos == std::string::npos) {
-        return false;  // Not a content disposition part
-    }
-
-    // Extract filename
-    size_t filename_pos = headers.find("filename=\"", content_disp_pos);
-    if (filename_pos == std::string::npos) {
-        return false;  // No filename, not a file upload
-    }
-
-    filename_pos += 10;  // Length of 'filename="'
-    size_t filename_end = headers.find("\"", filename_pos);
-    if (filename_end == std::string::npos) {
-        return false;  // Invalid format
-    }
-
-    filename = headers.substr(filename_pos, filename_end - filename_pos);
-    return !filename
-                .empty();  // Return true only if we found a non-empty filename
-}
-
-bool FileUploadHandler::extract_file_content(
-    Connection* conn, const std::string& body, size_t pos, size_t& content_end,
-    const std::string& full_boundary, const std::string& end_boundary,
-    const std::string& filename, bool& file_found) {
-    // Find next boundary
-    content_end = body.find(full_boundary, pos);
-    if (content_end == std::string::npos) {
-        content_end = body.find(end_boundary, pos);
-        if (content_end == std::string::npos) {
-            ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-            return false;
-        }
-    }
-
-    // Bounds checking
-    if (pos >= content_end || content_end > body.length()) {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-        return false;
-    }
-
-    // Remove trailing CRLF
-    content_end -= 2;
-
-    // Final validation after adjustment
-    if (pos >= content_end) {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-        return false;
-    }
-
-    // Safe extraction
-    std::vector<char> file_data(body.begin() + pos, body.begin() + content_end);
-
-     if (!save_uploaded_file(conn, filename, file_data)) {
-        return false;
-    }
-
-    file_found = true;
-    return true;
+void FileUploadHandler::store_upload(FileJob* job) {
+    UploadWriter& writer = job->upload_->writer_;
+    job->status_ = writer.link_files() ? codes::OK : writer.error();
 }
 
 std::string FileUploadHandler::get_upload_directory(Connection* conn) {
@@ -284,139 +369,6 @@ std::string FileUploadHandler::get_upload_directory(Connection* conn) {
     return upload_dir;
 }
 
-bool FileUploadHandler::save_uploaded_file(Connection* conn,
-                                           const std::string& filename,
-                                           const std::vector<char>& data) {
-    std::string upload_dir = get_upload_directory(conn);
-    
-    if (!ensure_upload_directory_exists(conn, upload_dir)) {
-        return false;
-    }
-
-    std::string safe_filename = sanitize_filename(filename);
-    if (safe_filename.empty()) {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-
-        return false;
-    }
-
-    std::string full_path = upload_dir + safe_filename;
-
-    return write_file_to_disk(conn, full_path, data);
-}
-
-bool FileUploadHandler::ensure_upload_directory_exists(Connection* conn, 
-                                                       const std::string& upload_dir) {
-    struct stat st;
-    if (stat(upload_dir.c_str(), &st) == 0) {
-        return true;  // Directory already exists
-    }
-
-    // Directory doesn't exist, create it recursively
-    return create_directory_recursive(conn, upload_dir);
-}
-
-bool FileUploadHandler::create_directory_recursive(Connection* conn, const std::string& path) {
-    size_t pos = 0;
-    while ((pos = path.find('/', pos + 1)) != std::string::npos) {
-        if (pos > 0) {
-            std::string parent_dir = path.substr(0, pos);
-            if (mkdir(parent_dir.c_str(), 0755) != 0 && errno != EEXIST) {
-                if (errno == EACCES || errno == EPERM) {
-                    ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
-                } else {
-                    ErrorHandler::generate_error_response(conn, codes::INTERNAL_SERVER_ERROR);
-                }
-                return false;
-            }
-        }
-    }
-
-    // Create final directory
-    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
-        if (errno == EACCES || errno == EPERM) {
-            ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
-        } else {
-            ErrorHandler::generate_error_response(conn, codes::INTERNAL_SERVER_ERROR);
-        }
-        return false;
-    }
-
-    return true;
-}
-
-bool FileUploadHandler::write_file_to_disk(Connection* conn, const std::string& file_path,
-                                           const std::vector<char>& data) {
-    if (data.empty()) {
-        ErrorHandler::generate_error_response(conn, codes::BAD_REQUEST);
-        return false;
-    }
-
-    std::ofstream file(file_path.c_str(), std::ios::binary);
-
-    if (!file.is_open()) {
-        if (errno == EACCES || errno == EPERM) {
-            ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
-        } else if (errno == ENOSPC) {
-            ErrorHandler::generate_error_response(conn, codes::INSUFFICIENT_STORAGE);
-        } else {
-            ErrorHandler::generate_error_response(conn, codes::INTERNAL_SERVER_ERROR);
-        }
-        return false;
-    }
-
-    // Write data
-    file.write(&data[0], data.size());
-
-    // Check for write errors
-    if (file.fail() || file.bad()) {
-        file.close();
-        // Try to remove partially written file
-        std::remove(file_path.c_str());
-
-        if (errno == ENOSPC) {
-            ErrorHandler::generate_error_response(conn, codes::INSUFFICIENT_STORAGE);
-        } else {
-            ErrorHandler::generate_error_response(conn, codes::INTERNAL_SERVER_ERROR);
-        }
-        return false;
-    }
-
-    file.close();
-    return true;
-}
-
-std::string FileUploadHandler::sanitize_filename(const std::string& filename) {
-    // Remove path information
-    std::string safe_filename = filename;
-    size_t last_slash = safe_filename.find_last_of("/\\");
-    if (last_slash != std::string::npos) {
-        safe_filename = safe_filename.substr(last_slash + 1);
-    }
-
-    // Remove potentially dangerous characters
-    for (size_t i = 0; i < safe_filename.length(); ++i) {
-        char c = safe_filename[i];
-        // Keep alphanumeric, dash, underscore, dot
-        if (!isalnum(c) && c != '-' && c != '_' && c != '.') {
-            safe_filename[i] = '_';
-        }
-    }
-
-    // Handle edge cases
-    if (safe_filename.empty() || safe_filename == "." ||
-        safe_filename == "..") {
-        return "upload_file";
-    }
-
-    // Limit filename length for filesystem compatibility
-    if (safe_filename.length() > 255) {
-        safe_filename = safe_filename.substr(0, 255);
-    }
-
-    return safe_filename;
-}
-
 std::string FileUploadHandler::extract_boundary(
     const std::string& content_type) {
     size_t boundary_pos = content_type.find("boundary=");
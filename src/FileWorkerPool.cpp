@@ -0,0 +1,390 @@
+#include "webserv.hpp"
+
+FileJob::FileJob(codes::FileJobType type, const std::string& path)
+    : type_(type),
+      path_(path),
+      read_content_(false),
+      list_directory_(false),
+      has_cached_listing_(false),
+      body_length_(0),
+      upload_length_(0),
+      upload_offset_(0),
+      conn_(NULL),
+      finished_(false),
+      exists_(false),
+      error_(0),
+      listing_current_(false),
+      listing_(NULL),
+      fd_(-1),
+      upload_(NULL),
+      created_(false),
+      status_(codes::UNDEFINED) {
+    memset(&cached_mtime_, 0, sizeof(cached_mtime_));
+    memset(&stat_, 0, sizeof(stat_));
+}
+
+FileJob::~FileJob() {
+    DirectoryListingCache::release(listing_);
+    delete upload_;  // Closes files it did not link
+    if (fd_ != -1) {
+        close(fd_);
+    }
+    if (!temp_path_.empty()) {
+        unlink(temp_path_.c_str());
+    }
+}
+
+FileWorkerPool::FileWorkerPool() : event_fd_(-1), stopping_(false) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&work_ready_, NULL);
+}
+
+FileWorkerPool::~FileWorkerPool() {
+    stop();
+
+    for (size_t i = 0; i < queue_.size(); ++i) {
+        delete queue_[i];
+    }
+    for (size_t i = 0; i < done_.size(); ++i) {
+        delete done_[i];
+    }
+    if (event_fd_ >= 0) {
+        close(event_fd_);
+    }
+    pthread_cond_destroy(&work_ready_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool FileWorkerPool::start(size_t thread_count) {
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        log(LOG_ERROR, "Failed to create file worker eventfd: %s",
+            strerror(errno));
+        return false;
+    }
+
+    // Signals are for the event loop, workers never see them
+    sigset_t all_signals;
+    sigset_t previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_t thread;
+        int error = pthread_create(&thread, NULL, worker_main, this);
+        if (error != 0) {
+            log(LOG_ERROR, "Failed to start file worker thread: %s",
+                strerror(error));
+            break;
+        }
+        threads_.push_back(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (threads_.size() != thread_count) {
+        return false;
+    }
+    log(LOG_DEBUG, "Started %zu file worker threads", thread_count);
+    return true;
+}
+
+void FileWorkerPool::stop() {
+    pthread_mutex_lock(&mutex_);
+    stopping_ = true;
+    pthread_cond_broadcast(&work_ready_);
+    pthread_mutex_unlock(&mutex_);
+
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        pthread_join(threads_[i], NULL);
+    }
+    threads_.clear();
+}
+
+void FileWorkerPool::submit(Connection* conn, FileJob* job) {
+    job->conn_ = conn;
+    conn->file_job_ = job;
+    conn->conn_state_ = codes::CONN_FILE_WAIT;
+    WebServer::update_epoll_events(conn->client_fd_, 0);
+
+    pthread_mutex_lock(&mutex_);
+    queue_.push_back(job);
+    pthread_cond_signal(&work_ready_);
+    pthread_mutex_unlock(&mutex_);
+
+    log(LOG_DEBUG, "Client_fd %d waits for file job on %s", conn->client_fd_,
+        job->path_.c_str());
+}
+
+void FileWorkerPool::dispatch_completions() {
+    uint64_t count;
+    if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        log(LOG_ERROR, "Failed to read file worker eventfd: %s",
+            strerror(errno));
+    }
+
+    std::vector<FileJob*> finished;
+    pthread_mutex_lock(&mutex_);
+    finished.swap(done_);
+    pthread_mutex_unlock(&mutex_);
+
+    for (size_t i = 0; i < finished.size(); ++i) {
+        FileJob* job = finished[i];
+        Connection* conn = job->conn_;
+        if (!conn) {
+            delete job;  // Its connection was closed meanwhile
+            continue;
+        }
+
+        job->finished_ = true;
+        // No handler yet for these, the request is still being read
+        if (job->type_ == codes::FILE_JOB_OPEN_BODY ||
+            job->type_ == codes::FILE_JOB_RESUMABLE_OPEN) {
+            WebServer::get_instance()->continue_spliced_body(conn);
+            continue;
+        }
+        if (job->type_ == codes::FILE_JOB_OPEN_UPLOAD) {
+            WebServer::get_instance()->continue_streamed_upload(conn);
+            continue;
+        }
+
+        // The handler runs again and takes the job from the connection
+        conn->conn_state_ = codes::CONN_PROCESSING;
+        WebServer::update_epoll_events(conn->client_fd_, EPOLLOUT);
+    }
+}
+
+void FileWorkerPool::cancel(Connection* conn) {
+    FileJob* job = conn->file_job_;
+    if (!job) {
+        return;
+    }
+    conn->file_job_ = NULL;
+
+    if (job->finished_) {
+        delete job;
+        return;
+    }
+
+    // Not picked up yet: drop it. Otherwise a worker still has it and
+    // dispatch_completions() drops it.
+    pthread_mutex_lock(&mutex_);
+    std::deque<FileJob*>::iterator it =
+        std::find(queue_.begin(), queue_.end(), job);
+    if (it != queue_.end()) {
+        queue_.erase(it);
+        delete job;
+    } else {
+        job->conn_ = NULL;
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void* FileWorkerPool::worker_main(void* pool) {
+    static_cast<FileWorkerPool*>(pool)->run_worker();
+    return NULL;
+}
+
+void FileWorkerPool::run_worker() {
+    pthread_mutex_lock(&mutex_);
+    while (true) {
+        while (queue_.empty() && !stopping_) {
+            pthread_cond_wait(&work_ready_, &mutex_);
+        }
+        if (stopping_) {
+            break;
+        }
+        FileJob* job = queue_.front();
+        queue_.pop_front();
+        pthread_mutex_unlock(&mutex_);
+
+        run_job(job);
+
+        pthread_mutex_lock(&mutex_);
+        done_.push_back(job);
+        uint64_t one = 1;
+        if (write(event_fd_, &one, sizeof(one)) < 0) {
+            // Only fails when the counter is about to overflow, in which case
+            // the event loop has a wakeup pending anyway
+        }
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void FileWorkerPool::run_job(FileJob* job) {
+    switch (job->type_) {
+        case codes::FILE_JOB_LOAD:
+            load_path(job);
+            break;
+        case codes::FILE_JOB_DELETE:
+            delete_file(job);
+            break;
+        case codes::FILE_JOB_OPEN_UPLOAD:
+            FileUploadHandler::create_upload_directory(job);
+            break;
+        case codes::FILE_JOB_UPLOAD:
+            FileUploadHandler::store_upload(job);
+            break;
+        case codes::FILE_JOB_OPEN_BODY:
+            FilePutHandler::open_body_file(job);
+            break;
+        case codes::FILE_JOB_STORE_BODY:
+            FilePutHandler::store_body(job);
+            break;
+        case codes::FILE_JOB_RESUMABLE_CREATE:
+            ResumableUploadHandler::create_upload(job);
+            break;
+        case codes::FILE_JOB_RESUMABLE_OPEN:
+            ResumableUploadHandler::open_upload_part(job);
+            break;
+        case codes::FILE_JOB_RESUMABLE_APPEND:
+            ResumableUploadHandler::append_to_upload(job);
+            break;
+        case codes::FILE_JOB_RESUMABLE_OFFSET:
+            ResumableUploadHandler::report_offset(job);
+            break;
+        case codes::FILE_JOB_RESUMABLE_DELETE:
+            ResumableUploadHandler::delete_upload(job);
+            break;
+    }
+}
+
+void FileWorkerPool::load_path(FileJob* job) {
+    if (stat(job->path_.c_str(), &job->stat_) != 0) {
+        job->error_ = errno;
+        return;
+    }
+    job->exists_ = true;
+
+    if (S_ISDIR(job->stat_.st_mode)) {
+        // An index file takes the place of the directory, if there is one
+        if (!job->index_.empty()) {
+            struct stat dir_stat = job->stat_;
+            if (load_file(job, job->path_ + job->index_)) {
+                return;
+            }
+            job->stat_ = dir_stat;
+            job->error_ = 0;
+        }
+        if (job->list_directory_) {
+            list_directory(job);
+        }
+    } else if (S_ISREG(job->stat_.st_mode)) {
+        load_file(job, job->path_);
+    }
+}
+
+// Opens a regular file and reads it if asked to. False if path is not a
+// regular file, which leaves the job untouched apart from stat_ and error_.
+bool FileWorkerPool::load_file(FileJob* job, const std::string& path) {
+    if (stat(path.c_str(), &job->stat_) != 0 || !S_ISREG(job->stat_.st_mode)) {
+        job->error_ = errno;
+        return false;
+    }
+    job->file_ = path;
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &job->stat_) != 0) {
+        job->error_ = errno;
+        if (fd != -1) {
+            close(fd);
+        }
+        return true;
+    }
+
+    if (job->read_content_) {
+        size_t size = job->stat_.st_size;
+        job->content_.resize(size);
+        size_t total = 0;
+        while (total < size) {
+            ssize_t bytes = read(fd, &job->content_[total], size - total);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                job->error_ = bytes < 0 ? errno : EIO;  // Truncated meanwhile
+                break;
+            }
+            total += bytes;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+// Reads the entries with one getdents64() per batch (readdir) and stats
+// each relative to the directory at most once: d_type alone tells a
+// directory, which shows no size
+void FileWorkerPool::list_directory(FileJob* job) {
+    int dir_fd = open(job->path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat dir_stat;
+    if (dir_fd == -1 || fstat(dir_fd, &dir_stat) != 0) {
+        job->error_ = errno;
+        if (dir_fd != -1) {
+            close(dir_fd);
+        }
+        return;
+    }
+
+    // Entries only change along with the mtime, taken before reading them
+    if (job->has_cached_listing_ &&
+        dir_stat.st_mtim.tv_sec == job->cached_mtime_.tv_sec &&
+        dir_stat.st_mtim.tv_nsec == job->cached_mtime_.tv_nsec) {
+        close(dir_fd);
+        job->listing_current_ = true;
+        return;
+    }
+
+    DIR* dir = fdopendir(dir_fd);
+    if (!dir) {
+        job->error_ = errno;
+        close(dir_fd);
+        return;
+    }
+
+    std::vector<DirectoryEntry> entries;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        DirectoryEntry listed;
+        listed.name_ = name;
+        listed.is_directory_ = (entry->d_type == DT_DIR);
+        listed.size_ = 0;
+        if (!listed.is_directory_) {
+            // Files for their size, symlinks and unknown types for what
+            // they are. Entries that vanish or can not be inspected are
+            // left out.
+            struct stat st;
+            if (fstatat(dir_fd, name, &st, 0) != 0) {
+                continue;
+            }
+            listed.is_directory_ = S_ISDIR(st.st_mode);
+            listed.size_ = st.st_size;
+        }
+        entries.push_back(listed);
+    }
+    closedir(dir);  // Closes dir_fd
+
+    job->listing_ = DirectoryListingCache::render(job->listing_uri_, entries,
+                                                  dir_stat.st_mtim);
+}
+
+void FileWorkerPool::delete_file(FileJob* job) {
+    if (stat(job->path_.c_str(), &job->stat_) != 0) {
+        job->error_ = errno;
+        return;
+    }
+    job->exists_ = true;
+
+    // Anything but a regular file is refused by the handler
+    if (!S_ISREG(job->stat_.st_mode)) {
+        return;
+    }
+    if (access(job->path_.c_str(), W_OK) != 0 ||
+        unlink(job->path_.c_str()) != 0) {
+        job->error_ = errno;
+    }
+}
@@ -1,45 +1,198 @@
 #include "webserv.hpp"
 
-HttpRequest::HttpRequest() {}
+// Known header names, indexed by codes::KnownHeader
+static const struct {
+    const char* name;
+    size_t length;
+} KNOWN_HEADERS[codes::HEADER_COUNT] = {
+    {"host", 4},
+    {"connection", 10},
+    {"content-length", 14},
+    {"content-type", 12},
+    {"transfer-encoding", 17},
+    {"expect", 6},
+    {"authorization", 13},
+    {"cookie", 6},
+    {"user-agent", 10},
+    {"accept", 6},
+    {"accept-encoding", 15},
+    {"accept-language", 15},
+    {"referer", 7},
+    {"if-modified-since", 17},
+    {"if-none-match", 13},
+    {"range", 5},
+};
+
+// Perfect hash over KNOWN_HEADERS: no two names share a slot, so one
+// comparison tells whether a name is known. Keep in sync when adding names.
+#define KNOWN_HEADER_HASH(first, last, length) \
+    (((first) + 7 * (last) + 17 * (length)) & 31)
+
+static const signed char KNOWN_HEADER_SLOTS[32] = {
+    codes::HEADER_AUTHORIZATION,      // 0
+    -1,                               // 1
+    -1,                               // 2
+    codes::HEADER_ACCEPT_LANGUAGE,    // 3
+    -1,                               // 4
+    -1,                               // 5
+    codes::HEADER_TRANSFER_ENCODING,  // 6
+    codes::HEADER_REFERER,            // 7
+    -1,                               // 8
+    codes::HEADER_CONTENT_LENGTH,     // 9
+    codes::HEADER_RANGE,              // 10
+    codes::HEADER_USER_AGENT,         // 11
+    codes::HEADER_COOKIE,             // 12
+    codes::HEADER_IF_MODIFIED_SINCE,  // 13
+    -1,                               // 14
+    codes::HEADER_CONNECTION,         // 15
+    -1,                               // 16
+    codes::HEADER_ACCEPT_ENCODING,    // 17
+    codes::HEADER_CONTENT_TYPE,       // 18
+    codes::HEADER_ACCEPT,             // 19
+    -1,                               // 20
+    -1,                               // 21
+    -1,                               // 22
+    codes::HEADER_EXPECT,             // 23
+    codes::HEADER_HOST,               // 24
+    -1,                               // 25
+    -1,                               // 26
+    -1,                               // 27
+    -1,                               // 28
+    -1,                               // 29
+    codes::HEADER_IF_NONE_MATCH,      // 30
+    -1,                               // 31
+};
+
+static bool equals_ignore_case(const char* a, const char* b, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) !=
+            std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpRequest::HttpRequest() : method_type_(codes::METHOD_UNKNOWN) {
+    std::fill(known_fields_, known_fields_ + codes::HEADER_COUNT, 0);
+}
 
 HttpRequest::~HttpRequest() {}
 
+codes::KnownHeader HttpRequest::find_known_header(const char* name,
+                                                  size_t length) {
+    if (length == 0) {
+        return codes::HEADER_OTHER;
+    }
+    int slot = KNOWN_HEADER_SLOTS[KNOWN_HEADER_HASH(
+        static_cast<unsigned char>(name[0]),
+        static_cast<unsigned char>(name[length - 1]), length)];
+    if (slot < 0 || KNOWN_HEADERS[slot].length != length ||
+        std::memcmp(KNOWN_HEADERS[slot].name, name, length) != 0) {
+        return codes::HEADER_OTHER;
+    }
+    return static_cast<codes::KnownHeader>(slot);
+}
+
+void HttpRequest::add_header(RequestArena& arena, const char* name,
+                             size_t name_length, const char* value,
+                             size_t value_length) {
+    char* bytes = arena.allocate(name_length + value_length);
+    std::memcpy(bytes, name, name_length);
+    std::memcpy(bytes + name_length, value, value_length);
+
+    HeaderField field;
+    field.name_ = bytes;
+    field.name_length_ = name_length;
+    field.value_ = bytes + name_length;
+    field.value_length_ = value_length;
+    field.known_ = find_known_header(name, name_length);
+    fields_.push_back(field);
+
+    // A repeated header replaces the earlier one for lookups
+    if (field.known_ != codes::HEADER_OTHER) {
+        known_fields_[field.known_] = fields_.size();
+    }
+}
+
+bool HttpRequest::has_header(codes::KnownHeader header) const {
+    return known_fields_[header] != 0;
+}
+
+std::string HttpRequest::get_header(codes::KnownHeader header) const {
+    if (!known_fields_[header]) {
+        return "";
+    }
+    const HeaderField& field = fields_[known_fields_[header] - 1];
+    return std::string(field_value(field), field.value_length_);
+}
+
 std::string HttpRequest::get_header(const std::string& name) const {
-    // Case-insensitive lookup for headers
     std::string lower_name = name;
     for (size_t i = 0; i < lower_name.size(); ++i) {
         lower_name[i] = std::tolower(static_cast<unsigned char>(lower_name[i]));
     }
 
-    std::map<std::string, std::string>::const_iterator it =
-        headers_.find(lower_name);
-    if (it != headers_.end()) {
-        log(LOG_TRACE, "Request header retrieved: '%s: %s'", lower_name.c_str(),
-            it->second.c_str());
-        return it->second;
+    codes::KnownHeader known =
+        find_known_header(lower_name.data(), lower_name.size());
+    if (known != codes::HEADER_OTHER) {
+        return get_header(known);
+    }
+
+    // Other headers are few, scan them from the last one
+    for (size_t i = fields_.size(); i > 0; --i) {
+        const HeaderField& field = fields_[i - 1];
+        if (field.name_length_ == lower_name.size() &&
+            std::memcmp(field_name(field), lower_name.data(),
+                        lower_name.size()) == 0) {
+            return std::string(field_value(field), field.value_length_);
+        }
     }
     log(LOG_DEBUG, "Request header '%s' not found", lower_name.c_str());
     return "";
 }
 
-void HttpRequest::set_header(const std::string& name,
-                             const std::string& value) {
-    // Case-insensitive lookup for headers
-    std::string lower_name = name;
-    for (size_t i = 0; i < lower_name.size(); ++i) {
-        lower_name[i] = std::tolower(static_cast<unsigned char>(lower_name[i]));
+bool HttpRequest::header_equals(codes::KnownHeader header,
+                                const char* value) const {
+    if (!known_fields_[header]) {
+        return false;
+    }
+    const HeaderField& field = fields_[known_fields_[header] - 1];
+    return field.value_length_ == std::strlen(value) &&
+           equals_ignore_case(field_value(field), value, field.value_length_);
+}
+
+bool HttpRequest::header_contains(codes::KnownHeader header,
+                                  const char* token) const {
+    if (!known_fields_[header]) {
+        return false;
     }
+    const HeaderField& field = fields_[known_fields_[header] - 1];
+    const char* value = field_value(field);
+    size_t token_length = std::strlen(token);
+    for (size_t i = 0; i + token_length <= field.value_length_; ++i) {
+        if (equals_ignore_case(value + i, token, token_length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* HttpRequest::field_name(const HeaderField& field) const {
+    return field.name_;
+}
 
-    headers_[lower_name] = value;
-    log(LOG_TRACE, "Request header set: '%s: %s'", lower_name.c_str(),
-        value.c_str());
+const char* HttpRequest::field_value(const HeaderField& field) const {
+    return field.value_;
 }
 
 void HttpRequest::clear() {
     method_.clear();
+    method_type_ = codes::METHOD_UNKNOWN;
     uri_.clear();
     version_.clear();
-    headers_.clear();
+    fields_.clear();
+    std::fill(known_fields_, known_fields_ + codes::HEADER_COUNT, 0);
     body_.clear();
     path_.clear();
     query_string_.clear();
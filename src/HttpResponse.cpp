@@ -1,6 +1,123 @@
 #include "webserv.hpp"
 
-HttpResponse::HttpResponse() : status_code_(codes::OK), content_length_(0) {
+static const struct {
+    int code;
+    const char* reason;
+} STATUS_REASONS[] = {
+    // 1xx - Informational
+    {100, "Continue"},
+
+    // 2xx - Success
+    {200, "OK"},
+    {201, "Created"},
+    {204, "No Content"},
+    {206, "Partial Content"},
+
+    // 3xx - Redirection
+    {301, "Moved Permanently"},
+    {302, "Found"},
+    {303, "See Other"},
+    {304, "Not Modified"},
+    {307, "Temporary Redirect"},
+    {308, "Permanent Redirect"},
+
+    // 4xx - Client Error
+    {400, "Bad Request"},
+    {401, "Unauthorized"},
+    {403, "Forbidden"},
+    {404, "Not Found"},
+    {405, "Method Not Allowed"},
+    {406, "Not Acceptable"},
+    {408, "Request Timeout"},
+    {409, "Conflict"},
+    {413, "Payload Too Large"},
+    {414, "URI Too Long"},
+    {415, "Unsupported Media Type"},
+    {417, "Expectation Failed"},
+    {429, "Too Many Requests"},
+    {431, "Request Header Fields Too Large"},
+
+    // 5xx - Server Error
+    {500, "Internal Server Error"},
+    {501, "Not Implemented"},
+    {502, "Bad Gateway"},
+    {503, "Service Unavailable"},
+    {504, "Gateway Timeout"},
+    {505, "HTTP Version Not Supported"},
+    {507, "Insufficient Storage"},
+};
+
+static const int MAX_STATUS_CODE = 599;
+
+// STATUS_REASONS indexed by code, filled before main()
+static struct StatusTable {
+    const char* reasons_[MAX_STATUS_CODE + 1];
+
+    StatusTable() {
+        for (int code = 0; code <= MAX_STATUS_CODE; ++code) {
+            reasons_[code] = "Unknown Status";
+        }
+        for (size_t i = 0; i < sizeof(STATUS_REASONS) / sizeof(*STATUS_REASONS);
+             ++i) {
+            reasons_[STATUS_REASONS[i].code] = STATUS_REASONS[i].reason;
+        }
+    }
+} STATUS_TABLE;
+
+const char* status_reason(int code) {
+    if (code < 0 || code > MAX_STATUS_CODE) {
+        return "Unknown Status";
+    }
+    return STATUS_TABLE.reasons_[code];
+}
+
+static std::string cached_date;
+static time_t cached_date_second = -1;
+
+const std::string& http_date() {
+    if (cached_date_second == -1) {
+        refresh_http_date(time(NULL));
+    }
+    return cached_date;
+}
+
+void refresh_http_date(time_t now) {
+    if (now == cached_date_second) {
+        return;
+    }
+    char buffer[64];
+    struct tm tm_info;
+    gmtime_r(&now, &tm_info);
+    size_t length = strftime(buffer, sizeof(buffer),
+                             "%a, %d %b %Y %H:%M:%S GMT", &tm_info);
+    cached_date.assign(buffer, length);
+    cached_date_second = now;
+}
+
+static bool name_equals(const std::string& name, const char* other) {
+    return strcasecmp(name.c_str(), other) == 0;
+}
+
+static void append(IoBuffer& out, const char* data, size_t length) {
+    out.insert(out.end(), data, data + length);
+}
+
+static void append(IoBuffer& out, const std::string& str) {
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+static void append_number(IoBuffer& out, size_t number) {
+    char digits[24];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number);
+    append(out, digits + pos, sizeof(digits) - pos);
+}
+
+HttpResponse::HttpResponse()
+    : status_code_(codes::OK), content_length_(0), has_content_length_(false) {
     version_ = "HTTP/1.1";
 }
 
@@ -8,83 +125,108 @@ HttpResponse::~HttpResponse() {}
 
 void HttpResponse::set_header(const std::string& name,
                               const std::string& value) {
-    // Case-insensitive lookup for headers
-    std::string lower_name = name;
-    for (size_t i = 0; i < lower_name.size(); ++i) {
-        lower_name[i] = std::tolower(static_cast<unsigned char>(lower_name[i]));
+    if (name_equals(name, "content-type")) {
+        content_type_ = value;
+        return;
+    }
+    if (name_equals(name, "content-length")) {
+        content_length_ = std::strtoul(value.c_str(), NULL, 10);
+        has_content_length_ = true;
+        return;
     }
 
-    headers_[lower_name] = value;
-
-    log(LOG_TRACE, "Response header set: '%s: %s'", lower_name.c_str(),
-        value.c_str());
+    for (size_t i = 0; i < headers_.size(); ++i) {
+        if (name_equals(headers_[i].name_, name.c_str())) {
+            headers_[i].value_ = value;
+            return;
+        }
+    }
+    headers_.resize(headers_.size() + 1);
+    headers_.back().name_ = name;
+    headers_.back().value_ = value;
 }
 
 void HttpResponse::set_status(int code) {
     status_code_ = code;
-    status_message_ = get_status_message(code);
-
-    log(LOG_TRACE, "Response status set: %d %s", status_code_,
-        status_message_.c_str());
+    status_message_ = status_reason(code);
 }
 
 std::string HttpResponse::get_header(const std::string& name) const {
-    // Case-insensitive lookup for headers
-    std::string lower_name = name;
-    for (size_t i = 0; i < lower_name.size(); ++i) {
-        lower_name[i] = std::tolower(static_cast<unsigned char>(lower_name[i]));
+    if (name_equals(name, "content-type")) {
+        return content_type_;
     }
-
-    std::map<std::string, std::string>::const_iterator it =
-        headers_.find(lower_name);
-    if (it != headers_.end()) {
-        log(LOG_DEBUG, "Response header retrieved: '%s: %s'",
-            lower_name.c_str(), it->second.c_str());
-        return it->second;
+    if (name_equals(name, "content-length")) {
+        if (!has_content_length_) {
+            return "";
+        }
+        std::ostringstream oss;
+        oss << content_length_;
+        return oss.str();
     }
-    log(LOG_DEBUG, "Response header '%s' not found", lower_name.c_str());
-    return "";
-}
-
-std::string HttpResponse::get_status_line() const {
-    std::ostringstream oss;
-    oss << version_ << " " << status_code_ << " " << status_message_;
-
-    log(LOG_TRACE, "Response status line: %s", oss.str().c_str());
 
-    return oss.str();
+    const std::string* value = find_header(name.c_str());
+    return value ? *value : "";
 }
 
-std::string HttpResponse::get_headers_string() const {
-    std::ostringstream oss;
-
-    // Add status line
-    oss << get_status_line() << "\r\n";
-
-    // Add headers
-    for (std::map<std::string, std::string>::const_iterator it =
-             headers_.begin();
-         it != headers_.end(); ++it) {
-        oss << it->first << ": " << it->second << "\r\n";
+const std::string* HttpResponse::find_header(const char* name) const {
+    for (size_t i = 0; i < headers_.size(); ++i) {
+        if (name_equals(headers_[i].name_, name)) {
+            return &headers_[i].value_;
+        }
     }
+    return NULL;
+}
 
-    // Add Content-Type if not already set in headers
-    if (headers_.find("content-type") == headers_.end() &&
-        !content_type_.empty()) {
-        oss << "Content-Type: " << content_type_ << "\r\n";
+void HttpResponse::write_head(IoBuffer& out, bool entity_headers) const {
+    // Status line
+    append(out, version_);
+    append(out, " ", 1);
+    append_number(out, static_cast<size_t>(status_code_));
+    append(out, " ", 1);
+    const char* reason = status_reason(status_code_);
+    append(out, reason, strlen(reason));
+    append(out, CRLF, 2);
+
+    bool has_date = false;
+    bool has_server = false;
+    bool chunked = false;
+    for (size_t i = 0; i < headers_.size(); ++i) {
+        const ResponseHeader& header = headers_[i];
+        append(out, header.name_);
+        append(out, ": ", 2);
+        append(out, header.value_);
+        append(out, CRLF, 2);
+
+        has_date = has_date || name_equals(header.name_, "date");
+        has_server = has_server || name_equals(header.name_, "server");
+        chunked = chunked || name_equals(header.name_, "transfer-encoding");
     }
 
-    // Add Content-Length if not already set in headers
-    if (headers_.find("content-length") == headers_.end()) {
-        oss << "Content-Length: " << content_length_ << "\r\n";
+    if (!has_date) {
+        append(out, "Date: ", 6);
+        append(out, http_date());
+        append(out, CRLF, 2);
+    }
+    if (!has_server) {
+        static const char SERVER[] = "Server: Webserv/1.0" CRLF;
+        append(out, SERVER, sizeof(SERVER) - 1);
     }
 
-    // End of headers
-    oss << "\r\n";
-
-    log(LOG_TRACE, "Response headers string: %s", oss.str().c_str());
-
-    return oss.str();
+    if (!entity_headers) {
+        return;
+    }
+    if (!content_type_.empty()) {
+        append(out, "Content-Type: ", 14);
+        append(out, content_type_);
+        append(out, CRLF, 2);
+    }
+    // A chunked body carries its own length
+    if (!chunked) {
+        append(out, "Content-Length: ", 16);
+        append_number(out, content_length_);
+        append(out, CRLF, 2);
+    }
+    append(out, CRLF, 2);
 }
 
 void HttpResponse::clear() {
@@ -94,7 +236,6 @@ void HttpResponse::clear() {
     headers_.clear();
     body_.clear();
     content_length_ = 0;
+    has_content_length_ = false;
     content_type_.clear();
-
-    log(LOG_TRACE, "HttpResponse cleared");
-}
\ No newline at end of file
+}
@@ -0,0 +1,228 @@
+#include "webserv.hpp"
+
+LocationMatcher::Node::Node()
+    : prefix_(-1),
+      prefix_slash_(-1),
+      exact_(-1),
+      exact_slash_(-1),
+      prefix_final_(false),
+      prefix_slash_final_(false) {}
+
+LocationMatcher::LocationMatcher() : nodes_(1) {}
+
+// Compiled regexes can not be copied, copies compile their own
+LocationMatcher::LocationMatcher(const LocationMatcher& other)
+    : nodes_(other.nodes_), regexes_(other.regexes_) {
+    compile_regexes();
+}
+
+LocationMatcher& LocationMatcher::operator=(const LocationMatcher& other) {
+    if (this != &other) {
+        free_regexes();
+        nodes_ = other.nodes_;
+        regexes_ = other.regexes_;
+        compile_regexes();
+    }
+    return *this;
+}
+
+LocationMatcher::~LocationMatcher() { free_regexes(); }
+
+bool LocationMatcher::compile(const std::vector<Location>& locations) {
+    free_regexes();
+    nodes_.assign(1, Node());
+    regexes_.clear();
+
+    for (size_t i = 0; i < locations.size(); ++i) {
+        const Location& location = locations[i];
+        if (location.is_regex()) {
+            RegexLocation regex;
+            regex.pattern_ = location.path_;
+            regex.icase_ = (location.match_type_ == codes::MATCH_REGEX_ICASE);
+            regex.location_ = static_cast<int>(i);
+            regexes_.push_back(regex);
+        } else if (location.path_.empty() || location.path_[0] != '/') {
+            log(LOG_WARNING, "Location %s does not start with '/', ignored",
+                location.path_.c_str());
+        } else {
+            insert(location.path_, static_cast<int>(i), location.match_type_);
+        }
+    }
+
+    return compile_regexes();
+}
+
+int LocationMatcher::match(const std::string& path) const {
+    int best = -1;
+    bool best_final = false;
+
+    if (!path.empty() && path[0] == '/') {
+        const Node* node = &nodes_[0];
+        if (path.length() == 1 && node->exact_slash_ >= 0) {
+            return node->exact_slash_;
+        }
+        if (node->prefix_slash_ >= 0) {
+            best = node->prefix_slash_;
+            best_final = node->prefix_slash_final_;
+        }
+
+        size_t pos = 1;
+        while (pos < path.length()) {
+            size_t end = path.find('/', pos);
+            if (end == std::string::npos) {
+                end = path.length();
+            }
+
+            size_t child =
+                find_child(static_cast<size_t>(node - &nodes_[0]),
+                           path.data() + pos, end - pos);
+            if (child == npos) {
+                break;
+            }
+            node = &nodes_[child];
+
+            if (end == path.length()) {
+                // The path ends on this segment
+                if (node->exact_ >= 0) {
+                    return node->exact_;
+                }
+                if (node->prefix_ >= 0) {
+                    best = node->prefix_;
+                    best_final = node->prefix_final_;
+                }
+                break;
+            }
+
+            // The path goes on after a '/'
+            if (end + 1 == path.length() && node->exact_slash_ >= 0) {
+                return node->exact_slash_;
+            }
+            if (node->prefix_ >= 0) {
+                best = node->prefix_;
+                best_final = node->prefix_final_;
+            }
+            if (node->prefix_slash_ >= 0) {
+                best = node->prefix_slash_;
+                best_final = node->prefix_slash_final_;
+            }
+            pos = end + 1;
+        }
+    }
+
+    if (best_final) {
+        return best;
+    }
+    for (size_t i = 0; i < compiled_.size(); ++i) {
+        if (regexec(&compiled_[i], path.c_str(), 0, NULL, 0) == 0) {
+            return regexes_[i].location_;
+        }
+    }
+    return best;
+}
+
+bool LocationMatcher::EdgeLess::operator()(
+    const Edge& edge, const std::pair<const char*, size_t>& segment) const {
+    if (edge.segment_.length() != segment.second) {
+        return edge.segment_.length() < segment.second;
+    }
+    return std::memcmp(edge.segment_.data(), segment.first, segment.second) <
+           0;
+}
+
+size_t LocationMatcher::find_child(size_t node, const char* segment,
+                                   size_t length) const {
+    const std::vector<Edge>& children = nodes_[node].children_;
+    std::pair<const char*, size_t> key(segment, length);
+    std::vector<Edge>::const_iterator it = std::lower_bound(
+        children.begin(), children.end(), key, EdgeLess());
+    if (it == children.end() || it->segment_.length() != length ||
+        std::memcmp(it->segment_.data(), segment, length) != 0) {
+        return npos;
+    }
+    return it->node_;
+}
+
+void LocationMatcher::insert(const std::string& path, int location,
+                             codes::LocationMatch type) {
+    bool trailing_slash = (path[path.length() - 1] == '/');
+    size_t node = 0;
+
+    // Walk (and create) one node per segment
+    size_t pos = 1;
+    size_t length = trailing_slash ? path.length() - 1 : path.length();
+    while (pos <= length && length > 0) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos || end > length) {
+            end = length;
+        }
+        size_t child = find_child(node, path.data() + pos, end - pos);
+        if (child == npos) {
+            Edge edge;
+            edge.segment_ = path.substr(pos, end - pos);
+            edge.node_ = nodes_.size();
+            std::vector<Edge>& children = nodes_[node].children_;
+            children.insert(
+                std::lower_bound(children.begin(), children.end(),
+                                 std::make_pair(edge.segment_.data(),
+                                                edge.segment_.length()),
+                                 EdgeLess()),
+                edge);
+            child = edge.node_;
+            nodes_.push_back(Node());
+        }
+        node = child;
+        pos = end + 1;
+    }
+
+    Node& target = nodes_[node];
+    int* slot;
+    bool* final_flag = NULL;
+    if (type == codes::MATCH_EXACT) {
+        slot = trailing_slash ? &target.exact_slash_ : &target.exact_;
+    } else if (trailing_slash) {
+        slot = &target.prefix_slash_;
+        final_flag = &target.prefix_slash_final_;
+    } else {
+        slot = &target.prefix_;
+        final_flag = &target.prefix_final_;
+    }
+
+    if (*slot >= 0) {
+        log(LOG_WARNING, "Duplicate location %s, keeping the first one",
+            path.c_str());
+        return;
+    }
+    *slot = location;
+    if (final_flag) {
+        *final_flag = (type == codes::MATCH_PREFIX_NO_REGEX);
+    }
+}
+
+bool LocationMatcher::compile_regexes() {
+    compiled_.resize(regexes_.size());
+    for (size_t i = 0; i < regexes_.size(); ++i) {
+        int flags = REG_EXTENDED | REG_NOSUB;
+        if (regexes_[i].icase_) {
+            flags |= REG_ICASE;
+        }
+        int error =
+            regcomp(&compiled_[i], regexes_[i].pattern_.c_str(), flags);
+        if (error != 0) {
+            char message[256];
+            regerror(error, &compiled_[i], message, sizeof(message));
+            log(LOG_ERROR, "Invalid location regex '%s': %s",
+                regexes_[i].pattern_.c_str(), message);
+            // Only the ones compiled so far need to be freed
+            compiled_.resize(i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void LocationMatcher::free_regexes() {
+    for (size_t i = 0; i < compiled_.size(); ++i) {
+        regfree(&compiled_[i]);
+    }
+    compiled_.clear();
+}
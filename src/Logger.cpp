@@ -12,14 +12,22 @@ void print_request(const Connection* conn) {
     std::cout << "uri: " << conn->request_data_->uri_ << std::endl;
     std::cout << "version: " << conn->request_data_->version_ << std::endl;
     std::cout << "headers: " << std::endl;
-    for (std::map<std::string, std::string>::const_iterator it =
-             conn->request_data_->headers_.begin();
-         it != conn->request_data_->headers_.end(); ++it) {
-        std::cout << "  " << it->first << ": " << it->second << std::endl;
+    const HttpRequest* request = conn->request_data_;
+    for (size_t i = 0; i < request->fields_.size(); ++i) {
+        const HeaderField& field = request->fields_[i];
+        std::cout << "  ";
+        std::cout.write(request->field_name(field), field.name_length_);
+        std::cout << ": ";
+        std::cout.write(request->field_value(field), field.value_length_);
+        std::cout << std::endl;
     }
     std::cout << "body: " << std::endl;
-    std::cout.write(conn->request_data_->body_.data(),
-                    conn->request_data_->body_.size());
+    const RequestBody& body = conn->request_data_->body_;
+    if (body.in_memory()) {
+        std::cout.write(body.data(), body.size());
+    } else {
+        std::cout << "(" << body.size() << " bytes spooled to a file)";
+    }
     std::cout << "Parse status: " << conn->parse_status_ << std::endl;
     std::cout << "\n====================================\n" << std::endl;
 }
@@ -34,10 +42,14 @@ void print_response(const Connection* conn) {
     std::cout << "Status: " << conn->response_data_->status_code_ << " "
               << conn->response_data_->status_message_ << std::endl;
     std::cout << "Headers: ";
-    for (std::map<std::string, std::string>::const_iterator it =
-             conn->response_data_->headers_.begin();
-         it != conn->response_data_->headers_.end(); ++it) {
-        std::cout << it->first << "=" << it->second << "; ";
+    const HttpResponse* resp = conn->response_data_;
+    if (!resp->content_type_.empty()) {
+        std::cout << "Content-Type=" << resp->content_type_ << "; ";
+    }
+    std::cout << "Content-Length=" << resp->content_length_ << "; ";
+    for (size_t i = 0; i < resp->headers_.size(); ++i) {
+        std::cout << resp->headers_[i].name_ << "=" << resp->headers_[i].value_
+                  << "; ";
     }
     std::cout << std::endl;
     std::cout << "Body size: " << conn->response_data_->body_.size() << " bytes"
@@ -99,6 +111,10 @@ void print_virtual_server(const VirtualServer& virtual_server) {
     }
     std::cout << std::endl;
 
+    std::cout << "Keep-Alive: " << virtual_server.keepalive_timeout_ << "s, "
+              << virtual_server.keepalive_requests_ << " requests"
+              << std::endl;
+
     // Print error pages
     std::cout << "Error Pages:" << std::endl;
     if (virtual_server.error_pages_.empty()) {
@@ -124,22 +140,15 @@ void print_virtual_server(const VirtualServer& virtual_server) {
         std::cout << "    autoindex: " << (loc.autoindex_ ? "on" : "off")
                   << std::endl;
 
-        std::cout << "    allowed_methods: ";
-        for (size_t j = 0; j < loc.allowed_methods_.size(); ++j) {
-            std::cout << loc.allowed_methods_[j];
-            if (j < loc.allowed_methods_.size() - 1) {
-                std::cout << ", ";
-            }
-        }
-        std::cout << std::endl;
+        std::cout << "    allowed_methods: " << loc.allow_header_ << std::endl;
 
         std::cout << "    cgi: " << (loc.cgi_enabled_ ? "on" : "off")
                   << std::endl;
 
         std::cout << "    index: " << loc.index_ << std::endl;
 
-        if (!loc.redirect_.empty()) {
-            std::cout << "    redirect: " << loc.redirect_ << std::endl;
+        if (!loc.return_.empty()) {
+            std::cout << "    return: " << loc.return_ << std::endl;
         }
     }
 
@@ -190,13 +199,12 @@ void build_mock_response(Connection* conn) {
     mock_response->body_.assign(hello_str.begin(), hello_str.end());
 }
 
-std::string get_current_gmt_time() {
-    char buffer[100];
+size_t get_current_gmt_time(char* buffer, size_t size) {
     time_t now = time(NULL);
-    struct tm* tm_info = gmtime(&now);
+    struct tm tm_info;
+    gmtime_r(&now, &tm_info);
 
-    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S: ", tm_info);
-    return std::string(buffer);
+    return strftime(buffer, size, "%a, %d %b %Y %H:%M:%S: ", &tm_info);
 }
 
 int log(log_level level, const char* msg, ...) {
@@ -211,7 +219,9 @@ int log(log_level level, const char* msg, ...) {
     va_start(args, msg);
     n = vsnprintf(output, 8192, msg, args);
 
-    std::string timestamp = get_current_gmt_time();
+    // On the stack, logging does not allocate
+    char timestamp[64];
+    get_current_gmt_time(timestamp, sizeof(timestamp));
 
     if (level == LOG_TRACE)
         std::cerr << WHITE << "[TRACE]\t";
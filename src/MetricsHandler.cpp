@@ -0,0 +1,76 @@
+#include "webserv.hpp"
+
+MetricsHandler::MetricsHandler() {}
+
+MetricsHandler::~MetricsHandler() {}
+
+void MetricsHandler::handle(Connection* conn) {
+    log(LOG_DEBUG, "MetricsHandler: Processing client_fd %d",
+        conn->client_fd_);
+
+    if (!(conn->request_data_->method_type_ &
+          (codes::METHOD_GET | codes::METHOD_HEAD))) {
+        ErrorHandler::generate_error_response(conn,
+                                              codes::METHOD_NOT_ALLOWED);
+        conn->response_data_->set_header("Allow", "GET, HEAD");
+        return;
+    }
+
+    WebServer* server = WebServer::get_instance();
+    std::ostringstream out;
+
+    const ConnectionManager* connections = server->get_conn_manager();
+    out << "webserv_active_connections "
+        << connections->get_active_connection_count() << "\n";
+    out << "webserv_idle_connections "
+        << connections->get_parked_connection_count() << "\n";
+    out << "webserv_connection_limit " << connections->get_connection_limit()
+        << "\n";
+
+    for (size_t i = 0; i < BufferPool::CLASS_COUNT; ++i) {
+        BufferPool::ClassStats pool = BufferPool::class_stats(i);
+        std::ostringstream labels;
+        labels << "{size=\"" << pool.block_size_ << "\"}";
+        out << "webserv_buffer_pool_slabs" << labels.str() << " "
+            << pool.slabs_ << "\n";
+        out << "webserv_buffer_pool_blocks_in_use" << labels.str() << " "
+            << pool.in_use_ << "\n";
+        out << "webserv_buffer_pool_blocks_free" << labels.str() << " "
+            << pool.free_ << "\n";
+    }
+    out << "webserv_buffer_pool_oversized_in_use "
+        << BufferPool::oversized_in_use() << "\n";
+
+    const std::map<std::string, Upstream>& upstreams = server->get_upstreams();
+    for (std::map<std::string, Upstream>::const_iterator it =
+             upstreams.begin();
+         it != upstreams.end(); ++it) {
+        const std::vector<UpstreamServer>& servers = it->second.servers_;
+        for (size_t i = 0; i < servers.size(); ++i) {
+            const UpstreamServer& backend = servers[i];
+            std::string labels = "{upstream=\"" + it->first +
+                                 "\",server=\"" + backend.address_ + "\"}";
+
+            out << "webserv_upstream_inflight" << labels << " "
+                << backend.inflight_ << "\n";
+            out << "webserv_upstream_latency_ewma_ms" << labels << " "
+                << backend.ewma_ms_ << "\n";
+            out << "webserv_upstream_requests_total" << labels << " "
+                << backend.requests_ << "\n";
+            out << "webserv_upstream_failures_total" << labels << " "
+                << backend.failures_ << "\n";
+            out << "webserv_upstream_healthy" << labels << " "
+                << (backend.healthy_ ? 1 : 0) << "\n";
+            out << "webserv_upstream_idle_connections" << labels << " "
+                << backend.idle_connections_.size() << "\n";
+        }
+    }
+
+    std::string body = out.str();
+    conn->response_data_->status_code_ = 200;
+    conn->response_data_->status_message_ = "OK";
+    conn->response_data_->set_header("Content-Type", "text/plain");
+    conn->response_data_->body_.assign(body.begin(), body.end());
+    conn->response_data_->content_length_ = body.size();
+    conn->conn_state_ = codes::CONN_WRITING;
+}
@@ -0,0 +1,271 @@
+#include "webserv.hpp"
+
+const size_t MultipartParser::npos;
+const size_t MultipartParser::MAX_BOUNDARY_LENGTH;
+const size_t MultipartParser::MAX_PART_HEADERS;
+
+// Bytes allowed between a boundary and its CRLF
+static const size_t MAX_BOUNDARY_TAIL = 64;
+
+MultipartParser::MultipartParser()
+    : state_(codes::MULTIPART_ERROR), sink_(NULL), file_parts_(0) {
+    std::fill(skip_, skip_ + 256, 0);
+}
+
+bool MultipartParser::reset(const std::string& boundary, MultipartSink* sink) {
+    state_ = codes::MULTIPART_ERROR;
+    if (boundary.empty() || boundary.size() > MAX_BOUNDARY_LENGTH ||
+        boundary.find_first_of(CRLF) != std::string::npos) {
+        log(LOG_ERROR, "Invalid multipart boundary: '%s'", boundary.c_str());
+        return false;
+    }
+
+    sink_ = sink;
+    delimiter_ = CRLF "--" + boundary;
+    headers_.clear();
+    file_parts_ = 0;
+
+    // Horspool: on a mismatch, shift so the byte under the delimiter's last
+    // position lines up with its last occurrence before that position
+    size_t last = delimiter_.size() - 1;
+    std::fill(skip_, skip_ + 256, delimiter_.size());
+    for (size_t i = 0; i < last; ++i) {
+        skip_[static_cast<unsigned char>(delimiter_[i])] = last - i;
+    }
+
+    // The first boundary may open the body without a CRLF before it
+    held_ = CRLF;
+    state_ = codes::MULTIPART_PREAMBLE;
+    return true;
+}
+
+bool MultipartParser::feed(const char* data, size_t length) {
+    while (length > 0 && state_ != codes::MULTIPART_DONE &&
+           state_ != codes::MULTIPART_ERROR) {
+        size_t used = 0;
+        switch (state_) {
+            case codes::MULTIPART_PREAMBLE:
+            case codes::MULTIPART_DATA:
+                used = parse_content(data, length);
+                break;
+            case codes::MULTIPART_BOUNDARY_TAIL:
+                used = parse_boundary_tail(data, length);
+                break;
+            case codes::MULTIPART_HEADERS:
+                used = parse_headers(data, length);
+                break;
+            default:
+                used = length;
+                break;
+        }
+        data += used;
+        length -= used;
+    }
+    return state_ != codes::MULTIPART_ERROR;
+}
+
+bool MultipartParser::finished() const {
+    return state_ == codes::MULTIPART_DONE;
+}
+
+bool MultipartParser::failed() const {
+    return state_ == codes::MULTIPART_ERROR;
+}
+
+size_t MultipartParser::file_parts() const { return file_parts_; }
+
+size_t MultipartParser::find_delimiter(const char* data, size_t length) const {
+    const size_t size = delimiter_.size();
+    if (length < size) {
+        return npos;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    const char* wanted = delimiter_.data();
+    const size_t last = size - 1;
+    const unsigned char last_byte = static_cast<unsigned char>(wanted[last]);
+
+    for (size_t pos = 0; pos <= length - size;) {
+        unsigned char byte = bytes[pos + last];
+        if (byte == last_byte && std::memcmp(data + pos, wanted, last) == 0) {
+            return pos;
+        }
+        pos += skip_[byte];
+    }
+    return npos;
+}
+
+// Content of a part, or the preamble. Returns the bytes of data used, 0 when
+// only the held bytes were settled.
+size_t MultipartParser::parse_content(const char* data, size_t length) {
+    const size_t size = delimiter_.size();
+
+    if (!held_.empty()) {
+        // A delimiter starting in the held bytes ends within the next
+        // delimiter length of data
+        size_t taken = std::min(length, size);
+        std::string window = held_ + std::string(data, taken);
+        size_t held = held_.size();
+        size_t found = window.find(delimiter_);
+        held_.clear();
+
+        if (found != std::string::npos) {
+            if (!emit(window.data(), found) || !end_content()) {
+                return length;
+            }
+            return found + size - held;
+        }
+        if (taken == length) {
+            // Still undecided, hold on to what may start a delimiter
+            size_t keep = std::min(window.size(), size - 1);
+            held_ = window.substr(window.size() - keep);
+            emit(window.data(), window.size() - keep);
+            return length;
+        }
+        // What was held is content, data is scanned on its own next
+        emit(window.data(), held);
+        return 0;
+    }
+
+    size_t found = find_delimiter(data, length);
+    if (found != npos) {
+        if (!emit(data, found) || !end_content()) {
+            return length;
+        }
+        return found + size;
+    }
+
+    // The end of data may be the start of a delimiter
+    size_t keep = std::min(length, size - 1);
+    if (emit(data, length - keep)) {
+        held_.assign(data + length - keep, keep);
+    }
+    return length;
+}
+
+bool MultipartParser::emit(const char* data, size_t length) {
+    if (state_ != codes::MULTIPART_DATA || length == 0) {
+        return state_ != codes::MULTIPART_ERROR;  // Preamble is dropped
+    }
+    if (!sink_->part_data(data, length)) {
+        return fail("part content not stored");
+    }
+    return true;
+}
+
+bool MultipartParser::end_content() {
+    if (state_ == codes::MULTIPART_DATA && !sink_->end_part()) {
+        return fail("part not stored");
+    }
+    headers_.clear();
+    state_ = codes::MULTIPART_BOUNDARY_TAIL;
+    return true;
+}
+
+// After a boundary: "--" closes the body, otherwise optional whitespace and
+// a CRLF start the next part's headers
+size_t MultipartParser::parse_boundary_tail(const char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        char c = data[i];
+        headers_ += c;
+
+        if (headers_ == "--") {
+            state_ = codes::MULTIPART_DONE;
+            return i + 1;
+        }
+        if (headers_ == "-") {
+            continue;
+        }
+        if (c == '\n' && headers_.size() >= 2 &&
+            headers_[headers_.size() - 2] == '\r') {
+            // The part may have no headers at all, so the CRLF is kept:
+            // the empty line ending them is then always found as CRLFCRLF
+            headers_ = CRLF;
+            state_ = codes::MULTIPART_HEADERS;
+            return i + 1;
+        }
+        if ((c != ' ' && c != '\t' && c != '\r') || headers_[0] == '-' ||
+            (headers_.size() >= 2 && headers_[headers_.size() - 2] == '\r') ||
+            headers_.size() > MAX_BOUNDARY_TAIL) {
+            fail("unexpected bytes after a boundary");
+            return length;
+        }
+    }
+    return length;
+}
+
+size_t MultipartParser::parse_headers(const char* data, size_t length) {
+    size_t old_size = headers_.size();
+    size_t room = MAX_PART_HEADERS + 4 - std::min(old_size, MAX_PART_HEADERS);
+    size_t taken = std::min(length, room);
+    headers_.append(data, taken);
+
+    // The empty line may have started in an earlier piece
+    size_t end = headers_.find(CRLF CRLF, old_size >= 3 ? old_size - 3 : 0);
+    if (end == std::string::npos) {
+        if (headers_.size() > MAX_PART_HEADERS) {
+            fail("part headers too long");
+        }
+        return taken;
+    }
+
+    headers_.resize(end);
+    std::string filename = extract_filename(headers_);
+    if (!filename.empty()) {
+        file_parts_++;
+    }
+    if (!sink_->begin_part(filename)) {
+        fail("part not accepted");
+        return length;
+    }
+    state_ = codes::MULTIPART_DATA;
+    return end + 4 - old_size;
+}
+
+std::string MultipartParser::extract_filename(const std::string& headers) {
+    std::string lower = headers;
+    for (size_t i = 0; i < lower.size(); ++i) {
+        lower[i] = std::tolower(static_cast<unsigned char>(lower[i]));
+    }
+
+    size_t line = lower.find("\r\ncontent-disposition:");
+    if (line == std::string::npos) {
+        return "";
+    }
+    size_t line_end = lower.find(CRLF, line + 2);
+    if (line_end == std::string::npos) {
+        line_end = lower.size();
+    }
+
+    // "filename=" on its own, not the end of another parameter's name
+    size_t pos = line;
+    while ((pos = lower.find("filename=", pos + 1)) < line_end) {
+        char before = lower[pos - 1];
+        if (before == ';' || before == ' ' || before == '\t') {
+            break;
+        }
+    }
+    if (pos >= line_end) {
+        return "";
+    }
+    pos += 9;  // Length of "filename="
+
+    if (pos < line_end && headers[pos] == '"') {
+        size_t quote = headers.find('"', pos + 1);
+        if (quote == std::string::npos || quote > line_end) {
+            return "";
+        }
+        return headers.substr(pos + 1, quote - pos - 1);
+    }
+    size_t value_end = headers.find_first_of("; \t\r", pos);
+    if (value_end == std::string::npos || value_end > line_end) {
+        value_end = line_end;
+    }
+    return headers.substr(pos, value_end - pos);
+}
+
+bool MultipartParser::fail(const char* reason) {
+    log(LOG_ERROR, "Malformed multipart body: %s", reason);
+    state_ = codes::MULTIPART_ERROR;
+    return false;
+}
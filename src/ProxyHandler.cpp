@@ -0,0 +1,868 @@
+#include "webserv.hpp"
+
+// Methods a request can be sent again with once the upstream may have seen
+// it (RFC 9110 9.2.2)
+static const unsigned int IDEMPOTENT_METHODS =
+    codes::METHOD_GET | codes::METHOD_HEAD | codes::METHOD_PUT |
+    codes::METHOD_DELETE | codes::METHOD_OPTIONS;
+
+// Headers that only describe a single connection and are never forwarded
+static bool is_hop_by_hop_header(const std::string& name) {
+    return name == "connection" || name == "keep-alive" ||
+           name == "proxy-connection" || name == "te" || name == "trailer" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+static std::string to_lower(const std::string& str) {
+    std::string lower = str;
+    for (size_t i = 0; i < lower.size(); ++i) {
+        lower[i] = std::tolower(static_cast<unsigned char>(lower[i]));
+    }
+    return lower;
+}
+
+static size_t pending_client_bytes(const Connection* conn) {
+    return conn->write_buffer_.size() - conn->write_buffer_offset_;
+}
+
+ProxyHandler::ProxyHandler() {}
+
+ProxyHandler::~ProxyHandler() {}
+
+void ProxyHandler::handle(Connection* conn) {
+    log(LOG_DEBUG, "ProxyHandler: Processing client_fd %d, state %d",
+        conn->client_fd_, conn->proxy_handler_state_);
+
+    switch (conn->proxy_handler_state_) {
+        case codes::PROXY_HANDLER_IDLE:
+            start_exchange(conn);
+            break;
+        case codes::PROXY_HANDLER_CONNECTING:
+            check_upstream_connect(conn);
+            break;
+        case codes::PROXY_HANDLER_SENDING_REQUEST:
+            send_upstream_request(conn);
+            break;
+        case codes::PROXY_HANDLER_READING_HEADERS:
+            read_upstream_headers(conn);
+            break;
+        case codes::PROXY_HANDLER_STREAMING_BODY:
+            stream_upstream_body(conn);
+            break;
+        case codes::PROXY_HANDLER_COMPLETE:
+        case codes::PROXY_HANDLER_ERROR:
+            break;
+    }
+}
+
+//--------------------------------------
+// Request side
+//--------------------------------------
+
+void ProxyHandler::start_exchange(Connection* conn) {
+    conn->upstream_ = conn->location_match_->upstream_;
+    if (!conn->upstream_) {
+        log(LOG_FATAL, "No upstream resolved for proxied location %s",
+            conn->location_match_->path_.c_str());
+        fail_exchange(conn, codes::INTERNAL_SERVER_ERROR);
+        return;
+    }
+
+    build_upstream_request(conn);
+
+    // Nothing to send to the client until the upstream responds
+    WebServer::update_epoll_events(conn->client_fd_, 0);
+
+    if (!open_upstream_connection(conn)) {
+        fail_exchange(conn, codes::BAD_GATEWAY);
+        return;
+    }
+
+    // A pooled connection is already established, no need to wait for
+    // the connect to complete
+    if (conn->proxy_handler_state_ == codes::PROXY_HANDLER_SENDING_REQUEST) {
+        send_upstream_request(conn);
+    }
+}
+
+bool ProxyHandler::open_upstream_connection(Connection* conn) {
+    // Each server of the upstream is tried at most once per request
+    while (conn->upstream_attempts_ < conn->upstream_->servers_.size()) {
+        conn->upstream_server_ = conn->upstream_->select_server();
+        conn->upstream_attempts_++;
+
+        if (connect_to_server(conn)) {
+            return true;
+        }
+        conn->upstream_->report_failure(conn->upstream_server_);
+        end_upstream_request(conn);
+    }
+    return false;
+}
+
+bool ProxyHandler::connect_to_server(Connection* conn) {
+    bool reused = false;
+    int fd = conn->upstream_server_->acquire_connection(reused);
+    if (fd < 0) {
+        return false;
+    }
+
+    // EPOLLOUT reports both connect completion and send buffer space
+    if (!WebServer::register_epoll_events(fd, EPOLLOUT)) {
+        close(fd);
+        return false;
+    }
+    WebServer::register_active_pipe(fd, conn);
+
+    conn->upstream_fd_ = fd;
+    conn->upstream_reused_ = reused;
+    conn->upstream_request_offset_ = 0;
+    conn->upstream_started_ms_ = Upstream::monotonic_ms();
+    conn->proxy_handler_state_ = reused ? codes::PROXY_HANDLER_SENDING_REQUEST
+                                        : codes::PROXY_HANDLER_CONNECTING;
+
+    log(LOG_DEBUG, "Client_fd %d proxied to %s over upstream fd %d (%s)",
+        conn->client_fd_, conn->upstream_server_->address_.c_str(), fd,
+        reused ? "pooled" : "new");
+    return true;
+}
+
+void ProxyHandler::build_upstream_request(Connection* conn) {
+    const HttpRequest* request = conn->request_data_;
+    std::string& head = conn->upstream_request_;
+
+    head.clear();
+    head.append(request->method_).append(" ").append(request->uri_);
+    head.append(" HTTP/1.1" CRLF);
+
+    // Keep the client's Host so name based backends see the original site
+    head.append("Host: ");
+    head.append(request->has_header(codes::HEADER_HOST)
+                    ? request->get_header(codes::HEADER_HOST)
+                    : conn->upstream_->host_);
+    head.append(CRLF);
+
+    std::string forwarded_for;
+    for (size_t i = 0; i < request->fields_.size(); ++i) {
+        const HeaderField& field = request->fields_[i];
+        if (field.known_ == codes::HEADER_HOST ||
+            field.known_ == codes::HEADER_CONTENT_LENGTH ||
+            field.known_ == codes::HEADER_EXPECT) {
+            continue;
+        }
+        std::string name(request->field_name(field), field.name_length_);
+        if (is_hop_by_hop_header(name)) {
+            continue;
+        }
+        if (name == "x-forwarded-for") {
+            forwarded_for.assign(request->field_value(field),
+                                 field.value_length_);
+            continue;
+        }
+        head.append(name).append(": ");
+        head.append(request->field_value(field), field.value_length_);
+        head.append(CRLF);
+    }
+
+    if (!conn->remote_addr_.empty()) {
+        if (!forwarded_for.empty()) {
+            forwarded_for.append(", ");
+        }
+        forwarded_for.append(conn->remote_addr_);
+    }
+    if (!forwarded_for.empty()) {
+        head.append("X-Forwarded-For: ").append(forwarded_for).append(CRLF);
+    }
+
+    // The body was already de-chunked by the parser, always send a length
+    if (!request->body_.empty() ||
+        (request->method_type_ &
+         (codes::METHOD_POST | codes::METHOD_PUT | codes::METHOD_PATCH))) {
+        std::ostringstream length;
+        length << request->body_.size();
+        head.append("Content-Length: ").append(length.str()).append(CRLF);
+    }
+
+    head.append(CRLF);
+}
+
+void ProxyHandler::check_upstream_connect(Connection* conn) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+
+    if (getsockopt(conn->upstream_fd_, SOL_SOCKET, SO_ERROR, &error,
+                   &error_len) < 0) {
+        error = errno;
+    }
+    if (error != 0) {
+        log(LOG_ERROR, "Failed to connect to upstream %s: %s",
+            conn->upstream_server_->address_.c_str(), strerror(error));
+        retry_or_fail(conn);
+        return;
+    }
+
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_SENDING_REQUEST;
+    send_upstream_request(conn);
+}
+
+void ProxyHandler::send_upstream_request(Connection* conn) {
+    const std::string& head = conn->upstream_request_;
+    const RequestBody& body = conn->request_data_->body_;
+    size_t total = head.size() + body.size();
+
+    // Head and a body in memory go out in a single call without being
+    // copied together, a spooled body follows the head with sendfile()
+    while (conn->upstream_request_offset_ < total) {
+        struct iovec iov[2];
+        int iov_count = 0;
+        size_t offset = conn->upstream_request_offset_;
+
+        if (offset < head.size()) {
+            iov[iov_count].iov_base = const_cast<char*>(head.data() + offset);
+            iov[iov_count].iov_len = head.size() - offset;
+            iov_count++;
+            offset = 0;
+        } else {
+            offset -= head.size();
+        }
+
+        ssize_t sent;
+        if (iov_count == 0 && !body.in_memory()) {
+            sent = body.write_to(conn->upstream_fd_, offset,
+                                 body.size() - offset);
+        } else {
+            if (offset < body.size() && body.in_memory()) {
+                iov[iov_count].iov_base =
+                    const_cast<char*>(body.data() + offset);
+                iov[iov_count].iov_len = body.size() - offset;
+                iov_count++;
+            }
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count;
+            sent = sendmsg(conn->upstream_fd_, &msg, MSG_NOSIGNAL);
+        }
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;  // Resume on the next EPOLLOUT
+            }
+            log(LOG_ERROR, "Failed to send request to upstream %s: %s",
+                conn->upstream_server_->address_.c_str(), strerror(errno));
+            retry_or_fail(conn);
+            return;
+        }
+        conn->upstream_request_offset_ += sent;
+    }
+
+    log(LOG_DEBUG, "Sent %zu request bytes to upstream %s for client_fd %d",
+        total, conn->upstream_server_->address_.c_str(), conn->client_fd_);
+
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_READING_HEADERS;
+    WebServer::update_epoll_events(conn->upstream_fd_, EPOLLIN);
+}
+
+//--------------------------------------
+// Response side
+//--------------------------------------
+
+ssize_t ProxyHandler::receive_from_upstream(Connection* conn) {
+    IoBuffer& buffer = conn->upstream_buffer_;
+    size_t used = buffer.size();
+
+    buffer.resize(used + http_limits::PROXY_READ_SIZE);
+    ssize_t bytes_read = recv(conn->upstream_fd_, &buffer[used],
+                              http_limits::PROXY_READ_SIZE, 0);
+    buffer.resize(used + (bytes_read > 0 ? bytes_read : 0));
+
+    if (bytes_read > 0) {
+        conn->last_activity_ = time(NULL);
+    }
+    return bytes_read;
+}
+
+void ProxyHandler::read_upstream_headers(Connection* conn) {
+    ssize_t bytes_read = receive_from_upstream(conn);
+    if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        }
+        log(LOG_ERROR, "Failed to read response from upstream %s: %s",
+            conn->upstream_server_->address_.c_str(), strerror(errno));
+        retry_or_fail(conn);
+        return;
+    }
+    if (bytes_read == 0) {
+        log(LOG_ERROR, "Upstream %s closed the connection without a response",
+            conn->upstream_server_->address_.c_str());
+        retry_or_fail(conn);
+        return;
+    }
+
+    static const char HEAD_END[] = CRLF CRLF;
+
+    // Loop because informational responses may precede the final one
+    while (conn->proxy_handler_state_ ==
+           codes::PROXY_HANDLER_READING_HEADERS) {
+        IoBuffer& buffer = conn->upstream_buffer_;
+        IoBuffer::iterator head_end =
+            std::search(buffer.begin(), buffer.end(), HEAD_END, HEAD_END + 4);
+
+        if (head_end == buffer.end()) {
+            if (buffer.size() > http_limits::MAX_UPSTREAM_HEADER_LENGTH) {
+                log(LOG_ERROR, "Response head from upstream %s is too large",
+                    conn->upstream_server_->address_.c_str());
+                conn->upstream_->report_failure(conn->upstream_server_);
+                fail_exchange(conn, codes::BAD_GATEWAY);
+            }
+            return;  // Wait for the rest of the head
+        }
+
+        size_t head_length = (head_end - buffer.begin()) + 4;
+        if (!parse_upstream_headers(conn, head_length)) {
+            conn->upstream_->report_failure(conn->upstream_server_);
+            fail_exchange(conn, codes::BAD_GATEWAY);
+            return;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + head_length);
+    }
+
+    // Whatever followed the head already belongs to the body
+    if (!process_body_bytes(conn)) {
+        abort_exchange(conn);
+        return;
+    }
+    if (conn->proxy_handler_state_ == codes::PROXY_HANDLER_STREAMING_BODY) {
+        relay_to_client(conn);
+    }
+}
+
+bool ProxyHandler::parse_upstream_headers(Connection* conn,
+                                          size_t head_length) {
+    const IoBuffer& buffer = conn->upstream_buffer_;
+    // Drop the final empty line, every remaining line ends with CRLF
+    std::string head(buffer.begin(), buffer.begin() + head_length - 2);
+
+    // Status line: "HTTP/1.x SSS [reason]"
+    size_t line_end = head.find(CRLF);
+    std::string status_line = head.substr(0, line_end);
+    if (status_line.compare(0, 7, "HTTP/1.") != 0 ||
+        status_line.length() < 12 || status_line[8] != ' ' ||
+        !isdigit(status_line[9]) || !isdigit(status_line[10]) ||
+        !isdigit(status_line[11]) ||
+        (status_line.length() > 12 && status_line[12] != ' ')) {
+        log(LOG_ERROR, "Invalid status line from upstream %s: %s",
+            conn->upstream_server_->address_.c_str(), status_line.c_str());
+        return false;
+    }
+
+    int status = atoi(status_line.substr(9, 3).c_str());
+    std::string reason =
+        status_line.length() > 13 ? status_line.substr(13) : "";
+
+    // Informational responses are not forwarded, the final response follows
+    // on the same connection
+    if (status < 200) {
+        log(LOG_DEBUG, "Skipping informational %d response from upstream %s",
+            status, conn->upstream_server_->address_.c_str());
+        return true;
+    }
+
+    bool upstream_close = (status_line.compare(0, 8, "HTTP/1.0") == 0);
+    bool chunked = false;
+    bool has_transfer_encoding = false;
+    bool has_content_length = false;
+    size_t content_length = 0;
+    std::string forwarded;
+
+    size_t pos = line_end + 2;
+    while (pos < head.length()) {
+        size_t end = head.find(CRLF, pos);
+        std::string line = head.substr(pos, end - pos);
+        pos = end + 2;
+
+        size_t colon_pos = line.find(':');
+        if (colon_pos == std::string::npos || colon_pos == 0) {
+            log(LOG_ERROR, "Invalid header line from upstream %s: %s",
+                conn->upstream_server_->address_.c_str(), line.c_str());
+            return false;
+        }
+
+        std::string name = to_lower(line.substr(0, colon_pos));
+        std::string value = trim(line.substr(colon_pos + 1));
+
+        if (name == "connection") {
+            std::string tokens = to_lower(value);
+            if (tokens.find("close") != std::string::npos) {
+                upstream_close = true;
+            } else if (tokens.find("keep-alive") != std::string::npos) {
+                upstream_close = false;
+            }
+        } else if (name == "transfer-encoding") {
+            // Only a final "chunked" coding delimits the body
+            std::string codings = to_lower(value);
+            has_transfer_encoding = true;
+            chunked = codings.length() >= 7 &&
+                      codings.compare(codings.length() - 7, 7, "chunked") == 0;
+        } else if (name == "content-length") {
+            char* end_ptr;
+            content_length = std::strtoul(value.c_str(), &end_ptr, 10);
+            if (value.empty() || *end_ptr != '\0' || !isdigit(value[0])) {
+                log(LOG_ERROR, "Invalid Content-Length from upstream %s: %s",
+                    conn->upstream_server_->address_.c_str(), value.c_str());
+                return false;
+            }
+            has_content_length = true;
+        } else if (!is_hop_by_hop_header(name)) {
+            // Forward in the original order and spelling, repeated headers
+            // such as Set-Cookie stay separate
+            forwarded.append(line).append(CRLF);
+        }
+    }
+
+    // How the backend delimits the body
+    const HttpRequest* request = conn->request_data_;
+    conn->upstream_body_remaining_ = 0;
+    conn->upstream_chunk_state_ = codes::CHUNK_SIZE_LINE;
+    if (request->method_type_ == codes::METHOD_HEAD ||
+        status == codes::NO_CONTENT ||
+        status == codes::NOT_MODIFIED) {
+        conn->upstream_framing_ = codes::FRAMING_NONE;
+    } else if (chunked) {
+        conn->upstream_framing_ = codes::FRAMING_CHUNKED;
+    } else if (has_transfer_encoding || !has_content_length) {
+        conn->upstream_framing_ = codes::FRAMING_UNTIL_CLOSE;
+        upstream_close = true;
+    } else if (content_length == 0) {
+        conn->upstream_framing_ = codes::FRAMING_NONE;
+    } else {
+        conn->upstream_framing_ = codes::FRAMING_CONTENT_LENGTH;
+        conn->upstream_body_remaining_ = content_length;
+    }
+    conn->upstream_keep_alive_ = !upstream_close;
+
+    // How we delimit it for the client. Bodies of unknown length are
+    // re-chunked for HTTP/1.1 clients so their connection can stay open.
+    bool client_http11 = (request->version_ == "HTTP/1.1");
+    if (conn->upstream_framing_ == codes::FRAMING_NONE ||
+        conn->upstream_framing_ == codes::FRAMING_CONTENT_LENGTH) {
+        conn->client_framing_ = conn->upstream_framing_;
+    } else {
+        conn->client_framing_ =
+            client_http11 ? codes::FRAMING_CHUNKED : codes::FRAMING_UNTIL_CLOSE;
+    }
+    bool client_keep_alive =
+        conn->is_keep_alive() &&
+        conn->client_framing_ != codes::FRAMING_UNTIL_CLOSE;
+
+    std::ostringstream out;
+    out << "HTTP/1.1 " << status << " " << reason << CRLF << forwarded;
+    if (conn->client_framing_ == codes::FRAMING_CHUNKED) {
+        out << "Transfer-Encoding: chunked" CRLF;
+    } else if (has_content_length && status != codes::NO_CONTENT) {
+        // Also kept for HEAD and 304, where it describes the omitted body
+        out << "Content-Length: " << content_length << CRLF;
+    }
+    if (!client_keep_alive) {
+        out << "Connection: close" CRLF;
+        conn->response_data_->set_header("connection", "close");
+    } else if (!client_http11) {
+        out << "Connection: keep-alive" CRLF;
+    }
+    out << CRLF;
+
+    std::string response_head = out.str();
+    conn->write_buffer_.insert(conn->write_buffer_.end(),
+                               response_head.begin(), response_head.end());
+    conn->response_prepared_ = true;
+
+    // Keep the response metadata for logging and keep-alive handling
+    conn->response_data_->status_code_ = status;
+    conn->response_data_->status_message_ = reason;
+    conn->response_data_->version_ = "HTTP/1.1";
+
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_STREAMING_BODY;
+
+    // Keep a copy of the response for the response cache
+    if (conn->cache_leader_) {
+        conn->cache_capturing_ = true;
+        conn->cache_headers_ = forwarded;
+        conn->cache_body_.clear();
+    }
+
+    // Time to response head feeds the latency estimate
+    conn->upstream_->report_success(
+        conn->upstream_server_,
+        Upstream::monotonic_ms() - conn->upstream_started_ms_);
+
+    log(LOG_INFO, "Upstream %s responded %d to client_fd %d",
+        conn->upstream_server_->address_.c_str(), status, conn->client_fd_);
+    return true;
+}
+
+void ProxyHandler::stream_upstream_body(Connection* conn) {
+    // Stop reading from the backend while the client is not keeping up
+    if (pending_client_bytes(conn) <
+        http_limits::PROXY_BUFFER_HIGH_WATERMARK) {
+        ssize_t bytes_read = receive_from_upstream(conn);
+
+        if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            log(LOG_ERROR, "Failed to read body from upstream %s: %s",
+                conn->upstream_server_->address_.c_str(), strerror(errno));
+            abort_exchange(conn);
+            return;
+        }
+
+        if (bytes_read == 0) {
+            if (conn->upstream_framing_ != codes::FRAMING_UNTIL_CLOSE) {
+                log(LOG_ERROR, "Upstream %s closed the connection mid-body",
+                    conn->upstream_server_->address_.c_str());
+                abort_exchange(conn);
+                return;
+            }
+            conn->upstream_keep_alive_ = false;
+            finish_exchange(conn);
+            return;
+        }
+
+        if (bytes_read > 0 && !process_body_bytes(conn)) {
+            abort_exchange(conn);
+            return;
+        }
+    }
+
+    if (conn->proxy_handler_state_ == codes::PROXY_HANDLER_STREAMING_BODY) {
+        relay_to_client(conn);
+    }
+}
+
+bool ProxyHandler::process_body_bytes(Connection* conn) {
+    IoBuffer& buffer = conn->upstream_buffer_;
+
+    switch (conn->upstream_framing_) {
+        case codes::FRAMING_NONE:
+            break;
+        case codes::FRAMING_CONTENT_LENGTH: {
+            size_t length =
+                std::min(buffer.size(), conn->upstream_body_remaining_);
+            append_client_body(conn, buffer.data(), length);
+            buffer.erase(buffer.begin(), buffer.begin() + length);
+            conn->upstream_body_remaining_ -= length;
+            if (conn->upstream_body_remaining_ > 0) {
+                return true;
+            }
+            break;
+        }
+        case codes::FRAMING_CHUNKED:
+            if (!process_chunked_bytes(conn)) {
+                return false;
+            }
+            if (conn->upstream_chunk_state_ != codes::CHUNK_DONE) {
+                return true;
+            }
+            break;
+        case codes::FRAMING_UNTIL_CLOSE:
+            append_client_body(conn, buffer.data(), buffer.size());
+            buffer.clear();
+            return true;
+    }
+
+    // Bytes past the end of the response mean the backend is out of sync
+    if (!buffer.empty()) {
+        log(LOG_WARNING, "Upstream %s sent %zu bytes past the response end",
+            conn->upstream_server_->address_.c_str(), buffer.size());
+        conn->upstream_keep_alive_ = false;
+    }
+    finish_exchange(conn);
+    return true;
+}
+
+bool ProxyHandler::process_chunked_bytes(Connection* conn) {
+    IoBuffer& buffer = conn->upstream_buffer_;
+    size_t pos = 0;
+    bool need_more = false;
+
+    while (!need_more && pos < buffer.size() &&
+           conn->upstream_chunk_state_ != codes::CHUNK_DONE) {
+        switch (conn->upstream_chunk_state_) {
+            case codes::CHUNK_SIZE_LINE:
+            case codes::CHUNK_TRAILERS: {
+                const char* start = buffer.data() + pos;
+                const char* end = buffer.data() + buffer.size();
+                const char* line_end = std::search(start, end, CRLF, CRLF + 2);
+                if (line_end == end) {
+                    if (static_cast<size_t>(end - start) >
+                        http_limits::MAX_HEADER_VALUE_LENGTH) {
+                        log(LOG_ERROR, "Chunk line from upstream too long");
+                        return false;
+                    }
+                    need_more = true;
+                    break;
+                }
+                pos = (line_end - buffer.data()) + 2;
+
+                if (conn->upstream_chunk_state_ == codes::CHUNK_TRAILERS) {
+                    // Trailers are dropped, the empty line ends the body
+                    if (line_end == start) {
+                        conn->upstream_chunk_state_ = codes::CHUNK_DONE;
+                    }
+                    break;
+                }
+
+                // "<hex size>[;extensions]"
+                char* end_ptr;
+                size_t chunk_size = std::strtoul(start, &end_ptr, 16);
+                if (end_ptr == start || !isxdigit(*start) ||
+                    (end_ptr != line_end && *end_ptr != ';' &&
+                     *end_ptr != ' ' && *end_ptr != '\t')) {
+                    log(LOG_ERROR, "Invalid chunk size from upstream");
+                    return false;
+                }
+                conn->upstream_body_remaining_ = chunk_size;
+                conn->upstream_chunk_state_ = chunk_size == 0
+                                                  ? codes::CHUNK_TRAILERS
+                                                  : codes::CHUNK_DATA;
+                break;
+            }
+            case codes::CHUNK_DATA: {
+                size_t length = std::min(buffer.size() - pos,
+                                         conn->upstream_body_remaining_);
+                append_client_body(conn, buffer.data() + pos, length);
+                pos += length;
+                conn->upstream_body_remaining_ -= length;
+                if (conn->upstream_body_remaining_ == 0) {
+                    conn->upstream_chunk_state_ = codes::CHUNK_DATA_CRLF;
+                }
+                break;
+            }
+            case codes::CHUNK_DATA_CRLF:
+                if (buffer.size() - pos < 2) {
+                    need_more = true;
+                    break;
+                }
+                if (buffer[pos] != '\r' || buffer[pos + 1] != '\n') {
+                    log(LOG_ERROR, "Missing CRLF after chunk from upstream");
+                    return false;
+                }
+                pos += 2;
+                conn->upstream_chunk_state_ = codes::CHUNK_SIZE_LINE;
+                break;
+            case codes::CHUNK_DONE:
+                break;
+        }
+    }
+
+    buffer.erase(buffer.begin(), buffer.begin() + pos);
+    return true;
+}
+
+void ProxyHandler::append_client_body(Connection* conn, const char* data,
+                                      size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    if (conn->cache_capturing_) {
+        if (conn->cache_body_.size() + length >
+            http_limits::MAX_CACHED_RESPONSE_SIZE) {
+            // Too large to cache, stop copying
+            conn->cache_capturing_ = false;
+            std::vector<char>().swap(conn->cache_body_);
+        } else {
+            conn->cache_body_.insert(conn->cache_body_.end(), data,
+                                     data + length);
+        }
+    }
+
+    IoBuffer& out = conn->write_buffer_;
+    if (conn->client_framing_ == codes::FRAMING_CHUNKED) {
+        char size_line[32];
+        int size_length = snprintf(size_line, sizeof(size_line), "%zx" CRLF,
+                                   length);
+        out.insert(out.end(), size_line, size_line + size_length);
+        out.insert(out.end(), data, data + length);
+        out.insert(out.end(), CRLF, CRLF + 2);
+    } else {
+        out.insert(out.end(), data, data + length);
+    }
+}
+
+bool ProxyHandler::flush_to_client(Connection* conn) {
+    size_t pending = pending_client_bytes(conn);
+    if (pending == 0) {
+        return true;
+    }
+
+    // Responses to earlier pipelined requests go first
+    codes::WriteStatus held =
+        WebServer::get_instance()->get_response_writer()->send_held_responses(
+            conn);
+    if (held != codes::WRITING_SUCCESS) {
+        return held == codes::WRITING_INCOMPLETE;
+    }
+
+    ssize_t sent =
+        send(conn->client_fd_,
+             conn->write_buffer_.data() + conn->write_buffer_offset_, pending,
+             MSG_NOSIGNAL);
+    if (sent < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    conn->write_buffer_offset_ += sent;
+    conn->last_activity_ = time(NULL);
+
+    // Reclaim sent bytes so the buffer stays bounded while streaming
+    if (conn->write_buffer_offset_ == conn->write_buffer_.size()) {
+        conn->write_buffer_.clear();
+        conn->write_buffer_offset_ = 0;
+    } else if (conn->write_buffer_offset_ >= http_limits::PROXY_READ_SIZE) {
+        conn->write_buffer_.erase(
+            conn->write_buffer_.begin(),
+            conn->write_buffer_.begin() + conn->write_buffer_offset_);
+        conn->write_buffer_offset_ = 0;
+    }
+    return true;
+}
+
+void ProxyHandler::relay_to_client(Connection* conn) {
+    if (!flush_to_client(conn)) {
+        log(LOG_ERROR, "Failed to relay upstream response to client_fd %d",
+            conn->client_fd_);
+        abort_exchange(conn);
+        return;
+    }
+
+    // Wait for the client while data is queued, and only keep reading from
+    // the backend while the queue is below the high watermark
+    size_t pending = pending_client_bytes(conn);
+    uint32_t client_events = 0;
+    uint32_t upstream_events = 0;
+    if (pending > 0) {
+        client_events = EPOLLOUT;
+    }
+    if (pending < http_limits::PROXY_BUFFER_HIGH_WATERMARK) {
+        upstream_events = EPOLLIN;
+    }
+    WebServer::update_epoll_events(conn->client_fd_, client_events);
+    WebServer::update_epoll_events(conn->upstream_fd_, upstream_events);
+}
+
+//--------------------------------------
+// Completion and failure
+//--------------------------------------
+
+void ProxyHandler::finish_exchange(Connection* conn) {
+    if (conn->client_framing_ == codes::FRAMING_CHUNKED) {
+        static const char LAST_CHUNK[] = "0" CRLF CRLF;
+        conn->write_buffer_.insert(conn->write_buffer_.end(), LAST_CHUNK,
+                                   LAST_CHUNK + sizeof(LAST_CHUNK) - 1);
+    }
+
+    release_upstream(conn, conn->upstream_keep_alive_);
+    end_upstream_request(conn);
+
+    ResponseCache* cache = WebServer::get_instance()->get_response_cache();
+    if (conn->cache_capturing_) {
+        cache->complete(conn, conn->cache_headers_, conn->cache_body_);
+        conn->cache_capturing_ = false;
+        std::vector<char>().swap(conn->cache_body_);
+    } else {
+        cache->abandon(conn);
+    }
+
+    // ResponseWriter sends whatever is still queued
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_COMPLETE;
+    conn->conn_state_ = codes::CONN_WRITING;
+    WebServer::update_epoll_events(conn->client_fd_, EPOLLOUT);
+
+    log(LOG_DEBUG, "Proxied response complete for client_fd %d",
+        conn->client_fd_);
+}
+
+void ProxyHandler::retry_or_fail(Connection* conn) {
+    UpstreamServer* server = conn->upstream_server_;
+
+    // Retrying is only safe while no response bytes arrived, and for a
+    // method that is not idempotent only if nothing of the request was sent
+    // yet: the upstream may have applied it already
+    bool can_retry =
+        conn->upstream_buffer_.empty() &&
+        ((conn->request_data_->method_type_ & IDEMPOTENT_METHODS) ||
+         conn->upstream_request_offset_ == 0);
+
+    // A pooled connection may have been closed by the backend just before
+    // we reused it. That says nothing about the server's health, so retry
+    // once on a fresh connection to the same server.
+    if (can_retry && conn->upstream_reused_ && !conn->upstream_retried_) {
+        log(LOG_INFO, "Pooled connection to upstream %s went stale, retrying",
+            server->address_.c_str());
+
+        release_upstream(conn, false);
+        // The backend most likely dropped all idle connections (restart)
+        server->close_idle_connections();
+        conn->upstream_retried_ = true;
+
+        if (connect_to_server(conn)) {
+            return;  // Continues on EPOLLOUT once connected
+        }
+    }
+
+    // Otherwise the server failed: back it off and try another one
+    release_upstream(conn, false);
+    conn->upstream_->report_failure(server);
+    end_upstream_request(conn);
+
+    if (can_retry && open_upstream_connection(conn)) {
+        if (conn->proxy_handler_state_ ==
+            codes::PROXY_HANDLER_SENDING_REQUEST) {
+            send_upstream_request(conn);
+        }
+        return;
+    }
+
+    fail_exchange(conn, codes::BAD_GATEWAY);
+}
+
+void ProxyHandler::fail_exchange(Connection* conn,
+                                 codes::ResponseStatus status) {
+    release_upstream(conn, false);
+    end_upstream_request(conn);
+    WebServer::get_instance()->get_response_cache()->abandon(conn);
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_ERROR;
+    ErrorHandler::generate_error_response(conn, status);
+}
+
+void ProxyHandler::abort_exchange(Connection* conn) {
+    // The response head is already on its way, the only way left to signal
+    // the failure is closing the client connection
+    log(LOG_ERROR, "Aborting proxied response for client_fd %d",
+        conn->client_fd_);
+    release_upstream(conn, false);
+    end_upstream_request(conn);
+    WebServer::get_instance()->get_response_cache()->abandon(conn);
+    conn->proxy_handler_state_ = codes::PROXY_HANDLER_ERROR;
+    conn->conn_state_ = codes::CONN_ERROR;
+}
+
+void ProxyHandler::release_upstream(Connection* conn, bool reusable) {
+    if (conn->upstream_fd_ < 0) {
+        return;
+    }
+
+    WebServer::unregister_active_pipe(conn->upstream_fd_);
+    if (reusable) {
+        conn->upstream_server_->release_connection(conn->upstream_fd_);
+    } else {
+        close(conn->upstream_fd_);
+    }
+    conn->upstream_fd_ = -1;
+}
+
+void ProxyHandler::end_upstream_request(Connection* conn) {
+    if (conn->upstream_server_) {
+        conn->upstream_->end_request(conn->upstream_server_);
+        conn->upstream_server_ = NULL;
+    }
+}
@@ -0,0 +1,147 @@
+#include "webserv.hpp"
+
+ReadBuffer::ReadBuffer()
+    : start_(0), end_(0), scanned_(0), cr_base_(0), cr_mask_(0) {}
+
+const char* ReadBuffer::data() const {
+    return storage_.empty() ? NULL : &storage_[start_];
+}
+
+size_t ReadBuffer::size() const { return end_ - start_; }
+
+bool ReadBuffer::empty() const { return start_ == end_; }
+
+char ReadBuffer::operator[](size_t index) const {
+    return storage_[start_ + index];
+}
+
+size_t ReadBuffer::find_crlf() {
+    const char* begin = data();
+    size_t length = size();
+
+    if (!DelimiterScanner::VECTORIZED) {
+        return find_crlf_from_scanned(begin, length);
+    }
+    while (true) {
+        while (cr_mask_) {
+            size_t cr = cr_base_ + __builtin_ctzll(cr_mask_);
+            if (cr + 1 >= length) {
+                return npos;  // The LF may still come with the next read
+            }
+            if (begin[cr + 1] == '\n') {
+                return cr;
+            }
+            cr_mask_ &= cr_mask_ - 1;  // A lone CR, try the next one
+        }
+
+        if (scanned_ >= length) {
+            return npos;
+        }
+        // Classify the next block. The storage past the received bytes can
+        // be read as part of it, unless it ends too soon.
+        size_t count =
+            std::min(length - scanned_, DelimiterScanner::BLOCK_SIZE);
+        const char* block = begin + scanned_;
+        char padded[DelimiterScanner::BLOCK_SIZE];
+        if (start_ + scanned_ + DelimiterScanner::BLOCK_SIZE >
+            storage_.size()) {
+            std::memset(padded, 0, sizeof(padded));
+            std::memcpy(padded, block, count);
+            block = padded;
+        }
+        cr_base_ = scanned_;
+        cr_mask_ =
+            DelimiterScanner::match(block, count, codes::DELIMITER_CR);
+        scanned_ += count;
+    }
+}
+
+// memchr pays off once the range is longer than a few words
+static inline const char* find_cr(const char* begin, const char* end) {
+    if (end - begin < 16) {
+        const char* cr = std::find(begin, end, '\r');
+        return cr != end ? cr : NULL;
+    }
+    return static_cast<const char*>(std::memchr(begin, '\r', end - begin));
+}
+
+// Goes from CR to CR instead of classifying blocks. scanned_ stops on the
+// CR of a line end still waiting for its LF.
+size_t ReadBuffer::find_crlf_from_scanned(const char* begin, size_t length) {
+    while (scanned_ < length) {
+        const char* cr = find_cr(begin + scanned_, begin + length);
+        if (!cr) {
+            scanned_ = length;
+            return npos;
+        }
+        scanned_ = cr - begin;
+        if (scanned_ + 1 >= length) {
+            return npos;  // The LF may still come with the next read
+        }
+        if (begin[scanned_ + 1] == '\n') {
+            return scanned_;
+        }
+        ++scanned_;  // A lone CR
+    }
+    return npos;
+}
+
+void ReadBuffer::consume(size_t count) {
+    count = std::min(count, size());
+    start_ += count;
+    scanned_ = scanned_ > count ? scanned_ - count : 0;
+    if (cr_base_ >= count) {
+        cr_base_ -= count;
+    } else {
+        // Drop the CRs of consumed bytes
+        size_t passed = count - cr_base_;
+        cr_mask_ = passed < 64 ? cr_mask_ >> passed : 0;
+        cr_base_ = 0;
+    }
+
+    // Fully parsed: the next read starts at the front again, for free
+    if (start_ == end_) {
+        clear();
+    }
+}
+
+void ReadBuffer::clear() {
+    start_ = 0;
+    end_ = 0;
+    scanned_ = 0;
+    cr_base_ = 0;
+    cr_mask_ = 0;
+}
+
+void ReadBuffer::release() {
+    clear();
+    IoBuffer().swap(storage_);
+}
+
+char* ReadBuffer::prepare(size_t min_room) {
+    if (storage_.size() - end_ < min_room) {
+        size_t unread = size();
+
+        // Slide the unread bytes to the front, growing only if that is
+        // still not enough room
+        if (start_ > 0) {
+            std::memmove(&storage_[0], &storage_[start_], unread);
+            start_ = 0;
+            end_ = unread;
+        }
+        // Whole pool blocks, the next size class up
+        if (storage_.size() - end_ < min_room) {
+            size_t size = BufferPool::block_size(
+                std::max(storage_.size() * 2, unread + min_room));
+            storage_.reserve(size);
+            storage_.resize(size);
+        }
+    }
+    return &storage_[end_];
+}
+
+size_t ReadBuffer::writable() const { return storage_.size() - end_; }
+
+void ReadBuffer::commit(size_t count) {
+    end_ += std::min(count, writable());
+}
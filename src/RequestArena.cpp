@@ -0,0 +1,84 @@
+#include "webserv.hpp"
+
+// Blocks of the smallest pool class, larger ones only for what does not fit
+static const size_t DEFAULT_BLOCK_SIZE = BufferPool::block_size(1);
+
+RequestArena::RequestArena()
+    : first_(NULL), last_(NULL), next_(NULL), end_(NULL) {}
+
+RequestArena::~RequestArena() { release(); }
+
+char* RequestArena::allocate(size_t size) {
+    if (!first_ || size > static_cast<size_t>(end_ - next_)) {
+        add_block(size);
+    }
+    char* bytes = next_;
+    next_ += size;
+    return bytes;
+}
+
+void RequestArena::reset() {
+    if (!first_) {
+        return;
+    }
+    // A larger first block is not worth keeping for the next request
+    if (first_->size_ != DEFAULT_BLOCK_SIZE) {
+        release();
+        return;
+    }
+
+    Block* block = first_->next_;
+    while (block) {
+        Block* next = block->next_;
+        BufferPool::deallocate(reinterpret_cast<char*>(block), block->size_);
+        block = next;
+    }
+    first_->next_ = NULL;
+    last_ = first_;
+    next_ = start_of(first_);
+    end_ = reinterpret_cast<char*>(first_) + first_->size_;
+}
+
+void RequestArena::release() {
+    Block* block = first_;
+    while (block) {
+        Block* next = block->next_;
+        BufferPool::deallocate(reinterpret_cast<char*>(block), block->size_);
+        block = next;
+    }
+    first_ = NULL;
+    last_ = NULL;
+    next_ = NULL;
+    end_ = NULL;
+}
+
+size_t RequestArena::block_count() const {
+    size_t count = 0;
+    for (Block* block = first_; block; block = block->next_) {
+        ++count;
+    }
+    return count;
+}
+
+// Chains a block with room for at least min_room bytes, the rest of the
+// last block is left unused
+void RequestArena::add_block(size_t min_room) {
+    size_t size = BufferPool::block_size(
+        std::max(sizeof(Block) + min_room, DEFAULT_BLOCK_SIZE));
+    Block* block = reinterpret_cast<Block*>(BufferPool::allocate(size));
+    block->next_ = NULL;
+    block->size_ = size;
+
+    if (last_) {
+        last_->next_ = block;
+    } else {
+        first_ = block;
+    }
+    last_ = block;
+    next_ = start_of(block);
+    end_ = reinterpret_cast<char*>(block) + size;
+}
+
+char* RequestArena::start_of(Block* block) {
+    return reinterpret_cast<char*>(block) + sizeof(Block);
+}
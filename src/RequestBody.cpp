@@ -0,0 +1,149 @@
+#include "webserv.hpp"
+
+// Until configure() is called every body stays in memory
+RequestBody::RequestBody()
+    : fd_(-1),
+      size_(0),
+      parser_(NULL),
+      buffer_size_(static_cast<size_t>(-1)) {}
+
+RequestBody::~RequestBody() { clear(); }
+
+void RequestBody::configure(size_t buffer_size, const std::string& temp_path) {
+    buffer_size_ = buffer_size;
+    temp_path_ = temp_path;
+}
+
+bool RequestBody::expect(size_t expected) {
+    if (expected > buffer_size_) {
+        return in_memory() ? spool() : true;
+    }
+    memory_.reserve(expected);
+    return true;
+}
+
+void RequestBody::stream_to(MultipartParser* parser) {
+    clear();
+    parser_ = parser;
+}
+
+bool RequestBody::append(const char* data, size_t length) {
+    if (parser_) {
+        parser_->feed(data, length);
+        size_ += length;
+        return true;
+    }
+    if (in_memory() && memory_.size() + length > buffer_size_ && !spool()) {
+        return false;
+    }
+    if (in_memory()) {
+        memory_.insert(memory_.end(), data, data + length);
+        return true;
+    }
+
+    size_t written = 0;
+    while (written < length) {
+        ssize_t bytes = ::write(fd_, data + written, length - written);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log(LOG_ERROR, "Failed to spool request body: %s",
+                strerror(errno));
+            return false;
+        }
+        written += bytes;
+    }
+    size_ += length;
+    return true;
+}
+
+size_t RequestBody::size() const {
+    return in_memory() && !parser_ ? memory_.size() : size_;
+}
+
+bool RequestBody::empty() const { return size() == 0; }
+
+bool RequestBody::in_memory() const { return fd_ == -1; }
+
+const char* RequestBody::data() const {
+    if (!in_memory() || memory_.empty()) {
+        return NULL;
+    }
+    return &memory_[0];
+}
+
+ssize_t RequestBody::read(size_t offset, char* out, size_t length) const {
+    if (offset >= size()) {
+        return 0;
+    }
+    length = std::min(length, size() - offset);
+    if (in_memory()) {
+        std::memcpy(out, &memory_[offset], length);
+        return length;
+    }
+    return pread(fd_, out, length, offset);
+}
+
+ssize_t RequestBody::write_to(int fd, size_t offset, size_t length) const {
+    if (offset >= size()) {
+        return 0;
+    }
+    length = std::min(length, size() - offset);
+    if (in_memory()) {
+        return ::write(fd, &memory_[offset], length);
+    }
+    // Straight from the page cache, the body never enters user space
+    off_t file_offset = offset;
+    return sendfile(fd, fd_, &file_offset, length);
+}
+
+void RequestBody::clear() {
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    parser_ = NULL;
+    memory_.clear();
+    if (memory_.capacity() > buffer_size_) {
+        std::vector<char>().swap(memory_);
+    }
+}
+
+void RequestBody::swap(RequestBody& other) {
+    memory_.swap(other.memory_);
+    std::swap(fd_, other.fd_);
+    std::swap(size_, other.size_);
+    std::swap(parser_, other.parser_);
+    std::swap(buffer_size_, other.buffer_size_);
+    temp_path_.swap(other.temp_path_);
+}
+
+bool RequestBody::spool() {
+    // An O_TMPFILE file never has a name. Filesystems without it get a
+    // named file, unlinked at once.
+    fd_ = open(temp_path_.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd_ == -1 && (errno == EOPNOTSUPP || errno == EISDIR)) {
+        std::string name = temp_path_ + "/webserv_body.XXXXXX";
+        fd_ = mkostemp(&name[0], O_CLOEXEC);
+        if (fd_ != -1) {
+            unlink(name.c_str());
+        }
+    }
+    if (fd_ == -1) {
+        log(LOG_ERROR, "Failed to create request body file in %s: %s",
+            temp_path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    // What arrived before the body outgrew memory goes first
+    std::vector<char> buffered;
+    buffered.swap(memory_);
+    size_ = 0;
+    if (!buffered.empty() && !append(&buffered[0], buffered.size())) {
+        return false;
+    }
+    log(LOG_DEBUG, "Request body spooled to a file in %s", temp_path_.c_str());
+    return true;
+}
@@ -1,5 +1,61 @@
 #include "webserv.hpp"
 
+// Character classes of request target bytes, RFC 3986:
+//   pchar = unreserved / pct-encoded / sub-delims / ":" / "@"
+//   path  = *( pchar / "/" ),  query = *( pchar / "/" / "?" )
+// Bytes 0x80 and up are never allowed unencoded.
+enum UriCharClass {
+    URI_PATH = 1 << 0,     // Allowed as is in the path
+    URI_QUERY = 1 << 1,    // Allowed as is in the query
+    URI_HEX = 1 << 2,      // Hex digit of a %XX escape
+    URI_CONTROL = 1 << 3,  // Never allowed, not even decoded
+    U_ = 0,
+    UP = URI_PATH | URI_QUERY,
+    UQ = URI_QUERY,
+    UH = URI_PATH | URI_QUERY | URI_HEX,
+    UC = URI_CONTROL
+};
+
+static const unsigned char URI_CHAR_CLASS[256] = {
+    // 0x00 - 0x1f: control characters
+    UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC,
+    UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC, UC,
+    // SP  !   "   #   $   %   &   '   (   )   *   +   ,   -   .   /
+    U_, UP, U_, U_, UP, U_, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP,
+    // 0   1   2   3   4   5   6   7   8   9   :   ;   <   =   >   ?
+    UH, UH, UH, UH, UH, UH, UH, UH, UH, UH, UP, UP, U_, UP, U_, UQ,
+    // @   A   B   C   D   E   F   G   H   I   J   K   L   M   N   O
+    UP, UH, UH, UH, UH, UH, UH, UP, UP, UP, UP, UP, UP, UP, UP, UP,
+    // P   Q   R   S   T   U   V   W   X   Y   Z   [   \   ]   ^   _
+    UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, U_, U_, U_, U_, UP,
+    // `   a   b   c   d   e   f   g   h   i   j   k   l   m   n   o
+    U_, UH, UH, UH, UH, UH, UH, UP, UP, UP, UP, UP, UP, UP, UP, UP,
+    // p   q   r   s   t   u   v   w   x   y   z   {   |   }   ~   DEL
+    UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, UP, U_, U_, U_, UP, UC,
+    // 0x80 - 0xff: zero
+};
+
+// Decodes the %XX escape at uri, which has at least one byte before end.
+// Returns false if it is cut short or not hex.
+static bool decode_percent(const unsigned char* uri, const unsigned char* end,
+                           unsigned char& out) {
+    if (end - uri < 3 || !(URI_CHAR_CLASS[uri[1]] & URI_HEX) ||
+        !(URI_CHAR_CLASS[uri[2]] & URI_HEX)) {
+        return false;
+    }
+    // Digits are 0x30-0x39, letters 0x41-0x46 and 0x61-0x66
+    unsigned char high = (uri[1] & 0xF) + 9 * (uri[1] >> 6);
+    unsigned char low = (uri[2] & 0xF) + 9 * (uri[2] >> 6);
+    out = (high << 4) | low;
+    return true;
+}
+
+// A decoded path segment may not be "." or ".."
+static bool is_dot_segment(const char* segment, size_t length) {
+    return (length == 1 && segment[0] == '.') ||
+           (length == 2 && segment[0] == '.' && segment[1] == '.');
+}
+
 RequestParser::RequestParser() {}
 
 RequestParser::~RequestParser() {}
@@ -7,13 +63,10 @@ RequestParser::~RequestParser() {}
 bool RequestParser::read_from_socket(Connection* conn) {
     log(LOG_DEBUG, "Reading from socket (fd: %i)", conn->client_fd_);
 
-    // Resize the read buffer to accommodate incoming data
-    size_t original_size = conn->read_buffer_.size();
-    conn->read_buffer_.resize(original_size + CHUNK_SIZE);
-
-    // Read data from the client socket
-    ssize_t bytes_read = recv(
-        conn->client_fd_, &conn->read_buffer_[original_size], CHUNK_SIZE, 0);
+    // Read into the free room at the end of the buffer, at least CHUNK_SIZE
+    char* destination = conn->read_buffer_.prepare(CHUNK_SIZE);
+    ssize_t bytes_read = recv(conn->client_fd_, destination,
+                              conn->read_buffer_.writable(), 0);
 
     if (bytes_read == 0) {
         // Connection closed by client
@@ -30,8 +83,7 @@ bool RequestParser::read_from_socket(Connection* conn) {
     // Update the last activity timestamp
     conn->last_activity_ = time(NULL);
 
-    // Resize the buffer to the actual size read
-    conn->read_buffer_.resize(original_size + bytes_read);
+    conn->read_buffer_.commit(bytes_read);
 
     log(LOG_DEBUG, "Read %zd bytes from socket (fd: %i)", bytes_read,
         conn->client_fd_);
@@ -39,6 +91,80 @@ bool RequestParser::read_from_socket(Connection* conn) {
     return true;
 }
 
+bool RequestParser::splice_body(Connection* conn) {
+    ReadBuffer& buffer = conn->read_buffer_;
+    conn->parse_status_ = codes::PARSE_INCOMPLETE;
+
+    // Body bytes that arrived with the headers are already in user space
+    size_t buffered = std::min(conn->body_remaining_bytes_, buffer.size());
+    while (buffered > 0) {
+        ssize_t bytes = write(conn->body_file_fd_, buffer.data(), buffered);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            log(LOG_ERROR, "Failed to write request body to file: %s",
+                strerror(errno));
+            conn->parser_state_ = codes::PARSING_ERROR;
+            conn->parse_status_ = codes::PARSE_BODY_STORAGE_FAILED;
+            return true;
+        }
+        buffer.consume(bytes);
+        buffered -= bytes;
+        conn->body_remaining_bytes_ -= bytes;
+    }
+
+    if (conn->body_remaining_bytes_ > 0) {
+        // Socket to pipe moves page references, pipe to file copies in the
+        // kernel. The file never blocks, so the pipe is always left empty.
+        size_t wanted = std::min(conn->body_remaining_bytes_,
+                                 http_limits::SPLICE_PIPE_SIZE);
+        ssize_t received = splice(conn->client_fd_, NULL, conn->body_pipe_[1],
+                                  NULL, wanted,
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (received == 0) {
+            log(LOG_WARNING, "Client disconnected (fd: %i)", conn->client_fd_);
+            return false;
+        }
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return true;
+            }
+            log(LOG_ERROR, "Error splicing from socket (fd: %i): %s",
+                conn->client_fd_, strerror(errno));
+            return false;
+        }
+        conn->last_activity_ = time(NULL);
+
+        size_t pending = received;
+        while (pending > 0) {
+            ssize_t bytes = splice(conn->body_pipe_[0], NULL,
+                                   conn->body_file_fd_, NULL, pending,
+                                   SPLICE_F_MOVE);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                log(LOG_ERROR, "Failed to splice request body to file: %s",
+                    strerror(errno));
+                conn->parser_state_ = codes::PARSING_ERROR;
+                conn->parse_status_ = codes::PARSE_BODY_STORAGE_FAILED;
+                return true;
+            }
+            pending -= bytes;
+        }
+        conn->body_remaining_bytes_ -= received;
+        log(LOG_DEBUG, "Spliced %zd body bytes (fd: %i), %zu still due",
+            received, conn->client_fd_, conn->body_remaining_bytes_);
+    }
+
+    if (conn->body_remaining_bytes_ == 0) {
+        conn->parser_state_ = codes::PARSING_COMPLETE;
+        conn->parse_status_ = codes::PARSE_SUCCESS;
+    }
+    return true;
+}
+
 codes::ParseStatus RequestParser::parse(Connection* conn) {
     log(LOG_DEBUG, "Starting parsing attempt on Connection '%i'",
         conn->client_fd_);
@@ -70,6 +196,10 @@ codes::ParseStatus RequestParser::parse(Connection* conn) {
                 parse_status = parse_chunked_body(conn);
                 break;
 
+            case codes::PARSING_SPLICED_BODY:
+                // The body never enters the buffer, see splice_body()
+                return codes::PARSE_INCOMPLETE;
+
             case codes::PARSING_COMPLETE:
                 parse_status = codes::PARSE_SUCCESS;
                 break;
@@ -83,6 +213,10 @@ codes::ParseStatus RequestParser::parse(Connection* conn) {
             log(LOG_DEBUG, "Parsing incomplete for connection: %i",
                 conn->client_fd_);
             break;  // Need more data
+        } else if (parse_status == codes::PARSE_HEADERS_COMPLETE) {
+            // The caller resolves the virtual server before the body is
+            // read, even if part of it is already buffered
+            return parse_status;
         } else if (parse_status >= codes::PARSE_ERROR) {
             log(LOG_ERROR, "Parsing error for connection: %i, status: %d",
                 conn->client_fd_, parse_status);
@@ -101,14 +235,13 @@ codes::ParseStatus RequestParser::parse(Connection* conn) {
 codes::ParseStatus RequestParser::parse_request_line(Connection* conn) {
     log(LOG_DEBUG, "Parsing request line for connection: %i", conn->client_fd_);
 
-    std::vector<char>& buffer = conn->read_buffer_;
+    ReadBuffer& buffer = conn->read_buffer_;
     HttpRequest* request = conn->request_data_;
 
     // Find the end of the request line (CRLF)
-    std::vector<char>::iterator line_end =
-        std::search(buffer.begin(), buffer.end(), CRLF, &CRLF[2]);
+    size_t line_end = buffer.find_crlf();
 
-    if (line_end == buffer.end()) {
+    if (line_end == ReadBuffer::npos) {
         // Not enough data yet
         if (buffer.size() > http_limits::MAX_REQUEST_LINE_LENGTH) {
             log(LOG_ERROR, "Request line too long for connection: %i",
@@ -120,9 +253,8 @@ codes::ParseStatus RequestParser::parse_request_line(Connection* conn) {
         return codes::PARSE_INCOMPLETE;
     }
 
-    // Get the complete request line
-    std::string request_line(buffer.begin(), line_end);
-    if (!split_request_line(request, request_line)) {
+    // Split the request line in place
+    if (!split_request_line(request, buffer.data(), line_end)) {
         return codes::PARSE_INVALID_REQUEST_LINE;
     }
 
@@ -133,8 +265,8 @@ codes::ParseStatus RequestParser::parse_request_line(Connection* conn) {
         return validation_status;
     }
 
-    // Remove processed data (including CRLF)
-    buffer.erase(buffer.begin(), line_end + 2);
+    // Consume processed data (including CRLF)
+    buffer.consume(line_end + 2);
 
     // Move to header parsing
     log(LOG_DEBUG, "Request line parsed successfully for connection: %i",
@@ -145,173 +277,49 @@ codes::ParseStatus RequestParser::parse_request_line(Connection* conn) {
 }
 
 bool RequestParser::split_request_line(HttpRequest* request,
-                                       std::string& request_line) {
-    // Parse method, URI, and version
-    size_t first_space = request_line.find(' ');
-    size_t last_space = request_line.rfind(' ');
-
-    if (first_space == std::string::npos || last_space == first_space) {
-        log(LOG_ERROR, "Invalid request line format: '%s'",
-            request_line.c_str());
+                                       const char* line, size_t length) {
+    // Parse method, URI, and version, separated by exactly two spaces
+    size_t first_space =
+        DelimiterScanner::find(line, length, codes::DELIMITER_SPACE);
+    size_t second_space = DelimiterScanner::npos;
+    if (first_space != DelimiterScanner::npos) {
+        second_space = DelimiterScanner::find(line + first_space + 1,
+                                              length - first_space - 1,
+                                              codes::DELIMITER_SPACE);
+    }
+
+    if (second_space == DelimiterScanner::npos ||
+        DelimiterScanner::find(line + first_space + second_space + 2,
+                               length - first_space - second_space - 2,
+                               codes::DELIMITER_SPACE) !=
+            DelimiterScanner::npos) {
+        log(LOG_ERROR, "Invalid request line format: '%.*s'",
+            static_cast<int>(length), line);
         return false;
     }
+    second_space += first_space + 1;
 
     // Extract components
-    request->method_ = request_line.substr(0, first_space);
-    request->uri_ =
-        request_line.substr(first_space + 1, last_space - first_space - 1);
-    request->version_ = request_line.substr(last_space + 1);
-
-    if (!split_uri_components(request)) {
-        return false;
-    }
-
-    return true;
-}
-
-bool RequestParser::split_uri_components(HttpRequest* request) {
-    std::string uri = request->uri_;
-
-    // Check for query string ('?' delimiter)
-    size_t query_pos = uri.find('?');
-    if (query_pos != std::string::npos) {
-        request->path_ = decode_uri_path(uri.substr(0, query_pos));
-        if (request->path_.empty()) {
-            log(LOG_ERROR, "Invalid path in URI: '%s'", uri.c_str());
-            return false;  // Invalid path
-        }
-        request->query_string_ =
-            decode_uri_query(request->uri_.substr(query_pos + 1));
-        if (request->query_string_.empty()) {
-            log(LOG_ERROR, "Invalid query string in URI: '%s'", uri.c_str());
-            return false;  // Invalid query string
-        }
-    } else {
-        request->path_ = decode_uri_path(request->uri_);
-        if (request->path_.empty()) {
-            log(LOG_ERROR, "Invalid path in URI: '%s'", uri.c_str());
-            return false;  // Invalid path
-        }
-        request->query_string_.clear();
-    }
+    request->method_.assign(line, first_space);
+    request->method_type_ = parse_method(request->method_);
+    request->uri_.assign(line + first_space + 1, second_space - first_space - 1);
+    request->version_.assign(line + second_space + 1, length - second_space - 1);
 
     return true;
 }
 
-std::string RequestParser::decode_uri_path(const std::string& uri) {
-    std::string decoded_uri;
-    decoded_uri.reserve(uri.length());  // Performance optimization
-
-    for (size_t i = 0; i < uri.length(); i++) {
-        if (uri[i] == '%') {
-            // Enhanced validation
-            if (i + 2 >= uri.length()) {
-                return "";  // Invalid encoding
-            }
-
-            char hex1 = uri[i + 1];
-            char hex2 = uri[i + 2];
-
-            if (!isxdigit(hex1) || !isxdigit(hex2)) {
-                return "";  // Invalid hex digits
-            }
-
-            // Convert and validate
-            int value = (hex_to_int(hex1) << 4) | hex_to_int(hex2);
-
-            // Reject null bytes and control characters
-            if (value == 0 || (value > 0 && value < 32) || value == 127) {
-                return "";
-            }
-
-            // Security: Reject double-encoded attempts
-            if (value == '%') {
-                return "";  // Potential double-encoding attack
-            }
-
-            decoded_uri += static_cast<char>(value);
-            i += 2;
-        } else {
-            // Validate regular characters
-            unsigned char c = static_cast<unsigned char>(uri[i]);
-            if (c < 32 || c == 127) {
-                return "";  // Control characters not allowed
-            }
-            decoded_uri += uri[i];
-        }
-    }
-
-    log(LOG_DEBUG, "Decoded URI path: '%s'", decoded_uri.c_str());
-    return decoded_uri;
-}
-
-std::string RequestParser::decode_uri_query(const std::string& uri) {
-    std::string decoded_uri;
-    decoded_uri.reserve(uri.length());  // Performance optimization
-
-    for (size_t i = 0; i < uri.length(); i++) {
-        if (uri[i] == '%') {
-            // Enhanced validation
-            if (i + 2 >= uri.length()) {
-                return "";  // Invalid encoding
-            }
-
-            char hex1 = uri[i + 1];
-            char hex2 = uri[i + 2];
-
-            if (!isxdigit(hex1) || !isxdigit(hex2)) {
-                return "";  // Invalid hex digits
-            }
-
-            // Convert and validate
-            int value = (hex_to_int(hex1) << 4) | hex_to_int(hex2);
-
-            // Reject null bytes and control characters
-            if (value == 0 || (value > 0 && value < 32) || value == 127) {
-                return "";
-            }
-
-            // Security: Reject double-encoded attempts
-            if (value == '%') {
-                return "";  // Potential double-encoding attack
-            }
-
-            decoded_uri += static_cast<char>(value);
-            i += 2;
-        } else if (uri[i] == '+') {
-            // Only convert + to space in query strings, not paths
-            decoded_uri += ' ';
-        } else {
-            // Validate regular characters
-            unsigned char c = static_cast<unsigned char>(uri[i]);
-            if (c < 32 || c == 127) {
-                return "";  // Control characters not allowed
-            }
-            decoded_uri += uri[i];
-        }
-    }
-
-    log(LOG_DEBUG, "Decoded URI query: '%s'", decoded_uri.c_str());
-    return decoded_uri;
-}
-
 codes::ParseStatus RequestParser::validate_request_line(
-    const HttpRequest* request) {
-    if (!validate_method(request->method_)) {
+    HttpRequest* request) {
+    if (request->method_type_ == codes::METHOD_UNKNOWN) {
         log(LOG_WARNING, "Invalid HTTP method: '%s'", request->method_.c_str());
         return codes::PARSE_METHOD_NOT_ALLOWED;
     }
 
-    if (!validate_path(request->path_)) {
-        log(LOG_WARNING, "Invalid path in request: '%s'",
-            request->path_.c_str());
-        return codes::PARSE_INVALID_PATH;
-    }
-
-    if (!validate_query_string(request->query_string_)) {
-        log(LOG_WARNING, "Invalid query string in request: '%s'",
-            request->query_string_.c_str());
-        return codes::PARSE_INVALID_QUERY_STRING;
+    codes::ParseStatus uri_status = decode_uri(request);
+    if (uri_status != codes::PARSE_SUCCESS) {
+        log(LOG_WARNING, "Invalid request target '%s': status %d",
+            request->uri_.c_str(), uri_status);
+        return uri_status;
     }
 
     if (!validate_http_version(request->version_)) {
@@ -327,136 +335,121 @@ codes::ParseStatus RequestParser::validate_request_line(
     return codes::PARSE_SUCCESS;
 }
 
-int RequestParser::hex_to_int(char c) {
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    }
-    if (c >= 'A' && c <= 'F') {
-        return c - 'A' + 10;
-    }
-    if (c >= 'a' && c <= 'f') {
-        return c - 'a' + 10;
-    }
-
-    log(LOG_FATAL, "Invalid hex character: '%c'", c);
-
-    return -1;  // Should never reach here due to isxdigit check
-}
-
-bool RequestParser::validate_method(const std::string& method) {
-    static const std::string methods[] = {
-        "GET",
-        "POST",
-        "DELETE",
-    };
-    static const std::vector<std::string> valid_methods(
-        methods, methods + sizeof(methods) / sizeof(methods[0]));
-
-    return std::find(valid_methods.begin(), valid_methods.end(), method) !=
-           valid_methods.end();
-}
+// Splits the request target into its path and query string, validating and
+// percent-decoding both in the same pass over the raw bytes
+codes::ParseStatus RequestParser::decode_uri(HttpRequest* request) {
+    const std::string& uri = request->uri_;
+    const unsigned char* begin =
+        reinterpret_cast<const unsigned char*>(uri.data());
+    const unsigned char* end = begin + uri.size();
 
-bool RequestParser::validate_path(const std::string& path) {
-    // If path is empty, it's invalid
-    if (path.empty()) {
-        log(LOG_WARNING, "Empty path in request");
-        return false;
-    }
-
-    // Check for length limit
-    if (path.size() > http_limits::MAX_PATH_LENGTH) {
-        log(LOG_WARNING, "Path too long in request: '%s'", path.c_str());
-        return false;
+    const unsigned char* query = static_cast<const unsigned char*>(
+        std::memchr(begin, '?', uri.size()));
+    if (!query) {
+        query = end;
     }
 
-    // Must start with a slash
-    if (path[0] != '/') {
-        log(LOG_WARNING, "Path must start with a slash: '%s'", path.c_str());
-        return false;
+    codes::ParseStatus status = decode_path(begin, query, request->path_);
+    if (status != codes::PARSE_SUCCESS) {
+        return status;
     }
 
-    // Check for multiple consecutive slashes (e.g. "//home")
-    if (path.find("//") != std::string::npos) {
-        log(LOG_WARNING, "Path contains multiple consecutive slashes: '%s'",
-            path.c_str());
-        return false;
+    if (query == end) {
+        request->query_string_.clear();
+        return codes::PARSE_SUCCESS;
     }
+    return decode_query(query + 1, end, request->query_string_);
+}
 
-    // Check each path segment for path traversal
-    std::string segment;
-    std::istringstream path_stream(path.substr(1));  // Skip leading '/'
-    while (std::getline(path_stream, segment, '/')) {
-        if (segment == ".." || segment == "." || segment.empty()) {
-            log(LOG_WARNING, "Path contains invalid segment: '%s'",
-                segment.c_str());
-            return false;
-        }
+// Decodes the path, rejecting characters outside RFC 3986 pchar, decoded
+// control characters and "%" (double encoding), empty segments ("//") and
+// "." or ".." segments. Segments are checked as they are closed, after
+// decoding, so "%2e%2e" is caught as well.
+codes::ParseStatus RequestParser::decode_path(const unsigned char* uri,
+                                              const unsigned char* end,
+                                              std::string& path) {
+    if (uri == end || *uri != '/') {
+        return codes::PARSE_INVALID_PATH;
     }
 
-    // According to RFC 3986, path should only contain:
-    // - path = *( pchar / "/" )
-    // - pchar = unreserved / pct-encoded / sub-delims / ":" / "@"
-    // This means we should check that characters are limited to:
-    // - Alphanumeric: a-z, A-Z, 0-9
-    // - Unreserved: -, ., _, ~
-    // - Sub-delimiters: !, $, &, ', (, ), *, +, ,, ;, =
-    // - Additional characters: :, @, /
-    for (size_t i = 0; i < path.length(); ++i) {
-        unsigned char c = static_cast<unsigned char>(path[i]);
+    // Decoding never makes the path longer
+    path.resize(end - uri);
+    char* out = &path[0];
+    size_t length = 0;
+    size_t segment = 1;  // Start of the current segment in out
 
-        // Allow these characters
-        if (isalnum(c) || strchr("-._~!$&'()*+,;=:@/", c)) {
-            continue;
+    for (; uri < end; ++uri) {
+        unsigned char c = *uri;
+        if (c == '%') {
+            if (!decode_percent(uri, end, c)) {
+                return codes::PARSE_INVALID_PERCENT_ENCODING;
+            }
+            if ((URI_CHAR_CLASS[c] & URI_CONTROL) || c == '%') {
+                return codes::PARSE_INVALID_PATH;
+            }
+            uri += 2;
+        } else if (!(URI_CHAR_CLASS[c] & URI_PATH)) {
+            return codes::PARSE_INVALID_PATH;
         }
 
-        // Reject any other characters
-        log(LOG_WARNING, "Invalid character in path: '%c' in '%s'", c,
-            path.c_str());
-        return false;
-    }
-
-    log(LOG_DEBUG, "Path validated successfully: '%s'", path.c_str());
-    return true;
-}
+        if (c == '/' && length > 0) {
+            if (length == segment) {
+                return codes::PARSE_INVALID_PATH;  // Empty segment
+            }
+            if (is_dot_segment(out + segment, length - segment)) {
+                return codes::PARSE_PATH_TRAVERSAL;
+            }
+            segment = length + 1;
+        }
 
-bool RequestParser::validate_query_string(const std::string& query_string) {
-    // If query string is empty, it's valid
-    if (query_string.empty()) {
-        log(LOG_DEBUG, "Empty query string is valid");
-        return true;
+        if (length == http_limits::MAX_PATH_LENGTH) {
+            return codes::PARSE_URI_TOO_LONG;
+        }
+        out[length++] = c;
     }
 
-    // Check for length limit
-    if (query_string.size() > http_limits::MAX_QUERY_LENGTH) {
-        log(LOG_WARNING, "Query string too long: '%s'", query_string.c_str());
-        return false;
+    // The last segment, empty after a trailing slash
+    if (is_dot_segment(out + segment, length - segment)) {
+        return codes::PARSE_PATH_TRAVERSAL;
     }
 
-    // According to RFC 3986, query strings should only contain:
-    // - query string = *( pchar / "/" / "?" )
-    // - pchar = unreserved / pct-encoded / sub-delims / ":" / "@"
-    // This means we should check that characters are limited to:
-    // - Alphanumeric: a-z, A-Z, 0-9
-    // - Unreserved: -, ., _, ~
-    // - Sub-delimiters: !, $, &, ', (, ), *, +, ,, ;, =
-    // - Additional characters: :, @, /, ?
-    for (size_t i = 0; i < query_string.length(); ++i) {
-        unsigned char c = static_cast<unsigned char>(query_string[i]);
+    path.resize(length);
+    return codes::PARSE_SUCCESS;
+}
 
-        // Allow these characters
-        if (isalnum(c) || strchr("-._~!$&'()*+,;=:@/?", c)) {
-            continue;
+// Decodes the query string: pchar, "/" and "?" are allowed as is, "+"
+// stands for a space, decoded control characters and "%" are rejected
+codes::ParseStatus RequestParser::decode_query(const unsigned char* uri,
+                                               const unsigned char* end,
+                                               std::string& query_string) {
+    query_string.resize(end - uri);
+    char* out = query_string.empty() ? NULL : &query_string[0];
+    size_t length = 0;
+
+    for (; uri < end; ++uri) {
+        unsigned char c = *uri;
+        if (c == '%') {
+            if (!decode_percent(uri, end, c)) {
+                return codes::PARSE_INVALID_PERCENT_ENCODING;
+            }
+            if ((URI_CHAR_CLASS[c] & URI_CONTROL) || c == '%') {
+                return codes::PARSE_INVALID_QUERY_STRING;
+            }
+            uri += 2;
+        } else if (c == '+') {
+            c = ' ';
+        } else if (!(URI_CHAR_CLASS[c] & URI_QUERY)) {
+            return codes::PARSE_INVALID_QUERY_STRING;
         }
 
-        // Reject any other characters
-        log(LOG_WARNING, "Invalid character in query string: '%c' in '%s'", c,
-            query_string.c_str());
-        return false;
+        if (length == http_limits::MAX_QUERY_LENGTH) {
+            return codes::PARSE_URI_TOO_LONG;
+        }
+        out[length++] = c;
     }
 
-    log(LOG_DEBUG, "Query string validated successfully: '%s'",
-        query_string.c_str());
-    return true;
+    query_string.resize(length);
+    return codes::PARSE_SUCCESS;
 }
 
 bool RequestParser::validate_http_version(const std::string& version) {
@@ -465,19 +458,17 @@ bool RequestParser::validate_http_version(const std::string& version) {
 
 codes::ParseStatus RequestParser::parse_headers(Connection* conn) {
     log(LOG_DEBUG, "Parsing headers for connection: %i", conn->client_fd_);
-    std::vector<char>& buffer = conn->read_buffer_;
-    HttpRequest* request = conn->request_data_;
+    ReadBuffer& buffer = conn->read_buffer_;
 
     // Process headers until we find an empty line or need more data
     bool headers_complete = false;
 
     while (!headers_complete && !buffer.empty()) {
         // Find the end of the current header line
-        std::vector<char>::iterator line_end =
-            std::search(buffer.begin(), buffer.end(), CRLF, &CRLF[2]);
+        size_t line_end = buffer.find_crlf();
 
         // Need more data?
-        if (line_end == buffer.end()) {
+        if (line_end == ReadBuffer::npos) {
             // Check header size limit before requesting more data
             if (buffer.size() > http_limits::MAX_HEADER_VALUE_LENGTH) {
                 log(LOG_ERROR, "Header value too long for connection: %i",
@@ -491,26 +482,25 @@ codes::ParseStatus RequestParser::parse_headers(Connection* conn) {
         }
 
         // Check for empty line (end of headers)
-        if (line_end == buffer.begin()) {
-            // Remove CRLF and mark headers as complete
-            buffer.erase(buffer.begin(), buffer.begin() + 2);
+        if (line_end == 0) {
+            // Consume CRLF and mark headers as complete
+            buffer.consume(2);
             headers_complete = true;
             break;
         }
 
         // Process a normal header line
-        std::string header_line(buffer.begin(), line_end);
         codes::ParseStatus parse_status =
-            process_single_header(header_line, request);
+            process_single_header(buffer.data(), line_end, conn);
 
         if (parse_status != codes::PARSE_SUCCESS) {
-            log(LOG_ERROR, "Failed to parse header '%s' for connection: %i",
-                header_line.c_str(), conn->client_fd_);
+            log(LOG_ERROR, "Failed to parse header '%.*s' for connection: %i",
+                static_cast<int>(line_end), buffer.data(), conn->client_fd_);
             return parse_status;
         }
 
-        // Remove processed line (including CRLF)
-        buffer.erase(buffer.begin(), line_end + 2);
+        // Consume processed line (including CRLF)
+        buffer.consume(line_end + 2);
     }
 
     // Headers are complete, determine next parser state
@@ -532,47 +522,60 @@ codes::ParseStatus RequestParser::parse_headers(Connection* conn) {
     return codes::PARSE_INCOMPLETE;
 }
 
-// Helper function to process a single header line
-codes::ParseStatus RequestParser::process_single_header(
-    const std::string& header_line, HttpRequest* request) {
+// Helper function to process a single header line. The line is read in
+// place, only the lowercased name and trimmed value are copied, into the
+// connection's arena.
+codes::ParseStatus RequestParser::process_single_header(const char* line,
+                                                        size_t length,
+                                                        Connection* conn) {
+    HttpRequest* request = conn->request_data_;
+
     // Find the colon
-    size_t colon_pos = header_line.find(':');
-    if (colon_pos == std::string::npos || colon_pos == 0) {
+    size_t name_length =
+        DelimiterScanner::find(line, length, codes::DELIMITER_COLON);
+    if (name_length == DelimiterScanner::npos || name_length == 0) {
         return codes::PARSE_ERROR;
     }
+    const char* colon = line + name_length;
+    if (name_length > http_limits::MAX_HEADER_NAME_LENGTH) {
+        return codes::PARSE_HEADER_TOO_LONG;
+    }
 
-    // Extract key and value
-    std::string key = header_line.substr(0, colon_pos);
-    std::string value = header_line.substr(colon_pos + 1);
-
-    // Check for invalid characters in key and convert to lowercase
-    for (size_t i = 0; i < key.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(key[i]);
+    // Check for invalid characters in the name and convert to lowercase
+    char name[http_limits::MAX_HEADER_NAME_LENGTH];
+    for (size_t i = 0; i < name_length; ++i) {
+        unsigned char c = static_cast<unsigned char>(line[i]);
 
         // RFC 7230: field-name = token
         // token = 1*tchar
         // tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." /
         //         "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
-        if (!(isalnum(c) || strchr("!#$%&'*+-.^_`|~", c))) {
+        if (!(isalnum(c) || (c && strchr("!#$%&'*+-.^_`|~", c)))) {
             return codes::PARSE_ERROR;
         }
 
-        key[i] = std::tolower(c);
+        name[i] = std::tolower(c);
     }
 
-    // Trim leading whitespace from value
-    size_t value_start = value.find_first_not_of(" \t");
-    if (value_start != std::string::npos) {
-        value = value.substr(value_start);
+    // Trim surrounding whitespace from the value
+    const char* value = colon + 1;
+    const char* value_end = line + length;
+    while (value < value_end && (*value == ' ' || *value == '\t')) {
+        ++value;
+    }
+    while (value_end > value &&
+           (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
     }
 
     // Check header count limit
-    if (request->headers_.size() >= http_limits::MAX_HEADERS) {
+    if (request->fields_.size() >= http_limits::MAX_HEADERS) {
         return codes::PARSE_TOO_MANY_HEADERS;
     }
 
     // Store the header
-    request->set_header(key, value);
+    request->add_header(conn->arena_, name, name_length, value,
+                        value_end - value);
     return codes::PARSE_SUCCESS;
 }
 
@@ -581,24 +584,34 @@ codes::ParseStatus RequestParser::determine_request_body_handling(
     Connection* conn) {
     HttpRequest* request = conn->request_data_;
     // Check for request body
-    if (request->method_ == "POST" || request->method_ == "PUT") {
+    if (request->method_type_ &
+        (codes::METHOD_POST | codes::METHOD_PUT | codes::METHOD_PATCH)) {
+        request->body_.configure(
+            conn->virtual_server_->client_body_buffer_size_,
+            conn->virtual_server_->client_body_temp_path_);
+
         // Check for Transfer-Encoding header
-        std::string transfer_encoding =
-            request->get_header("transfer-encoding");
-        if (!transfer_encoding.empty() &&
-            transfer_encoding.find("chunked") != std::string::npos) {
+        if (request->header_contains(codes::HEADER_TRANSFER_ENCODING,
+                                     "chunked")) {
             conn->parser_state_ = codes::PARSING_CHUNKED_BODY;
             return codes::PARSE_HEADERS_COMPLETE;
         }
 
         // Check for Content-Length header
-        std::string content_length = request->get_header("content-length");
+        std::string content_length =
+            request->get_header(codes::HEADER_CONTENT_LENGTH);
         if (!content_length.empty()) {
             char* end_ptr;
             size_t body_size =
                 std::strtoul(content_length.c_str(), &end_ptr, 10);
 
             if (body_size > 0) {
+                // The body is appended as it arrives, into room reserved
+                // once or a file opened once
+                conn->body_remaining_bytes_ = body_size;
+                if (!request->body_.expect(body_size)) {
+                    return codes::PARSE_BODY_STORAGE_FAILED;
+                }
                 conn->parser_state_ = codes::PARSING_BODY;
                 return codes::PARSE_HEADERS_COMPLETE;
             }
@@ -626,7 +639,8 @@ codes::ParseStatus RequestParser::validate_headers(Connection* conn) {
     // Host header required for HTTP/1.1
     HttpRequest* request = conn->request_data_;
     if (request->version_ == "HTTP/1.1" &&
-        request->get_header("host").empty()) {
+        (!request->has_header(codes::HEADER_HOST) ||
+         request->header_equals(codes::HEADER_HOST, ""))) {
         // Translates to response status 400
         log(LOG_ERROR,
             "Missing Host header in HTTP/1.1 request for connection: %i",
@@ -634,29 +648,31 @@ codes::ParseStatus RequestParser::validate_headers(Connection* conn) {
         return codes::PARSE_MISSING_HOST_HEADER;
     }
 
-    if (request->method_ == "POST" || request->method_ == "PUT") {
+    if (request->method_type_ &
+        (codes::METHOD_POST | codes::METHOD_PUT | codes::METHOD_PATCH)) {
         bool has_content_length =
-            !request->get_header("content-length").empty();
+            request->has_header(codes::HEADER_CONTENT_LENGTH);
         bool has_transfer_encoding =
-            !request->get_header("transfer-encoding").empty();
+            request->has_header(codes::HEADER_TRANSFER_ENCODING);
 
         if (!has_content_length && !has_transfer_encoding) {
             // Translates to response status 411
             log(LOG_ERROR,
-                "POST/PUT without Content-Length or Transfer-Encoding");
+                "POST/PUT/PATCH without Content-Length or Transfer-Encoding");
             return codes::PARSE_MISSING_CONTENT_LENGTH;
         }
 
         if (has_content_length && has_transfer_encoding) {
             // Translates to response status 400
             log(LOG_ERROR,
-                "POST/PUT with both Content-Length and Transfer-Encoding");
+                "POST/PUT/PATCH with both Content-Length and Transfer-Encoding");
             return codes::PARSE_INVALID_CONTENT_LENGTH;
         }
 
         if (has_content_length) {
             // Validate Content-Length
-            std::string content_length = request->get_header("content-length");
+            std::string content_length =
+                request->get_header(codes::HEADER_CONTENT_LENGTH);
             char* end_ptr;
             size_t body_size =
                 std::strtoul(content_length.c_str(), &end_ptr, 10);
@@ -679,11 +695,11 @@ codes::ParseStatus RequestParser::validate_headers(Connection* conn) {
 
         if (has_transfer_encoding) {
             // Validate Transfer-Encoding
-            std::string transfer_encoding =
-                request->get_header("transfer-encoding");
-            if (transfer_encoding != "chunked") {
+            if (!request->header_equals(codes::HEADER_TRANSFER_ENCODING,
+                                        "chunked")) {
                 log(LOG_ERROR, "Unknown Transfer-Encoding: '%s'",
-                    transfer_encoding.c_str());
+                    request->get_header(codes::HEADER_TRANSFER_ENCODING)
+                        .c_str());
                 // Translates to response status 501
                 return codes::PARSE_UNKNOWN_ENCODING;
             }
@@ -698,26 +714,25 @@ codes::ParseStatus RequestParser::validate_headers(Connection* conn) {
 codes::ParseStatus RequestParser::parse_body(Connection* conn) {
     log(LOG_DEBUG, "Parsing body for connection: %i", conn->client_fd_);
 
-    std::vector<char>& buffer = conn->read_buffer_;
+    ReadBuffer& buffer = conn->read_buffer_;
     HttpRequest* request = conn->request_data_;
 
-    // Get the expected body size from Content-Length
-    std::string content_length = request->get_header("content-length");
-    size_t body_size = std::strtoul(content_length.c_str(), NULL, 10);
+    // Move what arrived so far into the body, bytes of a pipelined request
+    // that follows stay in the buffer
+    size_t available = std::min(conn->body_remaining_bytes_, buffer.size());
+    if (!request->body_.append(buffer.data(), available)) {
+        return codes::PARSE_BODY_STORAGE_FAILED;
+    }
+    buffer.consume(available);
+    conn->body_remaining_bytes_ -= available;
 
     // Check if we have enough data
-    if (buffer.size() < body_size) {
+    if (conn->body_remaining_bytes_ > 0) {
         log(LOG_DEBUG, "Body parsing incomplete for connection: %i",
             conn->client_fd_);
         return codes::PARSE_INCOMPLETE;
     }
 
-    // Copy body data
-    request->body_.assign(buffer.begin(), buffer.begin() + body_size);
-
-    // Remove processed data
-    buffer.erase(buffer.begin(), buffer.begin() + body_size);
-
     // Request is complete
     log(LOG_DEBUG, "Body parsed successfully for connection: %i",
         conn->client_fd_);
@@ -731,64 +746,65 @@ codes::ParseStatus RequestParser::parse_body(Connection* conn) {
 codes::ParseStatus RequestParser::parse_chunked_body(Connection* conn) {
     log(LOG_DEBUG, "Parsing chunked body for connection: %i", conn->client_fd_);
 
-    std::vector<char>& buffer = conn->read_buffer_;
+    ReadBuffer& buffer = conn->read_buffer_;
     HttpRequest* request = conn->request_data_;
-    codes::ParseStatus parse_status;
-
-    while (!buffer.empty()) {
-        // Process based on chunked parsing state
-        if (conn->chunk_remaining_bytes_ == 0) {
-            // Reading a new chunk size
-            parse_status =
-                parse_chunk_header(buffer, conn->chunk_remaining_bytes_);
-
-            if (parse_status != codes::PARSE_SUCCESS) {
-                log(LOG_ERROR,
-                    "Failed to parse chunk header for "
-                    "connection: %i with status: %i",
-                    conn->client_fd_, parse_status);
-                return parse_status;  // Either incomplete or error
-            }
+    codes::ParseStatus parse_status = codes::PARSE_SUCCESS;
+
+    // The state survives between reads, so a chunk split anywhere by the
+    // network resumes exactly where it stopped
+    while (!buffer.empty() && parse_status == codes::PARSE_SUCCESS) {
+        switch (conn->chunk_state_) {
+            case codes::CHUNK_SIZE_LINE:
+                parse_status =
+                    parse_chunk_header(buffer, conn->chunk_remaining_bytes_);
+                if (parse_status == codes::PARSE_SUCCESS) {
+                    // A zero size chunk is the last one
+                    conn->chunk_state_ = conn->chunk_remaining_bytes_
+                                             ? codes::CHUNK_DATA
+                                             : codes::CHUNK_TRAILERS;
+                }
+                break;
+
+            case codes::CHUNK_DATA:
+                parse_status = read_chunk_data(
+                    buffer, request, conn->chunk_remaining_bytes_,
+                    conn->virtual_server_->client_max_body_size_);
+                if (parse_status == codes::PARSE_SUCCESS &&
+                    conn->chunk_remaining_bytes_ == 0) {
+                    conn->chunk_state_ = codes::CHUNK_DATA_CRLF;
+                }
+                break;
 
-            // If chunk size is 0, this is the last chunk
-            if (conn->chunk_remaining_bytes_ == 0) {
-                codes::ParseStatus status = finish_chunked_parsing(buffer);
-                if (status == codes::PARSE_SUCCESS) {
+            case codes::CHUNK_DATA_CRLF:
+                parse_status = process_chunk_terminator(buffer);
+                if (parse_status == codes::PARSE_SUCCESS) {
+                    conn->chunk_state_ = codes::CHUNK_SIZE_LINE;
+                }
+                break;
+
+            case codes::CHUNK_TRAILERS:
+                parse_status = finish_chunked_parsing(buffer);
+                if (parse_status == codes::PARSE_SUCCESS) {
                     log(LOG_DEBUG,
                         "Chunked body parsing complete for connection: %i",
                         conn->client_fd_);
+                    conn->chunk_state_ = codes::CHUNK_DONE;
                     conn->parser_state_ = codes::PARSING_COMPLETE;
+                    return codes::PARSE_SUCCESS;
                 }
-                return status;
-            }
-
-            continue;  // Process the chunk data in the next iteration
-        }
-
-        // Reading chunk data
-        parse_status =
-            read_chunk_data(buffer, request, conn->chunk_remaining_bytes_,
-                            conn->virtual_server_->client_max_body_size_);
+                break;
 
-        if (parse_status != codes::PARSE_SUCCESS) {
-            log(LOG_ERROR,
-                "Failed to read chunk data for connection: %i with status: %i",
-                conn->client_fd_, parse_status);
-            return parse_status;
+            case codes::CHUNK_DONE:
+                return codes::PARSE_SUCCESS;
         }
+    }
 
-        // If we've completed reading this chunk data
-        if (conn->chunk_remaining_bytes_ == 0) {
-            parse_status = process_chunk_terminator(buffer);
-
-            if (parse_status != codes::PARSE_SUCCESS) {
-                log(LOG_ERROR,
-                    "Failed to process chunk terminator for "
-                    "connection: %i with status: %i",
-                    conn->client_fd_, parse_status);
-                return parse_status;
-            }
-        }
+    if (parse_status != codes::PARSE_SUCCESS &&
+        parse_status != codes::PARSE_INCOMPLETE) {
+        log(LOG_ERROR,
+            "Failed to parse chunked body for connection: %i with status: %i",
+            conn->client_fd_, parse_status);
+        return parse_status;
     }
 
     // Need more data
@@ -798,19 +814,18 @@ codes::ParseStatus RequestParser::parse_chunked_body(Connection* conn) {
 }
 
 // Helper method for parsing chunk headers
-codes::ParseStatus RequestParser::parse_chunk_header(std::vector<char>& buffer,
+codes::ParseStatus RequestParser::parse_chunk_header(ReadBuffer& buffer,
                                                      size_t& out_chunk_size) {
     // Find the end of the chunk size line
-    std::vector<char>::iterator line_end =
-        std::search(buffer.begin(), buffer.end(), CRLF, &CRLF[2]);
+    size_t line_end = buffer.find_crlf();
 
-    if (line_end == buffer.end()) {
+    if (line_end == ReadBuffer::npos) {
         log(LOG_DEBUG, "Chunk header parsing incomplete, need more data");
         return codes::PARSE_INCOMPLETE;  // Need more data
     }
 
     // Parse the chunk size (hex)
-    std::string chunk_size_line(buffer.begin(), line_end);
+    std::string chunk_size_line(buffer.data(), line_end);
 
     // Remove any chunk extensions (after semicolon)
     size_t semicolon = chunk_size_line.find(';');
@@ -840,16 +855,16 @@ codes::ParseStatus RequestParser::parse_chunk_header(std::vector<char>& buffer,
         return codes::PARSE_INVALID_CHUNK_SIZE;
     }
 
-    // Remove chunk size line
-    buffer.erase(buffer.begin(), line_end + 2);
+    // Consume chunk size line
+    buffer.consume(line_end + 2);
 
-    log(LOG_DEBUG, "Parsed chunk size: %zu for connection: %i", out_chunk_size,
-        buffer.size());
+    log(LOG_DEBUG, "Parsed chunk size: %zu, %zu bytes left in buffer",
+        out_chunk_size, buffer.size());
     return codes::PARSE_SUCCESS;
 }
 
 // Helper method for reading chunk data
-codes::ParseStatus RequestParser::read_chunk_data(std::vector<char>& buffer,
+codes::ParseStatus RequestParser::read_chunk_data(ReadBuffer& buffer,
                                                   HttpRequest* request,
                                                   size_t& remaining_bytes,
                                                   size_t client_max_body_size) {
@@ -868,22 +883,20 @@ codes::ParseStatus RequestParser::read_chunk_data(std::vector<char>& buffer,
         return codes::PARSE_CONTENT_TOO_LARGE;
     }
 
-    // Append directly to body
-    request->body_.insert(request->body_.end(), buffer.begin(),
-                          buffer.begin() + bytes_to_read);
-
-    // Remove processed data
-    buffer.erase(buffer.begin(), buffer.begin() + bytes_to_read);
+    // Append straight from the read buffer to the body
+    if (!request->body_.append(buffer.data(), bytes_to_read)) {
+        return codes::PARSE_BODY_STORAGE_FAILED;
+    }
+    buffer.consume(bytes_to_read);
     remaining_bytes -= bytes_to_read;
 
-    log(LOG_DEBUG, "Read %zu bytes of chunk data for connection: %i",
+    log(LOG_DEBUG, "Read %zu bytes of chunk data, body is %zu bytes",
         bytes_to_read, request->body_.size());
     return codes::PARSE_SUCCESS;
 }
 
 // Helper method for processing chunk terminator (CRLF)
-codes::ParseStatus RequestParser::process_chunk_terminator(
-    std::vector<char>& buffer) {
+codes::ParseStatus RequestParser::process_chunk_terminator(ReadBuffer& buffer) {
     // Need CRLF after chunk data
     if (buffer.size() < 2) {
         log(LOG_DEBUG, "Chunk terminator incomplete, need more data");
@@ -896,40 +909,34 @@ codes::ParseStatus RequestParser::process_chunk_terminator(
         return codes::PARSE_ERROR;
     }
 
-    buffer.erase(buffer.begin(), buffer.begin() + 2);
-    log(LOG_TRACE, "Processed chunk terminator for connection: %i",
+    buffer.consume(2);
+    log(LOG_TRACE, "Processed chunk terminator, %zu bytes left in buffer",
         buffer.size());
     return codes::PARSE_SUCCESS;
 }
 
 // Helper method for finishing chunked parsing (last chunk)
-codes::ParseStatus RequestParser::finish_chunked_parsing(
-    std::vector<char>& buffer) {
+codes::ParseStatus RequestParser::finish_chunked_parsing(ReadBuffer& buffer) {
     // Process trailers line-by-line until we find an empty line
     while (true) {
         // Find the end of the current line
-        std::vector<char>::iterator line_end =
-            std::search(buffer.begin(), buffer.end(), CRLF, &CRLF[2]);
+        size_t line_end = buffer.find_crlf();
 
-        if (line_end == buffer.end()) {
+        if (line_end == ReadBuffer::npos) {
             log(LOG_DEBUG,
                 "Chunked trailers parsing incomplete, need more data");
             return codes::PARSE_INCOMPLETE;  // Need more data
         }
 
         // Check if this is an empty line (just CRLF)
-        if (line_end == buffer.begin()) {
-            // This is the end marker - remove it and finish
-            buffer.erase(buffer.begin(), buffer.begin() + 2);
-            log(LOG_DEBUG,
-                "Chunked trailers parsing complete for connection: %i",
-                buffer.size());
+        if (line_end == 0) {
+            // This is the end marker - consume it and finish
+            buffer.consume(2);
+            log(LOG_DEBUG, "Chunked trailers parsing complete");
             return codes::PARSE_SUCCESS;
         }
 
         // Otherwise, this is a trailer field - which we ignore
-
-        // Remove the processed line
-        buffer.erase(buffer.begin(), line_end + 2);
+        buffer.consume(line_end + 2);
     }
 }
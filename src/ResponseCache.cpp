@@ -0,0 +1,333 @@
+#include "webserv.hpp"
+
+static std::string to_lower(const std::string& str) {
+    std::string lower = str;
+    for (size_t i = 0; i < lower.size(); ++i) {
+        lower[i] = std::tolower(static_cast<unsigned char>(lower[i]));
+    }
+    return lower;
+}
+
+// Headers that describe one particular transfer and are rebuilt when a
+// cached response is served
+static bool is_per_response_header(const std::string& name) {
+    return name == "date" || name == "age" || name == "connection" ||
+           name == "content-length" || name == "transfer-encoding" ||
+           name == "status" || name == "x-cache";
+}
+
+ResponseCache::ResponseCache() : total_bytes_(0) {}
+
+ResponseCache::~ResponseCache() {}
+
+bool ResponseCache::serve_or_join(Connection* conn) {
+    const Location* location = conn->location_match_;
+    const HttpRequest* request = conn->request_data_;
+
+    // Only body-less GETs and HEADs to dynamic content of caching locations
+    bool is_head = request->method_type_ == codes::METHOD_HEAD;
+    if (!location || location->cache_ttl_ <= 0 || conn->cache_bypass_ ||
+        (request->method_type_ != codes::METHOD_GET && !is_head) ||
+        !request->body_.empty() ||
+        request->has_header(codes::HEADER_AUTHORIZATION) ||
+        (conn->conn_state_ != codes::CONN_CGI_EXEC &&
+         conn->conn_state_ != codes::CONN_PROXYING)) {
+        return false;
+    }
+
+    std::string key = make_key(conn);
+    time_t now = time(NULL);
+    bool in_flight = pending_.count(key) > 0;
+
+    std::map<std::string, CachedResponse>::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+        if (now < it->second.fresh_until_) {
+            serve(conn, it->second, "HIT");
+            return true;
+        }
+        // Someone is already refreshing it, the stale copy will do
+        if (now < it->second.stale_until_ && in_flight) {
+            serve(conn, it->second, "STALE");
+            return true;
+        }
+    }
+
+    // A HEAD is answered from a stored GET response but never fills the
+    // cache, as its response has no body to store
+    if (is_head) {
+        return false;
+    }
+
+    conn->cache_key_ = key;
+    if (in_flight) {
+        // Collapse onto the request that is already at the backend
+        pending_[key].push_back(conn);
+        conn->conn_state_ = codes::CONN_CACHE_WAIT;
+        WebServer::update_epoll_events(conn->client_fd_, 0);
+        log(LOG_DEBUG, "Client_fd %d waits for in-flight response to %s",
+            conn->client_fd_, key.c_str());
+        return true;
+    }
+
+    // This request fetches the response for everyone
+    pending_[key];
+    conn->cache_leader_ = true;
+    log(LOG_DEBUG, "Client_fd %d fetches %s for the response cache",
+        conn->client_fd_, key.c_str());
+    return false;
+}
+
+void ResponseCache::complete(Connection* leader) {
+    std::string header_lines;
+    const HttpResponse* resp = leader->response_data_;
+    if (!resp->content_type_.empty()) {
+        header_lines.append("Content-Type: ").append(resp->content_type_);
+        header_lines.append(CRLF);
+    }
+    for (size_t i = 0; i < resp->headers_.size(); ++i) {
+        header_lines.append(resp->headers_[i].name_).append(": ");
+        header_lines.append(resp->headers_[i].value_).append(CRLF);
+    }
+    complete(leader, header_lines, leader->response_data_->body_);
+}
+
+void ResponseCache::complete(Connection* leader,
+                             const std::string& header_lines,
+                             const std::vector<char>& body) {
+    if (!leader->cache_leader_) {
+        return;
+    }
+
+    store(leader, header_lines, body);
+    leader->cache_leader_ = false;
+    release_waiters(leader->cache_key_);
+    leader->cache_key_.clear();
+}
+
+void ResponseCache::abandon(Connection* leader) {
+    if (!leader->cache_leader_) {
+        return;
+    }
+
+    log(LOG_DEBUG, "Client_fd %d gave up fetching %s", leader->client_fd_,
+        leader->cache_key_.c_str());
+    leader->cache_leader_ = false;
+    release_waiters(leader->cache_key_);
+    leader->cache_key_.clear();
+}
+
+void ResponseCache::cancel(Connection* conn) {
+    if (conn->cache_leader_) {
+        abandon(conn);
+        return;
+    }
+    if (conn->cache_key_.empty()) {
+        return;
+    }
+
+    std::map<std::string, std::vector<Connection*> >::iterator it =
+        pending_.find(conn->cache_key_);
+    if (it != pending_.end()) {
+        std::vector<Connection*>& waiters = it->second;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), conn),
+                      waiters.end());
+    }
+    conn->cache_key_.clear();
+}
+
+int ResponseCache::remove_expired(time_t now) {
+    int removed = 0;
+    std::map<std::string, CachedResponse>::iterator it = entries_.begin();
+    while (it != entries_.end()) {
+        std::map<std::string, CachedResponse>::iterator current = it++;
+        if (now >= current->second.stale_until_) {
+            erase_entry(current);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void ResponseCache::store(const Connection* leader,
+                          const std::string& header_lines,
+                          const std::vector<char>& body) {
+    const std::string& key = leader->cache_key_;
+    time_t ttl = leader->location_match_->cache_ttl_;
+    time_t stale = leader->location_match_->cache_stale_;
+    bool cacheable = (leader->response_data_->status_code_ == codes::OK &&
+                      body.size() <= http_limits::MAX_CACHED_RESPONSE_SIZE);
+
+    // Keep the headers that belong to the content, and let the backend's
+    // Cache-Control override the location defaults
+    std::string kept;
+    long max_age = -1;
+    long s_maxage = -1;
+    size_t pos = 0;
+    while (cacheable && pos < header_lines.length()) {
+        size_t end = header_lines.find(CRLF, pos);
+        if (end == std::string::npos) {
+            end = header_lines.length();
+        }
+        std::string line = header_lines.substr(pos, end - pos);
+        pos = end + 2;
+
+        size_t colon_pos = line.find(':');
+        std::string name = to_lower(line.substr(0, colon_pos));
+        if (is_per_response_header(name)) {
+            continue;
+        }
+        kept.append(line).append(CRLF);
+
+        if (name == "set-cookie") {
+            cacheable = false;  // Meant for one client only
+        } else if (name == "vary") {
+            // Depends on request headers the key does not hold
+            cacheable = false;
+        } else if (name == "cache-control" && colon_pos != std::string::npos) {
+            std::istringstream directives(line.substr(colon_pos + 1));
+            std::string directive;
+            while (std::getline(directives, directive, ',')) {
+                directive = to_lower(trim(directive));
+                if (directive == "no-store" || directive == "no-cache" ||
+                    directive == "private") {
+                    cacheable = false;
+                } else if (directive.compare(0, 9, "s-maxage=") == 0) {
+                    s_maxage = std::atol(directive.c_str() + 9);
+                } else if (directive.compare(0, 8, "max-age=") == 0) {
+                    max_age = std::atol(directive.c_str() + 8);
+                } else if (directive.compare(0, 23,
+                                             "stale-while-revalidate=") == 0) {
+                    stale = std::atol(directive.c_str() + 23);
+                }
+            }
+        }
+    }
+    if (s_maxage >= 0) {
+        ttl = s_maxage;
+    } else if (max_age >= 0) {
+        ttl = max_age;
+    }
+
+    std::map<std::string, CachedResponse>::iterator it = entries_.find(key);
+    if (!cacheable || ttl <= 0) {
+        // Whatever was cached before is no longer what the backend says
+        if (it != entries_.end()) {
+            erase_entry(it);
+        }
+        log(LOG_DEBUG, "Response to %s is not cacheable", key.c_str());
+        return;
+    }
+
+    time_t now = time(NULL);
+    size_t old_size = (it != entries_.end()) ? it->second.body_.size() : 0;
+    if (total_bytes_ - old_size + body.size() >
+        http_limits::MAX_RESPONSE_CACHE_SIZE) {
+        remove_expired(now);
+        it = entries_.find(key);
+        old_size = (it != entries_.end()) ? it->second.body_.size() : 0;
+        if (total_bytes_ - old_size + body.size() >
+            http_limits::MAX_RESPONSE_CACHE_SIZE) {
+            log(LOG_WARNING, "Response cache full, not storing %s",
+                key.c_str());
+            return;
+        }
+    }
+
+    CachedResponse& entry = entries_[key];
+    total_bytes_ = total_bytes_ - old_size + body.size();
+    entry.status_code_ = leader->response_data_->status_code_;
+    entry.header_lines_ = kept;
+    entry.body_ = body;
+    entry.stored_at_ = now;
+    entry.fresh_until_ = now + ttl;
+    entry.stale_until_ = entry.fresh_until_ + stale;
+
+    log(LOG_DEBUG, "Cached %s for %ld s (+%ld s stale), %zu bytes",
+        key.c_str(), static_cast<long>(ttl), static_cast<long>(stale),
+        body.size());
+}
+
+void ResponseCache::release_waiters(const std::string& key) {
+    std::map<std::string, std::vector<Connection*> >::iterator pending_it =
+        pending_.find(key);
+    if (pending_it == pending_.end()) {
+        return;
+    }
+    std::vector<Connection*> waiters;
+    waiters.swap(pending_it->second);
+    pending_.erase(pending_it);
+
+    time_t now = time(NULL);
+    std::map<std::string, CachedResponse>::iterator it = entries_.find(key);
+    bool usable = (it != entries_.end() && now < it->second.stale_until_);
+
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        Connection* waiter = waiters[i];
+        waiter->cache_key_.clear();
+
+        if (usable) {
+            serve(waiter, it->second,
+                  now < it->second.fresh_until_ ? "HIT" : "STALE");
+        } else {
+            // Nothing to share: run the handler as if the cache was off
+            waiter->cache_bypass_ = true;
+            waiter->active_handler_ = NULL;
+            waiter->conn_state_ = codes::CONN_PROCESSING;
+        }
+        WebServer::update_epoll_events(waiter->client_fd_, EPOLLOUT);
+    }
+
+    if (!waiters.empty()) {
+        log(LOG_DEBUG, "Released %zu requests waiting for %s", waiters.size(),
+            key.c_str());
+    }
+}
+
+void ResponseCache::erase_entry(
+    std::map<std::string, CachedResponse>::iterator it) {
+    total_bytes_ -= it->second.body_.size();
+    entries_.erase(it);
+}
+
+std::string ResponseCache::make_key(const Connection* conn) {
+    const HttpRequest* request = conn->request_data_;
+    std::string host = request->has_header(codes::HEADER_HOST)
+                           ? to_lower(request->get_header(codes::HEADER_HOST))
+                           : conn->virtual_server_->host_name_;
+    // The same Host can reach other servers on other listeners, so the
+    // server and location that answer are part of the key
+    char scope[64];
+    snprintf(scope, sizeof(scope), "%p %p ",
+             static_cast<const void*>(conn->virtual_server_),
+             static_cast<const void*>(conn->location_match_));
+    // HEAD shares the entry of the GET for the same URI
+    return scope + ("GET " + host + " " + request->uri_);
+}
+
+void ResponseCache::serve(Connection* conn, const CachedResponse& entry,
+                          const char* cache_status) {
+    std::ostringstream head;
+    head << conn->request_data_->version_ << " " << entry.status_code_ << " "
+         << status_reason(entry.status_code_) << CRLF
+         << entry.header_lines_ << "Date: " << http_date() << CRLF
+         << "Age: " << (time(NULL) - entry.stored_at_) << CRLF
+         << "X-Cache: " << cache_status << CRLF;
+    if (!conn->is_keep_alive()) {
+        head << "Connection: close" CRLF;
+    }
+    head << "Content-Length: " << entry.body_.size() << CRLF << CRLF;
+
+    std::string head_str = head.str();
+    conn->write_buffer_.insert(conn->write_buffer_.end(), head_str.begin(),
+                               head_str.end());
+    if (conn->request_data_->method_type_ != codes::METHOD_HEAD) {
+        conn->write_buffer_.insert(conn->write_buffer_.end(),
+                                   entry.body_.begin(), entry.body_.end());
+    }
+    conn->response_prepared_ = true;
+    conn->response_data_->status_code_ = entry.status_code_;
+    conn->conn_state_ = codes::CONN_WRITING;
+
+    log(LOG_DEBUG, "Cache %s for client_fd %d", cache_status,
+        conn->client_fd_);
+}
@@ -13,51 +13,42 @@ codes::WriteStatus ResponseWriter::write_response(Connection* conn) {
         return codes::WRITING_ERROR;
     }
 
-    // If buffer is empty, prepare the response data first
-    if (conn->write_buffer_.empty()) {
-        // Write headers
-        if (!write_headers(conn)) {
-            return codes::WRITING_ERROR;
-        }
-
-        // Write body
-        if (!write_body(conn)) {
-            return codes::WRITING_ERROR;
-        }
-    }
-
-    // Nothing to send
-    if (conn->write_buffer_.empty()) {
-        return codes::WRITING_SUCCESS;
+    if (!prepare_response(conn)) {
+        return codes::WRITING_ERROR;
     }
 
-    // Send the response
-    ssize_t bytes_written =
-        send(conn->client_fd_,
-             conn->write_buffer_.data() + conn->write_buffer_offset_,
-             conn->write_buffer_.size() - conn->write_buffer_offset_,
-             MSG_NOSIGNAL);  // Prevents SIGPIPE
+    struct iovec parts[3];
+    size_t count = response_parts(conn, parts);
+    return send_parts(conn, parts, count);
+}
 
-    // Check for errors (any non positive return is an error)
-    if (bytes_written <= 0) {
-        // With level-triggered epoll, if we're here, it's a real error
-        // No need to check errno specifically
-        return codes::WRITING_ERROR;
+bool ResponseWriter::hold_response(Connection* conn) {
+    if (conn->write_buffer_offset_ != 0 || !prepare_response(conn)) {
+        return false;
     }
 
-    // Update the offset instead of erasing
-    conn->write_buffer_offset_ += bytes_written;
-
-    // Update the last activity timestamp
-    conn->last_activity_ = time(NULL);
+    struct iovec parts[3];
+    size_t count = response_parts(conn, parts);
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        length += parts[i].iov_len;
+    }
+    IoBuffer& held = conn->pipelined_output_;
+    if (held.size() + length > http_limits::PIPELINE_BATCH_SIZE) {
+        return false;
+    }
 
-    // Check if we've written everything
-    if (conn->write_buffer_offset_ == conn->write_buffer_.size()) {
-        return codes::WRITING_SUCCESS;
+    for (size_t i = 0; i < count; ++i) {
+        const char* data = static_cast<const char*>(parts[i].iov_base);
+        held.insert(held.end(), data, data + parts[i].iov_len);
     }
+    log(LOG_DEBUG, "Holding back %zu byte response for client_fd %d, %zu held",
+        length, conn->client_fd_, held.size());
+    return true;
+}
 
-    // More data to send
-    return codes::WRITING_INCOMPLETE;
+codes::WriteStatus ResponseWriter::send_held_responses(Connection* conn) {
+    return send_parts(conn, NULL, 0);
 }
 
 bool ResponseWriter::write_headers(Connection* conn) {
@@ -65,76 +56,144 @@ bool ResponseWriter::write_headers(Connection* conn) {
         return false;
     }
 
-    HttpResponse* resp = conn->response_data_;
-
-    // Format the response status line and headers
-    std::stringstream headers;
+    // Tell the client its connection ends with this response
+    if (conn->request_data_ && !conn->is_keep_alive() &&
+        !conn->response_data_->find_header("connection")) {
+        conn->response_data_->set_header("Connection", "close");
+    }
 
-    headers << resp->version_ << " " << resp->status_code_ << " "
-            << get_status_message(resp->status_code_) << "\r\n";
+    // An error page brings its Content-Type, Content-Length and the end of
+    // the headers along
+    conn->response_data_->write_head(conn->write_buffer_, !conn->error_page_);
+    return true;
+}
 
-    // Add custom headers first
-    for (std::map<std::string, std::string>::const_iterator it =
-             resp->headers_.begin();
-         it != resp->headers_.end(); ++it) {
-        headers << it->first << ": " << it->second << "\r\n";
+// Serializes the response into the write buffer once, unless a handler
+// already streamed it there
+bool ResponseWriter::prepare_response(Connection* conn) {
+    if (conn->response_prepared_) {
+        return true;
     }
 
-    // Add default headers if not already set
-    if (resp->headers_.find("date") == resp->headers_.end()) {
-        headers << "Date: " << get_current_gmt_time() << "\r\n";
+    if (conn->fixed_response_) {
+        // Only the Date line and a Connection line for the last request,
+        // spliced into the return response of the location by
+        // response_parts()
+        static const char DATE[] = "Date: ";
+        const std::string& date = http_date();
+        conn->write_buffer_.assign(DATE, DATE + sizeof(DATE) - 1);
+        conn->write_buffer_.insert(conn->write_buffer_.end(), date.begin(),
+                                   date.end());
+        conn->write_buffer_.insert(conn->write_buffer_.end(), CRLF, CRLF + 2);
+        if (!conn->is_keep_alive()) {
+            static const char CLOSE[] = "Connection: close" CRLF;
+            conn->write_buffer_.insert(conn->write_buffer_.end(), CLOSE,
+                                       CLOSE + sizeof(CLOSE) - 1);
+        }
+    } else if (!write_headers(conn)) {
+        return false;
     }
+    conn->response_prepared_ = true;
+    return true;
+}
 
-    if (resp->headers_.find("server") == resp->headers_.end()) {
-        headers << "Server: Webserv/1.0\r\n";
+// The pieces the prepared response is sent from, in order: the write buffer
+// with the shared error page or the response body after it, or the return
+// response of the location with the Date line in the write buffer after its
+// status line
+size_t ResponseWriter::response_parts(Connection* conn, struct iovec* parts) {
+    bool is_head = conn->request_data_ &&
+                   conn->request_data_->method_type_ == codes::METHOD_HEAD;
+
+    if (conn->fixed_response_) {
+        const Location* location = conn->location_match_;
+        const std::string& response = location->return_response_;
+        size_t length =
+            is_head ? location->return_head_length_ : response.size();
+        parts[0].iov_base = const_cast<char*>(response.data());
+        parts[0].iov_len = location->return_status_length_;
+        parts[1].iov_base = &conn->write_buffer_[0];
+        parts[1].iov_len = conn->write_buffer_.size();
+        parts[2].iov_base = const_cast<char*>(response.data()) +
+                            location->return_status_length_;
+        parts[2].iov_len = length - location->return_status_length_;
+        return 3;
     }
 
-    if (resp->headers_.find("content-type") == resp->headers_.end() &&
-        !resp->content_type_.empty()) {
-        headers << "Content-Type: " << resp->content_type_ << "\r\n";
+    parts[0].iov_base =
+        conn->write_buffer_.empty() ? NULL : &conn->write_buffer_[0];
+    parts[0].iov_len = conn->write_buffer_.size();
+    if (!conn->error_page_) {
+        std::vector<char>& body = conn->response_data_->body_;
+        if (is_head || body.empty()) {
+            return 1;
+        }
+        parts[1].iov_base = &body[0];
+        parts[1].iov_len = body.size();
+        return 2;
     }
+    const ErrorPage* page = conn->error_page_;
+    parts[1].iov_base = const_cast<char*>(page->data_.data());
+    parts[1].iov_len = is_head ? page->headers_length_ : page->data_.size();
+    return 2;
+}
 
-    if (resp->headers_.find("content-length") == resp->headers_.end()) {
-        headers << "Content-Length: " << resp->content_length_ << "\r\n";
+// Sends the held back responses and what is left of parts in one sendmsg().
+// write_buffer_offset_ counts the bytes of all parts sent so far.
+codes::WriteStatus ResponseWriter::send_parts(Connection* conn,
+                                              struct iovec* parts,
+                                              size_t count) {
+    struct iovec message_parts[4];
+    size_t used = 0;
+    IoBuffer& held = conn->pipelined_output_;
+    if (!held.empty()) {
+        message_parts[used].iov_base = &held[0];
+        message_parts[used].iov_len = held.size();
+        ++used;
     }
 
-    // End headers section
-    headers << "\r\n";
-
-    // Convert to string and add to write buffer
-    std::string headers_str = headers.str();
-    conn->write_buffer_.insert(conn->write_buffer_.end(), headers_str.begin(),
-                               headers_str.end());
-
-    return true;
-}
-
-bool ResponseWriter::write_body(Connection* conn) {
-    if (!conn || !conn->response_data_) {
-        return false;
+    // Skip what was sent already
+    size_t skip = conn->write_buffer_offset_;
+    size_t remaining = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (skip >= parts[i].iov_len) {
+            skip -= parts[i].iov_len;
+            continue;
+        }
+        message_parts[used].iov_base =
+            static_cast<char*>(parts[i].iov_base) + skip;
+        message_parts[used].iov_len = parts[i].iov_len - skip;
+        remaining += message_parts[used].iov_len;
+        skip = 0;
+        ++used;
+    }
+    if (used == 0) {
+        return codes::WRITING_SUCCESS;
     }
 
-    // Add body content to write buffer if it exists
-    if (!conn->response_data_->body_.empty()) {
-        // Insert body content into write buffer (vector<char>)
-        conn->write_buffer_.insert(conn->write_buffer_.end(), 
-                                  conn->response_data_->body_.begin(),
-                                  conn->response_data_->body_.end());
-        
-        log(LOG_DEBUG, "Added %zu bytes of body content to write buffer for client_fd %d", 
-            conn->response_data_->body_.size(), conn->client_fd_);
-    } else {
-        log(LOG_WARNING, "Response body is empty for client_fd %d", conn->client_fd_);
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = message_parts;
+    message.msg_iovlen = used;
+    ssize_t bytes_written = sendmsg(conn->client_fd_, &message, MSG_NOSIGNAL);
+    if (bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return codes::WRITING_INCOMPLETE;
     }
-    
-    return true;
-}
+    if (bytes_written <= 0) {
+        return codes::WRITING_ERROR;
+    }
+    conn->last_activity_ = time(NULL);
 
-std::string ResponseWriter::get_current_gmt_time() const {
-    char buffer[100];
-    time_t now = time(NULL);
-    struct tm* tm_info = gmtime(&now);
+    // The held back responses went first
+    size_t sent = bytes_written;
+    if (sent < held.size()) {
+        held.erase(held.begin(), held.begin() + sent);
+        return codes::WRITING_INCOMPLETE;
+    }
+    sent -= held.size();
+    held.clear();
 
-    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", tm_info);
-    return std::string(buffer);
+    conn->write_buffer_offset_ += sent;
+    return sent == remaining ? codes::WRITING_SUCCESS
+                             : codes::WRITING_INCOMPLETE;
 }
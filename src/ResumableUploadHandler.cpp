@@ -0,0 +1,560 @@
+#include "webserv.hpp"
+
+// curl -i -X POST -H "Upload-Length: 11" http://localhost:8080/files/
+// curl -i -X PATCH -H "Upload-Offset: 0" -H "Content-Type:
+//     application/offset+octet-stream" -d "hello world" <Location>
+
+static const char* const TUS_VERSION = "1.0.0";
+static const char* const PATCH_CONTENT_TYPE = "application/offset+octet-stream";
+static const size_t UPLOAD_ID_BYTES = 16;  // Shown as twice as many hex digits
+
+// Partial uploads are kept in this subdirectory of the upload directory
+static const char* const STATE_DIR = ".resumable/";
+
+// Methods of the protocol, for Allow on anything else
+static const unsigned int UPLOAD_METHODS =
+    codes::METHOD_HEAD | codes::METHOD_POST | codes::METHOD_PATCH |
+    codes::METHOD_DELETE | codes::METHOD_OPTIONS;
+
+// Upload-Length and Upload-Offset: digits only
+static bool parse_upload_number(const std::string& value, size_t& number) {
+    if (value.empty() || value.size() > 18 ||
+        value.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    number = std::strtoul(value.c_str(), NULL, 10);
+    return true;
+}
+
+// Uploads of a location go to its root, whatever the request path
+static std::string upload_directory(Connection* conn) {
+    std::string root = conn->location_match_->root_;
+    if (!root.empty() && root[0] == '/') {
+        root = root.substr(1);
+    }
+    return root + "/uploads/";
+}
+
+static std::string format_number(size_t number) {
+    std::ostringstream oss;
+    oss << number;
+    return oss.str();
+}
+
+// <upload dir>.resumable/<id><extension>
+static std::string state_file(const std::string& upload_dir,
+                              const std::string& id, const char* extension) {
+    return upload_dir + STATE_DIR + id + extension;
+}
+
+// Standard base64 with padding, as Upload-Metadata values are encoded
+static bool decode_base64(const std::string& in, std::string& out) {
+    static const std::string alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (in.size() % 4 != 0) {
+        return false;
+    }
+    out.clear();
+    unsigned int bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (in[i] == '=') {
+            // Padding only at the very end
+            if (in.size() - i > 2 ||
+                in.find_first_not_of('=', i) != std::string::npos) {
+                return false;
+            }
+            break;
+        }
+        size_t value = alphabet.find(in[i]);
+        if (value == std::string::npos) {
+            return false;
+        }
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += static_cast<char>((bits >> count) & 0xFF);
+        }
+    }
+    return true;
+}
+
+ResumableUploadHandler::ResumableUploadHandler() : AHandler() {}
+
+ResumableUploadHandler::~ResumableUploadHandler() {}
+
+void ResumableUploadHandler::handle(Connection* conn) {
+    log(LOG_DEBUG,
+        "ResumableUploadHandler: Starting processing for client_fd %d",
+        conn->client_fd_);
+
+    // Called again once the file worker is done
+    if (conn->file_job_) {
+        FileJob* job = conn->file_job_;
+        conn->file_job_ = NULL;
+        send_job_result(conn, *job);
+        delete job;
+        return;
+    }
+
+    submit_job(conn, upload_directory(conn));
+}
+
+bool ResumableUploadHandler::open_spliced_body(Connection* conn) {
+    HttpRequest* request = conn->request_data_;
+    size_t offset;
+    std::string id = extract_upload_id(conn);
+    if (id.empty() ||
+        !request->header_equals(codes::HEADER_CONTENT_TYPE,
+                                PATCH_CONTENT_TYPE) ||
+        !parse_upload_number(request->get_header("upload-offset"), offset)) {
+        return false;
+    }
+
+    FileJob* job =
+        new FileJob(codes::FILE_JOB_RESUMABLE_OPEN, upload_directory(conn));
+    job->upload_id_ = id;
+    job->upload_offset_ = offset;
+    job->body_length_ = conn->body_remaining_bytes_;
+    WebServer::get_instance()->get_file_workers()->submit(conn, job);
+    return true;
+}
+
+void ResumableUploadHandler::submit_job(Connection* conn,
+                                        const std::string& upload_dir) {
+    HttpRequest* request = conn->request_data_;
+    FileWorkerPool* workers = WebServer::get_instance()->get_file_workers();
+
+    codes::Method method = request->method_type_;
+    if (method == codes::METHOD_POST) {
+        size_t length;
+        if (!parse_upload_number(request->get_header("upload-length"),
+                                 length)) {
+            log(LOG_ERROR,
+                "ResumableUploadHandler: Missing or bad Upload-Length");
+            send_error(conn, codes::BAD_REQUEST);
+            return;
+        }
+        FileJob* job =
+            new FileJob(codes::FILE_JOB_RESUMABLE_CREATE, upload_dir);
+        job->upload_length_ = length;
+        job->filename_ =
+            extract_metadata_filename(request->get_header("upload-metadata"));
+        workers->submit(conn, job);
+        return;
+    }
+    if (!(method & UPLOAD_METHODS)) {
+        send_error(conn, codes::METHOD_NOT_ALLOWED);
+        conn->response_data_->set_header("Allow",
+                                         method_list(UPLOAD_METHODS));
+        return;
+    }
+
+    std::string id = extract_upload_id(conn);
+    if (id.empty()) {
+        send_error(conn, codes::NOT_FOUND);
+        return;
+    }
+
+    codes::FileJobType type = codes::FILE_JOB_RESUMABLE_DELETE;
+    size_t offset = 0;
+    if (method == codes::METHOD_PATCH) {
+        if (!request->header_equals(codes::HEADER_CONTENT_TYPE,
+                                    PATCH_CONTENT_TYPE)) {
+            send_error(conn, codes::UNSUPPORTED_MEDIA_TYPE);
+            return;
+        }
+        if (!parse_upload_number(request->get_header("upload-offset"),
+                                 offset)) {
+            log(LOG_ERROR,
+                "ResumableUploadHandler: Missing or bad Upload-Offset");
+            send_error(conn, codes::BAD_REQUEST);
+            return;
+        }
+        type = codes::FILE_JOB_RESUMABLE_APPEND;
+    } else if (method == codes::METHOD_HEAD) {
+        type = codes::FILE_JOB_RESUMABLE_OFFSET;
+    }
+
+    FileJob* job = new FileJob(type, upload_dir);
+    job->upload_id_ = id;
+    job->upload_offset_ = offset;
+    if (type == codes::FILE_JOB_RESUMABLE_APPEND) {
+        if (conn->body_file_fd_ >= 0) {
+            job->fd_ = conn->body_file_fd_;
+            conn->body_file_fd_ = -1;
+            conn->discard_body_file();  // Only the pipe is left
+        } else {
+            job->body_.swap(request->body_);
+        }
+    }
+    workers->submit(conn, job);
+}
+
+void ResumableUploadHandler::send_job_result(Connection* conn,
+                                             const FileJob& job) {
+    HttpResponse* resp = conn->response_data_;
+
+    if (job.status_ != codes::OK) {
+        send_error(conn, job.status_);
+        // Tells the client where to continue from
+        if (job.status_ == codes::CONFLICT) {
+            resp->set_header("Upload-Offset",
+                             format_number(job.upload_offset_));
+        }
+        return;
+    }
+
+    switch (job.type_) {
+        case codes::FILE_JOB_RESUMABLE_CREATE: {
+            std::string location = conn->request_data_->path_;
+            if (location.empty() || location[location.size() - 1] != '/') {
+                location += '/';
+            }
+            send_response(conn, codes::CREATED);
+            resp->set_header("Location", location + job.upload_id_);
+            break;
+        }
+        case codes::FILE_JOB_RESUMABLE_APPEND:
+            send_response(conn, codes::NO_CONTENT);
+            resp->set_header("Upload-Offset",
+                             format_number(job.upload_offset_));
+            break;
+        case codes::FILE_JOB_RESUMABLE_OFFSET:
+            send_response(conn, codes::OK);
+            resp->set_header("Upload-Offset",
+                             format_number(job.upload_offset_));
+            resp->set_header("Upload-Length",
+                             format_number(job.upload_length_));
+            resp->set_header("Cache-Control", "no-store");
+            break;
+        default:
+            send_response(conn, codes::NO_CONTENT);
+            break;
+    }
+}
+
+void ResumableUploadHandler::create_upload(FileJob* job) {
+    const std::string& upload_dir = job->path_;
+
+    if (!make_directories(upload_dir + STATE_DIR)) {
+        int mkdir_errno = errno;
+        log(LOG_ERROR, "ResumableUploadHandler: Cannot create %s%s: %s",
+            upload_dir.c_str(), STATE_DIR, strerror(mkdir_errno));
+        job->status_ = (mkdir_errno == EACCES || mkdir_errno == EPERM)
+                           ? codes::FORBIDDEN
+                           : codes::INTERNAL_SERVER_ERROR;
+        return;
+    }
+
+    std::string id = generate_upload_id();
+    if (id.empty()) {
+        job->status_ = codes::INTERNAL_SERVER_ERROR;
+        return;
+    }
+
+    UploadInfo info;
+    info.length_ = job->upload_length_;
+    info.filename_ = job->filename_;
+
+    std::string part_path = state_file(upload_dir, id, ".part");
+    int fd = open(part_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  0644);
+    if (fd == -1 || !save_info(upload_dir, id, info)) {
+        int create_errno = errno;
+        log(LOG_ERROR, "ResumableUploadHandler: Cannot create upload %s: %s",
+            part_path.c_str(), strerror(create_errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(part_path.c_str());
+        }
+        job->status_ = create_errno == ENOSPC ? codes::INSUFFICIENT_STORAGE
+                                              : codes::INTERNAL_SERVER_ERROR;
+        return;
+    }
+    close(fd);
+    job->upload_id_ = id;
+
+    // Nothing to wait for with an empty file
+    if (info.length_ == 0 && !complete_upload(job, info)) {
+        return;
+    }
+
+    log(LOG_INFO, "ResumableUploadHandler: Created upload %s of %zu bytes",
+        id.c_str(), info.length_);
+    job->status_ = codes::OK;
+}
+
+void ResumableUploadHandler::open_upload_part(FileJob* job) {
+    UploadInfo info;
+    if (!load_info(job->path_, job->upload_id_, info)) {
+        return;
+    }
+
+    std::string part_path = state_file(job->path_, job->upload_id_, ".part");
+    int fd = open(part_path.c_str(), O_WRONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+
+    // Anything but a PATCH at the current offset that fits is refused once
+    // the body is read
+    size_t current = st.st_size;
+    if (job->upload_offset_ != current ||
+        job->body_length_ > info.length_ - current) {
+        close(fd);
+        return;
+    }
+    lseek(fd, current, SEEK_SET);
+    job->fd_ = fd;
+}
+
+void ResumableUploadHandler::append_to_upload(FileJob* job) {
+    const std::string& id = job->upload_id_;
+
+    UploadInfo info;
+    if (!load_info(job->path_, id, info)) {
+        job->status_ = codes::NOT_FOUND;
+        return;
+    }
+
+    size_t current;
+    if (job->fd_ != -1) {
+        // Spliced in as it arrived, see open_upload_part()
+        struct stat st;
+        if (fstat(job->fd_, &st) != 0) {
+            job->status_ = codes::INTERNAL_SERVER_ERROR;
+            return;
+        }
+        current = st.st_size;
+        close(job->fd_);
+        job->fd_ = -1;
+    } else if (!write_to_upload(job, info, current)) {
+        return;
+    }
+
+    job->upload_offset_ = current;
+    log(LOG_DEBUG, "ResumableUploadHandler: Upload %s at %zu of %zu bytes",
+        id.c_str(), current, info.length_);
+    if (current == info.length_ && !complete_upload(job, info)) {
+        return;
+    }
+    job->status_ = codes::OK;
+}
+
+void ResumableUploadHandler::report_offset(FileJob* job) {
+    UploadInfo info;
+    std::string part_path = state_file(job->path_, job->upload_id_, ".part");
+    struct stat st;
+    if (!load_info(job->path_, job->upload_id_, info) ||
+        stat(part_path.c_str(), &st) != 0) {
+        job->status_ = codes::NOT_FOUND;
+        return;
+    }
+
+    job->upload_offset_ = st.st_size;
+    job->upload_length_ = info.length_;
+    job->status_ = codes::OK;
+}
+
+void ResumableUploadHandler::delete_upload(FileJob* job) {
+    const std::string& id = job->upload_id_;
+
+    std::string info_path = state_file(job->path_, id, ".info");
+    if (unlink(info_path.c_str()) != 0) {
+        job->status_ = errno == ENOENT ? codes::NOT_FOUND
+                                       : codes::INTERNAL_SERVER_ERROR;
+        return;
+    }
+    unlink(state_file(job->path_, id, ".part").c_str());
+
+    log(LOG_INFO, "ResumableUploadHandler: Deleted upload %s", id.c_str());
+    job->status_ = codes::OK;
+}
+
+bool ResumableUploadHandler::write_to_upload(FileJob* job,
+                                             const UploadInfo& info,
+                                             size_t& offset) {
+    std::string part_path = state_file(job->path_, job->upload_id_, ".part");
+    int fd = open(part_path.c_str(), O_WRONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        int open_errno = errno;
+        log(LOG_ERROR, "ResumableUploadHandler: Cannot open %s: %s",
+            part_path.c_str(), strerror(open_errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        job->status_ = open_errno == ENOENT ? codes::NOT_FOUND
+                                            : codes::INTERNAL_SERVER_ERROR;
+        return false;
+    }
+
+    // The client has to continue exactly where the stored data ends
+    size_t current = st.st_size;
+    const RequestBody& body = job->body_;
+    if (job->upload_offset_ != current) {
+        log(LOG_ERROR,
+            "ResumableUploadHandler: Upload %s is at %zu, PATCH sent for %zu",
+            job->upload_id_.c_str(), current, job->upload_offset_);
+        close(fd);
+        job->upload_offset_ = current;
+        job->status_ = codes::CONFLICT;
+        return false;
+    }
+    if (body.size() > info.length_ - current) {
+        close(fd);
+        job->status_ = codes::PAYLOAD_TOO_LARGE;
+        return false;
+    }
+
+    // Written at an explicit position: sendfile() from a spooled body does
+    // not support O_APPEND. What was written before a failure stays, the
+    // client resumes from there.
+    lseek(fd, current, SEEK_SET);
+    size_t written = 0;
+    while (written < body.size()) {
+        ssize_t bytes = body.write_to(fd, written, body.size() - written);
+        if (bytes <= 0) {
+            break;
+        }
+        written += bytes;
+    }
+    int write_errno = errno;
+    close(fd);
+
+    if (written != body.size()) {
+        log(LOG_ERROR, "ResumableUploadHandler: Failed to append to %s: %s",
+            part_path.c_str(), strerror(write_errno));
+        job->status_ = write_errno == ENOSPC ? codes::INSUFFICIENT_STORAGE
+                                             : codes::INTERNAL_SERVER_ERROR;
+        return false;
+    }
+    offset = current + written;
+    return true;
+}
+
+bool ResumableUploadHandler::complete_upload(FileJob* job,
+                                             const UploadInfo& info) {
+    const std::string& id = job->upload_id_;
+    std::string target =
+        job->path_ + (info.filename_.empty() ? id : info.filename_);
+    std::string part_path = state_file(job->path_, id, ".part");
+
+    if (rename(part_path.c_str(), target.c_str()) != 0) {
+        log(LOG_ERROR, "ResumableUploadHandler: Cannot move %s to %s: %s",
+            part_path.c_str(), target.c_str(), strerror(errno));
+        job->status_ = codes::INTERNAL_SERVER_ERROR;
+        return false;
+    }
+    unlink(state_file(job->path_, id, ".info").c_str());
+
+    log(LOG_INFO, "ResumableUploadHandler: Upload %s stored as %s",
+        id.c_str(), target.c_str());
+    return true;
+}
+
+bool ResumableUploadHandler::load_info(const std::string& upload_dir,
+                                       const std::string& id,
+                                       UploadInfo& info) {
+    std::ifstream file(state_file(upload_dir, id, ".info").c_str());
+    std::string key;
+    if (!(file >> key) || key != "length" || !(file >> info.length_)) {
+        return false;
+    }
+    info.filename_.clear();
+    if (file >> key && key == "filename") {
+        file >> info.filename_;
+    }
+    return true;
+}
+
+bool ResumableUploadHandler::save_info(const std::string& upload_dir,
+                                       const std::string& id,
+                                       const UploadInfo& info) {
+    std::string path = state_file(upload_dir, id, ".info");
+    std::ofstream file(path.c_str());
+    file << "length " << info.length_ << "\n";
+    if (!info.filename_.empty()) {
+        file << "filename " << info.filename_ << "\n";
+    }
+    file.close();
+    if (file.fail()) {
+        unlink(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string ResumableUploadHandler::extract_upload_id(Connection* conn) {
+    const std::string& path = conn->request_data_->path_;
+    std::string id = path.substr(path.find_last_of('/') + 1);
+    if (id.size() != UPLOAD_ID_BYTES * 2 ||
+        id.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        log(LOG_DEBUG, "ResumableUploadHandler: No upload id in %s",
+            path.c_str());
+        return "";
+    }
+    return id;
+}
+
+std::string ResumableUploadHandler::generate_upload_id() {
+    unsigned char bytes[UPLOAD_ID_BYTES];
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || read(fd, bytes, sizeof(bytes)) !=
+                        static_cast<ssize_t>(sizeof(bytes))) {
+        log(LOG_ERROR, "ResumableUploadHandler: Cannot read /dev/urandom: %s",
+            strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return "";
+    }
+    close(fd);
+
+    static const char hex[] = "0123456789abcdef";
+    std::string id;
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        id += hex[bytes[i] >> 4];
+        id += hex[bytes[i] & 0x0F];
+    }
+    return id;
+}
+
+// Upload-Metadata is "key base64value" pairs separated by commas
+std::string ResumableUploadHandler::extract_metadata_filename(
+    const std::string& metadata) {
+    std::istringstream pairs(metadata);
+    std::string pair;
+    while (std::getline(pairs, pair, ',')) {
+        std::istringstream fields(pair);
+        std::string key, value, filename;
+        if (fields >> key && key == "filename" && fields >> value &&
+            decode_base64(value, filename) && !filename.empty()) {
+            return sanitize_filename(filename);
+        }
+    }
+    return "";
+}
+
+void ResumableUploadHandler::send_response(Connection* conn,
+                                           codes::ResponseStatus status) {
+    HttpResponse* resp = conn->response_data_;
+    resp->set_status(status);
+    resp->body_.clear();
+    resp->content_length_ = 0;
+    resp->set_header("Content-Length", "0");
+    resp->set_header("Tus-Resumable", TUS_VERSION);
+    conn->conn_state_ = codes::CONN_WRITING;
+}
+
+void ResumableUploadHandler::send_error(Connection* conn,
+                                        codes::ResponseStatus status) {
+    ErrorHandler::generate_error_response(conn, status);
+    conn->response_data_->set_header("Tus-Resumable", TUS_VERSION);
+}
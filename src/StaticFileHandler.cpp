@@ -3,8 +3,8 @@
 // StaticFileHandler Flow
 
 // 1. Location Redirect Check
-// Checks if the location has a configured redirect
-// Returns 301 Moved Permanently if a redirect is configured
+// Locations with a return (or redirect) directive are answered by WebServer
+// from their precompiled response before any handler runs
 
 // 2. Method Validation
 // Verifies the request uses the GET method
@@ -13,6 +13,8 @@
 // 3. Path Resolution
 // Converts the URI to an absolute filesystem path
 // Combines location root with the relative path portion
+// Everything below that touches the filesystem runs as one FileJob on the
+// FileWorkerPool, the handler is called again with its result
 
 // 4. Directory Redirect Check
 // Checks if the path is a directory but URI lacks trailing slash
@@ -24,7 +26,9 @@
 // Sets up autoindex flag if needed
 
 // 6. Directory Listing Generation
-// Generates HTML directory listing if autoindex is enabled
+// Generates HTML directory listing if autoindex is enabled, or keeps the
+// cached one while the directory's mtime is unchanged
+// Listings of more than one page are streamed, chunked for HTTP/1.1
 // Returns 403 Forbidden if autoindex is disabled
 
 // 7. File Existence Check
@@ -44,8 +48,7 @@
 // Defaults to application/octet-stream if type is unknown
 
 // 11. File Reading
-// Reads the file content into memory
-// Handles large files appropriately
+// Reads the file content into memory (on the worker thread)
 
 // 12. Response Generation
 // Sets status code to 200 OK for successful requests
@@ -63,141 +66,144 @@ StaticFileHandler::~StaticFileHandler() {}
 void StaticFileHandler::handle(Connection* conn) {
     log(LOG_DEBUG, "StaticFileHandler::handle called for client_fd %d",
         conn->client_fd_);
-    //--CHECK Check if the request has errors to return an error response
 
-    // Fluxogram 301 - when location has redirect
-    if (process_location_redirect(conn)) {
-        return;  // Redirect response was set up, we're done
+    // A large directory listing is being sent
+    if (conn->listing_) {
+        stream_directory_listing(conn);
+        return;
     }
 
-    // Fluxogram 405 - call error handler
-    // Check if the request method is allowed (only supporting GET) // Fluxogram
-    // --CHECK I don't think it is necessary because of route
-    // if (conn->request_data_->method_ != "GET") {
-    //     ErrorHandler::generate_error_response(conn,
-    //     codes::METHOD_NOT_ALLOWED); conn->response_data_->headers_["Allow"] =
-    //     "GET"; log(LOG_DEBUG, "StaticFileHandler::handle: Method not allowed
-    //     for client_fd %d",
-    //         conn->client_fd_);
-    //     return;
-    // }
-
-    std::string absolute_path = parse_absolute_path(conn);
-
-    // TEMP - Carol
-    // if absolute_path ends with a slash, add index at end
-    // if (!absolute_path.empty() && absolute_path[absolute_path.size() - 1] ==
-    // '/') {
-    //     std::cout << "Location match index: " <<
-    //     conn->location_match_->index_ << std::endl; absolute_path +=
-    //     conn->location_match_->index_; std::cout << "New absolute path: " <<
-    //     absolute_path << std::endl;
-    // }
-    if (!absolute_path.empty() &&
-        absolute_path[absolute_path.size() - 1] == '/') {
-        if (conn->location_match_) {  // Add this null check
-            std::cout << "Location match index: "
-                      << conn->location_match_->index_ << std::endl;
-            absolute_path += conn->location_match_->index_;
-            std::cout << "New absolute path: " << absolute_path << std::endl;
-        } else {
-            log(LOG_ERROR,
-                "StaticFileHandler::handle: location_match_ is NULL for "
-                "client_fd %d",
-                conn->client_fd_);
-            ErrorHandler::generate_error_response(conn,
-                                                  codes::INTERNAL_SERVER_ERROR);
-            return;
+    // Called again once the file job below is done
+    if (conn->file_job_) {
+        FileJob* job = conn->file_job_;
+        conn->file_job_ = NULL;
+        respond(conn, *job);
+        delete job;
+        return;
+    }
+
+    submit_load(conn, true);
+}
+
+void StaticFileHandler::submit_load(Connection* conn, bool use_cached_listing) {
+    // A path with a trailing slash is served from its index file, or listed
+    // if autoindex is on
+    const std::string& path = conn->request_data_->path_;
+    FileJob* job = new FileJob(codes::FILE_JOB_LOAD, parse_absolute_path(conn));
+    if (!path.empty() && path[path.size() - 1] == '/') {
+        job->index_ = conn->location_match_->index_;
+        job->list_directory_ = conn->location_match_->autoindex_;
+        job->listing_uri_ = path;
+    }
+    // HEAD needs the size only, the file is not read
+    job->read_content_ =
+        conn->request_data_->method_type_ != codes::METHOD_HEAD;
+
+    // The worker keeps a cached listing whose directory is unchanged
+    if (job->list_directory_ && use_cached_listing) {
+        DirectoryListingCache* cache =
+            WebServer::get_instance()->get_listing_cache();
+        DirectoryListing* cached = cache->acquire(
+            DirectoryListingCache::make_key(job->path_, job->listing_uri_));
+        if (cached) {
+            job->has_cached_listing_ = true;
+            job->cached_mtime_ = cached->mtime_;
+            DirectoryListingCache::release(cached);
         }
     }
 
-    // Fluxogram 301 - check if the request should be a directory
-    if (process_directory_redirect(conn, absolute_path)) {
-        log(LOG_DEBUG,
-            "StaticFileHandler::handle: Directory redirect for client_fd %d",
-            conn->client_fd_);
-        return;  // Redirect was set up, we're done
+    log(LOG_DEBUG, "StaticFileHandler: Loading %s for client_fd %d",
+        job->path_.c_str(), conn->client_fd_);
+    WebServer::get_instance()->get_file_workers()->submit(conn, job);
+}
+
+void StaticFileHandler::respond(Connection* conn, FileJob& job) {
+    // Fluxogram 404 - request resource not found - call error handler
+    if (!job.exists_) {
+        log(LOG_DEBUG, "StaticFileHandler: Cannot stat %s: %s",
+            job.path_.c_str(), strerror(job.error_));
+        ErrorHandler::generate_error_response(conn,
+                                              status_for_error(job.error_));
+        return;
     }
 
-    bool need_autoindex = false;
-    if (process_directory_index(conn, absolute_path, need_autoindex)) {
-        if (need_autoindex) {
-            generate_directory_listing(conn, absolute_path);
-            log(LOG_DEBUG,
-                "StaticFileHandler::handle: Autoindex generated for client_fd "
-                "%d",
-                conn->client_fd_);
-            conn->conn_state_ = codes::CONN_WRITING;
-            return;
-        }
+    // A regular file, possibly the index file of the directory
+    if (!job.file_.empty()) {
+        send_file(conn, job);
+        return;
     }
 
-    // Try to open the file
-    int fd = open(absolute_path.c_str(), O_RDONLY);
-    log(LOG_DEBUG, "StaticFileHandler: Trying to open file: %s",
-        absolute_path.c_str());
-    log(LOG_DEBUG, "StaticFileHandler: open() returned fd=%d, errno=%d (%s)",
-        fd, errno, (fd == -1) ? strerror(errno) : "success");
-    if (fd == -1) {
-        // Fluxogram 404 - request resource not found - call error handler
-        if (errno == ENOENT) {
-            // File not found
-            ErrorHandler::generate_error_response(conn, codes::NOT_FOUND);
-            log(LOG_DEBUG,
-                "StaticFileHandler::handle: File not found for client_fd %d",
-                conn->client_fd_);
-            // Not in the Fluxogram, but possible 403 - call error handler
-        } else if (errno == EACCES) {
-            // Permission denied
-            ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
-            log(LOG_DEBUG,
-                "StaticFileHandler::handle: Permission denied for client_fd %d",
-                conn->client_fd_);
-            // Not in the Fluxogram, but possible 500 - call error handler
-        } else {
-            // Other error
-            std::cout << "1" << std::endl;
-            ErrorHandler::generate_error_response(conn,
-                                                  codes::INTERNAL_SERVER_ERROR);
-            log(LOG_DEBUG,
-                "StaticFileHandler::handle: Internal server error for "
-                "client_fd %d",
-                conn->client_fd_);
-        }
+    // Not in the Fluxogram, but possible 403 - devices, sockets etc.
+    if (!S_ISDIR(job.stat_.st_mode)) {
+        ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
         return;
     }
 
-    // Get file info
-    // Not in the Fluxogram, but possible 500 - call error handler
-    struct stat file_info;
-    if (fstat(fd, &file_info) == -1) {
-        close(fd);
-        std::cout << "2" << std::endl;
-        ErrorHandler::generate_error_response(conn,
-                                              codes::INTERNAL_SERVER_ERROR);
+    // Fluxogram 301 - check if the request should be a directory
+    if (process_directory_redirect(conn)) {
         log(LOG_DEBUG,
-            "StaticFileHandler::handle: fstat failed for client_fd %d",
+            "StaticFileHandler::handle: Directory redirect for client_fd %d",
             conn->client_fd_);
         return;
     }
 
-    // Check if it's a regular file
-    // Not in the Fluxogram, but possible 403 - call error handler
-    if (!S_ISREG(file_info.st_mode)) {
-        close(fd);
-        ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
+    if (job.listing_ || job.listing_current_) {
+        send_listing(conn, job);
+    } else if (job.list_directory_) {
+        log(LOG_ERROR, "Failed to open directory for listing: %s",
+            strerror(job.error_));
+        ErrorHandler::generate_error_response(conn,
+                                              status_for_error(job.error_));
+    } else {
+        // Fluxogram 403 - autoindex off - call error handler
         log(LOG_DEBUG,
-            "StaticFileHandler::handle: File is not a regular file for "
-            "client_fd %d",
-            conn->client_fd_);
+            "StaticFileHandler: No index file and autoindex off for %s",
+            job.path_.c_str());
+        ErrorHandler::generate_error_response(conn, codes::FORBIDDEN);
+    }
+}
+
+void StaticFileHandler::send_listing(Connection* conn, FileJob& job) {
+    DirectoryListingCache* cache =
+        WebServer::get_instance()->get_listing_cache();
+    std::string key =
+        DirectoryListingCache::make_key(job.path_, job.listing_uri_);
+
+    DirectoryListing* listing;
+    if (job.listing_) {
+        listing = job.listing_;
+        job.listing_ = NULL;
+        cache->store(key, listing);
+    } else {
+        // Replaced by a newer listing meanwhile is fine, gone is not
+        listing = cache->acquire(key);
+        if (!listing) {
+            submit_load(conn, false);
+            return;
+        }
+    }
+
+    generate_directory_listing(conn, listing);
+    DirectoryListingCache::release(listing);
+    log(LOG_DEBUG,
+        "StaticFileHandler::handle: Autoindex generated for client_fd %d",
+        conn->client_fd_);
+}
+
+void StaticFileHandler::send_file(Connection* conn, FileJob& job) {
+    if (job.error_) {
+        log(LOG_DEBUG, "StaticFileHandler: Cannot read %s: %s",
+            job.file_.c_str(), strerror(job.error_));
+        ErrorHandler::generate_error_response(conn,
+                                              status_for_error(job.error_));
         return;
     }
 
     // Determine content type
     std::string content_type = "application/octet-stream";  // Default type
-    size_t dot_pos = absolute_path.find_last_of('.');
+    size_t dot_pos = job.file_.find_last_of('.');
     if (dot_pos != std::string::npos) {
-        std::string extension = absolute_path.substr(dot_pos + 1);
+        std::string extension = job.file_.substr(dot_pos + 1);
         // Map common extensions to MIME types
         if (extension == "html" || extension == "htm") {
             content_type = "text/html";
@@ -216,37 +222,33 @@ void StaticFileHandler::handle(Connection* conn) {
         }
     }
 
-    // Read the file content
-    std::vector<char> file_content(file_info.st_size);
-    ssize_t bytes_read = read(fd, &file_content[0], file_info.st_size);
-    close(fd);
-
-    // Not in the Fluxogram, but possible 500 - call error handler
-    if (bytes_read != file_info.st_size) {
-        std::cout << "3" << std::endl;
-        ErrorHandler::generate_error_response(conn,
-                                              codes::INTERNAL_SERVER_ERROR);
-        log(LOG_DEBUG, "StaticFileHandler::handle: Read error for client_fd %d",
-            conn->client_fd_);
-        return;
-    }
-
     // Prepare response headers
     conn->response_data_->set_header("Content-Type", content_type);
 
     // Convert file size to string using ostringstream (C++98 compatible)
     std::ostringstream size_stream;
-    size_stream << file_info.st_size;
+    size_stream << job.stat_.st_size;
     conn->response_data_->set_header("Content-Length", size_stream.str());
 
     // Prepare the response
     // Fluxogram 200
     conn->response_data_->status_code_ = 200;
     conn->response_data_->status_message_ = "OK";
-    conn->response_data_->body_.assign(file_content.begin(),
-                                       file_content.end());
+    if (conn->request_data_->method_type_ != codes::METHOD_HEAD) {
+        conn->response_data_->body_.swap(job.content_);
+    }
     conn->conn_state_ = codes::CONN_WRITING;
     log(LOG_DEBUG,
         "StaticFileHandler::handle: File served successfully for client_fd %d",
         conn->client_fd_);
 }
+
+codes::ResponseStatus StaticFileHandler::status_for_error(int error) {
+    if (error == ENOENT || error == ENOTDIR) {
+        return codes::NOT_FOUND;
+    }
+    if (error == EACCES || error == EPERM) {
+        return codes::FORBIDDEN;
+    }
+    return codes::INTERNAL_SERVER_ERROR;
+}
@@ -0,0 +1,502 @@
+#include "webserv.hpp"
+
+// Peak-EWMA decay window: older latency samples lose weight over ~10s
+static const double EWMA_DECAY_MS = 10000.0;
+
+//--------------------------------------
+// UpstreamServer
+//--------------------------------------
+
+UpstreamServer::UpstreamServer()
+    : sockaddr_len_(0),
+      index_(0),
+      inflight_(0),
+      last_pick_(0),
+      ewma_ms_(0.0),
+      ewma_stamp_ms_(0.0),
+      requests_(0),
+      failures_(0),
+      consecutive_failures_(0),
+      healthy_(true),
+      retry_at_ms_(0.0) {
+    memset(&sockaddr_, 0, sizeof(sockaddr_));
+}
+
+bool UpstreamServer::parse_address(const std::string& address,
+                                   UpstreamServer& server) {
+    // Unix domain socket: "unix:/path/to.sock"
+    if (address.find("unix:") == 0) {
+        std::string path = address.substr(5);
+        struct sockaddr_un* addr =
+            reinterpret_cast<struct sockaddr_un*>(&server.sockaddr_);
+
+        if (path.empty() || path.length() >= sizeof(addr->sun_path)) {
+            log(LOG_ERROR, "Invalid unix socket path for upstream: %s",
+                address.c_str());
+            return false;
+        }
+
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, path.c_str(), path.length() + 1);
+        server.sockaddr_len_ = sizeof(struct sockaddr_un);
+        server.address_ = path;
+        return true;
+    }
+
+    // TCP: "host[:port]"
+    if (address.empty() || address.find('/') != std::string::npos) {
+        log(LOG_ERROR, "Invalid upstream server address: %s",
+            address.c_str());
+        return false;
+    }
+
+    std::string host = address;
+    int port = 80;
+    size_t colon_pos = address.find(':');
+    if (colon_pos != std::string::npos) {
+        host = address.substr(0, colon_pos);
+        std::istringstream iss(address.substr(colon_pos + 1));
+        if (!(iss >> port) || !iss.eof() || port <= 0 || port > 65535) {
+            log(LOG_ERROR, "Invalid port in upstream server address: %s",
+                address.c_str());
+            return false;
+        }
+    }
+
+    // Resolve once at load time, like the listen directive
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;  // IPv4 only
+    hints.ai_socktype = SOCK_STREAM;
+
+    int status = getaddrinfo(host.c_str(), NULL, &hints, &res);
+    if (status != 0) {
+        log(LOG_ERROR, "Error resolving upstream host '%s': %s", host.c_str(),
+            gai_strerror(status));
+        return false;
+    }
+
+    struct sockaddr_in* addr =
+        reinterpret_cast<struct sockaddr_in*>(&server.sockaddr_);
+    memcpy(addr, res->ai_addr, sizeof(struct sockaddr_in));
+    addr->sin_port = htons(port);
+    server.sockaddr_len_ = sizeof(struct sockaddr_in);
+    freeaddrinfo(res);
+
+    server.address_ = address;
+    return true;
+}
+
+int UpstreamServer::acquire_connection(bool& reused) {
+    // Prefer the most recently used idle connection, it is the least likely
+    // to have been closed by the backend
+    while (!idle_connections_.empty()) {
+        int fd = idle_connections_.back().fd_;
+        idle_connections_.pop_back();
+
+        // An idle connection must have nothing to read. EOF or pending data
+        // means the backend closed it or sent something unexpected.
+        char probe;
+        ssize_t peeked = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            log(LOG_DEBUG, "Reusing pooled upstream connection %d to %s", fd,
+                address_.c_str());
+            reused = true;
+            return fd;
+        }
+
+        log(LOG_DEBUG, "Dropping stale pooled upstream connection %d to %s",
+            fd, address_.c_str());
+        close(fd);
+    }
+
+    reused = false;
+    int fd = socket(sockaddr_.ss_family,
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log(LOG_ERROR, "Failed to create upstream socket for %s: %s",
+            address_.c_str(), strerror(errno));
+        return -1;
+    }
+
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&sockaddr_),
+                sockaddr_len_) < 0 &&
+        errno != EINPROGRESS) {
+        log(LOG_ERROR, "Failed to connect to upstream %s: %s",
+            address_.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    log(LOG_DEBUG, "Opened upstream connection %d to %s", fd,
+        address_.c_str());
+    return fd;
+}
+
+void UpstreamServer::release_connection(int fd) {
+    if (idle_connections_.size() >= http_limits::MAX_IDLE_UPSTREAM_CONNECTIONS) {
+        log(LOG_DEBUG, "Upstream pool for %s is full, closing connection %d",
+            address_.c_str(), fd);
+        close(fd);
+        return;
+    }
+
+    IdleUpstreamConnection idle;
+    idle.fd_ = fd;
+    idle.idle_since_ = time(NULL);
+    idle_connections_.push_back(idle);
+
+    log(LOG_DEBUG, "Parked upstream connection %d to %s (%zu idle)", fd,
+        address_.c_str(), idle_connections_.size());
+}
+
+int UpstreamServer::close_expired_connections(time_t now) {
+    int closed = 0;
+
+    // Oldest connections are at the front
+    std::vector<IdleUpstreamConnection>::iterator it =
+        idle_connections_.begin();
+    while (it != idle_connections_.end() &&
+           now - it->idle_since_ > http_limits::UPSTREAM_IDLE_TIMEOUT) {
+        close(it->fd_);
+        ++it;
+        closed++;
+    }
+    idle_connections_.erase(idle_connections_.begin(), it);
+
+    return closed;
+}
+
+void UpstreamServer::close_idle_connections() {
+    for (size_t i = 0; i < idle_connections_.size(); ++i) {
+        close(idle_connections_[i].fd_);
+    }
+    idle_connections_.clear();
+}
+
+double UpstreamServer::load_cost(double now_ms) const {
+    // Without new samples the estimate decays, so a server that was slow
+    // once is eventually probed again
+    double elapsed = now_ms - ewma_stamp_ms_;
+    double decayed = ewma_ms_;
+    if (elapsed > 0) {
+        decayed *= exp(-elapsed / EWMA_DECAY_MS);
+    }
+    return decayed * (inflight_ + 1);
+}
+
+//--------------------------------------
+// Upstream
+//--------------------------------------
+
+Upstream::Upstream()
+    : policy_(codes::BALANCE_ROUND_ROBIN),
+      rr_cursor_(0),
+      pick_sequence_(0),
+      random_state_(static_cast<unsigned int>(time(NULL))) {}
+
+bool Upstream::parse_target(const std::string& target, Upstream& upstream) {
+    upstream.name_ = target;
+
+    std::string address;
+    if (target.find("unix:") == 0) {
+        address = target;
+        upstream.host_ = "localhost";
+    } else if (target.find("http://") == 0) {
+        // An optional trailing slash is accepted, other URI parts are not
+        address = target.substr(7);
+        if (!address.empty() && address[address.length() - 1] == '/') {
+            address.erase(address.length() - 1);
+        }
+        upstream.host_ = address;
+    } else {
+        log(LOG_ERROR,
+            "proxy_pass must start with http:// or unix: but got: %s",
+            target.c_str());
+        return false;
+    }
+
+    UpstreamServer server;
+    if (!UpstreamServer::parse_address(address, server)) {
+        return false;
+    }
+    upstream.servers_.push_back(server);
+    return true;
+}
+
+bool Upstream::parse_block(std::ifstream& file, const std::string& line,
+                           Upstream& upstream) {
+    // "upstream <name> {"
+    std::istringstream iss(line);
+    std::string keyword, name, brace;
+    if (!(iss >> keyword >> name >> brace) || keyword != "upstream" ||
+        brace != "{") {
+        log(LOG_ERROR, "Invalid upstream block header: %s", line.c_str());
+        return false;
+    }
+    upstream.name_ = name;
+    upstream.host_ = name;
+
+    std::string block_line;
+    while (std::getline(file, block_line)) {
+        block_line = trim(block_line);
+
+        if (block_line.empty() || block_line[0] == '#') {
+            continue;
+        }
+
+        if (block_line == "}") {
+            if (upstream.servers_.empty()) {
+                log(LOG_ERROR, "Upstream '%s' has no servers", name.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        std::string key, value;
+        if (!VirtualServer::parse_directive(block_line, key, value)) {
+            log(LOG_ERROR, "Invalid directive in upstream block: %s",
+                block_line.c_str());
+            return false;
+        }
+
+        if (key == "server") {
+            UpstreamServer server;
+            if (!UpstreamServer::parse_address(value, server)) {
+                return false;
+            }
+            upstream.servers_.push_back(server);
+        } else if (key == "policy") {
+            if (value == "round_robin") {
+                upstream.policy_ = codes::BALANCE_ROUND_ROBIN;
+            } else if (value == "least_conn") {
+                upstream.policy_ = codes::BALANCE_LEAST_CONN;
+            } else if (value == "ewma") {
+                upstream.policy_ = codes::BALANCE_PEAK_EWMA;
+            } else {
+                log(LOG_ERROR,
+                    "Invalid upstream policy '%s' (round_robin, least_conn "
+                    "or ewma)",
+                    value.c_str());
+                return false;
+            }
+        } else {
+            log(LOG_ERROR, "Unknown directive in upstream block: %s",
+                key.c_str());
+            return false;
+        }
+    }
+
+    log(LOG_ERROR, "Unterminated upstream block: %s", name.c_str());
+    return false;
+}
+
+void Upstream::init_balancer() {
+    rr_healthy_.clear();
+    lc_healthy_.clear();
+    ewma_healthy_.clear();
+    ewma_position_.assign(servers_.size(), 0);
+    down_.clear();
+
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        servers_[i].index_ = i;
+        servers_[i].healthy_ = true;
+        add_healthy(servers_[i]);
+    }
+    // Start right before the first server
+    rr_cursor_ = servers_.size() - 1;
+}
+
+UpstreamServer* Upstream::select_server() {
+    double now = monotonic_ms();
+    revive_due_servers(now);
+
+    size_t index = 0;
+    if (down_.size() == servers_.size()) {
+        // Everything is down: try the server that is due soonest rather
+        // than failing without trying
+        index = down_.begin()->second;
+    } else if (policy_ == codes::BALANCE_ROUND_ROBIN) {
+        std::set<size_t>::iterator it = rr_healthy_.upper_bound(rr_cursor_);
+        if (it == rr_healthy_.end()) {
+            it = rr_healthy_.begin();
+        }
+        index = *it;
+        rr_cursor_ = index;
+    } else if (policy_ == codes::BALANCE_LEAST_CONN) {
+        // Fewest in flight, ties go to the least recently picked
+        index = lc_healthy_.begin()->second;
+    } else {
+        // Power of two choices on the peak-EWMA cost
+        size_t count = ewma_healthy_.size();
+        size_t first = rand_r(&random_state_) % count;
+        index = ewma_healthy_[first];
+        if (count > 1) {
+            // Second choice is always a different server
+            size_t offset = 1 + rand_r(&random_state_) % (count - 1);
+            size_t other = ewma_healthy_[(first + offset) % count];
+            if (servers_[other].load_cost(now) <
+                servers_[index].load_cost(now)) {
+                index = other;
+            }
+        }
+    }
+
+    UpstreamServer& server = servers_[index];
+    if (server.healthy_) {
+        remove_healthy(server);
+    }
+    server.inflight_++;
+    server.requests_++;
+    server.last_pick_ = ++pick_sequence_;
+    if (server.healthy_) {
+        add_healthy(server);
+    }
+
+    log(LOG_DEBUG, "Upstream '%s' selected server %s (%zu in flight)",
+        name_.c_str(), server.address_.c_str(), server.inflight_);
+    return &server;
+}
+
+void Upstream::end_request(UpstreamServer* server) {
+    if (server->inflight_ == 0) {
+        return;
+    }
+
+    if (server->healthy_) {
+        remove_healthy(*server);
+    }
+    server->inflight_--;
+    if (server->healthy_) {
+        add_healthy(*server);
+    }
+}
+
+void Upstream::report_success(UpstreamServer* server, double latency_ms) {
+    double now = monotonic_ms();
+
+    // Peak EWMA: a slower sample replaces the estimate at once, faster ones
+    // are blended in over time
+    if (latency_ms > server->ewma_ms_) {
+        server->ewma_ms_ = latency_ms;
+    } else {
+        double weight = exp(-(now - server->ewma_stamp_ms_) / EWMA_DECAY_MS);
+        server->ewma_ms_ =
+            server->ewma_ms_ * weight + latency_ms * (1.0 - weight);
+    }
+    server->ewma_stamp_ms_ = now;
+    server->consecutive_failures_ = 0;
+
+    // A server tried while marked down has recovered
+    if (!server->healthy_) {
+        down_.erase(std::make_pair(server->retry_at_ms_, server->index_));
+        server->healthy_ = true;
+        add_healthy(*server);
+    }
+}
+
+void Upstream::report_failure(UpstreamServer* server) {
+    double now = monotonic_ms();
+
+    server->failures_++;
+    server->consecutive_failures_++;
+
+    // Exponential backoff: 1s, 2s, 4s, ... up to the maximum
+    double backoff = http_limits::UPSTREAM_FAIL_BACKOFF_MS;
+    for (unsigned int i = 1; i < server->consecutive_failures_ &&
+                             backoff < http_limits::UPSTREAM_MAX_BACKOFF_MS;
+         ++i) {
+        backoff *= 2;
+    }
+    if (backoff > http_limits::UPSTREAM_MAX_BACKOFF_MS) {
+        backoff = http_limits::UPSTREAM_MAX_BACKOFF_MS;
+    }
+
+    if (server->healthy_) {
+        remove_healthy(*server);
+        server->healthy_ = false;
+    } else {
+        down_.erase(std::make_pair(server->retry_at_ms_, server->index_));
+    }
+    server->retry_at_ms_ = now + backoff;
+    down_.insert(std::make_pair(server->retry_at_ms_, server->index_));
+
+    log(LOG_WARNING,
+        "Upstream '%s' server %s marked down for %.0f ms (%u consecutive "
+        "failures)",
+        name_.c_str(), server->address_.c_str(), backoff,
+        server->consecutive_failures_);
+}
+
+int Upstream::close_expired_connections(time_t now) {
+    int closed = 0;
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        closed += servers_[i].close_expired_connections(now);
+    }
+    return closed;
+}
+
+void Upstream::close_idle_connections() {
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        servers_[i].close_idle_connections();
+    }
+}
+
+double Upstream::monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void Upstream::add_healthy(UpstreamServer& server) {
+    switch (policy_) {
+        case codes::BALANCE_ROUND_ROBIN:
+            rr_healthy_.insert(server.index_);
+            break;
+        case codes::BALANCE_LEAST_CONN:
+            lc_healthy_.insert(load_key(server));
+            break;
+        case codes::BALANCE_PEAK_EWMA:
+            ewma_position_[server.index_] = ewma_healthy_.size();
+            ewma_healthy_.push_back(server.index_);
+            break;
+    }
+}
+
+void Upstream::remove_healthy(UpstreamServer& server) {
+    switch (policy_) {
+        case codes::BALANCE_ROUND_ROBIN:
+            rr_healthy_.erase(server.index_);
+            break;
+        case codes::BALANCE_LEAST_CONN:
+            lc_healthy_.erase(load_key(server));
+            break;
+        case codes::BALANCE_PEAK_EWMA: {
+            // Swap with the last entry to remove in O(1)
+            size_t position = ewma_position_[server.index_];
+            size_t last = ewma_healthy_.back();
+            ewma_healthy_[position] = last;
+            ewma_position_[last] = position;
+            ewma_healthy_.pop_back();
+            break;
+        }
+    }
+}
+
+void Upstream::revive_due_servers(double now_ms) {
+    while (!down_.empty() && down_.begin()->first <= now_ms) {
+        UpstreamServer& server = servers_[down_.begin()->second];
+        down_.erase(down_.begin());
+
+        // Back in rotation; the next failure doubles the backoff
+        server.healthy_ = true;
+        add_healthy(server);
+        log(LOG_INFO, "Upstream '%s' server %s is eligible again",
+            name_.c_str(), server.address_.c_str());
+    }
+}
+
+Upstream::LoadKey Upstream::load_key(const UpstreamServer& server) const {
+    return std::make_pair(std::make_pair(server.inflight_, server.last_pick_),
+                          server.index_);
+}
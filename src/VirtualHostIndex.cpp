@@ -0,0 +1,182 @@
+#include "webserv.hpp"
+
+static const size_t INITIAL_BUCKETS = 16;  // Always a power of two
+
+VirtualHostIndex::LabelNode::LabelNode() : below_(NULL), self_(NULL) {}
+
+VirtualHostIndex::VirtualHostIndex()
+    : buckets_(INITIAL_BUCKETS), name_count_(0), leading_(1), trailing_(1) {}
+
+void VirtualHostIndex::add_server(VirtualServer* server) {
+    for (size_t i = 0; i < server->server_names_.size(); ++i) {
+        std::string name = normalize(server->server_names_[i]);
+        if (name.empty()) {
+            continue;
+        }
+
+        if (name.compare(0, 2, "*.") == 0) {
+            std::vector<std::string> labels = split_labels(name.substr(2));
+            std::reverse(labels.begin(), labels.end());
+            add_wildcard(leading_, labels, server, false);
+        } else if (name[0] == '.') {
+            std::vector<std::string> labels = split_labels(name.substr(1));
+            std::reverse(labels.begin(), labels.end());
+            add_wildcard(leading_, labels, server, true);
+        } else if (name.length() > 2 &&
+                   name.compare(name.length() - 2, 2, ".*") == 0) {
+            add_wildcard(trailing_,
+                         split_labels(name.substr(0, name.length() - 2)),
+                         server, false);
+        } else {
+            add_exact(name, server);
+        }
+    }
+}
+
+VirtualServer* VirtualHostIndex::find(const std::string& hostname) const {
+    const std::vector<NameEntry>& bucket =
+        buckets_[hash(hostname) & (buckets_.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].first == hostname) {
+            return bucket[i].second;
+        }
+    }
+
+    std::vector<std::string> labels = split_labels(hostname);
+    std::vector<std::string> reversed(labels.rbegin(), labels.rend());
+    VirtualServer* server = find_wildcard(leading_, reversed);
+    if (!server) {
+        server = find_wildcard(trailing_, labels);
+    }
+    return server;
+}
+
+std::string VirtualHostIndex::normalize(const std::string& host_header) {
+    std::string host = host_header;
+
+    // "[::1]:8080" keeps its brackets, "example.com:8080" loses the port
+    size_t port_pos = std::string::npos;
+    if (!host.empty() && host[0] == '[') {
+        size_t bracket = host.find(']');
+        if (bracket != std::string::npos) {
+            port_pos = bracket + 1;
+        }
+    } else {
+        port_pos = host.find(':');
+    }
+    if (port_pos < host.length()) {
+        host.erase(port_pos);
+    }
+
+    if (!host.empty() && host[host.length() - 1] == '.') {
+        host.erase(host.length() - 1);
+    }
+    for (size_t i = 0; i < host.length(); ++i) {
+        host[i] = std::tolower(static_cast<unsigned char>(host[i]));
+    }
+    return host;
+}
+
+void VirtualHostIndex::add_exact(const std::string& name,
+                                 VirtualServer* server) {
+    std::vector<NameEntry>& bucket =
+        buckets_[hash(name) & (buckets_.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].first == name) {
+            return;  // First server with the name keeps it
+        }
+    }
+    bucket.push_back(std::make_pair(name, server));
+
+    // Keep chains short: at most one name per bucket on average
+    if (++name_count_ > buckets_.size()) {
+        grow();
+    }
+}
+
+void VirtualHostIndex::grow() {
+    std::vector<std::vector<NameEntry> > buckets(buckets_.size() * 2);
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        for (size_t j = 0; j < buckets_[i].size(); ++j) {
+            const NameEntry& entry = buckets_[i][j];
+            buckets[hash(entry.first) & (buckets.size() - 1)].push_back(entry);
+        }
+    }
+    buckets_.swap(buckets);
+}
+
+// FNV-1a
+size_t VirtualHostIndex::hash(const std::string& name) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < name.length(); ++i) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void VirtualHostIndex::add_wildcard(std::vector<LabelNode>& trie,
+                                    const std::vector<std::string>& labels,
+                                    VirtualServer* server, bool match_self) {
+    size_t node = 0;
+    for (size_t i = 0; i < labels.size(); ++i) {
+        std::map<std::string, size_t>::iterator it =
+            trie[node].children_.find(labels[i]);
+        if (it == trie[node].children_.end()) {
+            size_t child = trie.size();
+            trie.push_back(LabelNode());
+            it = trie[node]
+                     .children_.insert(std::make_pair(labels[i], child))
+                     .first;
+        }
+        node = it->second;
+    }
+
+    if (!trie[node].below_) {
+        trie[node].below_ = server;
+    }
+    if (match_self && !trie[node].self_) {
+        trie[node].self_ = server;
+    }
+}
+
+VirtualServer* VirtualHostIndex::find_wildcard(
+    const std::vector<LabelNode>& trie,
+    const std::vector<std::string>& labels) {
+    VirtualServer* best = NULL;
+    size_t node = 0;
+
+    for (size_t i = 0; i < labels.size(); ++i) {
+        std::map<std::string, size_t>::const_iterator it =
+            trie[node].children_.find(labels[i]);
+        if (it == trie[node].children_.end()) {
+            break;
+        }
+        node = it->second;
+
+        if (i + 1 == labels.size()) {
+            // All labels used: only ".example.com" style names match
+            if (trie[node].self_) {
+                best = trie[node].self_;
+            }
+        } else if (trie[node].below_) {
+            best = trie[node].below_;
+        }
+    }
+    return best;
+}
+
+std::vector<std::string> VirtualHostIndex::split_labels(
+    const std::string& name) {
+    std::vector<std::string> labels;
+    size_t start = 0;
+    while (start <= name.length()) {
+        size_t end = name.find('.', start);
+        if (end == std::string::npos) {
+            end = name.length();
+        }
+        labels.push_back(name.substr(start, end - start));
+        start = end + 1;
+    }
+    return labels;
+}
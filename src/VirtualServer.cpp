@@ -4,6 +4,11 @@
 static const int DEFAULT_PORT = 80;
 static const std::string DEFAULT_HOST = "0.0.0.0";
 static const size_t DEFAULT_MAX_BODY_SIZE = 1024 * 1024;  // 1MB
+// Larger bodies are spooled to a file
+static const size_t DEFAULT_BODY_BUFFER_SIZE = 16 * 1024;  // 16KB
+static const std::string DEFAULT_BODY_TEMP_PATH = "/tmp";
+static const time_t DEFAULT_KEEPALIVE_TIMEOUT = 60;     // Seconds
+static const size_t DEFAULT_KEEPALIVE_REQUESTS = 1000;  // Per connection
 static const std::string DEFAULT_SERVER_NAME = "default_server";
 
 // Error page defaults
@@ -17,30 +22,41 @@ static const bool DEFAULT_AUTOINDEX = false;
 static const bool DEFAULT_CGI_ENABLED = false;
 static const std::string DEFAULT_INDEX = "index.html";
 
-static std::vector<std::string> create_default_allowed_methods() {
-    std::vector<std::string> methods;
-    methods.push_back("GET");
-    methods.push_back("POST");
-    methods.push_back("DELETE");
-    return methods;
-}
-
-static const std::vector<std::string> DEFAULT_ALLOWED_METHODS =
-    create_default_allowed_methods();
+static const unsigned int DEFAULT_ALLOWED_METHODS =
+    codes::METHOD_GET | codes::METHOD_HEAD | codes::METHOD_POST |
+    codes::METHOD_DELETE | codes::METHOD_OPTIONS;
 
 // Constructor for Location with defaults
 Location::Location()
-    : autoindex_(DEFAULT_AUTOINDEX),
+    : match_type_(codes::MATCH_PREFIX),
+      autoindex_(DEFAULT_AUTOINDEX),
       cgi_enabled_(DEFAULT_CGI_ENABLED),
-      index_(DEFAULT_INDEX) {
-    allowed_methods_ = DEFAULT_ALLOWED_METHODS;
+      index_(DEFAULT_INDEX),
+      return_code_(0),
+      return_status_length_(0),
+      return_head_length_(0),
+      upstream_(NULL),
+      metrics_(false),
+      resumable_upload_(false),
+      cache_ttl_(0),
+      cache_stale_(0) {
+    set_allowed_methods(DEFAULT_ALLOWED_METHODS);
+}
+
+void Location::set_allowed_methods(unsigned int methods) {
+    allowed_methods_ = methods;
+    allow_header_ = method_list(methods);
 }
 
 // Default constructor implementation
 VirtualServer::VirtualServer()
     : port_(DEFAULT_PORT),
       listen_specified_(false),
-      client_max_body_size_(DEFAULT_MAX_BODY_SIZE) {
+      client_max_body_size_(DEFAULT_MAX_BODY_SIZE),
+      client_body_buffer_size_(DEFAULT_BODY_BUFFER_SIZE),
+      client_body_temp_path_(DEFAULT_BODY_TEMP_PATH),
+      keepalive_timeout_(DEFAULT_KEEPALIVE_TIMEOUT),
+      keepalive_requests_(DEFAULT_KEEPALIVE_REQUESTS) {
     host_ = DEFAULT_HOST;
 }
 
@@ -58,7 +74,9 @@ bool VirtualServer::parse_server_block(std::ifstream& file,
         // Check for block end
         if (line == "}") {
             virtual_server.apply_defaults();
-            return true;
+            virtual_server.build_cgi_env_templates();
+            return virtual_server.location_matcher_.compile(
+                virtual_server.locations_);
         }
 
         if (line.find("location") == 0) {
@@ -86,11 +104,33 @@ bool VirtualServer::parse_server_block(std::ifstream& file,
 
 bool VirtualServer::parse_location_block(std::ifstream& file, std::string line,
                                          VirtualServer& virtual_server) {
-    // Extract location path
+    // Extract optional modifier and location path
     size_t pathStart = line.find_first_not_of(" \t", 8);  // Skip "location"
     if (pathStart == std::string::npos) return false;
 
-    size_t pathEnd = line.find_first_of(" \t{", pathStart);
+    codes::LocationMatch match_type = codes::MATCH_PREFIX;
+    size_t modifierEnd = line.find_first_of(" \t", pathStart);
+    if (modifierEnd != std::string::npos) {
+        std::string modifier = line.substr(pathStart, modifierEnd - pathStart);
+        if (modifier == "=") {
+            match_type = codes::MATCH_EXACT;
+        } else if (modifier == "^~") {
+            match_type = codes::MATCH_PREFIX_NO_REGEX;
+        } else if (modifier == "~") {
+            match_type = codes::MATCH_REGEX;
+        } else if (modifier == "~*") {
+            match_type = codes::MATCH_REGEX_ICASE;
+        }
+        if (match_type != codes::MATCH_PREFIX) {
+            pathStart = line.find_first_not_of(" \t", modifierEnd);
+            if (pathStart == std::string::npos) return false;
+        }
+    }
+
+    // Regexes may contain '{', they end at whitespace only
+    bool is_regex = (match_type == codes::MATCH_REGEX ||
+                     match_type == codes::MATCH_REGEX_ICASE);
+    size_t pathEnd = line.find_first_of(is_regex ? " \t" : " \t{", pathStart);
     if (pathEnd == std::string::npos) return false;
 
     std::string path = line.substr(pathStart, pathEnd - pathStart);
@@ -109,6 +149,7 @@ bool VirtualServer::parse_location_block(std::ifstream& file, std::string line,
     // Create a new Location
     Location location;
     location.path_ = path;
+    location.match_type_ = match_type;
 
     // Parse location block
     std::string locLine;
@@ -120,6 +161,7 @@ bool VirtualServer::parse_location_block(std::ifstream& file, std::string line,
         }
 
         if (locLine == "}") {
+            location.compile_return();
             virtual_server.locations_.push_back(location);
             return true;
         }
@@ -148,6 +190,14 @@ bool VirtualServer::handle_server_directive(const std::string& key,
         return parse_error_page(value, virtual_server);
     } else if (key == "client_max_body_size") {
         return parse_client_max_body_size(value, virtual_server);
+    } else if (key == "client_body_buffer_size") {
+        return parse_client_body_buffer_size(value, virtual_server);
+    } else if (key == "client_body_temp_path") {
+        return parse_client_body_temp_path(value, virtual_server);
+    } else if (key == "keepalive_timeout") {
+        return parse_keepalive_timeout(value, virtual_server);
+    } else if (key == "keepalive_requests") {
+        return parse_keepalive_requests(value, virtual_server);
     } else {
         log(LOG_ERROR, "Unknown directive in server block: %s", key.c_str());
         return false;
@@ -220,16 +270,17 @@ bool VirtualServer::parse_listen(const std::string& value,
     return true;
 }
 
-bool VirtualServer::parse_client_max_body_size(const std::string& value,
-                                               VirtualServer& virtual_server) {
+// Parses a size with an optional K, M or G unit, e.g. "16K"
+static bool parse_size(const std::string& directive, const std::string& value,
+                       size_t& size) {
     if (value.empty()) {
-        log(LOG_ERROR, "client_max_body_size cannot be empty");
+        log(LOG_ERROR, "%s cannot be empty", directive.c_str());
         return false;
     }
 
-    size_t size = 0;
     std::string numPart;
     char unit = '\0';
+    size = 0;
 
     // Check if last character is a unit
     if (isalpha(value[value.length() - 1])) {
@@ -242,7 +293,7 @@ bool VirtualServer::parse_client_max_body_size(const std::string& value,
     // Check that numPart contains only digits
     for (size_t i = 0; i < numPart.length(); i++) {
         if (!isdigit(numPart[i])) {
-            log(LOG_ERROR, "Invalid client_max_body_size value: %s",
+            log(LOG_ERROR, "Invalid %s value: %s", directive.c_str(),
                 value.c_str());
             return false;
         }
@@ -251,7 +302,7 @@ bool VirtualServer::parse_client_max_body_size(const std::string& value,
     // Parse the numeric part
     std::istringstream iss(numPart);
     if (!(iss >> size)) {
-        log(LOG_ERROR, "Invalid number format in client_max_body_size: %s",
+        log(LOG_ERROR, "Invalid number format in %s: %s", directive.c_str(),
             value.c_str());
         return false;
     }
@@ -269,19 +320,74 @@ bool VirtualServer::parse_client_max_body_size(const std::string& value,
                 size *= 1024 * 1024 * 1024;
                 break;
             default:
-                log(LOG_ERROR, "Unknown size unit '%c' in client_max_body_size",
-                    unit);
+                log(LOG_ERROR, "Unknown size unit '%c' in %s", unit,
+                    directive.c_str());
                 return false;
         }
     }
 
     // Check for zero
     if (size == 0) {
-        log(LOG_ERROR, "client_max_body_size cannot be zero");
+        log(LOG_ERROR, "%s cannot be zero", directive.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool VirtualServer::parse_client_max_body_size(const std::string& value,
+                                               VirtualServer& virtual_server) {
+    return parse_size("client_max_body_size", value,
+                      virtual_server.client_max_body_size_);
+}
+
+bool VirtualServer::parse_client_body_buffer_size(
+    const std::string& value, VirtualServer& virtual_server) {
+    return parse_size("client_body_buffer_size", value,
+                      virtual_server.client_body_buffer_size_);
+}
+
+// Spooled bodies are created in this directory, it must exist and be
+// writable when the server starts
+bool VirtualServer::parse_client_body_temp_path(
+    const std::string& value, VirtualServer& virtual_server) {
+    struct stat info;
+    if (value.empty() || stat(value.c_str(), &info) != 0 ||
+        !S_ISDIR(info.st_mode) || access(value.c_str(), W_OK | X_OK) != 0) {
+        log(LOG_ERROR, "client_body_temp_path is not a writable directory: %s",
+            value.c_str());
+        return false;
+    }
+    virtual_server.client_body_temp_path_ = value;
+    return true;
+}
+
+// "keepalive_timeout <seconds>", 0 closes every connection after its
+// response
+bool VirtualServer::parse_keepalive_timeout(const std::string& value,
+                                            VirtualServer& virtual_server) {
+    std::istringstream iss(value);
+    long seconds = -1;
+    std::string extra;
+    if (!(iss >> seconds) || seconds < 0 || (iss >> extra)) {
+        log(LOG_ERROR, "Invalid keepalive_timeout value: %s", value.c_str());
         return false;
     }
+    virtual_server.keepalive_timeout_ = seconds;
+    return true;
+}
 
-    virtual_server.client_max_body_size_ = size;
+// "keepalive_requests <count>", the connection is closed after the response
+// to the last one
+bool VirtualServer::parse_keepalive_requests(const std::string& value,
+                                             VirtualServer& virtual_server) {
+    std::istringstream iss(value);
+    long count = 0;
+    std::string extra;
+    if (!(iss >> count) || count <= 0 || (iss >> extra)) {
+        log(LOG_ERROR, "Invalid keepalive_requests value: %s", value.c_str());
+        return false;
+    }
+    virtual_server.keepalive_requests_ = count;
     return true;
 }
 
@@ -322,15 +428,26 @@ bool VirtualServer::add_directive_value(Location& location,
     } else if (key == "autoindex") {
         location.autoindex_ = (value == "on");
     } else if (key == "allow_methods") {
-        // Clear default methods first
-        location.allowed_methods_.clear();
-
-        // Split and add methods
+        // Replaces the defaults. GET implies HEAD, and OPTIONS is always
+        // answered once any method is allowed.
+        unsigned int methods = 0;
         std::istringstream iss(value);
-        std::string method;
-        while (iss >> method) {
-            location.allowed_methods_.push_back(method);
+        std::string name;
+        while (iss >> name) {
+            codes::Method method = parse_method(name);
+            if (method == codes::METHOD_UNKNOWN) {
+                log(LOG_ERROR, "Invalid HTTP method: %s", name.c_str());
+                return false;
+            }
+            methods |= method;
         }
+        if (methods & codes::METHOD_GET) {
+            methods |= codes::METHOD_HEAD;
+        }
+        if (methods) {
+            methods |= codes::METHOD_OPTIONS;
+        }
+        location.set_allowed_methods(methods);
     } else if (key == "cgi") {
         location.cgi_enabled_ = (value == "on");
     } else if (key == "index") {
@@ -349,8 +466,37 @@ bool VirtualServer::add_directive_value(Location& location,
         } else {
             location.index_ = DEFAULT_INDEX;
         }
+    } else if (key == "return") {
+        location.return_ = value;
     } else if (key == "redirect") {
-        location.redirect_ = value;
+        // The older form of "return" for redirects only
+        int code = std::atoi(value.c_str());
+        if (code < 300 || code > 399) {
+            log(LOG_ERROR,
+                "Invalid redirect status code: %s (must be 300-399)",
+                value.c_str());
+            return false;
+        }
+        location.return_ = value;
+    } else if (key == "proxy_pass") {
+        location.proxy_pass_ = value;
+    } else if (key == "metrics") {
+        location.metrics_ = (value == "on");
+    } else if (key == "resumable_upload") {
+        location.resumable_upload_ = (value == "on");
+    } else if (key == "response_cache") {
+        // "response_cache <ttl> [<stale-while-revalidate>]", in seconds
+        std::istringstream iss(value);
+        long ttl = 0;
+        long stale = 0;
+        std::string extra;
+        if (!(iss >> ttl) || ttl <= 0 || (!(iss >> stale) && !iss.eof()) ||
+            stale < 0 || (iss >> extra)) {
+            log(LOG_ERROR, "Invalid response_cache value: %s", value.c_str());
+            return false;
+        }
+        location.cache_ttl_ = ttl;
+        location.cache_stale_ = stale;
     } else {
         log(LOG_ERROR, "Unknown directive in location block: %s", key.c_str());
         return false;
@@ -411,6 +557,107 @@ bool VirtualServer::apply_defaults() {
     return true;
 }
 
+bool Location::is_regex() const {
+    return match_type_ == codes::MATCH_REGEX ||
+           match_type_ == codes::MATCH_REGEX_ICASE;
+}
+
+// Any 3xx but 304 Not Modified takes a URL
+bool Location::is_return_redirect() const {
+    return return_code_ >= 300 && return_code_ <= 399 &&
+           return_code_ != codes::NOT_MODIFIED;
+}
+
+// Builds the response of a return directive once, so a matching request is
+// answered by sending these bytes. Only the Date line is added per request.
+// Error codes without text are left to ErrorHandler and its error pages.
+void Location::compile_return() {
+    if (return_.empty()) {
+        return;
+    }
+
+    // "<code> [text|URL]", the text may be quoted
+    std::istringstream iss(return_);
+    iss >> return_code_;
+    std::string text;
+    std::getline(iss, text);
+    text = trim(text);
+    if (text.size() >= 2 && (text[0] == '"' || text[0] == '\'') &&
+        text[text.size() - 1] == text[0]) {
+        text = text.substr(1, text.size() - 2);
+    }
+    return_text_ = text;
+    if (return_code_ >= 400 && return_text_.empty()) {
+        return;
+    }
+
+    std::string body;
+    std::string content_type;
+    std::ostringstream head;
+    head << "HTTP/1.1 " << return_code_ << " "
+         << get_status_message(return_code_) << CRLF;
+    return_status_length_ = head.str().size();
+    head << "Server: Webserv/1.0" CRLF;
+    if (is_return_redirect()) {
+        head << "Location: " << return_text_ << CRLF;
+        std::ostringstream page;
+        page << "<html>\n<head><title>" << return_code_ << " "
+             << get_status_message(return_code_) << "</title></head>\n"
+             << "<body>\n<h1>" << return_code_ << " "
+             << get_status_message(return_code_) << "</h1>\n</body>\n</html>\n";
+        body = page.str();
+        content_type = "text/html";
+    } else if (!return_text_.empty()) {
+        body = return_text_;
+        content_type = (body[0] == '{' || body[0] == '[') ? "application/json"
+                                                         : "text/plain";
+    }
+
+    // No body at all for these
+    if (return_code_ != codes::NO_CONTENT &&
+        return_code_ != codes::NOT_MODIFIED) {
+        if (!content_type.empty()) {
+            head << "Content-Type: " << content_type << CRLF;
+        }
+        head << "Content-Length: " << body.size() << CRLF;
+    } else {
+        body.clear();
+    }
+    head << CRLF;
+
+    return_response_ = head.str();
+    return_head_length_ = return_response_.size();
+    return_response_.append(body);
+}
+
+const Location* VirtualServer::find_location(const std::string& path) const {
+    int index = location_matcher_.match(path);
+    return index >= 0 ? &locations_[index] : NULL;
+}
+
+// Precompute the per-location part of the CGI environment. These values only
+// depend on the configuration, so CgiHandler copies pointers to them instead
+// of rebuilding the strings for every request.
+void VirtualServer::build_cgi_env_templates() {
+    std::ostringstream port;
+    port << port_;
+
+    for (size_t i = 0; i < locations_.size(); ++i) {
+        Location& location = locations_[i];
+        if (!location.cgi_enabled_) {
+            continue;
+        }
+
+        std::vector<std::string>& env = location.cgi_env_template_;
+        env.clear();
+        env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+        env.push_back("SERVER_SOFTWARE=webserv/1.0");
+        env.push_back("SERVER_NAME=" + host_name_);
+        env.push_back("SERVER_PORT=" + port.str());
+        env.push_back("DOCUMENT_ROOT=" + location.root_);
+    }
+}
+
 // Implementation of validation methods
 bool VirtualServer::is_valid_host() const {
     // Check if the host is valid IP address format
@@ -546,43 +793,53 @@ bool Location::is_valid() const {
         return false;
     }
 
-    // Check if path starts with /
-    if (path_[0] != '/') {
-        log(LOG_ERROR, "Location path must start with /: %s", path_.c_str());
-        return false;
-    }
-
-    // Check for invalid characters in path
-    const std::string invalidChars = "<>\"'|*?";
-    for (size_t i = 0; i < invalidChars.length(); i++) {
-        if (path_.find(invalidChars[i]) != std::string::npos) {
-            log(LOG_ERROR, "Location path contains invalid character '%c': %s",
-                invalidChars[i], path_.c_str());
+    if (is_regex()) {
+        // The pattern is compiled again by the LocationMatcher
+        regex_t regex;
+        int flags = REG_EXTENDED | REG_NOSUB;
+        if (match_type_ == codes::MATCH_REGEX_ICASE) {
+            flags |= REG_ICASE;
+        }
+        if (regcomp(&regex, path_.c_str(), flags) != 0) {
+            log(LOG_ERROR, "Invalid location regex: %s", path_.c_str());
+            return false;
+        }
+        regfree(&regex);
+    } else {
+        // Check if path starts with /
+        if (path_[0] != '/') {
+            log(LOG_ERROR, "Location path must start with /: %s",
+                path_.c_str());
             return false;
         }
-    }
-
-    // Check if redirect is valid when specified
-    if (!redirect_.empty()) {
-        std::istringstream iss(redirect_);
-        std::string status_str, url;
 
-        if (iss >> status_str >> url) {
-            // Parse and validate status code
-            int status_code = atoi(status_str.c_str());
-            if (status_code < 300 || status_code > 399) {
+        // Check for invalid characters in path
+        const std::string invalidChars = "<>\"'|*?";
+        for (size_t i = 0; i < invalidChars.length(); i++) {
+            if (path_.find(invalidChars[i]) != std::string::npos) {
                 log(LOG_ERROR,
-                    "Invalid redirect status code: %s (must be 300-399)",
-                    status_str.c_str());
+                    "Location path contains invalid character '%c': %s",
+                    invalidChars[i], path_.c_str());
                 return false;
             }
+        }
+    }
+
+    // Check if return is valid when specified
+    if (!return_.empty()) {
+        if (return_code_ < 200 || return_code_ > 599) {
+            log(LOG_ERROR, "Invalid return status code: %s (must be 200-599)",
+                return_.c_str());
+            return false;
+        }
 
-            // Validate URL format - must be absolute URL or relative path
+        // Validate URL format - must be absolute URL or relative path
+        if (is_return_redirect()) {
+            const std::string& url = return_text_;
             if (url.empty()) {
                 log(LOG_ERROR, "Redirect URL cannot be empty");
                 return false;
             }
-
             if (url[0] != '/' && url.find("http://") != 0 &&
                 url.find("https://") != 0) {
                 log(LOG_ERROR,
@@ -591,58 +848,40 @@ bool Location::is_valid() const {
                     url.c_str());
                 return false;
             }
-
-            // Check for additional parameters and warn
-            std::string extra;
-            if (iss >> extra) {
-                log(LOG_INFO,
-                    "Multiple redirect parameters specified, using first URL: "
-                    "%s",
-                    url.c_str());
-            }
-        } else {
-            log(LOG_ERROR,
-                "Invalid redirect format: expected 'status_code URL' but got: "
-                "%s",
-                redirect_.c_str());
-            return false;
         }
     }
 
-    if (root_.empty()) {
-        log(LOG_ERROR, "Root directive is mandatory for location: %s",
-            path_.c_str());
-        return false;
-    }
+    // Proxied, metrics and return locations never touch the filesystem, so
+    // root is optional. proxy_pass targets are checked once upstream blocks
+    // are known.
+    if (proxy_pass_.empty() && !metrics_ && return_.empty()) {
+        if (root_.empty()) {
+            log(LOG_ERROR, "Root directive is mandatory for location: %s",
+                path_.c_str());
+            return false;
+        }
 
-    // Validate root path exists and is a directory
-    struct stat path_stat;
-    log(LOG_DEBUG, "Checking root directory: %s", root_.c_str());
-    if (stat(root_.c_str(), &path_stat) != 0) {
-        log(LOG_ERROR, "Root directory does not exist: %s", root_.c_str());
-        return false;
-    }
+        // Validate root path exists and is a directory
+        struct stat path_stat;
+        log(LOG_DEBUG, "Checking root directory: %s", root_.c_str());
+        if (stat(root_.c_str(), &path_stat) != 0) {
+            log(LOG_ERROR, "Root directory does not exist: %s", root_.c_str());
+            return false;
+        }
 
-    if (!S_ISDIR(path_stat.st_mode)) {
-        log(LOG_ERROR, "Root path is not a directory: %s", root_.c_str());
-        return false;
-    }
+        if (!S_ISDIR(path_stat.st_mode)) {
+            log(LOG_ERROR, "Root path is not a directory: %s", root_.c_str());
+            return false;
+        }
 
-    if (access(root_.c_str(), R_OK) != 0) {
-        log(LOG_ERROR, "No read permission for root directory: %s",
-            root_.c_str());
-        return false;
+        if (access(root_.c_str(), R_OK) != 0) {
+            log(LOG_ERROR, "No read permission for root directory: %s",
+                root_.c_str());
+            return false;
+        }
     }
 
-    if (!allowed_methods_.empty()) {
-        for (size_t i = 0; i < allowed_methods_.size(); i++) {
-            const std::string& method = allowed_methods_[i];
-            if (method != "GET" && method != "POST" && method != "DELETE") {
-                log(LOG_ERROR, "Invalid HTTP method: %s", method.c_str());
-                return false;
-            }
-        }
-    } else {
+    if (!allowed_methods_) {
         log(LOG_ERROR,
             "At least one HTTP method must be allowed for location: %s",
             path_.c_str());
@@ -8,10 +8,18 @@ WebServer::WebServer()
       conn_manager_(NULL),
       request_parser_(NULL),
       response_writer_(NULL),
+      response_cache_(NULL),
+      file_workers_(NULL),
+      listing_cache_(NULL),
+      error_pages_(NULL),
       static_file_handler_(NULL),
       cgi_handler_(NULL),
       file_upload_handler_(NULL),
-      file_delete_handler_(NULL) {
+      file_delete_handler_(NULL),
+      file_put_handler_(NULL),
+      resumable_upload_handler_(NULL),
+      proxy_handler_(NULL),
+      metrics_handler_(NULL) {
     instance_ = this;
 }
 
@@ -20,10 +28,24 @@ WebServer::~WebServer() {
     delete conn_manager_;
     delete request_parser_;
     delete response_writer_;
+    delete response_cache_;
+    delete file_workers_;  // After the connections, which cancel their jobs
+    delete listing_cache_;
+    delete error_pages_;
     delete static_file_handler_;
     delete cgi_handler_;
     delete file_upload_handler_;
     delete file_delete_handler_;
+    delete file_put_handler_;
+    delete resumable_upload_handler_;
+    delete proxy_handler_;
+    delete metrics_handler_;
+
+    // Close pooled upstream connections
+    for (std::map<std::string, Upstream>::iterator it = upstreams_.begin();
+         it != upstreams_.end(); ++it) {
+        it->second.close_idle_connections();
+    }
 
     // Close listener sockets if they are open
     for (std::vector<int>::iterator it = listener_fds_.begin();
@@ -48,18 +70,29 @@ bool WebServer::init() {
         conn_manager_ = new ConnectionManager();
         request_parser_ = new RequestParser();
         response_writer_ = new ResponseWriter();
+        response_cache_ = new ResponseCache();
+        file_workers_ = new FileWorkerPool();
+        listing_cache_ = new DirectoryListingCache();
+        error_pages_ = new ErrorPageCache();
 
         // Initialize handlers
         static_file_handler_ = new StaticFileHandler();
         cgi_handler_ = new CgiHandler();
         file_upload_handler_ = new FileUploadHandler();
         file_delete_handler_ = new FileDeleteHandler();
+        file_put_handler_ = new FilePutHandler();
+        resumable_upload_handler_ = new ResumableUploadHandler();
+        proxy_handler_ = new ProxyHandler();
+        metrics_handler_ = new MetricsHandler();
     } catch (const std::bad_alloc& e) {
         log(LOG_ERROR, "WebServer components memory allocation failed: %s",
             e.what());
         return false;
     }
 
+    // Error responses are served from pages read once, not per request
+    error_pages_->preload(virtual_servers_);
+
     // Set up signal handlers
     if (!setup_signal_handlers()) {
         log(LOG_ERROR, "Failed to set up signal handlers");
@@ -73,12 +106,22 @@ bool WebServer::init() {
         return false;
     }
 
+    // Blocking filesystem calls run on worker threads, which wake the event
+    // loop through an eventfd
+    if (!file_workers_->start(http_limits::FILE_WORKER_THREADS) ||
+        !register_epoll_events(file_workers_->event_fd())) {
+        log(LOG_ERROR, "Failed to start the file worker pool");
+        return false;
+    }
+
     // Set up the listener sockets
     if (!setup_listener_sockets()) {
         return false;
     }
 
     log(LOG_INFO, "WebServer initialized successfully");
+    log(LOG_DEBUG, "Request parser scans with the %s implementation",
+        DelimiterScanner::implementation());
 
     return true;
 }
@@ -111,6 +154,23 @@ bool WebServer::parse_config_file(const std::string& filename) {
             continue;
         }
 
+        // Upstream blocks sit next to server blocks
+        if (line.find("upstream") == 0) {
+            Upstream upstream;
+            if (!Upstream::parse_block(file, line, upstream)) {
+                return false;
+            }
+            if (upstreams_.count(upstream.name_)) {
+                log(LOG_ERROR, "Error: Duplicate upstream block: %s",
+                    upstream.name_.c_str());
+                return false;
+            }
+            upstreams_.insert(std::make_pair(upstream.name_, upstream));
+            log(LOG_DEBUG, "Parsed upstream %s with %zu servers",
+                upstream.name_.c_str(), upstream.servers_.size());
+            continue;
+        }
+
         // Look for server block
         if (line == "server {" ||
             (line.find("server") == 0 && line.find("{") != std::string::npos)) {
@@ -160,6 +220,10 @@ bool WebServer::parse_config_file(const std::string& filename) {
     // Close the file
     file.close();
 
+    if (!resolve_upstreams()) {
+        return false;
+    }
+
     log(LOG_INFO, "Parsed %zu virtual servers from configuration file",
         virtual_servers_.size());
     return true;
@@ -205,10 +269,19 @@ void WebServer::event_loop() {
                 ready_events);
         }
 
+        // The Date of every response sent on this turn
+        refresh_http_date(time(NULL));
+
         for (int i = 0; i < ready_events; i++) {
             int fd = events[i].data.fd;
             uint32_t event_flags = events[i].events;
 
+            // Finished filesystem jobs
+            if (fd == file_workers_->event_fd()) {
+                file_workers_->dispatch_completions();
+                continue;
+            }
+
             // Check if this is a listener socket
             bool is_listener = false;
             for (std::vector<int>::iterator it = listener_fds_.begin();
@@ -258,7 +331,11 @@ void WebServer::accept_new_connection(int listener_fd) {
     }
 
     // Accept a new connection and set it to non-blocking mode
-    int client_fd = accept4(listener_fd, NULL, NULL, SOCK_NONBLOCK);
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    int client_fd =
+        accept4(listener_fd, reinterpret_cast<struct sockaddr*>(&client_addr),
+                &client_addr_len, SOCK_NONBLOCK);
     if (client_fd < 0) {
         log(LOG_ERROR, "Failed to accept new connection listener socket '%i'",
             listener_fd);
@@ -269,6 +346,15 @@ void WebServer::accept_new_connection(int listener_fd) {
         "accept_new_connection: Accepted new client_fd %d from listener_fd %d",
         client_fd, listener_fd);
 
+    if (!conn_manager_->has_room()) {
+        log(LOG_WARNING,
+            "accept_new_connection: Connection limit of %zu reached, "
+            "refusing client_fd %d",
+            conn_manager_->get_connection_limit(), client_fd);
+        close(client_fd);
+        return;
+    }
+
     // Register with epoll for read events
     if (!register_epoll_events(client_fd)) {
         close(client_fd);
@@ -280,6 +366,15 @@ void WebServer::accept_new_connection(int listener_fd) {
         conn_manager_->create_connection(client_fd, default_server);
     if (!conn) {
         close(client_fd);
+        return;
+    }
+
+    conn->host_index_ = &listener_host_indexes_[listener_fd];
+
+    char addr_str[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &client_addr.sin_addr, addr_str,
+                  sizeof(addr_str))) {
+        conn->remote_addr_ = addr_str;
     }
 }
 
@@ -289,6 +384,38 @@ void WebServer::handle_connection_event(int client_fd, uint32_t events) {
         return;
     }
 
+    // A kept-alive connection wakes up for its next request
+    if (conn->parked_) {
+        conn_manager_->unpark(conn);
+    }
+
+    // Events on the upstream socket of a proxied request, including the
+    // backend hanging up, are handled by the proxy state machine
+    if (conn->is_proxy() && client_fd != conn->client_fd_) {
+        handle_write(conn);
+        return;
+    }
+
+    // A CGI script that wrote its output and exited hangs up the pipe. The
+    // handler reads what is left and sees the end of file itself.
+    if (conn->is_cgi() && client_fd == conn->cgi_pipe_stdout_fd_ &&
+        !(events & EPOLLERR)) {
+        handle_write(conn);
+        return;
+    }
+
+    // Responses held back for a pipelined request that is still being read
+    if ((events & EPOLLOUT) && !(events & (EPOLLERR | EPOLLHUP)) &&
+        conn->is_readable()) {
+        if (!flush_held_responses(conn)) {
+            handle_error(conn);
+            return;
+        }
+        if (!(events & EPOLLIN)) {
+            return;
+        }
+    }
+
     if (events & (EPOLLERR | EPOLLHUP)) {
         log(LOG_ERROR,
             "handle_connection_event: Error or hangup on client_fd %d, events: "
@@ -297,7 +424,8 @@ void WebServer::handle_connection_event(int client_fd, uint32_t events) {
         handle_error(conn);
     } else if ((events & EPOLLIN) && conn->is_readable()) {
         handle_read(conn);
-    } else if (((events & EPOLLOUT) && conn->is_writable()) || conn->is_cgi()) {
+    } else if (((events & EPOLLOUT) && conn->is_writable()) || conn->is_cgi() ||
+               conn->is_proxy()) {
         handle_write(conn);
     } else {
         log(LOG_FATAL,
@@ -330,28 +458,86 @@ void WebServer::close_client_connection(Connection* conn) {
 void WebServer::handle_read(Connection* conn) {
     log(LOG_DEBUG, "handle_read: Starting for client_fd %d", conn->client_fd_);
 
-    // Read data from the socket
-    if (!request_parser_->read_from_socket(conn)) {
-        log(LOG_ERROR,
-            "handle_read: Failed to read from socket for client_fd %d",
-            conn->client_fd_);
-        handle_error(conn);
-        return;
+    if (conn->parser_state_ == codes::PARSING_SPLICED_BODY) {
+        // The body goes from the socket straight into its file
+        if (!request_parser_->splice_body(conn)) {
+            handle_error(conn);
+            return;
+        }
+    } else {
+        // Read data from the socket
+        if (!request_parser_->read_from_socket(conn)) {
+            log(LOG_ERROR,
+                "handle_read: Failed to read from socket for client_fd %d",
+                conn->client_fd_);
+            handle_error(conn);
+            return;
+        }
+
+        // Try to parse the buffer into a full request
+        conn->parse_status_ = request_parser_->parse(conn);
     }
 
-    // Try to parse the buffer into a full request
-    conn->parse_status_ = request_parser_->parse(conn);
+    continue_request(conn);
+}
 
+void WebServer::continue_request(Connection* conn) {
     // If we have completed parsing headers, we need to match the host header
     if (conn->parse_status_ == codes::PARSE_HEADERS_COMPLETE) {
         log(LOG_DEBUG,
             "handle_read: Headers complete, matching host for client_fd %d",
             conn->client_fd_);
         match_host_header(conn);
+        if (!answer_expectation(conn)) {
+            // Rejected without the body, the error response goes out now
+            return;
+        }
+        if (start_spliced_body(conn)) {
+            // Goes on in continue_spliced_body() once the file is open
+            return;
+        }
+        if (start_streamed_upload(conn)) {
+            // Goes on in continue_streamed_upload()
+            return;
+        }
         // Re-parse the request with the matched virtual server
         conn->parse_status_ = request_parser_->parse(conn);
     }
+    finish_reading(conn);
+}
 
+void WebServer::continue_spliced_body(Connection* conn) {
+    conn->conn_state_ = codes::CONN_READING;
+    update_epoll_events(
+        conn->client_fd_,
+        conn->pipelined_output_.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+
+    if (AHandler::body_file_opened(conn)) {
+        if (!request_parser_->splice_body(conn)) {
+            handle_error(conn);
+            return;
+        }
+    } else {
+        // Re-parse the request with the matched virtual server
+        conn->parse_status_ = request_parser_->parse(conn);
+    }
+    finish_reading(conn);
+}
+
+void WebServer::continue_streamed_upload(Connection* conn) {
+    conn->conn_state_ = codes::CONN_READING;
+    update_epoll_events(
+        conn->client_fd_,
+        conn->pipelined_output_.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+
+    file_upload_handler_->upload_directory_created(conn);
+    // Re-parse the request with the matched virtual server, which feeds
+    // what is buffered of the body to the multipart parser
+    conn->parse_status_ = request_parser_->parse(conn);
+    finish_reading(conn);
+}
+
+void WebServer::finish_reading(Connection* conn) {
     // If request parsing is incomplete, return and wait for more data
     if (conn->parse_status_ == codes::PARSE_INCOMPLETE) {
         log(LOG_DEBUG,
@@ -470,7 +656,9 @@ void WebServer::handle_write(Connection* conn) {
     //     %d", conn->request_data_->method_.c_str(),
     //     conn->request_data_->path_.c_str(), conn->client_fd_);
 
-    if (conn->parse_status_ != codes::PARSE_SUCCESS) {
+    // A request rejected by answer_expectation() has its response already
+    if (conn->parse_status_ != codes::PARSE_SUCCESS &&
+        conn->conn_state_ != codes::CONN_WRITING) {
         log(LOG_WARNING, "handle_write: Invalid request from client_fd %d",
             conn->client_fd_);
         ErrorHandler::generate_error_response(conn);
@@ -482,7 +670,8 @@ void WebServer::handle_write(Connection* conn) {
     //     conn->conn_state_, conn->client_fd_);
 
     if (conn->conn_state_ == codes::CONN_PROCESSING ||
-        conn->conn_state_ == codes::CONN_CGI_EXEC) {
+        conn->conn_state_ == codes::CONN_CGI_EXEC ||
+        conn->conn_state_ == codes::CONN_PROXYING) {
         bool can_execute_handler = true;
         // log(LOG_DEBUG,
         //     "handle_write: [Checkpoint 1] Inside handler logic block for "
@@ -498,15 +687,41 @@ void WebServer::handle_write(Connection* conn) {
             if (!validate_request_location(conn)) {
                 // ErrorHandler::generate_error_response was already called
                 can_execute_handler = false;
+            } else if (answer_return(conn)) {
+                can_execute_handler = false;
+            } else if (answer_options_request(conn)) {
+                can_execute_handler = false;
             } else {
                 // Choose handler always return a handler
                 conn->active_handler_ = choose_handler(conn);
+                // A cached or collapsed request does not reach the handler
+                if (response_cache_->serve_or_join(conn)) {
+                    can_execute_handler = false;
+                }
             }
         }
         // Call the handler to process the request and generate a response
         if (conn->active_handler_ && can_execute_handler) {
             conn->active_handler_->handle(conn);
         }
+
+        // Responses held back for this request do not wait for a CGI
+        // script, an upstream or another request to answer it
+        if (!conn->pipelined_output_.empty() &&
+            (conn->conn_state_ == codes::CONN_CGI_EXEC ||
+             conn->conn_state_ == codes::CONN_PROXYING ||
+             conn->conn_state_ == codes::CONN_CACHE_WAIT) &&
+            response_writer_->send_held_responses(conn) ==
+                codes::WRITING_ERROR) {
+            handle_error(conn);
+            return;
+        }
+    }
+
+    // A handler failed after part of the response was already sent
+    if (conn->conn_state_ == codes::CONN_ERROR) {
+        handle_error(conn);
+        return;
     }
 
     // // TEMP - Call StaticFileHandler to test
@@ -553,8 +768,17 @@ void WebServer::handle_write(Connection* conn) {
     // TEMP
 
     if (conn->conn_state_ == codes::CONN_WRITING) {
-        // Write the response to the client
-        codes::WriteStatus status = response_writer_->write_response(conn);
+        // A response to a pipelined request waits for the requests behind it
+        // that were read already, to be sent with theirs in one sendmsg()
+        codes::WriteStatus status;
+        if (conn->write_buffer_offset_ == 0 && has_pipelined_request(conn) &&
+            !closes_after_response(conn) &&
+            response_writer_->hold_response(conn)) {
+            status = codes::WRITING_SUCCESS;
+        } else {
+            // Write the response to the client
+            status = response_writer_->write_response(conn);
+        }
 
         // TODO - Remove switch state, call logs and handle_error before
         // returning the status. Leave condition if(status ==
@@ -583,54 +807,68 @@ void WebServer::handle_write(Connection* conn) {
                 break;
         }
 
-        // TODO - Wrap the code below in a function e.g. handle_keep_alive
-
-        // Check for error status codes that should close the connection
-        int status_code = conn->response_data_->status_code_;
-        log(LOG_DEBUG, "handle_write: Response status code %d for client_fd %d",
-            status_code, conn->client_fd_);
-
-        // ADDED: Check if response explicitly sets connection: close
-        std::string response_connection =
-            conn->response_data_->get_header("connection");
-        bool should_close = false;
-
-        if (response_connection == "close") {
-            should_close = true;
+        if (closes_after_response(conn)) {
             log(LOG_DEBUG,
-                "handle_write: Response sets connection: close for client_fd "
-                "%d",
-                conn->client_fd_);
-        } else if (status_code == 400 || status_code == 413 ||
-                   status_code >= 500) {
-            // ADDED: Close connections for client and server errors
-            should_close = true;
-            log(LOG_INFO,
-                "handle_write: Closing connection for error status %d on "
-                "client_fd %d",
-                status_code, conn->client_fd_);
+                "handle_write: Closing connection for client_fd %d after "
+                "status %d",
+                conn->client_fd_, conn->response_data_->status_code_);
+            close_client_connection(conn);
+            return;
         }
 
-        // ADDED: Proper connection handling logic
-        if (should_close) {
-            log(LOG_DEBUG, "handle_write: Closing connection for client_fd %d",
-                conn->client_fd_);
-            close_client_connection(conn);
-        } else if (conn->is_keep_alive()) {
-            log(LOG_DEBUG,
-                "handle_write: Keep-alive enabled, resetting connection for "
-                "client_fd %d",
-                conn->client_fd_);
-            conn->reset_for_keep_alive();
+        log(LOG_DEBUG,
+            "handle_write: Keep-alive enabled, resetting connection for "
+            "client_fd %d",
+            conn->client_fd_);
+        conn->reset_for_keep_alive();
+
+        // Requests pipelined behind this one may have been read with it, and
+        // no read event comes for them
+        if (conn->read_buffer_.empty()) {
             update_epoll_events(conn->client_fd_, EPOLLIN);
-        } else {
-            log(LOG_DEBUG,
-                "handle_write: No keep-alive, closing connection for client_fd "
-                "%d",
-                conn->client_fd_);
-            close_client_connection(conn);
+            conn_manager_->park(conn);
+            return;
         }
+        log(LOG_DEBUG, "handle_write: %zu pipelined bytes from client_fd %d",
+            conn->read_buffer_.size(), conn->client_fd_);
+        conn->parse_status_ = request_parser_->parse(conn);
+        continue_request(conn);
+
+        // Still reading it, the responses held back go out meanwhile
+        if (conn->conn_state_ == codes::CONN_READING) {
+            update_epoll_events(
+                conn->client_fd_,
+                conn->pipelined_output_.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+        }
+    }
+}
+
+bool WebServer::closes_after_response(Connection* conn) const {
+    // Client and server errors leave the rest of the stream unusable
+    int status_code = conn->response_data_->status_code_;
+    return conn->response_data_->get_header("connection") == "close" ||
+           status_code == 400 || status_code == 413 || status_code >= 500 ||
+           !conn->is_keep_alive();
+}
+
+bool WebServer::has_pipelined_request(Connection* conn) const {
+    static const char HEAD_END[] = CRLF CRLF;
+    const char* data = conn->read_buffer_.data();
+    const char* end = data + conn->read_buffer_.size();
+    return std::search(data, end, HEAD_END, HEAD_END + 4) != end;
+}
+
+bool WebServer::flush_held_responses(Connection* conn) {
+    codes::WriteStatus status = response_writer_->send_held_responses(conn);
+    if (status == codes::WRITING_ERROR) {
+        log(LOG_ERROR, "Failed to send held responses to client_fd %d",
+            conn->client_fd_);
+        return false;
+    }
+    if (status == codes::WRITING_SUCCESS) {
+        update_epoll_events(conn->client_fd_, EPOLLIN);
     }
+    return true;
 }
 
 void WebServer::handle_error(Connection* conn) {
@@ -735,14 +973,96 @@ bool WebServer::create_listener_socket(
             hosts[host][0];  // First server is default
     }
 
+    // Index the server names reachable through this listener: its own IP
+    // first, then the servers listening on every address
+    VirtualHostIndex& host_index = listener_host_indexes_[listener_fd];
+    const std::vector<VirtualServer*>& own_servers = hosts[host];
+    for (size_t i = 0; i < own_servers.size(); ++i) {
+        host_index.add_server(own_servers[i]);
+    }
+    if (host != "0.0.0.0" && hosts.find("0.0.0.0") != hosts.end()) {
+        const std::vector<VirtualServer*>& any_servers = hosts["0.0.0.0"];
+        for (size_t i = 0; i < any_servers.size(); ++i) {
+            host_index.add_server(any_servers[i]);
+        }
+    }
+
     log(LOG_INFO, "Created socket for %s:%i", host.c_str(), port);
     return true;
 }
 
 int WebServer::cleanup_timed_out_connections() {
+    time_t now = time(NULL);
+    int expired = response_cache_->remove_expired(now);
+    if (expired > 0) {
+        log(LOG_DEBUG, "Removed %d expired response cache entries", expired);
+    }
+
+    for (std::map<std::string, Upstream>::iterator it = upstreams_.begin();
+         it != upstreams_.end(); ++it) {
+        int closed = it->second.close_expired_connections(now);
+        if (closed > 0) {
+            log(LOG_DEBUG, "Closed %d idle connections to upstream %s", closed,
+                it->second.name_.c_str());
+        }
+    }
+
     return conn_manager_->close_timed_out_connections();
 }
 
+// Give every proxied location a pointer to its shared Upstream.
+// "proxy_pass http://<name>" refers to an upstream block when one has that
+// name. Any other target gets an implicit single server upstream, shared by
+// all locations with the same target.
+bool WebServer::resolve_upstreams() {
+    for (std::list<VirtualServer>::iterator vs_it = virtual_servers_.begin();
+         vs_it != virtual_servers_.end(); ++vs_it) {
+        for (size_t i = 0; i < vs_it->locations_.size(); ++i) {
+            Location& location = vs_it->locations_[i];
+            if (location.proxy_pass_.empty()) {
+                continue;
+            }
+
+            std::string block_name;
+            if (location.proxy_pass_.find("http://") == 0) {
+                block_name = location.proxy_pass_.substr(7);
+                if (!block_name.empty() &&
+                    block_name[block_name.length() - 1] == '/') {
+                    block_name.erase(block_name.length() - 1);
+                }
+            }
+
+            std::map<std::string, Upstream>::iterator up_it =
+                upstreams_.find(block_name);
+            if (up_it == upstreams_.end()) {
+                up_it = upstreams_.find(location.proxy_pass_);
+            }
+            if (up_it == upstreams_.end()) {
+                Upstream upstream;
+                if (!Upstream::parse_target(location.proxy_pass_, upstream)) {
+                    return false;
+                }
+                up_it = upstreams_
+                            .insert(std::make_pair(location.proxy_pass_,
+                                                   upstream))
+                            .first;
+                log(LOG_DEBUG, "Upstream %s resolved to %s",
+                    location.proxy_pass_.c_str(),
+                    up_it->second.servers_[0].address_.c_str());
+            }
+            location.upstream_ = &up_it->second;
+        }
+    }
+
+    // Servers are final now, build the selection indexes
+    for (std::map<std::string, Upstream>::iterator it = upstreams_.begin();
+         it != upstreams_.end(); ++it) {
+        it->second.init_balancer();
+    }
+
+    return true;
+}
+
 void WebServer::remove_listener_socket(int fd) {
     // First, unregister from epoll
     if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) < 0) {
@@ -906,50 +1226,13 @@ void WebServer::signal_handler(int signal) {
 
 const Location* WebServer::find_matching_location(
     const VirtualServer* virtual_server, const std::string& uri) const {
-    // Use a reference instead of making a copy
-    const std::vector<Location>& locations_ = virtual_server->locations_;
-    const Location* best_match = NULL;
-
-    for (std::vector<Location>::const_iterator it = locations_.begin();
-         it != locations_.end(); ++it) {
-        const Location& location = *it;
-        // Check if the request path starts with the location path
-        if (uri.find(location.path_) == 0) {
-            // Make sure we match complete segments
-            if (location.path_ == "/" ||  // Root always matches
-                uri == location.path_ ||  // Exact match
-                (uri.length() > location.path_.length() &&
-                 (uri[location.path_.length()] == '/' ||
-                  location.path_[location.path_.length() - 1] == '/'))) {
-                if (!best_match ||
-                    location.path_.length() > best_match->path_.length()) {
-                    best_match = &location;
-                }
-            }
-        }
-    }
+    const Location* best_match = virtual_server->find_location(uri);
 
     if (!best_match) {
         log(LOG_FATAL, "No matching location found for URI: %s", uri.c_str());
     } else {
         log(LOG_DEBUG, "Found matching location: %s",
             best_match->path_.c_str());
-
-        std::string allowed_methods_str = "";
-        for (size_t i = 0; i < best_match->allowed_methods_.size(); i++) {
-            if (i > 0) {
-                allowed_methods_str += ", ";
-            }
-            allowed_methods_str += best_match->allowed_methods_[i];
-        }
-
-        log(LOG_TRACE,
-            "Location details: path=%s, root=%s, autoindex=%d, cgi_enabled=%d, "
-            "allowed_methods=%s, index=%s, redirect=%s",
-            best_match->path_.c_str(), best_match->root_.c_str(),
-            best_match->autoindex_, best_match->cgi_enabled_,
-            allowed_methods_str.c_str(), best_match->index_.c_str(),
-            best_match->redirect_.c_str());
     }
 
     return best_match;
@@ -967,44 +1250,26 @@ bool WebServer::validate_request_location(Connection* conn) {
     const std::string& request_method = conn->request_data_->method_;
 
     // Check if the requested method is allowed for this location
-    if (!matching_location->allowed_methods_.empty()) {
-        bool method_allowed = false;
-        std::string allowed_methods_str;
-
-        for (size_t i = 0; i < matching_location->allowed_methods_.size();
-             i++) {
-            // Build Allow header value
-            if (i > 0) {
-                allowed_methods_str += ", ";
-            }
-            allowed_methods_str += matching_location->allowed_methods_[i];
-
-            // Check if the current request method is allowed
-            if (matching_location->allowed_methods_[i] == request_method) {
-                method_allowed = true;
-            }
-        }
-
-        if (!method_allowed) {
-            log(LOG_DEBUG,
-                "Connection '%i', Host '%s': Method not allowed: %s, Allowed "
-                "methods: %s",
-                conn->client_fd_, conn->virtual_server_->host_name_.c_str(),
-                request_method.c_str(), allowed_methods_str.c_str());
-
-            // Apply 405 error directly to the response
-            ErrorHandler::generate_error_response(conn,
-                                                  codes::METHOD_NOT_ALLOWED);
-            log(LOG_WARNING,
-                "validate_request_location: Invalid request location for "
-                "client_fd %d",
-                conn->client_fd_);
+    if (!(matching_location->allowed_methods_ &
+          conn->request_data_->method_type_)) {
+        log(LOG_DEBUG,
+            "Connection '%i', Host '%s': Method not allowed: %s, Allowed "
+            "methods: %s",
+            conn->client_fd_, conn->virtual_server_->host_name_.c_str(),
+            request_method.c_str(), matching_location->allow_header_.c_str());
+
+        // Apply 405 error directly to the response
+        ErrorHandler::generate_error_response(conn, codes::METHOD_NOT_ALLOWED);
+        log(LOG_WARNING,
+            "validate_request_location: Invalid request location for "
+            "client_fd %d",
+            conn->client_fd_);
 
-            // Add the Allow header
-            conn->response_data_->set_header("Allow", allowed_methods_str);
+        // Add the Allow header
+        conn->response_data_->set_header("Allow",
+                                         matching_location->allow_header_);
 
-            return false;
-        }
+        return false;
     }
 
     log(LOG_DEBUG,
@@ -1015,6 +1280,157 @@ bool WebServer::validate_request_location(Connection* conn) {
     return true;
 }
 
+bool WebServer::answer_return(Connection* conn) {
+    const Location* location = conn->location_match_;
+    if (location->return_.empty()) {
+        return false;
+    }
+
+    // Error statuses without a text get the error page like any other error
+    if (location->return_response_.empty()) {
+        ErrorHandler::generate_error_response(conn, location->return_code_);
+        return true;
+    }
+
+    // The response was built with the configuration, only the Date line is
+    // added when it is sent
+    HttpResponse* resp = conn->response_data_;
+    resp->status_code_ = location->return_code_;
+    resp->status_message_ = get_status_message(location->return_code_);
+    conn->fixed_response_ = true;
+    conn->conn_state_ = codes::CONN_WRITING;
+
+    log(LOG_DEBUG, "Return %d for client_fd %d", location->return_code_,
+        conn->client_fd_);
+    return true;
+}
+
+bool WebServer::answer_options_request(Connection* conn) {
+    // Proxied locations let the upstream answer
+    if (conn->request_data_->method_type_ != codes::METHOD_OPTIONS ||
+        conn->location_match_->upstream_) {
+        return false;
+    }
+
+    HttpResponse* resp = conn->response_data_;
+    resp->status_code_ = codes::NO_CONTENT;
+    resp->status_message_ = "No Content";
+    resp->body_.clear();
+    resp->content_length_ = 0;
+    resp->set_header("Allow", conn->location_match_->allow_header_);
+    conn->conn_state_ = codes::CONN_WRITING;
+
+    log(LOG_DEBUG, "OPTIONS for client_fd %d: Allow %s", conn->client_fd_,
+        conn->location_match_->allow_header_.c_str());
+    return true;
+}
+
+bool WebServer::answer_expectation(Connection* conn) {
+    HttpRequest* request = conn->request_data_;
+    // HTTP/1.0 clients do not know the mechanism, RFC 7231 5.1.1
+    if (!request->has_header(codes::HEADER_EXPECT) ||
+        request->version_ != "HTTP/1.1") {
+        return true;
+    }
+    if (!request->header_equals(codes::HEADER_EXPECT, "100-continue")) {
+        log(LOG_WARNING, "Unsupported expectation from client_fd %d: %s",
+            conn->client_fd_,
+            request->get_header(codes::HEADER_EXPECT).c_str());
+        ErrorHandler::generate_error_response(conn,
+                                              codes::EXPECTATION_FAILED);
+        return false;
+    }
+    // Nothing to wait for without a body, or once the client started
+    // sending it anyway
+    if ((conn->parser_state_ != codes::PARSING_BODY &&
+         conn->parser_state_ != codes::PARSING_CHUNKED_BODY) ||
+        !conn->read_buffer_.empty()) {
+        return true;
+    }
+
+    // The checks handle_write() would make after the body, with the limit of
+    // the matched virtual server
+    conn->location_match_ =
+        find_matching_location(conn->virtual_server_, request->path_);
+    if (!validate_request_location(conn)) {
+        return false;
+    }
+    if (conn->parser_state_ == codes::PARSING_BODY &&
+        conn->body_remaining_bytes_ >
+            conn->virtual_server_->client_max_body_size_) {
+        log(LOG_WARNING,
+            "Refusing %zu byte body from client_fd %d before it is sent",
+            conn->body_remaining_bytes_, conn->client_fd_);
+        ErrorHandler::generate_error_response(conn, codes::PAYLOAD_TOO_LARGE);
+        return false;
+    }
+
+    // Responses to earlier pipelined requests go first. Little else is
+    // queued on the socket while a request is read, so the interim response
+    // fits its send buffer whole. Should it fail anyway, the client sends
+    // the body after its own timeout.
+    static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (response_writer_->send_held_responses(conn) !=
+        codes::WRITING_SUCCESS) {
+        log(LOG_WARNING,
+            "Responses to client_fd %d still queued, not sending 100 Continue",
+            conn->client_fd_);
+    } else if (send(conn->client_fd_, continue_response,
+             sizeof(continue_response) - 1, MSG_NOSIGNAL) < 0) {
+        log(LOG_WARNING, "Failed to send 100 Continue to client_fd %d",
+            conn->client_fd_);
+    } else {
+        log(LOG_DEBUG, "Sent 100 Continue to client_fd %d", conn->client_fd_);
+    }
+    return true;
+}
+
+bool WebServer::start_spliced_body(Connection* conn) {
+    // Only a Content-Length body of a PUT that FilePutHandler will take, or
+    // of a PATCH to a resumable upload, see choose_handler()
+    codes::Method method = conn->request_data_->method_type_;
+    if ((method != codes::METHOD_PUT && method != codes::METHOD_PATCH) ||
+        conn->parser_state_ != codes::PARSING_BODY) {
+        return false;
+    }
+    const Location* location = find_matching_location(
+        conn->virtual_server_, conn->request_data_->path_);
+    if (!location || !(location->allowed_methods_ & method) ||
+        !location->return_.empty() || location->metrics_ ||
+        location->upstream_) {
+        return false;
+    }
+
+    conn->location_match_ = location;
+    if (location->resumable_upload_) {
+        return method == codes::METHOD_PATCH &&
+               resumable_upload_handler_->open_spliced_body(conn);
+    }
+    return method == codes::METHOD_PUT &&
+           file_put_handler_->open_spliced_body(conn);
+}
+
+bool WebServer::start_streamed_upload(Connection* conn) {
+    // Only a Content-Length body of a POST that FileUploadHandler will take,
+    // see choose_handler(). It requires Content-Length anyway.
+    if (conn->request_data_->method_type_ != codes::METHOD_POST ||
+        conn->parser_state_ != codes::PARSING_BODY) {
+        return false;
+    }
+    const Location* location = find_matching_location(
+        conn->virtual_server_, conn->request_data_->path_);
+    if (!location || !(location->allowed_methods_ & codes::METHOD_POST) ||
+        !location->return_.empty() || location->metrics_ ||
+        location->upstream_ || location->resumable_upload_ ||
+        (location->cgi_enabled_ &&
+         is_cgi_extension(conn->request_data_->path_))) {
+        return false;
+    }
+
+    conn->location_match_ = location;
+    return file_upload_handler_->open_streamed_upload(conn);
+}
+
 AHandler* WebServer::choose_handler(Connection* conn) {
     log(LOG_DEBUG,
         "choose_handler: Finding handler for client_fd %d, method %s, path %s",
@@ -1022,29 +1438,59 @@ AHandler* WebServer::choose_handler(Connection* conn) {
         conn->request_data_->path_.c_str());
 
     const Location* matching_location = conn->location_match_;
-    const std::string& request_method = conn->request_data_->method_;
+    codes::Method request_method = conn->request_data_->method_type_;
     const std::string& request_path = conn->request_data_->path_;
 
     // TODO - Change CGI condition to cgi_enabled + executable file + valid
     // script extension?
     // Return appropriate handler based on location config
     // CHECK AND TEST - Carol
-    if (matching_location->cgi_enabled_ && is_cgi_extension(request_path) &&
-        request_method != "DELETE") {
+    if (matching_location->metrics_) {
+        log(LOG_DEBUG,
+            "choose_handler: Using MetricsHandler for client_fd %d, path %s",
+            conn->client_fd_, matching_location->path_.c_str());
+        conn->conn_state_ = codes::CONN_PROCESSING;
+        return metrics_handler_;
+    } else if (matching_location->upstream_) {
+        // Proxied locations forward every method to the upstream
+        log(LOG_DEBUG,
+            "choose_handler: Using ProxyHandler for client_fd %d, path %s",
+            conn->client_fd_, matching_location->path_.c_str());
+        conn->conn_state_ = codes::CONN_PROXYING;
+        return proxy_handler_;
+    } else if (matching_location->resumable_upload_) {
+        // Resumable upload locations take every method of the protocol
+        log(LOG_DEBUG,
+            "choose_handler: Using ResumableUploadHandler for client_fd %d, "
+            "path %s",
+            conn->client_fd_, matching_location->path_.c_str());
+        conn->conn_state_ = codes::CONN_PROCESSING;
+        return resumable_upload_handler_;
+    } else if (matching_location->cgi_enabled_ &&
+               is_cgi_extension(request_path) &&
+               (request_method & (codes::METHOD_GET | codes::METHOD_HEAD |
+                                  codes::METHOD_POST))) {
         // CGI handler for CGI-enabled locations
         log(LOG_DEBUG,
             "choose_handler: Using CgiHandler for client_fd %d, path %s",
             conn->client_fd_, matching_location->path_.c_str());
         conn->conn_state_ = codes::CONN_CGI_EXEC;
         return cgi_handler_;
-    } else if (request_method == "POST") {
+    } else if (request_method == codes::METHOD_POST) {
         // FileUploadHandler for file uploads
         log(LOG_DEBUG,
             "choose_handler: Using FileUploadHandler for client_fd %d, path %s",
             conn->client_fd_, matching_location->path_.c_str());
         conn->conn_state_ = codes::CONN_PROCESSING;
         return file_upload_handler_;
-    } else if (request_method == "DELETE") {
+    } else if (request_method == codes::METHOD_PUT) {
+        // FilePutHandler stores the body at the request path
+        log(LOG_DEBUG,
+            "choose_handler: Using FilePutHandler for client_fd %d, path %s",
+            conn->client_fd_, matching_location->path_.c_str());
+        conn->conn_state_ = codes::CONN_PROCESSING;
+        return file_put_handler_;
+    } else if (request_method == codes::METHOD_DELETE) {
         // DeleteHandler for dlete requests
         log(LOG_DEBUG,
             "choose_handler: Using DeleteHandler for client_fd %d, path %s",
@@ -1071,7 +1517,7 @@ void WebServer::match_host_header(Connection* conn) {
 
     // Get Host header value from the request
     std::string request_host_header_val =
-        conn->request_data_->get_header("Host");
+        conn->request_data_->get_header(codes::HEADER_HOST);
     std::string target_hostname = request_host_header_val;
     if (target_hostname.empty()) {
         conn->virtual_server_ = conn->default_virtual_server_;
@@ -1080,81 +1526,10 @@ void WebServer::match_host_header(Connection* conn) {
         return;
     }
 
-    // Strip port number from Host header if present
-    size_t colon_pos = target_hostname.find(':');
-    if (colon_pos != std::string::npos) {
-        target_hostname = target_hostname.substr(0, colon_pos);
-    }
-
-    // The connection's default_virtual_server_ tells us the port and listen IP
-    // this connection is associated with.
-    int listener_port = conn->default_virtual_server_->port_;
-    std::string listener_host_ip =
-        conn->default_virtual_server_->host_;  // IP from 'listen' directive
-
-    VirtualServer* matched_vs = NULL;
-
-    // 1. Check servers listening on the specific IP:Port of the connection
-    std::map<int, std::map<std::string, std::vector<VirtualServer*> > >::
-        const_iterator port_it = port_to_hosts_.find(listener_port);
-    if (port_it != port_to_hosts_.end()) {
-        const std::map<std::string, std::vector<VirtualServer*> >&
-            hosts_on_port = port_it->second;
-
-        // Check specific listener IP
-        std::map<std::string, std::vector<VirtualServer*> >::const_iterator
-            host_ip_it = hosts_on_port.find(listener_host_ip);
-        if (host_ip_it != hosts_on_port.end()) {
-            const std::vector<VirtualServer*>& candidate_servers =
-                host_ip_it->second;
-            for (std::vector<VirtualServer*>::const_iterator server_it =
-                     candidate_servers.begin();
-                 server_it != candidate_servers.end(); ++server_it) {
-                VirtualServer* vs = *server_it;
-                for (std::vector<std::string>::const_iterator name_it =
-                         vs->server_names_.begin();
-                     name_it != vs->server_names_.end(); ++name_it) {
-                    if (*name_it == target_hostname) {
-                        matched_vs = vs;
-                        break;  // Found specific server_name match on specific
-                                // IP
-                    }
-                }
-                if (matched_vs) {
-                    break;
-                }  // Break if we found a match
-            }
-        }
-
-        // 2. If no match on specific IP, check servers listening on 0.0.0.0
-        // (wildcard) for the same port
-        if (!matched_vs && listener_host_ip != "0.0.0.0") {
-            std::map<std::string, std::vector<VirtualServer*> >::const_iterator
-                wildcard_host_ip_it = hosts_on_port.find("0.0.0.0");
-            if (wildcard_host_ip_it != hosts_on_port.end()) {
-                const std::vector<VirtualServer*>& candidate_wildcard_servers =
-                    wildcard_host_ip_it->second;
-                for (std::vector<VirtualServer*>::const_iterator server_it =
-                         candidate_wildcard_servers.begin();
-                     server_it != candidate_wildcard_servers.end();
-                     ++server_it) {
-                    VirtualServer* vs = *server_it;
-                    for (std::vector<std::string>::const_iterator name_it =
-                             vs->server_names_.begin();
-                         name_it != vs->server_names_.end(); ++name_it) {
-                        if (*name_it == target_hostname) {
-                            matched_vs = vs;
-                            break;  // Found specific server_name match on
-                                    // wildcard IP
-                        }
-                    }
-                    if (matched_vs) {
-                        break;
-                    }
-                }
-            }
-        }
-    }
+    // One hash lookup in the listener's index, wildcards included
+    target_hostname = VirtualHostIndex::normalize(target_hostname);
+    VirtualServer* matched_vs =
+        conn->host_index_ ? conn->host_index_->find(target_hostname) : NULL;
 
     if (matched_vs) {
         log(LOG_DEBUG,
@@ -0,0 +1,104 @@
+#include "webserv.hpp"
+
+// Helper function to trim whitespace
+std::string trim(const std::string& str) {
+    size_t first = str.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = str.find_last_not_of(" \t");
+    return str.substr(first, last - first + 1);
+}
+
+
+std::string get_status_message(int code) { return status_reason(code); }
+
+// Request methods in the order they are listed in Allow headers
+static const struct {
+    const char* name;
+    codes::Method method;
+} METHOD_NAMES[] = {
+    {"GET", codes::METHOD_GET},
+    {"HEAD", codes::METHOD_HEAD},
+    {"POST", codes::METHOD_POST},
+    {"PUT", codes::METHOD_PUT},
+    {"PATCH", codes::METHOD_PATCH},
+    {"DELETE", codes::METHOD_DELETE},
+    {"OPTIONS", codes::METHOD_OPTIONS},
+};
+static const size_t METHOD_COUNT =
+    sizeof(METHOD_NAMES) / sizeof(METHOD_NAMES[0]);
+
+// Case-sensitive, as method names are
+codes::Method parse_method(const std::string& name) {
+    for (size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (name == METHOD_NAMES[i].name) {
+            return METHOD_NAMES[i].method;
+        }
+    }
+    return codes::METHOD_UNKNOWN;
+}
+
+// Allow header value for a method bitmask, e.g. "GET, HEAD, POST"
+std::string method_list(unsigned int methods) {
+    std::string list;
+    for (size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (methods & METHOD_NAMES[i].method) {
+            if (!list.empty()) {
+                list += ", ";
+            }
+            list += METHOD_NAMES[i].name;
+        }
+    }
+    return list;
+}
+
+// A client supplied file name reduced to a single safe path component
+std::string sanitize_filename(const std::string& filename) {
+    // Remove path information
+    std::string safe_filename = filename;
+    size_t last_slash = safe_filename.find_last_of("/\\");
+    if (last_slash != std::string::npos) {
+        safe_filename = safe_filename.substr(last_slash + 1);
+    }
+
+    // Remove potentially dangerous characters
+    for (size_t i = 0; i < safe_filename.length(); ++i) {
+        char c = safe_filename[i];
+        // Keep alphanumeric, dash, underscore, dot
+        if (!isalnum(c) && c != '-' && c != '_' && c != '.') {
+            safe_filename[i] = '_';
+        }
+    }
+
+    // Handle edge cases
+    if (safe_filename.empty() || safe_filename == "." ||
+        safe_filename == "..") {
+        return "upload_file";
+    }
+
+    // Limit filename length for filesystem compatibility
+    if (safe_filename.length() > 255) {
+        safe_filename = safe_filename.substr(0, 255);
+    }
+
+    return safe_filename;
+}
+
+bool make_directories(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        return true;  // Directory already exists
+    }
+
+    size_t pos = 0;
+    while ((pos = path.find('/', pos + 1)) != std::string::npos) {
+        std::string parent_dir = path.substr(0, pos);
+        if (mkdir(parent_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+
+    // Create final directory
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
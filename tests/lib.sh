@@ -0,0 +1,77 @@
+#!/bin/bash
+# filepath: tests/lib.sh
+
+# Helpers shared by the test scripts, sourced with
+#   . "$(dirname "$0")/lib.sh"
+# Scripts call begin_tests first and end with finish_tests. Run them from
+# the repository root after `make`.
+
+WEBSERV=./webserv
+FAILED=0
+STOP_ON_EXIT=""
+
+# Prints the banner and creates $WORKDIR. It is made in the working
+# directory, as roots in the configurations are relative to it.
+begin_tests() {
+    local title="$1"
+    local tag="$2"
+
+    echo "=== $title Test ==="
+    echo
+    WORKDIR=$(mktemp -d ".webserv_${tag}_test.XXXXXX")
+    trap cleanup EXIT
+}
+
+# Kills a background process when the script exits
+stop_on_exit() {
+    STOP_ON_EXIT="$STOP_ON_EXIT $1"
+}
+
+# Starts webserv on a configuration, logging to $WORKDIR/webserv.log, and
+# gives it a second to listen. WEBSERV_PID is the new server.
+start_server() {
+    $WEBSERV "$1" >> "$WORKDIR/webserv.log" 2>&1 &
+    WEBSERV_PID=$!
+    stop_on_exit $WEBSERV_PID
+    sleep 1
+}
+
+stop_server() {
+    kill $WEBSERV_PID 2> /dev/null
+    wait $WEBSERV_PID 2> /dev/null
+}
+
+# Stops what was started and removes $WORKDIR, kept when a check failed.
+# Scripts with more to undo define on_cleanup.
+cleanup() {
+    kill $STOP_ON_EXIT 2> /dev/null
+    wait $STOP_ON_EXIT 2> /dev/null
+    if declare -F on_cleanup > /dev/null; then
+        on_cleanup
+    fi
+    [ $FAILED -eq 0 ] && rm -rf "$WORKDIR"
+}
+
+check() {
+    local test_name="$1"
+    local expected="$2"
+    local actual="$3"
+
+    if [ "$actual" = "$expected" ]; then
+        echo "✅ $test_name"
+    else
+        echo "❌ $test_name: expected '$expected', got '$actual'"
+        FAILED=1
+    fi
+}
+
+# Prints the result of the tests named by $1 and exits with it
+finish_tests() {
+    echo
+    if [ $FAILED -eq 0 ]; then
+        echo "All $1 passed"
+    else
+        echo "Some $1 failed, see $WORKDIR/webserv.log"
+    fi
+    exit $FAILED
+}
@@ -0,0 +1,138 @@
+// Microbenchmark of the allocations made while parsing requests, as done by
+// RequestParser on a connection.
+//
+// Parses a corpus of typical request heads and reports heap allocations per
+// request for:
+// - a request on a new connection, with a new HttpRequest and no arena block
+//   yet
+// - kept-alive requests, reset between them the way
+//   Connection::reset_for_keep_alive() resets the parse state
+// Build and run with `make bench`.
+
+#include <new>
+
+#include "webserv.hpp"
+
+static const size_t RUNS = 5;
+static const size_t CORPUS_REPEAT = 2000;
+
+// Counts every heap allocation of the process
+static size_t allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    ++allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Out of line, so GCC does not pair the free() with a new expression
+__attribute__((noinline)) static void release(void* p) { std::free(p); }
+
+void operator delete(void* p) throw() { release(p); }
+
+static const char* const CORPUS[] = {
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, "
+    "like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/"
+    "avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;"
+    "q=0.7\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: _ga=GA1.2.1234567890.1700000000; _gid=GA1.2.987654321."
+    "1700000000; session=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIx"
+    "MjM0NTY3ODkwIn0.dozjgNryP4J3jVmNHl0w5N_XgL0n3I9PlFUP0THsR8U\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "\r\n",
+
+    "GET /images/logo.png HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:125.0) "
+    "Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Connection: keep-alive\r\n"
+    "If-Modified-Since: Tue, 14 May 2024 09:12:44 GMT\r\n"
+    "If-None-Match: \"6643298c-1f4a\"\r\n"
+    "\r\n",
+
+    "GET /api/v1/status?verbose=1 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+};
+static const size_t CORPUS_SIZE = sizeof(CORPUS) / sizeof(CORPUS[0]);
+
+// Parses one head on conn, false if it does not parse as a complete request
+static bool parse(RequestParser& parser, Connection* conn, const char* head) {
+    size_t length = std::strlen(head);
+    std::memcpy(conn->read_buffer_.prepare(length), head, length);
+    conn->read_buffer_.commit(length);
+    return parser.parse(conn) == codes::PARSE_HEADERS_COMPLETE &&
+           conn->parser_state_ == codes::PARSING_COMPLETE;
+}
+
+// Parses the corpus one way, prints the allocations of the best of RUNS.
+// Returns false if a request did not parse.
+static bool run(const char* label, bool keep_alive, Connection* conn) {
+    RequestParser parser;
+    size_t best = 0;
+    size_t requests = CORPUS_REPEAT * CORPUS_SIZE;
+
+    for (size_t run = 0; run < RUNS; ++run) {
+        size_t parse_allocations = 0;
+        for (size_t repeat = 0; repeat < CORPUS_REPEAT; ++repeat) {
+            for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+                if (!keep_alive) {
+                    delete conn->request_data_;
+                    conn->request_data_ = new HttpRequest();
+                    conn->arena_.release();
+                }
+
+                size_t allocations_before = allocations;
+                if (!parse(parser, conn, CORPUS[i])) {
+                    std::printf("  %-12s request %zu did not parse!\n", label,
+                                i);
+                    return false;
+                }
+                parse_allocations += allocations - allocations_before;
+
+                conn->request_data_->clear();
+                conn->arena_.reset();
+                conn->parser_state_ = codes::PARSING_REQUEST_LINE;
+            }
+        }
+        if (run == 0 || parse_allocations < best) {
+            best = parse_allocations;
+        }
+    }
+
+    std::printf("  %-12s %6.2f allocations/request, %zu arena block(s)\n",
+                label,
+                static_cast<double>(best) / static_cast<double>(requests),
+                conn->arena_.block_count());
+    return true;
+}
+
+int main() {
+    VirtualServer server;
+    // Never destroyed, its destructor reaches into the WebServer
+    Connection* conn = new Connection(-1, &server);
+
+    std::printf("Parsing request heads:\n");
+    bool parsed = run("new", false, conn);
+    parsed = run("kept alive", true, conn) && parsed;
+    return parsed ? 0 : 1;
+}
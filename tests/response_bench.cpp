@@ -0,0 +1,244 @@
+// Microbenchmark of response head serialization, as done by ResponseWriter.
+//
+// Builds and serializes the heads of a few typical responses and reports
+// cycles and heap allocations per response for:
+// - the writer before HttpResponse::write_head(): headers in a std::map,
+//   a std::stringstream per head, the reason phrase copied out of a switch
+//   and the Date formatted with strftime() every time
+// - HttpResponse::write_head() into a reused buffer, with the flat header
+//   list and the Date of the current second
+// Build and run with `make bench`.
+
+#include <ctime>
+#include <new>
+
+#include "webserv.hpp"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static unsigned long long ticks() { return __rdtsc(); }
+#else
+#define BENCH_UNIT "ns"
+static unsigned long long ticks() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+#endif
+
+static const size_t RUNS = 5;
+static const size_t RESPONSES = 200000;
+
+// Counts every heap allocation of the process
+static size_t allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    ++allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Out of line, so GCC does not pair the free() with a new expression
+__attribute__((noinline)) static void release(void* p) { std::free(p); }
+
+void operator delete(void* p) throw() { release(p); }
+
+// Stand-in for the logger the server links with
+int log(log_level, const char*, ...) { return 0; }
+
+// A response as the handlers describe it
+struct Sample {
+    const char* label;
+    int status;
+    const char* content_type;  // NULL if none
+    size_t content_length;
+    const char* headers[3][2];  // Other headers, name NULL after the last
+};
+
+static const Sample SAMPLES[] = {
+    {"static file", 200, "text/html", 5120, {{NULL, NULL}}},
+    {"error", 404, "text/html; charset=UTF-8", 1528,
+     {{"Connection", "close"}, {NULL, NULL}}},
+    {"upload", 201, NULL, 0,
+     {{"Location", "/files/8f14e45fceea167a5a36dedd4bea2543"},
+      {"Tus-Resumable", "1.0.0"},
+      {"Upload-Offset", "0"}}},
+};
+static const size_t SAMPLE_COUNT = sizeof(SAMPLES) / sizeof(SAMPLES[0]);
+
+// The response and writer before, reduced to what serialization touched
+struct OldResponse {
+    int status_code_;
+    std::string version_;
+    std::map<std::string, std::string> headers_;
+    size_t content_length_;
+    std::string content_type_;
+
+    void set_header(const std::string& name, const std::string& value) {
+        std::string lower_name = name;
+        for (size_t i = 0; i < lower_name.size(); ++i) {
+            lower_name[i] =
+                std::tolower(static_cast<unsigned char>(lower_name[i]));
+        }
+        headers_[lower_name] = value;
+    }
+};
+
+static std::string old_status_message(int code) {
+    switch (code) {
+        case 200:
+            return "OK";
+        case 201:
+            return "Created";
+        case 404:
+            return "Not Found";
+        default:
+            return "Unknown Status";
+    }
+}
+
+static std::string old_gmt_time() {
+    char buffer[100];
+    time_t now = time(NULL);
+    struct tm* tm_info = gmtime(&now);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", tm_info);
+    return std::string(buffer);
+}
+
+static void old_write_headers(const OldResponse& resp, IoBuffer& out) {
+    std::stringstream headers;
+
+    headers << resp.version_ << " " << resp.status_code_ << " "
+            << old_status_message(resp.status_code_) << "\r\n";
+    for (std::map<std::string, std::string>::const_iterator it =
+             resp.headers_.begin();
+         it != resp.headers_.end(); ++it) {
+        headers << it->first << ": " << it->second << "\r\n";
+    }
+    if (resp.headers_.find("date") == resp.headers_.end()) {
+        headers << "Date: " << old_gmt_time() << "\r\n";
+    }
+    if (resp.headers_.find("server") == resp.headers_.end()) {
+        headers << "Server: Webserv/1.0\r\n";
+    }
+    if (resp.headers_.find("content-type") == resp.headers_.end() &&
+        !resp.content_type_.empty()) {
+        headers << "Content-Type: " << resp.content_type_ << "\r\n";
+    }
+    if (resp.headers_.find("content-length") == resp.headers_.end() &&
+        resp.headers_.find("transfer-encoding") == resp.headers_.end()) {
+        headers << "Content-Length: " << resp.content_length_ << "\r\n";
+    }
+    headers << "\r\n";
+
+    std::string headers_str = headers.str();
+    out.insert(out.end(), headers_str.begin(), headers_str.end());
+}
+
+static void build_old(const Sample& sample, OldResponse& resp) {
+    resp.status_code_ = sample.status;
+    resp.version_ = "HTTP/1.1";
+    resp.headers_.clear();
+    resp.content_type_ = sample.content_type ? sample.content_type : "";
+    resp.content_length_ = sample.content_length;
+    for (size_t i = 0; i < 3 && sample.headers[i][0]; ++i) {
+        resp.set_header(sample.headers[i][0], sample.headers[i][1]);
+    }
+}
+
+static void build_new(const Sample& sample, HttpResponse& resp) {
+    resp.clear();
+    resp.status_code_ = sample.status;
+    if (sample.content_type) {
+        resp.content_type_ = sample.content_type;
+    }
+    resp.content_length_ = sample.content_length;
+    for (size_t i = 0; i < 3 && sample.headers[i][0]; ++i) {
+        resp.set_header(sample.headers[i][0], sample.headers[i][1]);
+    }
+}
+
+// Builds and serializes RESPONSES heads of sample one way, prints the best
+// of RUNS. Returns the last head.
+static std::string run(const char* label, bool use_new, const Sample& sample) {
+    OldResponse old_resp;
+    HttpResponse new_resp;
+    IoBuffer out;
+    unsigned long long best = 0;
+    size_t best_allocations = 0;
+
+    for (size_t run = 0; run < RUNS; ++run) {
+        size_t allocations_before = allocations;
+        unsigned long long start = ticks();
+        for (size_t i = 0; i < RESPONSES; ++i) {
+            out.clear();
+            if (use_new) {
+                // Once per event loop turn in the server, here per response
+                refresh_http_date(time(NULL));
+                build_new(sample, new_resp);
+                new_resp.write_head(out, true);
+            } else {
+                build_old(sample, old_resp);
+                old_write_headers(old_resp, out);
+            }
+        }
+        unsigned long long elapsed = ticks() - start;
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+            best_allocations = allocations - allocations_before;
+        }
+    }
+
+    std::printf("  %-12s %8.1f %s/response %6.2f allocations/response\n",
+                label,
+                static_cast<double>(best) / static_cast<double>(RESPONSES),
+                BENCH_UNIT,
+                static_cast<double>(best_allocations) /
+                    static_cast<double>(RESPONSES));
+    return std::string(out.begin(), out.end());
+}
+
+// Header lines of a head in sorted order, as the old writer sorted them by
+// name and the new one keeps the order they were set in. The Date line is
+// left out, the second may change between runs.
+static std::string normalized(const std::string& head) {
+    std::vector<std::string> lines;
+    size_t pos = 0;
+    size_t end;
+    while ((end = head.find(CRLF, pos)) != std::string::npos) {
+        std::string line = head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        for (size_t i = 0; i < colon && colon != std::string::npos; ++i) {
+            line[i] = std::tolower(static_cast<unsigned char>(line[i]));
+        }
+        if (line.compare(0, 5, "date:") != 0) {
+            lines.push_back(line);
+        }
+        pos = end + 2;
+    }
+    std::sort(lines.begin(), lines.end());
+    std::string joined;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        joined.append(lines[i]).append("\n");
+    }
+    return joined;
+}
+
+int main() {
+    bool consistent = true;
+
+    for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+        std::printf("%s response:\n", SAMPLES[i].label);
+        std::string expected = run("before", false, SAMPLES[i]);
+        std::string head = run("write_head", true, SAMPLES[i]);
+        if (normalized(head) != normalized(expected)) {
+            std::printf("  write_head produced a different head!\n");
+            consistent = false;
+        }
+    }
+    return consistent ? 0 : 1;
+}
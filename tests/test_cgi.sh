@@ -0,0 +1,58 @@
+#!/bin/bash
+# filepath: tests/test_cgi.sh
+
+# Tests the environment given to CGI scripts: the per-location template
+# and the variables of each request.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8112
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "CGI" cgi
+
+mkdir -p "$WORKDIR/cgi"
+cat > "$WORKDIR/cgi/env.sh" << 'EOF'
+#!/bin/sh
+printf 'Content-Type: text/plain\r\n\r\n'
+env
+EOF
+chmod +x "$WORKDIR/cgi/env.sh"
+
+cat > "$WORKDIR/cgi.conf" << EOF
+server {
+    listen 127.0.0.1:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR;
+        cgi on;
+        allow_methods GET;
+    }
+}
+EOF
+
+start_server "$WORKDIR/cgi.conf"
+
+curl -s -H "X-Test-Header: forwarded" "$BASE_URL/cgi/env.sh?a=1&b=2" \
+    > "$WORKDIR/env"
+
+env_var() {
+    grep "^$1=" "$WORKDIR/env" | cut -d= -f2-
+}
+
+check "GATEWAY_INTERFACE" "CGI/1.1" "$(env_var GATEWAY_INTERFACE)"
+check "SERVER_SOFTWARE" "webserv/1.0" "$(env_var SERVER_SOFTWARE)"
+# SERVER_NAME is the listen host
+check "SERVER_NAME" "127.0.0.1" "$(env_var SERVER_NAME)"
+check "SERVER_PORT" "$PORT" "$(env_var SERVER_PORT)"
+check "DOCUMENT_ROOT" "$WORKDIR" "$(env_var DOCUMENT_ROOT)"
+check "REQUEST_METHOD" "GET" "$(env_var REQUEST_METHOD)"
+check "QUERY_STRING" "a=1&b=2" "$(env_var QUERY_STRING)"
+check "SERVER_PROTOCOL" "HTTP/1.1" "$(env_var SERVER_PROTOCOL)"
+check "REMOTE_ADDR" "127.0.0.1" "$(env_var REMOTE_ADDR)"
+check "Request header as HTTP_ variable" "forwarded" \
+    "$(env_var HTTP_X_TEST_HEADER)"
+
+finish_tests "CGI tests"
@@ -0,0 +1,129 @@
+#!/bin/bash
+# filepath: tests/test_error_pages.sh
+
+# Tests error responses, which are served from pages prepared at startup:
+# configured pages per virtual server, default pages, HEAD, and reloading a
+# page file once it changes.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8106
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Error Page" error_pages
+
+mkdir -p "$WORKDIR/www"
+echo "first missing page" > "$WORKDIR/404.html"
+echo "other missing page" > "$WORKDIR/other404.html"
+# Larger than a socket buffer, so it is sent in several parts
+head -c 600000 /dev/urandom | base64 > "$WORKDIR/403.html"
+mkdir -p "$WORKDIR/www/closed"
+
+cat > "$WORKDIR/error_pages.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    error_page 404 $WORKDIR/404.html;
+    error_page 403 $WORKDIR/403.html;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET HEAD;
+    }
+}
+
+server {
+    listen $HOST:$PORT;
+    server_name other.local;
+    error_page 404 $WORKDIR/other404.html;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+EOF
+
+start_server "$WORKDIR/error_pages.conf"
+
+# Value of a response header in a file written by `curl -D`
+header() {
+    grep -i "^$1:" "$2" | tr -d '\r' | cut -d' ' -f2-
+}
+
+curl -s -D "$WORKDIR/404.head" -o "$WORKDIR/404.body" $BASE_URL/missing
+check "Configured page is served" "first missing page" \
+    "$(cat "$WORKDIR/404.body")"
+check "Its Content-Length matches" "$(wc -c < "$WORKDIR/404.html")" \
+    "$(header Content-Length "$WORKDIR/404.head")"
+check "Its Content-Type is HTML" "text/html; charset=UTF-8" \
+    "$(header Content-Type "$WORKDIR/404.head")"
+check "Connection is closed" "close" \
+    "$(header Connection "$WORKDIR/404.head")"
+check "Date is sent" "yes" \
+    "$([ -n "$(header Date "$WORKDIR/404.head")" ] && echo yes || echo no)"
+
+check "Page of the other virtual server" "other missing page" \
+    "$(curl -s -H "Host: other.local" $BASE_URL/missing)"
+
+curl -s -D "$WORKDIR/405.head" -o "$WORKDIR/405.body" -X DELETE \
+    $BASE_URL/index.html
+check "Default page is served" "405 yes" \
+    "$(head -1 "$WORKDIR/405.head" | cut -d' ' -f2) \
+$(grep -q '<div class="error-code">405</div>' "$WORKDIR/405.body" \
+    && echo yes || echo no)"
+check "Default page Content-Length matches" "$(wc -c < "$WORKDIR/405.body")" \
+    "$(header Content-Length "$WORKDIR/405.head")"
+
+check "Large page is sent whole" "$(md5sum < "$WORKDIR/403.html")" \
+    "$(curl -s $BASE_URL/closed/ | md5sum)"
+
+# Bytes after the head of a HEAD response, read until the server closes
+HEAD_BODY=$(python3 - "$HOST" "$PORT" << 'EOF'
+import socket, sys
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])))
+s.sendall(b"HEAD /missing HTTP/1.1\r\nHost: localhost\r\n\r\n")
+data = b""
+while True:
+    chunk = s.recv(65536)
+    if not chunk:
+        break
+    data += chunk
+head, _, body = data.partition(b"\r\n\r\n")
+length = [l.split(b":")[1].strip() for l in head.split(b"\r\n")
+          if l.lower().startswith(b"content-length:")]
+print(len(body), length[0].decode() if length else "none")
+EOF
+)
+check "HEAD gets the headers only" "0 $(wc -c < "$WORKDIR/404.html")" \
+    "$HEAD_BODY"
+
+# Many errors from the same shared page
+URLS=""
+for i in $(seq 1 200); do
+    URLS="$URLS $BASE_URL/missing$i"
+done
+check "Repeated errors are all served" "200" \
+    "$(curl -s $URLS | grep -c 'first missing page')"
+
+# Changed pages are picked up within a second or so
+sleep 1.1
+echo "second missing page" > "$WORKDIR/404.html"
+sleep 1.1
+check "Changed page is reloaded" "second missing page" \
+    "$(curl -s $BASE_URL/missing)"
+
+rm "$WORKDIR/404.html"
+sleep 1.1
+check "Removed page falls back to the default" "yes" \
+    "$(curl -s $BASE_URL/missing | grep -q '<div class="error-code">404</div>' \
+        && echo yes || echo no)"
+
+echo "third missing page" > "$WORKDIR/404.html"
+sleep 1.1
+check "Recreated page is served again" "third missing page" \
+    "$(curl -s $BASE_URL/missing)"
+
+finish_tests "error page tests"
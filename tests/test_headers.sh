@@ -0,0 +1,93 @@
+#!/bin/bash
+# filepath: tests/test_headers.sh
+
+# Tests request header parsing: case-insensitive names, whitespace around
+# values, repeated headers, invalid names and the header count limit.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8100
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Request Headers" headers
+
+mkdir -p "$WORKDIR/www"
+echo "hello headers" > "$WORKDIR/www/index.html"
+
+cat > "$WORKDIR/headers.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET PUT;
+    }
+}
+
+server {
+    listen $HOST:$PORT;
+    server_name other.test;
+
+    location / {
+        root $WORKDIR/www;
+        redirect 301 /other;
+    }
+}
+EOF
+
+start_server "$WORKDIR/headers.conf"
+
+# Sends a raw request and prints the response
+raw() {
+    printf "$1" | python3 -c '
+import socket, sys
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])), timeout=2)
+s.sendall(sys.stdin.buffer.read())
+data = b""
+try:
+    while b"\r\n\r\n" not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+except socket.timeout:
+    pass
+sys.stdout.write(data.decode("latin-1"))
+' $HOST $PORT
+}
+
+# Prints the status code of the response to a raw request
+raw_status() {
+    raw "$1" | head -1 | awk '{print $2}'
+}
+
+check "Header names are case-insensitive" "201" \
+    "$(raw_status "PUT /a.txt HTTP/1.1\r\nhOsT: localhost\r\nCONTENT-length: 3\r\n\r\nabc")"
+check "Body length comes from the parsed header" "abc" \
+    "$(cat "$WORKDIR/www/a.txt")"
+check "Whitespace around values is ignored" "204" \
+    "$(raw_status "PUT /a.txt HTTP/1.1\r\nHost: localhost\r\nContent-Length:  \t2 \t\r\n\r\nxy")"
+check "Last of repeated headers wins" "/other" \
+    "$(raw "GET / HTTP/1.1\r\nHost: localhost\r\nHost: other.test\r\n\r\n" |
+        grep -i '^location:' | awk '{print $NF}' | tr -d '\r')"
+check "Invalid header name is rejected" "400" \
+    "$(raw_status "GET / HTTP/1.1\r\nHost: localhost\r\nBad Name: x\r\n\r\n")"
+check "Header without colon is rejected" "400" \
+    "$(raw_status "GET / HTTP/1.1\r\nHost: localhost\r\nNoColon\r\n\r\n")"
+
+MANY=""
+for i in $(seq 1 101); do
+    MANY="${MANY}X-Header-$i: $i\r\n"
+done
+check "Too many headers are rejected" "431" \
+    "$(raw_status "GET / HTTP/1.1\r\nHost: localhost\r\n$MANY\r\n")"
+
+check "Connection: close is honoured" "hello headers" \
+    "$(curl -s -H 'Connection: Close' $BASE_URL/index.html)"
+check "Server still serves requests" "200" \
+    "$(curl -s -o /dev/null -w '%{http_code}' $BASE_URL/index.html)"
+
+finish_tests "request header tests"
@@ -0,0 +1,231 @@
+#!/bin/bash
+# filepath: tests/test_keepalive.sh
+
+# Tests the keep-alive policy: keepalive_requests, keepalive_timeout, idle
+# connections waking up for their next request, and idle timeouts cut down
+# as the connection count nears the limit.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8108
+IDLE_PORT=8109
+CLOSE_PORT=8110
+FULL_PORT=8111
+HOST=127.0.0.1
+
+begin_tests "Keep-Alive" keepalive
+
+mkdir -p "$WORKDIR/www"
+echo "hello" > "$WORKDIR/www/index.html"
+
+cat > "$WORKDIR/keepalive.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    keepalive_requests 3;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+
+    location /metrics {
+        metrics on;
+    }
+}
+
+server {
+    listen $HOST:$PORT;
+    server_name short.test;
+    keepalive_timeout 1;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+
+server {
+    listen $HOST:$IDLE_PORT;
+    server_name localhost;
+    keepalive_timeout 1;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+
+server {
+    listen $HOST:$IDLE_PORT;
+    server_name long.test;
+    keepalive_timeout 30;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+
+server {
+    listen $HOST:$CLOSE_PORT;
+    server_name localhost;
+    keepalive_timeout 0;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+EOF
+
+cat > "$WORKDIR/full.conf" << EOF
+server {
+    listen $HOST:$FULL_PORT;
+    server_name localhost;
+    keepalive_timeout 10;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+EOF
+
+# 64 descriptors leave room for 32 clients
+(ulimit -n 64 && exec $WEBSERV "$WORKDIR/full.conf") \
+    > "$WORKDIR/full.log" 2>&1 &
+stop_on_exit $!
+start_server "$WORKDIR/keepalive.conf"
+
+GET='GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n'
+
+# Sends each piece on one connection, pausing between them, and prints the
+# status codes, the Connection headers (- if none) and whether the server
+# closed the connection
+exchange() {
+    python3 - "$HOST" "$@" << 'EOF'
+import re, socket, sys, time
+port = int(sys.argv[2])
+s = socket.create_connection((sys.argv[1], port), timeout=4)
+data = b""
+for piece in sys.argv[3:]:
+    if piece.startswith("sleep "):
+        time.sleep(float(piece[6:]))
+        continue
+    s.sendall(piece.encode().decode("unicode_escape").encode("latin-1"))
+    time.sleep(0.2)
+closed = "open"
+try:
+    s.settimeout(0.5)
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            closed = "closed"
+            break
+        data += chunk
+except socket.timeout:
+    pass
+except ConnectionResetError:
+    closed = "closed"
+text = data.decode("latin-1")
+codes = re.findall(r"HTTP/1\.[01] (\d{3}) ", text)
+heads = re.split(r"HTTP/1\.[01] \d{3} ", text)[1:]
+connection = []
+for head in heads:
+    fields = head.split("\r\n\r\n")[0] + "\r\n"
+    match = re.search(r"\r\nConnection: ([^\r]*)\r\n", fields, re.I)
+    connection.append(match.group(1) if match else "-")
+print(" ".join(codes), "|", " ".join(connection), "|", closed)
+EOF
+}
+
+check "Kept-alive requests are served" "200 200 | - - | open" \
+    "$(exchange $PORT "$GET" "$GET")"
+check "Connection closes after keepalive_requests" \
+    "200 200 200 | - - close | closed" \
+    "$(exchange $PORT "$GET" "$GET" "$GET" "$GET")"
+check "Pipelined requests past the limit are dropped" \
+    "200 200 200 | - - close | closed" \
+    "$(exchange $PORT "$GET$GET$GET$GET$GET")"
+check "HTTP/1.0 without keep-alive is told the connection closes" \
+    "200 | close | closed" \
+    "$(exchange $PORT 'GET /index.html HTTP/1.0\r\n\r\n')"
+check "Idle connection serves its next request" "200 200 | - - | open" \
+    "$(exchange $IDLE_PORT "$GET" "sleep 0.5" "$GET")"
+check "Idle connection closes after keepalive_timeout" "200 | - | closed" \
+    "$(exchange $IDLE_PORT "$GET" "sleep 2.5")"
+# The server named in Host sets the idle timeout, not the default one
+check "Idle timeout of a shorter name-based server" "200 | - | closed" \
+    "$(exchange $PORT "${GET/localhost/short.test}" "sleep 2.5")"
+check "Idle timeout of a longer name-based server" "200 | - | open" \
+    "$(exchange $IDLE_PORT "${GET/localhost/long.test}" "sleep 2.5")"
+check "keepalive_timeout 0 closes after the response" "200 | close | closed" \
+    "$(exchange $CLOSE_PORT "$GET")"
+
+# Many idle connections, parked between requests without buffers
+IDLE=$(python3 - "$HOST" "$PORT" << 'EOF'
+import socket, sys, time, urllib.request
+host, port = sys.argv[1], int(sys.argv[2])
+request = b"GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
+sockets = []
+for _ in range(100):
+    s = socket.create_connection((host, port), timeout=3)
+    s.sendall(request)
+    sockets.append(s)
+answered = sum(1 for s in sockets if s.recv(65536).startswith(b"HTTP/1.1 200"))
+time.sleep(0.2)
+metrics = urllib.request.urlopen("http://%s:%d/metrics" % (host, port)).read()
+def metric(name):
+    values = [l.split()[1] for l in metrics.decode().splitlines()
+              if l.startswith(name + " ")]
+    return int(values[0]) if values else -1
+idle = metric("webserv_idle_connections")
+# Only the connection asking for the metrics holds buffer blocks: read,
+# write and request arena
+blocks = metric('webserv_buffer_pool_blocks_in_use{size="4096"}')
+for s in sockets:
+    s.sendall(request)
+again = sum(1 for s in sockets if s.recv(65536).startswith(b"HTTP/1.1 200"))
+print(answered, idle, "released" if 0 <= blocks <= 3 else blocks, again)
+EOF
+)
+check "Idle connections are parked and wake up" "100 100 released 100" \
+    "$IDLE"
+
+# Near the limit of 32 clients, idle connections time out well before their
+# 10 seconds, and clients past the limit are refused
+FULL=$(python3 - "$HOST" "$FULL_PORT" << 'EOF'
+import socket, sys, time
+host, port = sys.argv[1], int(sys.argv[2])
+request = b"GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
+sockets = []
+for _ in range(32):
+    s = socket.create_connection((host, port), timeout=3)
+    s.sendall(request)
+    s.recv(65536)
+    sockets.append(s)
+extra = socket.create_connection((host, port), timeout=3)
+try:
+    refused = extra.recv(65536) == b""
+except (ConnectionResetError, socket.timeout):
+    refused = True
+time.sleep(4)
+closed = 0
+for s in sockets:
+    s.setblocking(False)
+    try:
+        if s.recv(65536) == b"":
+            closed += 1
+    except BlockingIOError:
+        pass
+    except ConnectionResetError:
+        closed += 1
+print("refused" if refused else "accepted",
+      "early" if 0 < closed < 32 else "closed %d" % closed)
+EOF
+)
+check "Idle timeout shrinks near the connection limit" "refused early" "$FULL"
+
+finish_tests "keep-alive tests"
@@ -0,0 +1,86 @@
+#!/bin/bash
+# filepath: tests/test_location_matching.sh
+
+# Tests location selection: longest prefix on segment boundaries, exact (=),
+# ^~ and regex (~, ~*) locations. Each location redirects to its own name.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8097
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "Location Matching" location
+
+cat > "$WORKDIR/locations.conf" << EOF
+server {
+    listen 127.0.0.1:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR;
+        redirect 301 /root;
+    }
+
+    location /static {
+        root $WORKDIR;
+        redirect 301 /static;
+    }
+
+    location /static/ {
+        root $WORKDIR;
+        redirect 301 /static-slash;
+    }
+
+    location /static/img/deep {
+        root $WORKDIR;
+        redirect 301 /deep;
+    }
+
+    location = /static/logo.png {
+        root $WORKDIR;
+        redirect 301 /exact;
+    }
+
+    location ^~ /static/raw {
+        root $WORKDIR;
+        redirect 301 /no-regex;
+    }
+
+    location ~ \.png\$ {
+        root $WORKDIR;
+        redirect 301 /regex-png;
+    }
+
+    location ~* \.jpg\$ {
+        root $WORKDIR;
+        redirect 301 /regex-jpg;
+    }
+}
+EOF
+
+start_server "$WORKDIR/locations.conf"
+
+# Prints the name of the location that handled the path
+matched() {
+    curl -s -D - -o /dev/null "$BASE_URL$1" | grep -i '^location:' |
+        awk '{print $NF}' | tr -d '\r'
+}
+
+check "Root location catches everything else" "/root" "$(matched /other)"
+check "Prefix without trailing slash matches itself" "/static" \
+    "$(matched /static)"
+check "Prefix only matches whole segments" "/root" "$(matched /staticfiles)"
+check "Trailing slash prefix is longer" "/static-slash" \
+    "$(matched /static/file.txt)"
+check "Longest prefix wins" "/deep" "$(matched /static/img/deep/a.txt)"
+check "Exact location wins" "/exact" "$(matched /static/logo.png)"
+check "Exact location needs the whole path" "/regex-png" \
+    "$(matched /static/logo.png/x.png)"
+check "Regex beats a plain prefix" "/regex-png" \
+    "$(matched /static/img/deep/a.png)"
+check "^~ prefix skips regexes" "/no-regex" "$(matched /static/raw/a.png)"
+check "Case-insensitive regex" "/regex-jpg" "$(matched /photos/A.JPG)"
+check "Case-sensitive regex" "/static-slash" "$(matched /static/A.PNG)"
+
+finish_tests "location matching tests"
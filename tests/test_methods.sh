@@ -0,0 +1,114 @@
+#!/bin/bash
+# filepath: tests/test_methods.sh
+
+# Tests request methods: HEAD, OPTIONS and PUT, and the per-location
+# allow_methods set with its Allow header. Run from the repository root
+# after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8099
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "Request Methods" methods
+
+mkdir -p "$WORKDIR/www" "$WORKDIR/files"
+echo "hello methods" > "$WORKDIR/www/index.html"
+
+cat > "$WORKDIR/methods.conf" << EOF
+server {
+    listen 127.0.0.1:$PORT;
+    server_name localhost;
+    client_max_body_size 64M;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+
+    location /files {
+        root $WORKDIR/files;
+        allow_methods GET PUT DELETE;
+    }
+}
+EOF
+
+start_server "$WORKDIR/methods.conf"
+
+# Prints the value of a response header, without the trailing CR
+header() {
+    grep -i "^$1:" | head -1 | cut -d' ' -f2- | tr -d '\r'
+}
+
+check "HEAD returns 200" "200" \
+    "$(curl -s -I -o /dev/null -w '%{http_code}' $BASE_URL/index.html)"
+check "HEAD has the GET Content-Length" "14" \
+    "$(curl -s -I $BASE_URL/index.html | header content-length)"
+check "HEAD has no body" "0" \
+    "$(curl -s -I -o /dev/null -w '%{size_download}' $BASE_URL/index.html)"
+check "Keep-alive survives a HEAD" "200 200" \
+    "$(curl -s -I -o /dev/null -o /dev/null -w '%{http_code} ' \
+        $BASE_URL/index.html $BASE_URL/index.html | sed 's/ $//')"
+
+check "OPTIONS returns 204" "204" \
+    "$(curl -s -X OPTIONS -o /dev/null -w '%{http_code}' $BASE_URL/)"
+check "OPTIONS lists the allowed methods" "GET, HEAD, OPTIONS" \
+    "$(curl -s -X OPTIONS -D - -o /dev/null $BASE_URL/ | header allow)"
+
+check "Disallowed method returns 405" "405" \
+    "$(curl -s -X DELETE -o /dev/null -w '%{http_code}' $BASE_URL/index.html)"
+check "405 carries the Allow header" "GET, HEAD, OPTIONS" \
+    "$(curl -s -X DELETE -D - -o /dev/null $BASE_URL/index.html | header allow)"
+check "Unknown method is rejected" "405" \
+    "$(curl -s -X BREW -o /dev/null -w '%{http_code}' $BASE_URL/)"
+
+check "PUT creates a file" "201" \
+    "$(curl -s -X PUT --data-binary 'first' -o /dev/null -w '%{http_code}' \
+        $BASE_URL/files/note.txt)"
+check "PUT content is stored" "first" "$(cat "$WORKDIR/files/note.txt")"
+check "PUT replaces a file" "204" \
+    "$(curl -s -X PUT --data-binary 'second' -o /dev/null -w '%{http_code}' \
+        $BASE_URL/files/note.txt)"
+check "GET returns the replaced content" "second" \
+    "$(curl -s $BASE_URL/files/note.txt)"
+check "PUT into a missing directory is a conflict" "409" \
+    "$(curl -s -X PUT --data-binary 'x' -o /dev/null -w '%{http_code}' \
+        $BASE_URL/files/missing/note.txt)"
+check "PUT is refused where not allowed" "405" \
+    "$(curl -s -X PUT --data-binary 'x' -o /dev/null -w '%{http_code}' \
+        $BASE_URL/new.txt)"
+# Large bodies are spliced into the file instead of being held in memory
+head -c 52428800 /dev/urandom > "$WORKDIR/big.bin"
+check "Large PUT creates a file" "201" \
+    "$(curl -s -X PUT --data-binary @"$WORKDIR/big.bin" -o /dev/null \
+        -w '%{http_code}' $BASE_URL/files/big.bin)"
+check "Large PUT is stored intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$WORKDIR/files/big.bin")"
+PEAK_KB=$(grep VmHWM /proc/$WEBSERV_PID/status | awk '{print $2}')
+check "Large PUT is not buffered" "yes" \
+    "$([ "$PEAK_KB" -lt 32768 ] && echo yes || echo "no (${PEAK_KB} kB)")"
+
+# A PUT cut off halfway leaves the old file
+python3 - 127.0.0.1 "$PORT" << 'EOF'
+import socket, sys, time
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])))
+try:
+    s.sendall(b"PUT /files/big.bin HTTP/1.1\r\nHost: localhost\r\n"
+              b"Content-Length: 52428800\r\n\r\n")
+    s.sendall(b"x" * 4000000)
+    time.sleep(0.2)
+except OSError:
+    pass
+s.close()
+EOF
+sleep 0.2
+check "Dropped PUT leaves the file intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$WORKDIR/files/big.bin")"
+check "No temporary files are left" "" \
+    "$(ls -A "$WORKDIR/files" | grep '\.put-')"
+
+check "DELETE after PUT" "204" \
+    "$(curl -s -X DELETE -o /dev/null -w '%{http_code}' \
+        $BASE_URL/files/note.txt)"
+
+finish_tests "request method tests"
@@ -0,0 +1,251 @@
+#!/bin/bash
+# filepath: tests/test_proxy.sh
+
+# Tests proxy_pass against a local stand-in backend (python3).
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8095
+BACKEND_PORT=9095
+BACKEND2_PORT=9096
+BACKEND_SOCK=/tmp/webserv_proxy_test.sock
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "Reverse Proxy" proxy
+
+# Stand-in backend: HTTP/1.1 keep-alive server on TCP and a unix socket
+cat > "$WORKDIR/backend.py" << 'EOF'
+import os, socketserver, sys, threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    hits = 0
+
+    def log_message(self, *args):
+        pass
+
+    def reply(self, body, status=200):
+        self.send_response(status)
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Set-Cookie", "a=1")
+        self.send_header("Set-Cookie", "b=2")
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(body)
+
+    def do_HEAD(self):
+        self.do_GET()
+
+    def do_GET(self):
+        if self.path == "/proxy/hello":
+            self.reply(b"hello from upstream")
+        elif self.path == "/unix/hello":
+            self.reply(b"hello over unix")
+        elif self.path == "/pcache/count":
+            # Counts requests that reach the backend
+            Handler.hits += 1
+            body = str(Handler.hits).encode()
+            self.send_response(200)
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        elif self.path == "/proxy/patches":
+            self.reply(str(Handler.patches).encode())
+        elif self.path == "/pool/who":
+            # Identifies the backend that served the request
+            self.reply(str(self.server.server_address[1]).encode())
+        elif self.path == "/proxy/conn":
+            # Identifies the backend-side connection to observe pooling
+            self.reply(str(self.client_address).encode())
+        elif self.path == "/proxy/headers":
+            self.reply(str(self.headers).encode())
+        elif self.path == "/proxy/chunked":
+            self.send_response(200)
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for part in (b"first ", b"second ", b"third"):
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(part), part))
+            self.wfile.write(b"0\r\n\r\n")
+        elif self.path == "/proxy/big":
+            size = 8 * 1024 * 1024
+            self.send_response(200)
+            self.send_header("Content-Length", str(size))
+            self.end_headers()
+            block = b"x" * 65536
+            for _ in range(size // len(block)):
+                self.wfile.write(block)
+        elif self.path == "/proxy/close":
+            # No length: body ends when the backend closes
+            self.send_response(200)
+            self.send_header("Connection", "close")
+            self.end_headers()
+            self.wfile.write(b"until close")
+            self.close_connection = True
+        else:
+            self.reply(b"not found", 404)
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        self.reply(self.rfile.read(length))
+
+    patches = 0
+
+    def do_PATCH(self):
+        # Applies the change, then drops the connection without an answer
+        self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        Handler.patches += 1
+        self.close_connection = True
+
+class UnixServer(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+class UnixHandler(Handler):
+    def address_string(self):
+        return "unix"
+
+tcp = ThreadingHTTPServer(("127.0.0.1", int(sys.argv[1])), Handler)
+if len(sys.argv) < 3:
+    tcp.serve_forever()
+if os.path.exists(sys.argv[2]):
+    os.unlink(sys.argv[2])
+unix = UnixServer(sys.argv[2], UnixHandler)
+threading.Thread(target=unix.serve_forever, daemon=True).start()
+tcp.serve_forever()
+EOF
+
+cat > "$WORKDIR/proxy.conf" << EOF
+upstream backends {
+    server 127.0.0.1:$BACKEND_PORT;
+    server 127.0.0.1:$BACKEND2_PORT;
+    server 127.0.0.1:1;
+    policy round_robin;
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name localhost;
+
+    location / {
+        root tests;
+        allow_methods GET;
+    }
+
+    location /proxy {
+        proxy_pass http://127.0.0.1:$BACKEND_PORT;
+        allow_methods GET POST PATCH;
+    }
+
+    location /unix {
+        proxy_pass unix:$BACKEND_SOCK;
+    }
+
+    location /down {
+        proxy_pass http://127.0.0.1:1;
+    }
+
+    location /pool {
+        proxy_pass http://backends;
+    }
+
+    location /pcache {
+        proxy_pass http://127.0.0.1:$BACKEND_PORT;
+        response_cache 30;
+    }
+
+    location /metrics {
+        metrics on;
+    }
+}
+EOF
+
+on_cleanup() {
+    rm -f "$BACKEND_SOCK"
+}
+
+python3 "$WORKDIR/backend.py" $BACKEND_PORT $BACKEND_SOCK &
+stop_on_exit $!
+python3 "$WORKDIR/backend.py" $BACKEND2_PORT &
+stop_on_exit $!
+start_server "$WORKDIR/proxy.conf"
+
+check "GET with Content-Length body" "hello from upstream" \
+    "$(curl -s $BASE_URL/proxy/hello)"
+
+check "Repeated Set-Cookie headers are kept" "2" \
+    "$(curl -s -D - -o /dev/null $BASE_URL/proxy/hello | grep -ci '^set-cookie')"
+
+check "HEAD is forwarded without a body" "0" \
+    "$(curl -s -I $BASE_URL/proxy/hello -o /dev/null -w '%{size_download}')"
+
+check "Chunked upstream body" "first second third" \
+    "$(curl -s $BASE_URL/proxy/chunked)"
+
+check "Chunked upstream body to an HTTP/1.0 client" "first second third" \
+    "$(curl -s --http1.0 $BASE_URL/proxy/chunked)"
+
+check "Close-delimited upstream body" "until close" \
+    "$(curl -s $BASE_URL/proxy/close)"
+
+check "POST body is forwarded" "payload=42" \
+    "$(curl -s -d 'payload=42' $BASE_URL/proxy/echo)"
+
+# Over client_body_buffer_size, sent to the backend from the spooled file
+head -c 102400 /dev/urandom > "$WORKDIR/post.bin"
+check "Spooled POST body is forwarded intact" \
+    "$(md5sum < "$WORKDIR/post.bin")" \
+    "$(curl -s --data-binary @"$WORKDIR/post.bin" $BASE_URL/proxy/echo | md5sum)"
+
+# Sent on a pooled connection, the PATCH looks like it hit a stale one, but
+# the backend may have applied it and it must not be sent again
+curl -s -o /dev/null $BASE_URL/proxy/hello
+check "PATCH is not sent again after the upstream drops it" "502 1" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -X PATCH -d 'x=1' \
+        $BASE_URL/proxy/patch) $(curl -s $BASE_URL/proxy/patches)"
+
+check "X-Forwarded-For is added" "1" \
+    "$(curl -s $BASE_URL/proxy/headers | grep -ci '^x-forwarded-for: 127.0.0.1')"
+
+check "Large body is streamed intact" "8388608" \
+    "$(curl -s $BASE_URL/proxy/big | wc -c | tr -d ' ')"
+
+check "Slow reader receives the whole body" "8388608" \
+    "$(curl -s --limit-rate 4M $BASE_URL/proxy/big | wc -c | tr -d ' ')"
+
+FIRST=$(curl -s $BASE_URL/proxy/conn)
+SECOND=$(curl -s $BASE_URL/proxy/conn)
+check "Upstream connection is reused from the pool" "$FIRST" "$SECOND"
+
+check "Unix socket upstream" "hello over unix" \
+    "$(curl -s $BASE_URL/unix/hello)"
+
+check "Unreachable upstream returns 502" "502" \
+    "$(curl -s -o /dev/null -w '%{http_code}' $BASE_URL/down)"
+
+# The dead third server fails over to a live one and is then skipped
+POOL_CODES=""
+POOL_PORTS=""
+for i in 1 2 3 4 5 6; do
+    POOL_CODES="$POOL_CODES$(curl -s -o "$WORKDIR/who" -w '%{http_code}' $BASE_URL/pool/who) "
+    POOL_PORTS="$POOL_PORTS$(cat "$WORKDIR/who")\n"
+done
+check "Upstream block fails over a dead server" \
+    "200 200 200 200 200 200 " "$POOL_CODES"
+check "Round robin spreads requests over both backends" "2" \
+    "$(printf "$POOL_PORTS" | sort -u | grep -c .)"
+
+METRICS=$(curl -s $BASE_URL/metrics)
+check "Metrics report the dead server unhealthy" "1" \
+    "$(echo "$METRICS" | grep -c 'webserv_upstream_healthy{upstream="backends",server="127.0.0.1:1"} 0')"
+check "Metrics report backend requests and latency" "2" \
+    "$(echo "$METRICS" | grep -c 'webserv_upstream_latency_ewma_ms{upstream="backends",server="127.0.0.1:909[56]"}')"
+
+curl -s -o /dev/null $BASE_URL/pcache/count
+check "Proxied response is served from the cache" "1" \
+    "$(curl -s $BASE_URL/pcache/count)"
+
+check "Server still serves requests" "hello from upstream" \
+    "$(curl -s $BASE_URL/proxy/hello)"
+
+finish_tests "proxy tests"
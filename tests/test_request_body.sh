@@ -0,0 +1,218 @@
+#!/bin/bash
+# filepath: tests/test_request_body.sh
+
+# Tests reading request bodies: chunked bodies split at every awkward point,
+# Content-Length bodies arriving in pieces and large bodies, which are
+# spooled to temporary files instead of being held in memory. Requests with
+# "Expect: 100-continue" are answered before the body is sent. Pipelined
+# requests are all answered, in order.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8101
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Request Body" body
+
+mkdir -p "$WORKDIR/www" "$WORKDIR/spool"
+echo "hello body" > "$WORKDIR/www/index.html"
+
+cat > "$WORKDIR/body.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    client_max_body_size 20M;
+    client_body_buffer_size 4K;
+    client_body_temp_path $WORKDIR/spool;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET PUT;
+    }
+}
+
+server {
+    listen $HOST:$PORT;
+    server_name small.local;
+    client_max_body_size 1K;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET PUT;
+    }
+}
+EOF
+
+start_server "$WORKDIR/body.conf"
+
+# Sends the request in the given pieces, pausing between them, and prints
+# the status codes of all responses on the connection
+send_pieces() {
+    python3 - "$HOST" "$PORT" "$@" << 'EOF'
+import re, socket, sys, time
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])), timeout=3)
+for piece in sys.argv[3:]:
+    s.sendall(piece.encode().decode("unicode_escape").encode("latin-1"))
+    time.sleep(0.05)
+data = b""
+try:
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+except socket.timeout:
+    pass
+# Status lines follow the previous body directly
+codes = re.findall(r"HTTP/1\.[01] (\d{3}) ", data.decode("latin-1"))
+print(" ".join(codes))
+EOF
+}
+
+HEAD_CHUNKED='PUT /chunked.txt HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n'
+check "Chunked body split inside size, data and CRLF" "201" \
+    "$(send_pieces "$HEAD_CHUNKED" '5\r' '\nhel' 'lo\r' '\n' '6;ext=1\r\n wor' 'ld\r\n0\r\n' 'X-Trailer: 1\r\n' '\r\n')"
+check "Chunked body is reassembled" "hello world" \
+    "$(cat "$WORKDIR/www/chunked.txt")"
+
+HEAD_LENGTH='PUT /length.txt HTTP/1.1\r\nHost: localhost\r\nContent-Length: 12\r\nConnection: close\r\n\r\n'
+check "Content-Length body arriving in pieces" "201" \
+    "$(send_pieces "$HEAD_LENGTH" 'first' ' and ' 'ab')"
+check "Content-Length body is complete" "first and ab" \
+    "$(cat "$WORKDIR/www/length.txt")"
+
+head -c 8388608 /dev/urandom > "$WORKDIR/big.bin"
+curl -s -o /dev/null -X PUT --data-binary @"$WORKDIR/big.bin" \
+    $BASE_URL/big.bin
+check "Large body is stored intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$WORKDIR/www/big.bin")"
+
+curl -s -o /dev/null -X PUT -H 'Transfer-Encoding: chunked' \
+    --data-binary @"$WORKDIR/big.bin" $BASE_URL/big-chunked.bin
+check "Large chunked body is stored intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$WORKDIR/www/big-chunked.bin")"
+
+# Several large uploads at once, the bodies must not pile up in memory
+UPLOAD_PIDS=""
+for i in 1 2 3 4; do
+    curl -s -o /dev/null -X PUT --data-binary @"$WORKDIR/big.bin" \
+        $BASE_URL/concurrent$i.bin &
+    UPLOAD_PIDS="$UPLOAD_PIDS $!"
+done
+wait $UPLOAD_PIDS
+check "Concurrent large bodies are stored intact" "4" \
+    "$(md5sum "$WORKDIR"/www/concurrent*.bin | grep -c "$(md5sum < "$WORKDIR/big.bin" | cut -d' ' -f1)")"
+PEAK_KB=$(awk '/VmHWM/ {print $2}' /proc/$WEBSERV_PID/status)
+check "Large bodies are not held in memory" "yes" \
+    "$([ "$PEAK_KB" -lt 8192 ] && echo yes || echo "no (peak ${PEAK_KB}kB)")"
+check "Spooled bodies leave no files behind" "" "$(ls "$WORKDIR/spool")"
+
+# Sends the head of a request with "Expect: 100-continue" and prints the
+# status of the first response. The body only follows a 100 Continue, then
+# the final status is printed too. Arguments: method, path, host, body.
+expect_continue() {
+    python3 - "$HOST" "$PORT" "$@" << 'EOF'
+import socket, sys
+host, port, method, path, vhost, body = sys.argv[1:7]
+s = socket.create_connection((host, int(port)), timeout=0.5)
+s.sendall(("%s %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %d\r\n"
+           "Expect: 100-continue\r\n\r\n" % (method, path, vhost, len(body)))
+          .encode())
+def status():
+    try:
+        data = s.recv(65536).decode("latin-1")
+    except socket.timeout:
+        return "timeout"
+    return data.split()[1] if data else "closed"
+first = status()
+if first == "100":
+    s.settimeout(3)
+    s.sendall(body.encode())
+    first += " " + status()
+print(first)
+EOF
+}
+
+check "Expect: 100-continue gets 100, then the response" "100 201" \
+    "$(expect_continue PUT /expect.txt localhost "expected body")"
+check "Body sent after 100 Continue is stored" "expected body" \
+    "$(cat "$WORKDIR/www/expect.txt")"
+check "Disallowed method is refused before the body" "405" \
+    "$(expect_continue POST /expect.txt localhost "refused body")"
+check "Virtual server body limit applies before the body" "413" \
+    "$(expect_continue PUT /expect.txt small.local "$(head -c 2048 /dev/zero | tr '\0' x)")"
+check "Small body within the virtual server limit" "100 204" \
+    "$(expect_continue PUT /expect.txt small.local "small")"
+check "Unknown expectation" "417" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -X PUT -H "Expect: magic" \
+        --data-binary "x" $BASE_URL/expect.txt)"
+START=$(date +%s%N)
+CODE=$(head -c 5242880 /dev/zero | curl -s -o /dev/null -w '%{http_code}' \
+    -X POST -H "Expect: 100-continue" --data-binary @- $BASE_URL/upload.bin)
+ELAPSED_MS=$((($(date +%s%N) - START) / 1000000))
+check "curl upload is refused without waiting" "405 fast" \
+    "$CODE $([ $ELAPSED_MS -lt 800 ] && echo fast || echo "slow (${ELAPSED_MS}ms)")"
+
+# Pipelined requests sent in one write, no read event comes for the later
+# ones
+GET_ONE='GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n'
+GET_LAST='GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n'
+PIPELINE=""
+for i in $(seq 1 50); do
+    PIPELINE="$PIPELINE$GET_ONE"
+done
+START=$(date +%s%N)
+CODES=$(send_pieces "$PIPELINE$GET_LAST")
+ELAPSED_MS=$((($(date +%s%N) - START) / 1000000))
+check "Pipelined requests are all answered" "51 fast" \
+    "$(echo $CODES | tr ' ' '\n' | grep -c '^200$') \
+$([ $ELAPSED_MS -lt 1000 ] && echo fast || echo "slow (${ELAPSED_MS}ms)")"
+
+PUT_ONE='PUT /pipe1.txt HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nfirst'
+PUT_TWO='PUT /pipe2.txt HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n6\r\nsecond\r\n0\r\n\r\n'
+GET_MISSING='GET /missing.txt HTTP/1.1\r\nHost: localhost\r\n\r\n'
+check "Pipelined bodies and requests keep their order" "201 201 200 404" \
+    "$(send_pieces "$PUT_ONE$PUT_TWO$GET_ONE$GET_MISSING")"
+check "Pipelined bodies are stored" "first second" \
+    "$(cat "$WORKDIR/www/pipe1.txt") $(cat "$WORKDIR/www/pipe2.txt")"
+
+# The second request arrives partly with the first, the rest later
+check "Pipelined request split across reads" "200 200" \
+    "$(send_pieces "${GET_ONE}GET /index.html HTTP/1.1\r\nHo" \
+        'st: localhost\r\nConnection: close\r\n\r\n')"
+
+# Responses in order, the bodies of the GETs between them
+PIPELINED_BODIES=$(python3 - "$HOST" "$PORT" << 'EOF'
+import socket, sys
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])), timeout=3)
+paths = ["/pipe1.txt", "/pipe2.txt", "/index.html"] * 20
+requests = "".join("GET %s HTTP/1.1\r\nHost: localhost\r\n%s\r\n"
+                   % (path, "Connection: close\r\n" if i == len(paths) - 1
+                      else "") for i, path in enumerate(paths))
+s.sendall(requests.encode())
+data = b""
+while True:
+    chunk = s.recv(65536)
+    if not chunk:
+        break
+    data += chunk
+bodies = []
+while data:
+    head, _, rest = data.partition(b"\r\n\r\n")
+    length = [int(l.split(b":")[1]) for l in head.split(b"\r\n")
+              if l.lower().startswith(b"content-length:")][0]
+    bodies.append(rest[:length].strip().decode())
+    data = rest[length:]
+print(" ".join(sorted(set(" ".join(bodies[i:i + 3])
+                          for i in range(0, len(bodies), 3)))), len(bodies))
+EOF
+)
+check "Pipelined responses come in request order" \
+    "first second hello body 60" "$PIPELINED_BODIES"
+
+check "Server still serves requests" "hello body" \
+    "$(curl -s $BASE_URL/index.html)"
+
+finish_tests "request body tests"
@@ -0,0 +1,127 @@
+#!/bin/bash
+# filepath: tests/test_response_cache.sh
+
+# Tests response_cache on a CGI location: hits, request collapsing,
+# Cache-Control and stale-while-revalidate.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8096
+OTHER_PORT=8114
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "Response Cache" cache
+
+mkdir -p "$WORKDIR/cache"
+
+# Slow scripts that count their runs, so backend hits can be observed
+make_script() {
+    local name="$1"
+    local headers="$2"
+    cat > "$WORKDIR/cache/$name" << EOF
+#!/bin/sh
+echo run >> "$PWD/$WORKDIR/$name.runs"
+sleep 1
+printf '${headers}Content-Type: text/plain\r\n\r\n'
+printf 'generation %s' \$(wc -l < "$PWD/$WORKDIR/$name.runs")
+EOF
+    chmod +x "$WORKDIR/cache/$name"
+}
+make_script cached.sh ""
+make_script nostore.sh 'Cache-Control: no-store\r\n'
+make_script vary.sh 'Vary: Accept-Encoding\r\n'
+make_script swr.sh 'Cache-Control: max-age=1, stale-while-revalidate=30\r\n'
+
+# Same URI on another server, with a different answer
+mkdir -p "$WORKDIR/other/cache"
+cat > "$WORKDIR/other/cache/cached.sh" << 'EOF'
+#!/bin/sh
+printf 'Content-Type: text/plain\r\n\r\nother server'
+EOF
+chmod +x "$WORKDIR/other/cache/cached.sh"
+
+runs() {
+    wc -l < "$WORKDIR/$1.runs" 2> /dev/null | tr -d ' '
+}
+
+cat > "$WORKDIR/cache.conf" << EOF
+server {
+    listen 127.0.0.1:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR;
+        cgi on;
+        allow_methods GET;
+        response_cache 30;
+    }
+}
+
+server {
+    listen 127.0.0.1:$OTHER_PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR/other;
+        cgi on;
+        allow_methods GET;
+        response_cache 30;
+    }
+}
+EOF
+
+start_server "$WORKDIR/cache.conf"
+
+# A burst of identical misses runs the script once
+BURST_PIDS=""
+for i in 1 2 3 4 5; do
+    curl -s -o "$WORKDIR/burst.$i" $BASE_URL/cache/cached.sh &
+    BURST_PIDS="$BURST_PIDS $!"
+done
+wait $BURST_PIDS
+check "Burst of misses runs the script once" "1" "$(runs cached.sh)"
+check "Every request of the burst gets the response" "5" \
+    "$(cat "$WORKDIR"/burst.* | grep -o 'generation 1' | wc -l | tr -d ' ')"
+
+check "Later request is a cache hit" "HIT" \
+    "$(curl -s -D - -o /dev/null $BASE_URL/cache/cached.sh |
+        grep -i '^x-cache' | cut -d' ' -f2 | tr -d '\r')"
+check "Hit does not run the script" "1" "$(runs cached.sh)"
+check "HEAD is answered from the cached GET" "HIT 0" \
+    "$(curl -s -I -o /dev/null -w '%header{x-cache} %{size_download}' \
+        $BASE_URL/cache/cached.sh)"
+check "HEAD does not run the script" "1" "$(runs cached.sh)"
+
+curl -s -o /dev/null $BASE_URL/cache/cached.sh?other
+check "Query string is part of the key" "2" "$(runs cached.sh)"
+
+curl -s -o /dev/null -H 'Host: x' $BASE_URL/cache/cached.sh
+check "Another server does not share entries for the same Host" \
+    "other server" \
+    "$(curl -s -H 'Host: x' http://127.0.0.1:$OTHER_PORT/cache/cached.sh)"
+
+curl -s -o /dev/null $BASE_URL/cache/nostore.sh
+curl -s -o /dev/null $BASE_URL/cache/nostore.sh
+check "Cache-Control: no-store is honoured" "2" "$(runs nostore.sh)"
+
+curl -s -o /dev/null -H 'Accept-Encoding: gzip' $BASE_URL/cache/vary.sh
+curl -s -o /dev/null $BASE_URL/cache/vary.sh
+check "Response with Vary is not cached" "2" "$(runs vary.sh)"
+
+curl -s -o /dev/null $BASE_URL/cache/swr.sh
+sleep 2
+# The first request after max-age refreshes the entry, others get it stale
+curl -s -o "$WORKDIR/refresh" $BASE_URL/cache/swr.sh &
+REFRESH_PID=$!
+sleep 0.3
+check "Expired entry is served stale while refreshing" "STALE" \
+    "$(curl -s -m 0.5 -D - -o /dev/null $BASE_URL/cache/swr.sh |
+        grep -i '^x-cache' | cut -d' ' -f2 | tr -d '\r')"
+wait $REFRESH_PID
+check "Refresh fetched a new response" "generation 2" \
+    "$(cat "$WORKDIR/refresh")"
+check "Refreshed entry is served" "generation 2" \
+    "$(curl -s $BASE_URL/cache/swr.sh)"
+
+finish_tests "response cache tests"
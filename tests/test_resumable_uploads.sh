@@ -0,0 +1,144 @@
+#!/bin/bash
+# filepath: tests/test_resumable_uploads.sh
+
+# Tests resumable uploads: an upload is created with POST, filled with PATCH
+# requests at the offset HEAD reports, keeps what a dropped PATCH sent,
+# survives restarts, and lands in the upload directory once complete.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8104
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+CHUNK=3145728
+
+begin_tests "Resumable Upload" resumable
+UPLOADS="$WORKDIR/www/uploads"
+
+mkdir -p "$WORKDIR/www"
+
+cat > "$WORKDIR/resumable.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    client_max_body_size 4M;
+
+    location /files/ {
+        root $WORKDIR/www;
+        resumable_upload on;
+        allow_methods GET POST PATCH DELETE;
+    }
+}
+EOF
+
+# Value of a response header from `curl -i` output
+header() {
+    grep -i "^$1:" | tr -d '\r' | cut -d' ' -f2
+}
+
+# Creates an upload and prints its path. Arguments: length, filename.
+create_upload() {
+    curl -s -i -X POST -H "Content-Length: 0" -H "Upload-Length: $1" \
+        -H "Upload-Metadata: filename $(printf '%s' "$2" | base64 -w0)" \
+        $BASE_URL/files/ | header Location
+}
+
+# Sends a PATCH and prints its status. Arguments: upload path, offset,
+# file to take the body from, bytes to skip in it, byte count.
+patch_upload() {
+    tail -c +$(($4 + 1)) "$3" | head -c $5 > "$WORKDIR/chunk.bin"
+    curl -s -o /dev/null -w '%{http_code}' -X PATCH \
+        -H "Upload-Offset: $2" \
+        -H "Content-Type: application/offset+octet-stream" \
+        --data-binary @"$WORKDIR/chunk.bin" "$BASE_URL$1"
+}
+
+current_offset() {
+    curl -s -I "$BASE_URL$1" | header Upload-Offset
+}
+
+start_server "$WORKDIR/resumable.conf"
+
+head -c 8388608 /dev/urandom > "$WORKDIR/big.bin"
+UPLOAD=$(create_upload 8388608 big.bin)
+check "Upload is created" "yes" \
+    "$(echo "$UPLOAD" | grep -qE '^/files/[0-9a-f]{32}$' && echo yes \
+        || echo "no ($UPLOAD)")"
+check "New upload is at offset 0" "0" "$(current_offset "$UPLOAD")"
+check "HEAD reports the length" "8388608" \
+    "$(curl -s -I "$BASE_URL$UPLOAD" | header Upload-Length)"
+
+check "First chunk is appended" "204" \
+    "$(patch_upload "$UPLOAD" 0 "$WORKDIR/big.bin" 0 $CHUNK)"
+check "Offset follows the data" "$CHUNK" "$(current_offset "$UPLOAD")"
+
+# What a PATCH cut off partway sent is kept, the client resumes after it
+PARTIAL=$((CHUNK + 1000000))
+python3 - "$HOST" "$PORT" "$UPLOAD" "$CHUNK" "$WORKDIR/big.bin" << 'EOF'
+import socket, sys, time
+host, port, path, offset = sys.argv[1], int(sys.argv[2]), sys.argv[3], sys.argv[4]
+with open(sys.argv[5], "rb") as f:
+    f.seek(int(offset))
+    data = f.read(1000000)
+s = socket.create_connection((host, port))
+try:
+    s.sendall(("PATCH %s HTTP/1.1\r\nHost: localhost\r\nUpload-Offset: %s\r\n"
+               "Content-Type: application/offset+octet-stream\r\n"
+               "Content-Length: 3145728\r\n\r\n" % (path, offset)).encode())
+    s.sendall(data)
+    time.sleep(0.2)
+except OSError:
+    pass
+s.close()
+EOF
+sleep 0.2
+check "Dropped PATCH advances the offset" "$PARTIAL" \
+    "$(current_offset "$UPLOAD")"
+
+check "PATCH at a stale offset" "409" \
+    "$(patch_upload "$UPLOAD" 0 "$WORKDIR/big.bin" 0 1000)"
+check "PATCH without the offset content type" "415" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -X PATCH \
+        -H "Upload-Offset: $PARTIAL" -H "Content-Type: text/plain" \
+        --data-binary "data" "$BASE_URL$UPLOAD")"
+
+# Resumed after a restart, the state is on disk
+stop_server
+start_server "$WORKDIR/resumable.conf"
+check "Offset survives a restart" "$PARTIAL" "$(current_offset "$UPLOAD")"
+check "Second chunk is appended" "204" \
+    "$(patch_upload "$UPLOAD" $PARTIAL "$WORKDIR/big.bin" $PARTIAL $CHUNK)"
+check "Last chunk is appended" "204" \
+    "$(patch_upload "$UPLOAD" $((PARTIAL + CHUNK)) "$WORKDIR/big.bin" \
+        $((PARTIAL + CHUNK)) $((8388608 - PARTIAL - CHUNK)))"
+check "Complete upload is stored intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$UPLOADS/big.bin")"
+check "Complete upload is gone from the state" "404" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -I "$BASE_URL$UPLOAD")"
+
+echo "0123456789" > "$WORKDIR/small.txt"
+UPLOAD=$(create_upload 5 "../../escape.txt")
+check "PATCH past the length" "413" \
+    "$(patch_upload "$UPLOAD" 0 "$WORKDIR/small.txt" 0 10)"
+check "Exact PATCH completes it" "204" \
+    "$(patch_upload "$UPLOAD" 0 "$WORKDIR/small.txt" 0 5)"
+check "Filename is reduced to a name" "01234" "$(cat "$UPLOADS/escape.txt")"
+
+UPLOAD=$(create_upload 100 dropped.bin)
+check "Upload is deleted" "204" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -X DELETE "$BASE_URL$UPLOAD")"
+check "Deleted upload is gone" "404" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -I "$BASE_URL$UPLOAD")"
+check "No partial state is left" "" "$(ls -A "$UPLOADS/.resumable")"
+
+check "Unknown upload" "404" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -I \
+        $BASE_URL/files/0123456789abcdef0123456789abcdef)"
+check "POST without Upload-Length" "400" \
+    "$(curl -s -o /dev/null -w '%{http_code}' -X POST \
+        -H "Content-Length: 0" $BASE_URL/files/)"
+check "GET is not part of the protocol" "405" \
+    "$(curl -s -o /dev/null -w '%{http_code}' $BASE_URL/files/)"
+
+finish_tests "resumable upload tests"
@@ -0,0 +1,143 @@
+#!/bin/bash
+# filepath: tests/test_return.sh
+
+# Tests the return directive: fixed bodies, redirects, bodiless statuses and
+# error statuses answered with the error pages, over one connection and with
+# HEAD.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8107
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Return Directive" return
+
+echo "closed" > "$WORKDIR/403.html"
+
+cat > "$WORKDIR/return.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    error_page 403 $WORKDIR/403.html;
+
+    location /health {
+        return 200 '{"status":"ok"}';
+    }
+
+    location /hello {
+        return 200 hello world;
+    }
+
+    location /moved {
+        return 302 /new;
+    }
+
+    location /away {
+        return 308 https://example.com/away;
+    }
+
+    location /old {
+        redirect 307 /new;
+    }
+
+    location /empty {
+        return 204;
+    }
+
+    location /closed {
+        return 403;
+    }
+
+    location /teapot {
+        return 418;
+    }
+}
+EOF
+
+start_server "$WORKDIR/return.conf"
+
+# Value of a response header in a file written by `curl -D`
+header() {
+    grep -i "^$1:" "$2" | tr -d '\r' | cut -d' ' -f2-
+}
+
+status() {
+    curl -s -o /dev/null -w '%{http_code}' "$@"
+}
+
+curl -s -D "$WORKDIR/health.head" -o "$WORKDIR/health.body" $BASE_URL/health
+check "Fixed body is sent" '{"status":"ok"}' "$(cat "$WORKDIR/health.body")"
+check "JSON body has its type" "application/json" \
+    "$(header Content-Type "$WORKDIR/health.head")"
+check "Its Content-Length matches" "15" \
+    "$(header Content-Length "$WORKDIR/health.head")"
+check "Date is sent" "yes" \
+    "$([ -n "$(header Date "$WORKDIR/health.head")" ] && echo yes || echo no)"
+check "Any method gets it" "200" "$(status -X POST -d x $BASE_URL/health)"
+
+curl -s -D "$WORKDIR/hello.head" -o "$WORKDIR/hello.body" $BASE_URL/hello
+check "Unquoted text is the body" "hello world" "$(cat "$WORKDIR/hello.body")"
+check "Text body is plain text" "text/plain" \
+    "$(header Content-Type "$WORKDIR/hello.head")"
+
+curl -s -D "$WORKDIR/moved.head" -o /dev/null $BASE_URL/moved
+check "Redirect keeps its status" "302" \
+    "$(head -1 "$WORKDIR/moved.head" | cut -d' ' -f2)"
+check "Redirect sends the URL" "/new" \
+    "$(header Location "$WORKDIR/moved.head")"
+check "Redirect to another site" "308 https://example.com/away" \
+    "$(curl -s -o /dev/null -w '%{http_code} %{redirect_url}' $BASE_URL/away)"
+
+curl -s -D "$WORKDIR/old.head" -o /dev/null $BASE_URL/old
+check "redirect directive keeps its status" "307" \
+    "$(head -1 "$WORKDIR/old.head" | cut -d' ' -f2)"
+check "redirect directive sends the URL only" "/new" \
+    "$(header Location "$WORKDIR/old.head")"
+
+curl -s -D "$WORKDIR/empty.head" -o "$WORKDIR/empty.body" $BASE_URL/empty
+check "204 has no body or length" "204 0 none" \
+    "$(head -1 "$WORKDIR/empty.head" | cut -d' ' -f2) \
+$(wc -c < "$WORKDIR/empty.body") \
+$(grep -qi '^content-length:' "$WORKDIR/empty.head" && echo some || echo none)"
+
+check "Error status uses the configured page" "403 closed" \
+    "$(curl -s -w '%{http_code} ' -o "$WORKDIR/closed.body" $BASE_URL/closed)\
+$(cat "$WORKDIR/closed.body")"
+check "Other statuses use a default page" "418" "$(status $BASE_URL/teapot)"
+
+# Several requests on one connection, the HEAD one without its body
+RESPONSES=$(python3 - "$HOST" "$PORT" << 'EOF'
+import socket, sys
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])))
+s.settimeout(2)
+out = []
+for method, path in [("GET", "/health"), ("HEAD", "/health"),
+                     ("GET", "/moved"), ("GET", "/empty"), ("GET", "/hello")]:
+    s.sendall(("%s %s HTTP/1.1\r\nHost: localhost\r\n\r\n"
+               % (method, path)).encode())
+    data = b""
+    while b"\r\n\r\n" not in data:
+        data += s.recv(4096)
+    head, _, body = data.partition(b"\r\n\r\n")
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.lower() == b"content-length":
+            length = int(value)
+    if method == "HEAD":
+        length = 0
+    while len(body) < length:
+        body += s.recv(4096)
+    if body.startswith(b"<html>"):
+        body = b"<html>"
+    out.append("%s:%s" % (head.split(b" ")[1].decode(), body.decode()))
+print(" ".join(out))
+EOF
+)
+check "Responses share one connection" \
+    '200:{"status":"ok"} 200: 302:<html> 204: 200:hello world' \
+    "$RESPONSES"
+
+finish_tests "return tests"
@@ -0,0 +1,130 @@
+#!/bin/bash
+# filepath: tests/test_static_files.sh
+
+# Tests static files, index files, directory listings and DELETE, whose
+# filesystem calls run on the file worker threads instead of the event loop.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8105
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Static File" static
+
+mkdir -p "$WORKDIR/www/listed/sub" "$WORKDIR/www/closed" "$WORKDIR/www/files" \
+    "$WORKDIR/www/listed/many"
+echo "home page" > "$WORKDIR/www/index.html"
+echo "a" > "$WORKDIR/www/listed/b.txt"
+echo "bb" > "$WORKDIR/www/listed/a.txt"
+echo "secret" > "$WORKDIR/www/closed/data.txt"
+echo "delete me" > "$WORKDIR/www/files/old.txt"
+head -c 3000000 /dev/urandom > "$WORKDIR/www/big.bin"
+# Several listing pages of 1024 entries
+(cd "$WORKDIR/www/listed/many" && seq -f "file%05g.txt" 1 3000 | xargs touch)
+
+cat > "$WORKDIR/static.conf" << EOF2
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET HEAD;
+    }
+
+    location /listed/ {
+        root $WORKDIR/www/listed;
+        autoindex on;
+        allow_methods GET;
+    }
+
+    location /files/ {
+        root $WORKDIR/www/files;
+        allow_methods GET DELETE;
+    }
+}
+EOF2
+
+start_server "$WORKDIR/static.conf"
+
+status() {
+    curl -s -o /dev/null -w '%{http_code}' "$@"
+}
+
+check "File workers are running" "5" \
+    "$(ls /proc/$WEBSERV_PID/task | wc -l)"
+
+check "Index file is served" "home page" "$(curl -s $BASE_URL/)"
+check "File is served intact" "$(md5sum < "$WORKDIR/www/big.bin")" \
+    "$(curl -s $BASE_URL/big.bin | md5sum)"
+check "HEAD reports the size" "3000000" \
+    "$(curl -s -I $BASE_URL/big.bin | grep -i '^content-length' \
+        | tr -d '\r' | cut -d' ' -f2)"
+check "Missing file" "404" "$(status $BASE_URL/missing.txt)"
+check "Missing directory" "404" "$(status $BASE_URL/missing/)"
+check "File used as a directory" "404" "$(status $BASE_URL/index.html/)"
+check "Directory without slash is redirected" "301" \
+    "$(status $BASE_URL/closed)"
+check "Directory without index or autoindex" "403" \
+    "$(status $BASE_URL/closed/)"
+
+LISTING=$(curl -s $BASE_URL/listed/)
+check "Directory is listed, directories first" "many/ sub/ a.txt b.txt" \
+    "$(echo "$LISTING" | sed -n 's/.*<td class="name"><a href="\([^"]*\)".*/\1/p' \
+        | tr '\n' ' ' | sed 's/ $//')"
+check "Listing has a Content-Length" "$(echo -n "$LISTING" | wc -c)" \
+    "$(curl -s -I $BASE_URL/listed/ | grep -i '^content-length' \
+        | tr -d '\r' | cut -d' ' -f2)"
+
+# Growing a file leaves the directory's mtime, and the cached listing, as is
+head -c 5000 /dev/zero >> "$WORKDIR/www/listed/a.txt"
+check "Listing is cached until the directory changes" "3 B" \
+    "$(curl -s $BASE_URL/listed/ | grep -A1 '"a.txt"' \
+        | sed -n 's/.*<td class="size">\(.*\)<\/td>.*/\1/p')"
+echo "c" > "$WORKDIR/www/listed/c.txt"
+check "Changed directory is listed again" "yes 4 KB" \
+    "$(curl -s $BASE_URL/listed/ | grep -q '"c.txt"' && echo -n 'yes ' \
+        && curl -s $BASE_URL/listed/ | grep -A1 '"a.txt"' \
+        | sed -n 's/.*<td class="size">\(.*\)<\/td>.*/\1/p')"
+
+curl -s -D "$WORKDIR/many.head" -o "$WORKDIR/many.html" $BASE_URL/listed/many/
+check "Large listing is chunked" "chunked" \
+    "$(grep -i '^transfer-encoding' "$WORKDIR/many.head" | tr -d '\r' \
+        | cut -d' ' -f2)"
+check "Large listing has every entry" "3000" \
+    "$(grep -c '<td class="name">' "$WORKDIR/many.html")"
+check "Large listing is complete" "</html>" "$(tail -c 7 "$WORKDIR/many.html")"
+check "Cached large listing is the same" "$(md5sum < "$WORKDIR/many.html")" \
+    "$(curl -s $BASE_URL/listed/many/ | md5sum)"
+check "Connection is kept after a large listing" "0" \
+    "$(curl -s -o /dev/null $BASE_URL/listed/many/ --next -s -o /dev/null \
+        -w '%{num_connects}' $BASE_URL/)"
+check "HTTP/1.0 large listing has a Content-Length" \
+    "$(wc -c < "$WORKDIR/many.html")" \
+    "$(curl -s -0 -D - -o /dev/null $BASE_URL/listed/many/ \
+        | grep -i '^content-length' | tr -d '\r' | cut -d' ' -f2)"
+
+# Many requests waiting for the workers at once
+CURL_PIDS=""
+for i in $(seq 1 40); do
+    curl -s $BASE_URL/big.bin | md5sum > "$WORKDIR/parallel.$i" &
+    CURL_PIDS="$CURL_PIDS $!"
+done
+wait $CURL_PIDS
+check "Parallel requests are served intact" "40" \
+    "$(cat "$WORKDIR"/parallel.* | grep -c "$(md5sum < "$WORKDIR/www/big.bin" \
+        | cut -d' ' -f1)")"
+
+check "DELETE removes the file" "204" "$(status -X DELETE $BASE_URL/files/old.txt)"
+check "Deleted file is gone" "no" \
+    "$([ -e "$WORKDIR/www/files/old.txt" ] && echo yes || echo no)"
+check "DELETE of a missing file" "404" \
+    "$(status -X DELETE $BASE_URL/files/old.txt)"
+mkdir "$WORKDIR/www/files/dir"
+check "DELETE of a directory" "403" "$(status -X DELETE $BASE_URL/files/dir)"
+
+check "Server still serves requests" "home page" "$(curl -s $BASE_URL/)"
+
+finish_tests "static file tests"
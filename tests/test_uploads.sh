@@ -0,0 +1,181 @@
+#!/bin/bash
+# filepath: tests/test_uploads.sh
+
+# Tests multipart/form-data uploads: files stored intact whatever their size
+# and content, written as the body arrives, several files per request, and
+# malformed or cut off bodies that must leave nothing behind.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8103
+HOST=127.0.0.1
+BASE_URL="http://$HOST:$PORT"
+
+begin_tests "Upload" upload
+UPLOADS="$WORKDIR/www/uploads"
+
+mkdir -p "$WORKDIR/www" "$WORKDIR/spool"
+echo "hello upload" > "$WORKDIR/www/index.html"
+
+cat > "$WORKDIR/upload.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+    client_max_body_size 20M;
+    client_body_buffer_size 4K;
+    client_body_temp_path $WORKDIR/spool;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+
+    location /upload/ {
+        root $WORKDIR/www;
+        allow_methods POST;
+    }
+}
+EOF
+
+start_server "$WORKDIR/upload.conf"
+
+# Posts a multipart body built by python and prints the status code.
+# Arguments: boundary, then "name:filename:source" parts (an empty filename
+# makes a form field, source is a file path or "=text"), then options:
+# "--no-end" leaves out the closing boundary.
+post_multipart() {
+    python3 - "$HOST" "$PORT" "$@" << 'EOF'
+import socket, sys
+host, port, boundary = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+body = b"preamble to ignore\r\n"
+closing = True
+for arg in sys.argv[4:]:
+    if arg == "--no-end":
+        closing = False
+        continue
+    name, filename, source = arg.split(":", 2)
+    data = source[1:].encode() if source.startswith("=") else open(source, "rb").read()
+    disposition = 'form-data; name="%s"' % name
+    if filename:
+        disposition += '; filename="%s"' % filename
+    body += b"--" + boundary.encode() + b"\r\n"
+    body += b"Content-Disposition: " + disposition.encode() + b"\r\n"
+    body += b"Content-Type: application/octet-stream\r\n\r\n"
+    body += data + b"\r\n"
+if closing:
+    body += b"--" + boundary.encode() + b"--\r\nepilogue to ignore"
+head = ("POST /upload/ HTTP/1.1\r\nHost: localhost\r\n"
+        "Content-Type: multipart/form-data; boundary=%s\r\n"
+        "Content-Length: %d\r\nConnection: close\r\n\r\n" % (boundary, len(body)))
+s = socket.create_connection((host, port), timeout=10)
+s.sendall(head.encode() + body)
+data = b""
+try:
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+except socket.timeout:
+    pass
+print(data.split(b" ")[1].decode() if data else "")
+EOF
+}
+
+check "Small file upload" "201" \
+    "$(curl -s -o /dev/null -w '%{http_code}' \
+        -F "file=@$WORKDIR/www/index.html;filename=small.txt" $BASE_URL/upload/)"
+check "Small file is stored" "hello upload" "$(cat "$UPLOADS/small.txt")"
+
+head -c 8388608 /dev/urandom > "$WORKDIR/big.bin"
+check "Large file upload" "201" \
+    "$(curl -s -o /dev/null -w '%{http_code}' \
+        -F "file=@$WORKDIR/big.bin;filename=big.bin" $BASE_URL/upload/)"
+check "Large file is stored intact" "$(md5sum < "$WORKDIR/big.bin")" \
+    "$(md5sum < "$UPLOADS/big.bin")"
+PEAK_KB=$(awk '/VmHWM/ {print $2}' /proc/$WEBSERV_PID/status)
+check "Large upload is not held in memory" "yes" \
+    "$([ "$PEAK_KB" -lt 8192 ] && echo yes || echo "no (peak ${PEAK_KB}kB)")"
+
+# Near misses of the delimiter, some likely to straddle the pieces the body
+# is received in, and the delimiter without its leading CRLF
+python3 - "$WORKDIR/tricky.bin" << 'EOF'
+import sys
+data = bytearray(b"x" * 200000)
+for offset, text in ((100, b"\r\n--b0und"), (65536 - 6, b"\r\n--b0undar"),
+                     (131072 - 3, b"\r\n-"), (150000, b"--b0undary\r\n"),
+                     (199990, b"\r\n--b0und")):
+    data[offset:offset + len(text)] = text
+open(sys.argv[1], "wb").write(data)
+EOF
+check "Content with delimiter near misses" "201" \
+    "$(post_multipart b0undary "f:tricky.bin:$WORKDIR/tricky.bin")"
+check "Near misses are kept as content" "$(md5sum < "$WORKDIR/tricky.bin")" \
+    "$(md5sum < "$UPLOADS/tricky.bin")"
+
+check "Several files and a form field" "201" \
+    "$(post_multipart sep "note::=just a field" "a:one.txt:=first" \
+        "b:two.txt:=second")"
+check "Every file is stored" "first second" \
+    "$(cat "$UPLOADS/one.txt") $(cat "$UPLOADS/two.txt")"
+check "Form fields are not stored" "" "$(ls "$UPLOADS" | grep note)"
+
+check "Existing file is replaced" "201" \
+    "$(post_multipart sep "a:one.txt:=replaced")"
+check "Replaced file has the new content" "replaced" "$(cat "$UPLOADS/one.txt")"
+
+check "Empty file upload" "201" "$(post_multipart sep "a:empty.txt:=")"
+check "Empty file is stored" "0" "$(stat -c %s "$UPLOADS/empty.txt")"
+
+check "Missing closing boundary" "400" \
+    "$(post_multipart sep "a:cut.txt:=cut off" --no-end)"
+check "Cut off upload leaves no file" "" "$(ls "$UPLOADS" | grep cut)"
+check "Body without a file part" "400" "$(post_multipart sep "note::=text")"
+
+FILES=""
+for i in $(seq 65); do
+    FILES="$FILES many$i:many$i.txt:=$i"
+done
+check "More files than allowed" "413" "$(post_multipart sep $FILES)"
+check "Too many files are not stored" "" "$(ls "$UPLOADS" | grep many)"
+
+# A complete file and half of a second one, then the upload stalls: the
+# second file is written as it arrives, nothing goes to the spool directory
+python3 - "$HOST" "$PORT" "$WEBSERV_PID" "$WORKDIR" > "$WORKDIR/stalled.txt" \
+    << 'EOF'
+import os, socket, sys, time
+host, port, pid, workdir = sys.argv[1], int(sys.argv[2]), sys.argv[3], sys.argv[4]
+def part(filename):
+    return (b'--sep\r\nContent-Disposition: form-data; name="f"; '
+            b'filename="%s"\r\n\r\n' % filename.encode())
+body = part("whole.txt") + b"complete\r\n" + part("stalled.txt") + b"x" * 65536
+s = socket.create_connection((host, port))
+s.sendall(b"POST /upload/ HTTP/1.1\r\nHost: localhost\r\n"
+          b"Content-Type: multipart/form-data; boundary=sep\r\n"
+          b"Content-Length: 1000000\r\n\r\n" + body)
+time.sleep(0.5)
+fd_dir = "/proc/%s/fd" % pid
+open_files = []
+for fd in os.listdir(fd_dir):
+    try:
+        open_files.append(os.readlink(os.path.join(fd_dir, fd)))
+    except OSError:
+        pass
+workdir = os.path.abspath(workdir)
+print(len([f for f in open_files if f.startswith(workdir + "/www/uploads/")]))
+print(len([f for f in open_files if f.startswith(workdir + "/spool/")]))
+s.close()
+EOF
+sleep 0.2
+check "Stalled upload has its files open" "2" "$(sed -n 1p "$WORKDIR/stalled.txt")"
+check "Stalled upload is not spooled" "0" "$(sed -n 2p "$WORKDIR/stalled.txt")"
+check "Cut off upload stores none of its files" "" \
+    "$(ls "$UPLOADS" | grep -e whole -e stalled)"
+check "No temporary files are left" "" \
+    "$(ls -a "$UPLOADS" "$WORKDIR/spool" | grep -e '-tmp' -e 'webserv_body')"
+
+check "Server still serves requests" "hello upload" \
+    "$(curl -s $BASE_URL/index.html)"
+
+finish_tests "upload tests"
@@ -0,0 +1,89 @@
+#!/bin/bash
+# filepath: tests/test_uri_decoding.sh
+
+# Tests decoding and validation of the request target: percent-decoding,
+# allowed characters, dot segments and length limits.
+# Run from the repository root after `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8102
+HOST=127.0.0.1
+
+begin_tests "URI Decoding" uri
+
+mkdir -p "$WORKDIR/www/dir name" "$WORKDIR/www/docs"
+echo "hello uri" > "$WORKDIR/www/index.html"
+echo "spaced" > "$WORKDIR/www/dir name/file.txt"
+echo "docs" > "$WORKDIR/www/docs/index.html"
+
+cat > "$WORKDIR/uri.conf" << EOF
+server {
+    listen $HOST:$PORT;
+    server_name localhost;
+
+    location / {
+        root $WORKDIR/www;
+        allow_methods GET;
+    }
+}
+EOF
+
+start_server "$WORKDIR/uri.conf"
+
+# Sends "GET <target>" as is and prints the status code
+status() {
+    python3 - "$HOST" "$PORT" "$1" << 'EOF'
+import socket, sys
+s = socket.create_connection((sys.argv[1], int(sys.argv[2])), timeout=2)
+s.sendall(("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"
+           % sys.argv[3]).encode("latin-1"))
+data = b""
+try:
+    while b"\r\n" not in data:
+        chunk = s.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+except socket.timeout:
+    pass
+print(data.split(b" ")[1].decode() if data else "")
+EOF
+}
+
+check "Plain path" "200" "$(status /index.html)"
+check "Encoded space in a directory name" "200" \
+    "$(status '/dir%20name/file.txt')"
+check "Encoded letters are decoded" "200" "$(status '/%69ndex.html')"
+check "Trailing slash" "200" "$(status /docs/)"
+check "Query with escapes and plus" "200" \
+    "$(status '/index.html?a=1&b=%41+c&path=/x?y')"
+check "Empty query" "200" "$(status '/index.html?')"
+
+check "Dot-dot segment" "400" "$(status /docs/../index.html)"
+check "Encoded dot-dot segment" "400" "$(status '/%2e%2e/index.html')"
+check "Dot segment" "400" "$(status /./index.html)"
+check "Trailing dot-dot" "400" "$(status /docs/..)"
+check "Dots inside a name are fine" "404" "$(status /docs/..hidden)"
+check "Empty segment" "400" "$(status //index.html)"
+check "Encoded slash making an empty segment" "400" \
+    "$(status '/docs/%2Findex.html')"
+
+check "Truncated escape" "400" "$(status '/index.html%4')"
+check "Non-hex escape" "400" "$(status '/%zzindex.html')"
+check "Encoded NUL" "400" "$(status '/index%00.html')"
+check "Encoded newline in the query" "400" "$(status '/index.html?a=%0a')"
+check "Double encoding" "400" "$(status '/index%2541.html')"
+check "Character outside pchar" "400" "$(status '/index.html<')"
+check "Character outside pchar in the query" "400" \
+    "$(status '/index.html?a=<b>')"
+check "Relative target" "400" "$(status index.html)"
+
+LONG_PATH="/$(head -c 3000 /dev/zero | tr '\0' 'a')"
+check "Path over the limit" "414" "$(status "$LONG_PATH")"
+LONG_QUERY="/index.html?$(head -c 3000 /dev/zero | tr '\0' 'q')"
+check "Query over the limit" "414" "$(status "$LONG_QUERY")"
+
+check "Server still serves requests" "200" "$(status /index.html)"
+
+finish_tests "URI decoding tests"
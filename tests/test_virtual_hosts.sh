@@ -0,0 +1,103 @@
+#!/bin/bash
+# filepath: tests/test_virtual_hosts.sh
+
+# Tests Host header resolution: exact names, leading (*.x, .x) and trailing
+# (x.*) wildcards, case and port normalization, and the default server.
+# Each server redirects to its own name. Run from the repository root after
+# `make`.
+
+. "$(dirname "$0")/lib.sh"
+
+PORT=8098
+BASE_URL="http://127.0.0.1:$PORT"
+
+begin_tests "Virtual Host" vhost
+
+cat > "$WORKDIR/vhosts.conf" << EOF
+server {
+    listen 127.0.0.1:$PORT;
+    server_name default.test;
+    location / {
+        root $WORKDIR;
+        redirect 301 /default;
+    }
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name www.example.com api.example.com;
+    location / {
+        root $WORKDIR;
+        redirect 301 /exact;
+    }
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name *.example.com;
+    location / {
+        root $WORKDIR;
+        redirect 301 /star-com;
+    }
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name *.img.example.com;
+    location / {
+        root $WORKDIR;
+        redirect 301 /star-img;
+    }
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name .example.org;
+    location / {
+        root $WORKDIR;
+        redirect 301 /dot-org;
+    }
+}
+
+server {
+    listen 127.0.0.1:$PORT;
+    server_name www.example.*;
+    location / {
+        root $WORKDIR;
+        redirect 301 /www-star;
+    }
+}
+EOF
+
+start_server "$WORKDIR/vhosts.conf"
+
+# Prints the name of the server that handled the Host header
+matched() {
+    curl -s -D - -o /dev/null -H "Host: $1" "$BASE_URL/" |
+        grep -i '^location:' | awk '{print $NF}' | tr -d '\r'
+}
+
+check "Unknown host uses the default server" "/default" \
+    "$(matched unknown.test)"
+check "Exact name" "/exact" "$(matched www.example.com)"
+check "Second exact name of a server" "/exact" "$(matched api.example.com)"
+check "Exact name beats wildcards" "/exact" "$(matched www.example.com)"
+check "Leading wildcard" "/star-com" "$(matched shop.example.com)"
+check "Leading wildcard spans several labels" "/star-com" \
+    "$(matched a.b.example.com)"
+check "Longest leading wildcard wins" "/star-img" \
+    "$(matched cdn.img.example.com)"
+check "*. wildcard does not match the bare domain" "/default" \
+    "$(matched example.com)"
+check ".name matches the bare domain" "/dot-org" "$(matched example.org)"
+check ".name matches subdomains" "/dot-org" "$(matched shop.example.org)"
+check "Trailing wildcard" "/www-star" "$(matched www.example.net)"
+check "Leading wildcard beats trailing" "/dot-org" \
+    "$(matched www.example.org)"
+check "Trailing wildcard needs a following label" "/default" \
+    "$(matched www.example)"
+check "Host is case-insensitive" "/exact" "$(matched WWW.Example.COM)"
+check "Port is stripped" "/exact" "$(matched www.example.com:$PORT)"
+check "Trailing dot is stripped" "/exact" "$(matched www.example.com.)"
+
+finish_tests "virtual host tests"